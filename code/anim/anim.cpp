@@ -1,5 +1,6 @@
 #include "anim.h"
 #include <util/memory.h>
+#include <util/trace.h>
 
 namespace bx{ namespace anim {
 
@@ -149,6 +150,7 @@ namespace anim_ext{
     
     void processBlendTree( Context* ctx, const u16 root_index, const BlendBranch* blend_branches, unsigned int num_branches, const BlendLeaf* blend_leaves, unsigned int num_leaves )
     {
+        BX_TRACE_SCOPE( "anim::processBlendTree" );
         evaluateBlendTree( ctx, root_index, blend_branches, num_branches, blend_leaves, num_leaves );
         evaluateCommandList( ctx, blend_branches, num_branches, blend_leaves, num_leaves );
     }
@@ -3,6 +3,7 @@
 
 #include <util/memory.h>
 #include <util/common.h>
+#include <util/trace.h>
 
 namespace bx{
 namespace anim{
@@ -88,6 +89,7 @@ bool CascadePlayer::play( const Clip* clip, float startTime, float blendDuration
 
 void CascadePlayer::tick( float deltaTime )
 {
+    BX_TRACE_SCOPE( "anim::CascadePlayer::tick" );
     if( _root_node_index == UINT32_MAX ) 
     {
         // no animations to play
@@ -386,6 +388,7 @@ void SimplePlayer::play( const anim::Clip* clip, float startTime, float blendTim
 
 void SimplePlayer::tick( float deltaTime )
 {
+    BX_TRACE_SCOPE( "anim::SimplePlayer::tick" );
     memcpy( _prev_joints, localJoints(), _ctx->numJoints * sizeof( Joint ) );
     _Tick_processBlendTree();
     _Tick_updateTime( deltaTime );
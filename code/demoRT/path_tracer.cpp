@@ -0,0 +1,1054 @@
+#include "path_tracer.h"
+
+#include <util/memory.h>
+#include <util/common.h>
+#include <util/debug.h>
+#include <util/array.h>
+#include <util/time.h>
+#include <util/thread/atomic.h>
+#include <util/thread/parallel.h>
+
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+namespace bxPathTracer
+{
+    namespace
+    {
+        enum : u32
+        {
+            eSPHERE_BIT = 0x80000000,
+            eNO_HIT = UINT32_MAX,
+            eMAX_LEAF_SIZE = 4,
+            eNUM_BINS = 12,
+            eSTACK_SIZE = 64,
+            eMAX_DEPTH = eSTACK_SIZE - 2,
+        };
+        static const f32 RAY_EPSILON = 1e-4f;
+        static const f32 SURFACE_OFFSET = 1e-3f;
+
+        struct Triangle
+        {
+            f32 v0[3];
+            f32 e1[3];
+            f32 e2[3];
+            u32 material;
+        };
+        struct Sphere
+        {
+            f32 center[3];
+            f32 radius;
+            u32 material;
+        };
+        // interior node when count == 0. Children are always next to each other
+        struct BvhNode
+        {
+            f32 bmin[3];
+            u32 left_first;
+            f32 bmax[3];
+            u32 count;
+        };
+
+        struct Ray
+        {
+            f32 o[3];
+            f32 d[3];
+            f32 inv_d[3];
+        };
+        struct Hit
+        {
+            f32 t;
+            u32 prim;
+        };
+
+        // 4 rays in SoA layout
+        struct RayPacket
+        {
+            __m128 ox, oy, oz;
+            __m128 dx, dy, dz;
+            __m128 ix, iy, iz;
+            __m128 t;
+            __m128 prim;    // u32 bits
+            __m128 active;  // lane mask
+        };
+
+        inline f32 _Dot( const f32 a[3], const f32 b[3] ) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+        inline void _Cross( f32 r[3], const f32 a[3], const f32 b[3] )
+        {
+            r[0] = a[1] * b[2] - a[2] * b[1];
+            r[1] = a[2] * b[0] - a[0] * b[2];
+            r[2] = a[0] * b[1] - a[1] * b[0];
+        }
+        inline f32 _SafeInv( f32 x ) { return ( fabsf( x ) > 1e-20f ) ? 1.f / x : ( ( x < 0.f ) ? -FLT_MAX : FLT_MAX ); }
+
+        inline __m128 _Select( __m128 mask, __m128 a, __m128 b ) { return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) ); }
+
+        struct Rng
+        {
+            u32 state;
+
+            explicit Rng( u32 seed ) : state( ( seed ) ? seed : 1 ) {}
+            f32 next()
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                union
+                {
+                    u32 i;
+                    f32 f;
+                };
+                i = ( state >> 9 ) | 0x3f800000;
+                return f - 1.f;
+            }
+        };
+        inline u32 _HashU32( u32 x )
+        {
+            x ^= x >> 16;
+            x *= 0x7feb352d;
+            x ^= x >> 15;
+            x *= 0x846ca68b;
+            x ^= x >> 16;
+            return x;
+        }
+    }//
+
+    struct Scene
+    {
+        array_t<Triangle> triangles;
+        array_t<Sphere> spheres;
+        array_t<float4_t> materials;
+        array_t<u32> prims;      // sphere index with eSPHERE_BIT or triangle index, in BVH leaf order
+        array_t<BvhNode> nodes;
+        u32 num_nodes = 0;
+    };
+
+    Scene* scene_new()
+    {
+        return BX_NEW( bxDefaultAllocator(), Scene );
+    }
+    void scene_delete( Scene** scene )
+    {
+        BX_DELETE0( bxDefaultAllocator(), scene[0] );
+    }
+
+    static u32 _AddMaterial( Scene* scene, const Vector3& color )
+    {
+        return (u32)array::push_back( scene->materials, float4_t( color.getX().getAsFloat(), color.getY().getAsFloat(), color.getZ().getAsFloat(), 1.f ) );
+    }
+
+    void scene_addSphere( Scene* scene, const Vector4& sphere, const Vector3& color )
+    {
+        Sphere s;
+        s.center[0] = sphere.getX().getAsFloat();
+        s.center[1] = sphere.getY().getAsFloat();
+        s.center[2] = sphere.getZ().getAsFloat();
+        s.radius = sphere.getW().getAsFloat();
+        s.material = _AddMaterial( scene, color );
+        array::push_back( scene->spheres, s );
+    }
+
+    void scene_addMesh( Scene* scene, const Matrix4& pose, const f32* points, u32 numPoints, const u32* indices, u32 numTriangles, const Vector3& color )
+    {
+        const u32 material = _AddMaterial( scene, color );
+        array::reserve( scene->triangles, (int)( array::sizeu( scene->triangles ) + numTriangles ) );
+        for( u32 itri = 0; itri < numTriangles; ++itri )
+        {
+            f32 v[3][3];
+            for( u32 i = 0; i < 3; ++i )
+            {
+                const u32 index = indices[itri * 3 + i];
+                SYS_ASSERT( index < numPoints );
+                const f32* p = points + index * 3;
+                const Vector4 wp = pose * Point3( p[0], p[1], p[2] );
+                v[i][0] = wp.getX().getAsFloat();
+                v[i][1] = wp.getY().getAsFloat();
+                v[i][2] = wp.getZ().getAsFloat();
+            }
+
+            Triangle tri;
+            for( u32 i = 0; i < 3; ++i )
+            {
+                tri.v0[i] = v[0][i];
+                tri.e1[i] = v[1][i] - v[0][i];
+                tri.e2[i] = v[2][i] - v[0][i];
+            }
+            tri.material = material;
+            array::push_back( scene->triangles, tri );
+        }
+    }
+
+    u32 scene_numPrimitives( const Scene* scene ) { return array::sizeu( scene->prims ); }
+    u32 scene_numNodes( const Scene* scene ) { return scene->num_nodes; }
+
+    ////
+    // BVH build
+    namespace
+    {
+        struct BuildPrim
+        {
+            f32 bmin[3];
+            f32 bmax[3];
+            f32 center[3];
+        };
+        struct Bin
+        {
+            f32 bmin[3];
+            f32 bmax[3];
+            u32 count;
+        };
+
+        inline void _BoundsReset( f32 bmin[3], f32 bmax[3] )
+        {
+            bmin[0] = bmin[1] = bmin[2] = FLT_MAX;
+            bmax[0] = bmax[1] = bmax[2] = -FLT_MAX;
+        }
+        inline void _BoundsGrow( f32 bmin[3], f32 bmax[3], const f32 pmin[3], const f32 pmax[3] )
+        {
+            for( u32 i = 0; i < 3; ++i )
+            {
+                bmin[i] = minOfPair( bmin[i], pmin[i] );
+                bmax[i] = maxOfPair( bmax[i], pmax[i] );
+            }
+        }
+        inline f32 _HalfArea( const f32 bmin[3], const f32 bmax[3] )
+        {
+            const f32 ex = bmax[0] - bmin[0];
+            const f32 ey = bmax[1] - bmin[1];
+            const f32 ez = bmax[2] - bmin[2];
+            return ( ex < 0.f ) ? 0.f : ex * ey + ey * ez + ez * ex;
+        }
+
+        void _UpdateNodeBounds( BvhNode* node, const u32* prims, const BuildPrim* bp )
+        {
+            _BoundsReset( node->bmin, node->bmax );
+            for( u32 i = 0; i < node->count; ++i )
+            {
+                const BuildPrim& p = bp[prims[node->left_first + i]];
+                _BoundsGrow( node->bmin, node->bmax, p.bmin, p.bmax );
+            }
+        }
+
+        // depth is limited, so traversal stacks can't overflow
+        void _Subdivide( BvhNode* nodes, u32* numNodes, u32* prims, const BuildPrim* bp, u32 nodeIndex, u32 depth )
+        {
+            BvhNode& node = nodes[nodeIndex];
+            if( node.count <= 1 || depth >= eMAX_DEPTH )
+                return;
+
+            f32 cmin[3], cmax[3];
+            _BoundsReset( cmin, cmax );
+            for( u32 i = 0; i < node.count; ++i )
+            {
+                const BuildPrim& p = bp[prims[node.left_first + i]];
+                _BoundsGrow( cmin, cmax, p.center, p.center );
+            }
+
+            // binned SAH
+            f32 bestCost = FLT_MAX;
+            u32 bestAxis = 0;
+            u32 bestSplit = 0;
+            for( u32 axis = 0; axis < 3; ++axis )
+            {
+                const f32 extent = cmax[axis] - cmin[axis];
+                if( extent <= 0.f )
+                    continue;
+
+                Bin bins[eNUM_BINS];
+                for( u32 i = 0; i < eNUM_BINS; ++i )
+                {
+                    _BoundsReset( bins[i].bmin, bins[i].bmax );
+                    bins[i].count = 0;
+                }
+                const f32 scale = eNUM_BINS / extent;
+                for( u32 i = 0; i < node.count; ++i )
+                {
+                    const BuildPrim& p = bp[prims[node.left_first + i]];
+                    const u32 ibin = minOfPair( (u32)( ( p.center[axis] - cmin[axis] ) * scale ), (u32)eNUM_BINS - 1 );
+                    _BoundsGrow( bins[ibin].bmin, bins[ibin].bmax, p.bmin, p.bmax );
+                    bins[ibin].count += 1;
+                }
+
+                f32 leftArea[eNUM_BINS - 1];
+                u32 leftCount[eNUM_BINS - 1];
+                f32 bmin[3], bmax[3];
+                _BoundsReset( bmin, bmax );
+                u32 count = 0;
+                for( u32 i = 0; i < eNUM_BINS - 1; ++i )
+                {
+                    count += bins[i].count;
+                    _BoundsGrow( bmin, bmax, bins[i].bmin, bins[i].bmax );
+                    leftArea[i] = _HalfArea( bmin, bmax );
+                    leftCount[i] = count;
+                }
+
+                _BoundsReset( bmin, bmax );
+                count = 0;
+                for( u32 i = eNUM_BINS - 1; i > 0; --i )
+                {
+                    count += bins[i].count;
+                    _BoundsGrow( bmin, bmax, bins[i].bmin, bins[i].bmax );
+                    const f32 cost = leftArea[i - 1] * leftCount[i - 1] + _HalfArea( bmin, bmax ) * count;
+                    if( leftCount[i - 1] && count && cost < bestCost )
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = i;
+                    }
+                }
+            }
+
+            const f32 leafCost = _HalfArea( node.bmin, node.bmax ) * node.count;
+            if( bestCost == FLT_MAX || ( bestCost >= leafCost && node.count <= eMAX_LEAF_SIZE ) )
+                return;
+
+            const f32 scale = eNUM_BINS / ( cmax[bestAxis] - cmin[bestAxis] );
+            u32 i = node.left_first;
+            u32 j = i + node.count - 1;
+            while( i <= j )
+            {
+                const f32 c = bp[prims[i]].center[bestAxis];
+                const u32 ibin = minOfPair( (u32)( ( c - cmin[bestAxis] ) * scale ), (u32)eNUM_BINS - 1 );
+                if( ibin < bestSplit )
+                {
+                    ++i;
+                }
+                else
+                {
+                    const u32 tmp = prims[i];
+                    prims[i] = prims[j];
+                    prims[j] = tmp;
+                    if( j == 0 )
+                        break;
+                    --j;
+                }
+            }
+
+            const u32 leftCount = i - node.left_first;
+            if( leftCount == 0 || leftCount == node.count )
+                return;
+
+            const u32 left = *numNodes;
+            *numNodes += 2;
+            nodes[left].left_first = node.left_first;
+            nodes[left].count = leftCount;
+            nodes[left + 1].left_first = i;
+            nodes[left + 1].count = node.count - leftCount;
+            node.left_first = left;
+            node.count = 0;
+
+            _UpdateNodeBounds( &nodes[left], prims, bp );
+            _UpdateNodeBounds( &nodes[left + 1], prims, bp );
+            _Subdivide( nodes, numNodes, prims, bp, left, depth + 1 );
+            _Subdivide( nodes, numNodes, prims, bp, left + 1, depth + 1 );
+        }
+    }//
+
+    void scene_build( Scene* scene )
+    {
+        const u32 numSpheres = array::sizeu( scene->spheres );
+        const u32 numTriangles = array::sizeu( scene->triangles );
+        const u32 numPrims = numSpheres + numTriangles;
+
+        array::resize( scene->prims, (int)numPrims );
+        array::resize( scene->nodes, (int)maxOfPair( numPrims * 2, 2u ) );
+        scene->num_nodes = 1;
+
+        BvhNode& root = scene->nodes[0];
+        root.left_first = 0;
+        root.count = numPrims;
+        _BoundsReset( root.bmin, root.bmax );
+        if( numPrims == 0 )
+            return;
+
+        BuildPrim* bp = (BuildPrim*)BX_MALLOC( bxDefaultAllocator(), numPrims * sizeof( BuildPrim ), ALIGNOF( BuildPrim ) );
+        for( u32 i = 0; i < numSpheres; ++i )
+        {
+            const Sphere& s = scene->spheres[i];
+            BuildPrim& p = bp[i];
+            for( u32 k = 0; k < 3; ++k )
+            {
+                p.bmin[k] = s.center[k] - s.radius;
+                p.bmax[k] = s.center[k] + s.radius;
+                p.center[k] = s.center[k];
+            }
+        }
+        for( u32 i = 0; i < numTriangles; ++i )
+        {
+            const Triangle& t = scene->triangles[i];
+            BuildPrim& p = bp[numSpheres + i];
+            for( u32 k = 0; k < 3; ++k )
+            {
+                const f32 v1 = t.v0[k] + t.e1[k];
+                const f32 v2 = t.v0[k] + t.e2[k];
+                p.bmin[k] = minOfPair( t.v0[k], minOfPair( v1, v2 ) );
+                p.bmax[k] = maxOfPair( t.v0[k], maxOfPair( v1, v2 ) );
+                p.center[k] = ( p.bmin[k] + p.bmax[k] ) * 0.5f;
+            }
+        }
+
+        // build works on build primitive indices, which are encoded to primitive references afterwards
+        for( u32 i = 0; i < numPrims; ++i )
+            scene->prims[i] = i;
+
+        _UpdateNodeBounds( &root, scene->prims.begin(), bp );
+        _Subdivide( scene->nodes.begin(), &scene->num_nodes, scene->prims.begin(), bp, 0, 0 );
+
+        for( u32 i = 0; i < numPrims; ++i )
+        {
+            const u32 index = scene->prims[i];
+            scene->prims[i] = ( index < numSpheres ) ? index | eSPHERE_BIT : index - numSpheres;
+        }
+        BX_FREE( bxDefaultAllocator(), bp );
+    }
+
+    ////
+    // single ray
+    namespace
+    {
+        inline Ray _MakeRay( const Vector3& o, const Vector3& d )
+        {
+            Ray r;
+            r.o[0] = o.getX().getAsFloat(); r.o[1] = o.getY().getAsFloat(); r.o[2] = o.getZ().getAsFloat();
+            r.d[0] = d.getX().getAsFloat(); r.d[1] = d.getY().getAsFloat(); r.d[2] = d.getZ().getAsFloat();
+            for( u32 i = 0; i < 3; ++i )
+                r.inv_d[i] = _SafeInv( r.d[i] );
+            return r;
+        }
+
+        // returns entry distance or FLT_MAX when box is missed
+        inline f32 _IntersectBox( const BvhNode& n, const Ray& r, f32 tmax )
+        {
+            const f32 tx0 = ( n.bmin[0] - r.o[0] ) * r.inv_d[0];
+            const f32 tx1 = ( n.bmax[0] - r.o[0] ) * r.inv_d[0];
+            const f32 ty0 = ( n.bmin[1] - r.o[1] ) * r.inv_d[1];
+            const f32 ty1 = ( n.bmax[1] - r.o[1] ) * r.inv_d[1];
+            const f32 tz0 = ( n.bmin[2] - r.o[2] ) * r.inv_d[2];
+            const f32 tz1 = ( n.bmax[2] - r.o[2] ) * r.inv_d[2];
+            const f32 tnear = maxOfPair( maxOfPair( minOfPair( tx0, tx1 ), minOfPair( ty0, ty1 ) ), minOfPair( tz0, tz1 ) );
+            const f32 tfar = minOfPair( minOfPair( maxOfPair( tx0, tx1 ), maxOfPair( ty0, ty1 ) ), maxOfPair( tz0, tz1 ) );
+            return ( tnear <= tfar && tfar > 0.f && tnear < tmax ) ? tnear : FLT_MAX;
+        }
+
+        inline bool _IntersectTriangle( const Triangle& tri, const Ray& r, f32* t )
+        {
+            f32 p[3], q[3], tv[3];
+            _Cross( p, r.d, tri.e2 );
+            const f32 det = _Dot( tri.e1, p );
+            if( fabsf( det ) < 1e-12f )
+                return false;
+
+            const f32 inv = 1.f / det;
+            tv[0] = r.o[0] - tri.v0[0]; tv[1] = r.o[1] - tri.v0[1]; tv[2] = r.o[2] - tri.v0[2];
+            const f32 u = _Dot( tv, p ) * inv;
+            if( u < 0.f || u > 1.f )
+                return false;
+
+            _Cross( q, tv, tri.e1 );
+            const f32 v = _Dot( r.d, q ) * inv;
+            if( v < 0.f || u + v > 1.f )
+                return false;
+
+            const f32 th = _Dot( tri.e2, q ) * inv;
+            if( th <= RAY_EPSILON || th >= *t )
+                return false;
+
+            *t = th;
+            return true;
+        }
+
+        inline bool _IntersectSphere( const Sphere& s, const Ray& r, f32* t )
+        {
+            const f32 p[3] = { r.o[0] - s.center[0], r.o[1] - s.center[1], r.o[2] - s.center[2] };
+            const f32 b = _Dot( p, r.d );
+            const f32 c = _Dot( p, p ) - s.radius * s.radius;
+            const f32 h = b * b - c;
+            if( h < 0.f )
+                return false;
+
+            const f32 th = -b - sqrtf( h );
+            if( th <= RAY_EPSILON || th >= *t )
+                return false;
+
+            *t = th;
+            return true;
+        }
+
+        // anyHit stops on first hit closer than hit->t (shadow rays)
+        bool _Intersect( const Scene* scene, const Ray& r, Hit* hit, bool anyHit )
+        {
+            const BvhNode* nodes = scene->nodes.begin();
+            if( _IntersectBox( nodes[0], r, hit->t ) == FLT_MAX )
+                return false;
+
+            u32 stack[eSTACK_SIZE];
+            u32 sp = 0;
+            u32 current = 0;
+            bool found = false;
+            for( ;; )
+            {
+                const BvhNode& node = nodes[current];
+                if( node.count )
+                {
+                    for( u32 i = 0; i < node.count; ++i )
+                    {
+                        const u32 prim = scene->prims[node.left_first + i];
+                        const bool primHit = ( prim & eSPHERE_BIT )
+                            ? _IntersectSphere( scene->spheres[prim & ~eSPHERE_BIT], r, &hit->t )
+                            : _IntersectTriangle( scene->triangles[prim], r, &hit->t );
+                        if( primHit )
+                        {
+                            hit->prim = prim;
+                            found = true;
+                            if( anyHit )
+                                return true;
+                        }
+                    }
+                    if( sp == 0 )
+                        break;
+                    current = stack[--sp];
+                    continue;
+                }
+
+                u32 first = node.left_first;
+                u32 second = node.left_first + 1;
+                f32 tfirst = _IntersectBox( nodes[first], r, hit->t );
+                f32 tsecond = _IntersectBox( nodes[second], r, hit->t );
+                if( tsecond < tfirst )
+                {
+                    const u32 tmpn = first; first = second; second = tmpn;
+                    const f32 tmpt = tfirst; tfirst = tsecond; tsecond = tmpt;
+                }
+
+                if( tfirst == FLT_MAX )
+                {
+                    if( sp == 0 )
+                        break;
+                    current = stack[--sp];
+                }
+                else
+                {
+                    current = first;
+                    if( tsecond != FLT_MAX )
+                    {
+                        SYS_ASSERT( sp < eSTACK_SIZE );
+                        stack[sp++] = second;
+                    }
+                }
+            }
+        return found;
+        }
+    }//
+
+    ////
+    // 4 ray packet
+    namespace
+    {
+        inline __m128 _IntersectBox4( const BvhNode& n, const RayPacket& p )
+        {
+            const __m128 tx0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bmin[0] ), p.ox ), p.ix );
+            const __m128 tx1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bmax[0] ), p.ox ), p.ix );
+            const __m128 ty0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bmin[1] ), p.oy ), p.iy );
+            const __m128 ty1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bmax[1] ), p.oy ), p.iy );
+            const __m128 tz0 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bmin[2] ), p.oz ), p.iz );
+            const __m128 tz1 = _mm_mul_ps( _mm_sub_ps( _mm_set1_ps( n.bmax[2] ), p.oz ), p.iz );
+            const __m128 tnear = _mm_max_ps( _mm_max_ps( _mm_min_ps( tx0, tx1 ), _mm_min_ps( ty0, ty1 ) ), _mm_min_ps( tz0, tz1 ) );
+            const __m128 tfar = _mm_min_ps( _mm_min_ps( _mm_max_ps( tx0, tx1 ), _mm_max_ps( ty0, ty1 ) ), _mm_max_ps( tz0, tz1 ) );
+            const __m128 mask = _mm_and_ps( _mm_and_ps( _mm_cmple_ps( tnear, tfar ), _mm_cmpgt_ps( tfar, _mm_setzero_ps() ) ), _mm_cmplt_ps( tnear, p.t ) );
+            return _mm_and_ps( mask, p.active );
+        }
+
+        inline void _IntersectTriangle4( RayPacket* p, const Triangle& tri, u32 prim )
+        {
+            const __m128 e1x = _mm_set1_ps( tri.e1[0] ), e1y = _mm_set1_ps( tri.e1[1] ), e1z = _mm_set1_ps( tri.e1[2] );
+            const __m128 e2x = _mm_set1_ps( tri.e2[0] ), e2y = _mm_set1_ps( tri.e2[1] ), e2z = _mm_set1_ps( tri.e2[2] );
+
+            const __m128 px = _mm_sub_ps( _mm_mul_ps( p->dy, e2z ), _mm_mul_ps( p->dz, e2y ) );
+            const __m128 py = _mm_sub_ps( _mm_mul_ps( p->dz, e2x ), _mm_mul_ps( p->dx, e2z ) );
+            const __m128 pz = _mm_sub_ps( _mm_mul_ps( p->dx, e2y ), _mm_mul_ps( p->dy, e2x ) );
+            const __m128 det = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e1x, px ), _mm_mul_ps( e1y, py ) ), _mm_mul_ps( e1z, pz ) );
+            const __m128 absDet = _mm_andnot_ps( _mm_set1_ps( -0.f ), det );
+            const __m128 inv = _mm_div_ps( _mm_set1_ps( 1.f ), det );
+
+            const __m128 tvx = _mm_sub_ps( p->ox, _mm_set1_ps( tri.v0[0] ) );
+            const __m128 tvy = _mm_sub_ps( p->oy, _mm_set1_ps( tri.v0[1] ) );
+            const __m128 tvz = _mm_sub_ps( p->oz, _mm_set1_ps( tri.v0[2] ) );
+            const __m128 u = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( tvx, px ), _mm_mul_ps( tvy, py ) ), _mm_mul_ps( tvz, pz ) ), inv );
+
+            const __m128 qx = _mm_sub_ps( _mm_mul_ps( tvy, e1z ), _mm_mul_ps( tvz, e1y ) );
+            const __m128 qy = _mm_sub_ps( _mm_mul_ps( tvz, e1x ), _mm_mul_ps( tvx, e1z ) );
+            const __m128 qz = _mm_sub_ps( _mm_mul_ps( tvx, e1y ), _mm_mul_ps( tvy, e1x ) );
+            const __m128 v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( p->dx, qx ), _mm_mul_ps( p->dy, qy ) ), _mm_mul_ps( p->dz, qz ) ), inv );
+            const __m128 t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( e2x, qx ), _mm_mul_ps( e2y, qy ) ), _mm_mul_ps( e2z, qz ) ), inv );
+
+            const __m128 zero = _mm_setzero_ps();
+            __m128 mask = _mm_cmpge_ps( absDet, _mm_set1_ps( 1e-12f ) );
+            mask = _mm_and_ps( mask, _mm_cmpge_ps( u, zero ) );
+            mask = _mm_and_ps( mask, _mm_cmpge_ps( v, zero ) );
+            mask = _mm_and_ps( mask, _mm_cmple_ps( _mm_add_ps( u, v ), _mm_set1_ps( 1.f ) ) );
+            mask = _mm_and_ps( mask, _mm_cmpgt_ps( t, _mm_set1_ps( RAY_EPSILON ) ) );
+            mask = _mm_and_ps( mask, _mm_cmplt_ps( t, p->t ) );
+            mask = _mm_and_ps( mask, p->active );
+
+            p->t = _Select( mask, t, p->t );
+            p->prim = _Select( mask, _mm_castsi128_ps( _mm_set1_epi32( (int)prim ) ), p->prim );
+        }
+
+        inline void _IntersectSphere4( RayPacket* p, const Sphere& s, u32 prim )
+        {
+            const __m128 px = _mm_sub_ps( p->ox, _mm_set1_ps( s.center[0] ) );
+            const __m128 py = _mm_sub_ps( p->oy, _mm_set1_ps( s.center[1] ) );
+            const __m128 pz = _mm_sub_ps( p->oz, _mm_set1_ps( s.center[2] ) );
+            const __m128 b = _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, p->dx ), _mm_mul_ps( py, p->dy ) ), _mm_mul_ps( pz, p->dz ) );
+            const __m128 c = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, px ), _mm_mul_ps( py, py ) ), _mm_mul_ps( pz, pz ) ), _mm_set1_ps( s.radius * s.radius ) );
+            const __m128 h = _mm_sub_ps( _mm_mul_ps( b, b ), c );
+            const __m128 t = _mm_sub_ps( _mm_sub_ps( _mm_setzero_ps(), b ), _mm_sqrt_ps( _mm_max_ps( h, _mm_setzero_ps() ) ) );
+
+            __m128 mask = _mm_cmpge_ps( h, _mm_setzero_ps() );
+            mask = _mm_and_ps( mask, _mm_cmpgt_ps( t, _mm_set1_ps( RAY_EPSILON ) ) );
+            mask = _mm_and_ps( mask, _mm_cmplt_ps( t, p->t ) );
+            mask = _mm_and_ps( mask, p->active );
+
+            p->t = _Select( mask, t, p->t );
+            p->prim = _Select( mask, _mm_castsi128_ps( _mm_set1_epi32( (int)prim ) ), p->prim );
+        }
+
+        // packet goes down the tree as long as any of its rays hits the node
+        void _Intersect4( const Scene* scene, RayPacket* p )
+        {
+            const BvhNode* nodes = scene->nodes.begin();
+            u32 stack[eSTACK_SIZE];
+            u32 sp = 0;
+            stack[sp++] = 0;
+            while( sp )
+            {
+                const BvhNode& node = nodes[stack[--sp]];
+                if( !_mm_movemask_ps( _IntersectBox4( node, *p ) ) )
+                    continue;
+
+                if( node.count )
+                {
+                    for( u32 i = 0; i < node.count; ++i )
+                    {
+                        const u32 prim = scene->prims[node.left_first + i];
+                        if( prim & eSPHERE_BIT )
+                            _IntersectSphere4( p, scene->spheres[prim & ~eSPHERE_BIT], prim );
+                        else
+                            _IntersectTriangle4( p, scene->triangles[prim], prim );
+                    }
+                    continue;
+                }
+
+                // visit child closer to packet origin first (primary rays share origin)
+                SYS_ASSERT( sp + 2 <= eSTACK_SIZE );
+                const BvhNode& left = nodes[node.left_first];
+                const BvhNode& right = nodes[node.left_first + 1];
+                const f32 o[3] = { _mm_cvtss_f32( p->ox ), _mm_cvtss_f32( p->oy ), _mm_cvtss_f32( p->oz ) };
+                f32 dl = 0.f, dr = 0.f;
+                for( u32 k = 0; k < 3; ++k )
+                {
+                    const f32 cl = ( left.bmin[k] + left.bmax[k] ) * 0.5f - o[k];
+                    const f32 cr = ( right.bmin[k] + right.bmax[k] ) * 0.5f - o[k];
+                    dl += cl * cl;
+                    dr += cr * cr;
+                }
+                const u32 first = ( dl <= dr ) ? node.left_first : node.left_first + 1;
+                const u32 second = ( dl <= dr ) ? node.left_first + 1 : node.left_first;
+                stack[sp++] = second;
+                stack[sp++] = first;
+            }
+        }
+    }//
+
+    ////
+    // shading
+    namespace
+    {
+        struct Camera
+        {
+            Vector3 eye;
+            Vector3 axis_x;
+            Vector3 axis_y;
+            Vector3 axis_z;
+            f32 focal;
+            f32 inv_height;
+            f32 width;
+            f32 height;
+        };
+
+        inline Vector3 _PrimaryDirection( const Camera& cam, f32 px, f32 py )
+        {
+            // same projection as old demo tracer: image plane of height 2 in 'focal' distance
+            const f32 x = ( px * 2.f - cam.width ) * cam.inv_height;
+            const f32 y = ( cam.height - py * 2.f ) * cam.inv_height;
+            return normalize( cam.axis_x * x + cam.axis_y * y - cam.axis_z * cam.focal );
+        }
+
+        inline Vector3 _Normal( const Scene* scene, u32 prim, const Vector3& pos )
+        {
+            if( prim & eSPHERE_BIT )
+            {
+                const Sphere& s = scene->spheres[prim & ~eSPHERE_BIT];
+                return normalize( pos - Vector3( s.center[0], s.center[1], s.center[2] ) );
+            }
+            const Triangle& t = scene->triangles[prim];
+            f32 n[3];
+            _Cross( n, t.e1, t.e2 );
+            return normalize( Vector3( n[0], n[1], n[2] ) );
+        }
+
+        inline Vector3 _Color( const Scene* scene, u32 prim )
+        {
+            const u32 material = ( prim & eSPHERE_BIT ) ? scene->spheres[prim & ~eSPHERE_BIT].material : scene->triangles[prim].material;
+            const float4_t& c = scene->materials[material];
+            return Vector3( c.x, c.y, c.z );
+        }
+
+        inline Vector3 _CosineSample( const Vector3& n, Rng& rng )
+        {
+            const f32 phi = PI2 * rng.next();
+            const f32 r2 = rng.next();
+            const f32 r = sqrtf( r2 );
+            const Vector3 axis = ( fabsf( n.getX().getAsFloat() ) > 0.1f ) ? Vector3::yAxis() : Vector3::xAxis();
+            const Vector3 u = normalize( cross( axis, n ) );
+            const Vector3 v = cross( n, u );
+            return normalize( u * ( cosf( phi ) * r ) + v * ( sinf( phi ) * r ) + n * sqrtf( 1.f - r2 ) );
+        }
+
+        // continues path from first hit. Miss of primary ray gives background, miss of bounce ray ends the path
+        Vector3 _Radiance( const Scene* scene, const RenderDesc& desc, Vector3 ro, Vector3 rd, Hit hit, Rng& rng, u64* numRays )
+        {
+            if( hit.prim == eNO_HIT )
+                return desc.background;
+
+            Vector3 tcol( 0.f );
+            Vector3 fcol( 1.f );
+            const Vector3 toSun = -desc.sun_dir;
+            for( u32 ilevel = 0; ; )
+            {
+                const Vector3 pos = ro + rd * hit.t;
+                Vector3 nrm = _Normal( scene, hit.prim, pos );
+                nrm = select( nrm, -nrm, dot( nrm, rd ) > zeroVec );
+                const Vector3 matCol = _Color( scene, hit.prim );
+                const Vector3 offsetPos = pos + nrm * SURFACE_OFFSET;
+
+                fcol = mulPerElem( fcol, matCol );
+
+                const f32 ndl = clamp( dot( nrm, toSun ).getAsFloat(), 0.f, 1.f );
+                if( ndl > 0.f )
+                {
+                    Hit shadow = { FLT_MAX, eNO_HIT };
+                    *numRays += 1;
+                    if( !_Intersect( scene, _MakeRay( offsetPos, toSun ), &shadow, true ) )
+                    {
+                        const Vector3 litCol = mulPerElem( desc.sun_color * ndl, matCol ) * PI_INV;
+                        tcol += mulPerElem( fcol, litCol );
+                    }
+                }
+
+                if( ++ilevel >= desc.max_bounces )
+                    break;
+
+                ro = offsetPos;
+                rd = _CosineSample( nrm, rng );
+                hit.t = FLT_MAX;
+                hit.prim = eNO_HIT;
+                *numRays += 1;
+                if( !_Intersect( scene, _MakeRay( ro, rd ), &hit, false ) )
+                    break;
+            }
+            return tcol;
+        }
+
+        struct PassJob
+        {
+            Film* film;
+            const Scene* scene;
+            const RenderDesc* desc;
+            Camera camera;
+            u32 pass;
+            u32 tiles_x;
+            atomic64 num_rays;
+        };
+
+        void _RenderTile( PassJob* job, u32 tileIndex )
+        {
+            const RenderDesc& desc = *job->desc;
+            const Camera& cam = job->camera;
+            Film* film = job->film;
+
+            const u32 x0 = ( tileIndex % job->tiles_x ) * desc.tile_size;
+            const u32 y0 = ( tileIndex / job->tiles_x ) * desc.tile_size;
+            const u32 x1 = minOfPair( x0 + desc.tile_size, desc.width );
+            const u32 y1 = minOfPair( y0 + desc.tile_size, desc.height );
+
+            Rng rng( _HashU32( desc.seed ^ _HashU32( job->pass * 0x9E3779B9 + tileIndex ) ) );
+            u64 numRays = 0;
+
+            const __m128 eyeX = _mm_set1_ps( cam.eye.getX().getAsFloat() );
+            const __m128 eyeY = _mm_set1_ps( cam.eye.getY().getAsFloat() );
+            const __m128 eyeZ = _mm_set1_ps( cam.eye.getZ().getAsFloat() );
+
+            for( u32 y = y0; y < y1; y += 2 )
+            {
+                for( u32 x = x0; x < x1; x += 2 )
+                {
+                    // lanes: (x,y) (x+1,y) (x,y+1) (x+1,y+1)
+                    u32 px[4], py[4];
+                    bool valid[4];
+                    for( u32 lane = 0; lane < 4; ++lane )
+                    {
+                        px[lane] = x + ( lane & 1 );
+                        py[lane] = y + ( lane >> 1 );
+                        valid[lane] = px[lane] < x1 && py[lane] < y1;
+                    }
+
+                    for( u32 isample = 0; isample < desc.samples_per_pass; ++isample )
+                    {
+                        Vector3 dirs[4];
+                        BIT_ALIGNMENT_16 f32 dx[4], dy[4], dz[4], ix[4], iy[4], iz[4];
+                        BIT_ALIGNMENT_16 u32 active[4];
+                        for( u32 lane = 0; lane < 4; ++lane )
+                        {
+                            const f32 jx = rng.next();
+                            const f32 jy = rng.next();
+                            dirs[lane] = _PrimaryDirection( cam, (f32)px[lane] + jx, (f32)py[lane] + jy );
+                            dx[lane] = dirs[lane].getX().getAsFloat();
+                            dy[lane] = dirs[lane].getY().getAsFloat();
+                            dz[lane] = dirs[lane].getZ().getAsFloat();
+                            ix[lane] = _SafeInv( dx[lane] );
+                            iy[lane] = _SafeInv( dy[lane] );
+                            iz[lane] = _SafeInv( dz[lane] );
+                            active[lane] = ( valid[lane] ) ? UINT32_MAX : 0;
+                            numRays += ( valid[lane] ) ? 1 : 0;
+                        }
+
+                        RayPacket packet;
+                        packet.ox = eyeX; packet.oy = eyeY; packet.oz = eyeZ;
+                        packet.dx = _mm_load_ps( dx ); packet.dy = _mm_load_ps( dy ); packet.dz = _mm_load_ps( dz );
+                        packet.ix = _mm_load_ps( ix ); packet.iy = _mm_load_ps( iy ); packet.iz = _mm_load_ps( iz );
+                        packet.t = _mm_set1_ps( FLT_MAX );
+                        packet.prim = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+                        packet.active = _mm_load_ps( (const f32*)active );
+                        _Intersect4( job->scene, &packet );
+
+                        BIT_ALIGNMENT_16 f32 t[4];
+                        BIT_ALIGNMENT_16 u32 prim[4];
+                        _mm_store_ps( t, packet.t );
+                        _mm_store_ps( (f32*)prim, packet.prim );
+
+                        for( u32 lane = 0; lane < 4; ++lane )
+                        {
+                            if( !valid[lane] )
+                                continue;
+
+                            const Hit hit = { t[lane], prim[lane] };
+                            const Vector3 col = _Radiance( job->scene, desc, cam.eye, dirs[lane], hit, rng, &numRays );
+                            f32* dst = film->accum + ( py[lane] * film->width + px[lane] ) * 3;
+                            dst[0] += col.getX().getAsFloat();
+                            dst[1] += col.getY().getAsFloat();
+                            dst[2] += col.getZ().getAsFloat();
+                        }
+                    }
+                }
+            }
+
+            bxAtomic::interlockedAdd( &job->num_rays, (i64)numRays );
+        }
+    }//
+
+    void film_startUp( Film* film, u32 width, u32 height )
+    {
+        SYS_ASSERT( film->accum == nullptr );
+        film->width = width;
+        film->height = height;
+        film->accum = (f32*)BX_MALLOC( bxDefaultAllocator(), width * height * 3 * sizeof( f32 ), 16 );
+        film_clear( film );
+    }
+    void film_shutDown( Film* film )
+    {
+        BX_FREE0( bxDefaultAllocator(), film->accum );
+        film->width = film->height = 0;
+        film->num_samples = 0;
+    }
+    void film_clear( Film* film )
+    {
+        memset( film->accum, 0x00, film->width * film->height * 3 * sizeof( f32 ) );
+        film->num_samples = 0;
+    }
+    void film_resolve( f32* rgbOut, const Film& film )
+    {
+        const f32 scale = ( film.num_samples ) ? 1.f / (f32)film.num_samples : 0.f;
+        const u32 n = film.width * film.height * 3;
+        for( u32 i = 0; i < n; ++i )
+            rgbOut[i] = film.accum[i] * scale;
+    }
+
+    void renderPass( Film* film, const Scene* scene, const RenderDesc& desc, u32 passIndex, RenderStats* stats )
+    {
+        SYS_ASSERT( film->width == desc.width && film->height == desc.height );
+        SYS_ASSERT( desc.tile_size >= 2 && ( desc.tile_size & 1 ) == 0 );
+        SYS_ASSERT( scene->num_nodes > 0 );
+
+        const u64 startUS = bxTime::us();
+
+        PassJob job;
+        job.film = film;
+        job.scene = scene;
+        job.desc = &desc;
+        job.camera.eye = desc.camera_world.getTranslation();
+        job.camera.axis_x = desc.camera_world.getCol0().getXYZ();
+        job.camera.axis_y = desc.camera_world.getCol1().getXYZ();
+        job.camera.axis_z = desc.camera_world.getCol2().getXYZ();
+        job.camera.focal = desc.focal;
+        job.camera.width = (f32)desc.width;
+        job.camera.height = (f32)desc.height;
+        job.camera.inv_height = 1.f / (f32)desc.height;
+        job.pass = passIndex;
+        job.tiles_x = ( desc.width + desc.tile_size - 1 ) / desc.tile_size;
+        job.num_rays = 0;
+
+        const u32 tilesY = ( desc.height + desc.tile_size - 1 ) / desc.tile_size;
+        bxParallel::forRange( job.tiles_x * tilesY, 1, [&job]( u32 begin, u32 end, u32 )
+        {
+            for( u32 i = begin; i < end; ++i )
+                _RenderTile( &job, i );
+        } );
+
+        film->num_samples += desc.samples_per_pass;
+        if( stats )
+        {
+            stats->num_rays += (u64)job.num_rays;
+            stats->duration_us += bxTime::us() - startUS;
+        }
+    }
+
+    ////
+    // image output
+    namespace
+    {
+        inline u8 _ToByte( f32 x ) { return (u8)( powf( clamp( x, 0.f, 1.f ), 0.454545455f ) * 255.f + 0.5f ); }
+
+        // returns pointer to 'size' new bytes at the end of 'out'
+        inline u8* _Append( array_t<u8>& out, u32 size )
+        {
+            const u32 offset = array::sizeu( out );
+            if( offset + size > (u32)out.capacity )
+                array::reserve( out, (int)maxOfPair( offset + size, (u32)out.capacity * 2 ) );
+
+            array::resize( out, (int)( offset + size ) );
+            return out.begin() + offset;
+        }
+        inline void _Write( array_t<u8>& out, const void* data, u32 size )
+        {
+            memcpy( _Append( out, size ), data, size );
+        }
+        inline void _WriteString( array_t<u8>& out, const char* str ) { _Write( out, str, (u32)strlen( str ) + 1 ); }
+        inline void _WriteI32( array_t<u8>& out, i32 v ) { _Write( out, &v, sizeof( v ) ); }
+        inline void _WriteAttribute( array_t<u8>& out, const char* name, const char* type, const void* data, u32 size )
+        {
+            _WriteString( out, name );
+            _WriteString( out, type );
+            _WriteI32( out, (i32)size );
+            _Write( out, data, size );
+        }
+
+        int _WriteFile( const char* filename, const void* data, size_t size )
+        {
+            FILE* f = nullptr;
+            errno_t err = fopen_s( &f, filename, "wb" );
+            if( err != 0 )
+            {
+                bxLogError( "Can not open file %s (errno: %d)", filename, err );
+                return -1;
+            }
+            const size_t written = fwrite( data, 1, size, f );
+            fclose( f );
+            return ( written == size ) ? 0 : -1;
+        }
+    }//
+
+    int image_writePPM( const char* filename, const f32* rgb, u32 width, u32 height )
+    {
+        char header[64];
+        const int headerLen = sprintf_s( header, sizeof( header ), "P6\n%u %u\n255\n", width, height );
+
+        array_t<u8> out;
+        array::reserve( out, headerLen + (int)( width * height * 3 ) );
+        _Write( out, header, (u32)headerLen );
+        for( u32 y = 0; y < height; ++y )
+        {
+            const f32* src = rgb + y * width * 3;
+            u8* dst = _Append( out, width * 3 );
+            for( u32 i = 0; i < width * 3; ++i )
+                dst[i] = _ToByte( src[i] );
+        }
+        return _WriteFile( filename, out.begin(), array::sizeu( out ) );
+    }
+
+    int image_writeEXR( const char* filename, const f32* rgb, u32 width, u32 height )
+    {
+        array_t<u8> out;
+        const u8 magic[4] = { 0x76, 0x2f, 0x31, 0x01 };
+        _Write( out, magic, 4 );
+        _WriteI32( out, 2 ); // version 2, single part scanline
+
+        {// channels have to be sorted by name
+            array_t<u8> chlist;
+            const char* names[3] = { "B", "G", "R" };
+            for( u32 i = 0; i < 3; ++i )
+            {
+                _WriteString( chlist, names[i] );
+                _WriteI32( chlist, 2 ); // FLOAT
+                const u8 linearAndReserved[4] = { 0, 0, 0, 0 };
+                _Write( chlist, linearAndReserved, 4 );
+                _WriteI32( chlist, 1 ); // x sampling
+                _WriteI32( chlist, 1 ); // y sampling
+            }
+            const u8 terminator = 0;
+            _Write( chlist, &terminator, 1 );
+            _WriteAttribute( out, "channels", "chlist", chlist.begin(), array::sizeu( chlist ) );
+        }
+        const u8 compression = 0; // none
+        _WriteAttribute( out, "compression", "compression", &compression, 1 );
+        const i32 window[4] = { 0, 0, (i32)width - 1, (i32)height - 1 };
+        _WriteAttribute( out, "dataWindow", "box2i", window, sizeof( window ) );
+        _WriteAttribute( out, "displayWindow", "box2i", window, sizeof( window ) );
+        const u8 lineOrder = 0; // increasing y
+        _WriteAttribute( out, "lineOrder", "lineOrder", &lineOrder, 1 );
+        const f32 aspect = 1.f;
+        _WriteAttribute( out, "pixelAspectRatio", "float", &aspect, sizeof( aspect ) );
+        const f32 center[2] = { 0.f, 0.f };
+        _WriteAttribute( out, "screenWindowCenter", "v2f", center, sizeof( center ) );
+        const f32 windowWidth = 1.f;
+        _WriteAttribute( out, "screenWindowWidth", "float", &windowWidth, sizeof( windowWidth ) );
+        const u8 headerEnd = 0;
+        _Write( out, &headerEnd, 1 );
+
+        // offset table, then one scanline per block: y, data size, B G R planes
+        const u32 lineSize = width * 3 * sizeof( f32 );
+        const u64 tableEnd = array::sizeu( out ) + (u64)height * sizeof( u64 );
+        array::reserve( out, (int)( tableEnd + (u64)height * ( lineSize + 8 ) ) );
+        for( u32 y = 0; y < height; ++y )
+        {
+            const u64 offset = tableEnd + (u64)y * ( lineSize + 8 );
+            _Write( out, &offset, sizeof( offset ) );
+        }
+        for( u32 y = 0; y < height; ++y )
+        {
+            _WriteI32( out, (i32)y );
+            _WriteI32( out, (i32)lineSize );
+            for( i32 c = 2; c >= 0; --c )
+            {
+                f32* dst = (f32*)_Append( out, width * sizeof( f32 ) );
+                const f32* src = rgb + y * width * 3 + c;
+                for( u32 x = 0; x < width; ++x )
+                    dst[x] = src[x * 3];
+            }
+        }
+        return _WriteFile( filename, out.begin(), array::sizeu( out ) );
+    }
+}///
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <util/type.h>
+#include <util/vectormath/vectormath.h>
+
+// Headless CPU path tracer.
+// Scene is made of spheres and triangles, both kept in one BVH (binned SAH).
+// Image is split into tiles which are rendered by all bxParallel threads. Every tile has its own random stream
+// seeded from (seed, pass, tile), so result doesn't depend on thread count or scheduling.
+// Primary rays are traced in 2x2 pixel packets with SSE, secondary and shadow rays are traced one by one.
+// Passes accumulate in Film, so image converges progressively and can be written at any time.
+namespace bxPathTracer
+{
+    struct Scene;
+
+    Scene* scene_new();
+    void   scene_delete( Scene** scene );
+    void   scene_addSphere( Scene* scene, const Vector4& sphere, const Vector3& color );
+    // points are xyz triplets transformed with 'pose'. Triangles are two sided
+    void   scene_addMesh( Scene* scene, const Matrix4& pose, const f32* points, u32 numPoints, const u32* indices, u32 numTriangles, const Vector3& color );
+    // has to be called after scene is changed and before rendering
+    void   scene_build( Scene* scene );
+    u32    scene_numPrimitives( const Scene* scene );
+    u32    scene_numNodes( const Scene* scene );
+
+    struct RenderDesc
+    {
+        u32 width = 640;
+        u32 height = 640;
+        u32 tile_size = 16;         // has to be even
+        u32 samples_per_pass = 1;
+        u32 max_bounces = 4;
+        u32 seed = 0xBAADC0DE;
+        f32 focal = 2.5f;           // distance from eye to image plane of height 2
+
+        Matrix4 camera_world = Matrix4::identity();
+        Vector3 sun_dir = Vector3( 0.f, -1.f, 0.f );
+        Vector3 sun_color = Vector3( 1.f );
+        Vector3 background = Vector3( 0.5f, 0.6f, 0.7f );
+    };
+
+    struct RenderStats
+    {
+        u64 num_rays = 0;       // primary, bounce and shadow rays
+        u64 duration_us = 0;
+
+        f64 raysPerSecond() const { return ( duration_us ) ? f64( num_rays ) * 1000000.0 / f64( duration_us ) : 0.0; }
+    };
+
+    // progressive accumulation buffer
+    struct Film
+    {
+        f32* accum = nullptr;   // rgb sums
+        u32 width = 0;
+        u32 height = 0;
+        u32 num_samples = 0;    // per pixel
+    };
+    void film_startUp ( Film* film, u32 width, u32 height );
+    void film_shutDown( Film* film );
+    void film_clear   ( Film* film );
+    // writes average of accumulated samples. rgbOut has to have room for width*height*3 floats
+    void film_resolve ( f32* rgbOut, const Film& film );
+
+    // renders 'samples_per_pass' samples per pixel and adds them to film. Stats are accumulated
+    void renderPass( Film* film, const Scene* scene, const RenderDesc& desc, u32 passIndex, RenderStats* stats );
+
+    // binary PPM with gamma 2.2
+    int image_writePPM( const char* filename, const f32* rgb, u32 width, u32 height );
+    // linear, uncompressed 32 bit float RGB scanlines
+    int image_writeEXR( const char* filename, const f32* rgb, u32 width, u32 height );
+}///
@@ -0,0 +1,317 @@
+#include "flood_boundary_map.h"
+#include "SPHKernels.h"
+
+#include <util/common.h>
+#include <util/grid.h>
+#include <util/hash.h>
+#include <util/memory.h>
+#include <util/debug.h>
+#include <util/filesystem.h>
+#include <util/thread/parallel.h>
+#include <resource_manager/resource_manager.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace bx{ namespace flood{
+
+static const char CACHE_DIR[] = "fluid_cache";
+
+// quadrature points per axis used for volume integral (over cube enclosing support sphere)
+static const u32 VOLUME_QUADRATURE_RES = 16;
+
+struct BoundaryMapKey
+{
+    f32 box_center[3];
+    f32 box_half_extents[3];
+    f32 support_radius;
+    f32 cell_size;
+    u32 quadrature_res;
+};
+
+struct BoundaryMapFileHeader
+{
+    enum : u32
+    {
+        TAG = 0x30504D42, // BMP0
+        VERSION = 1,
+    };
+
+    u32 tag;
+    u32 version;
+    BoundaryMapKey key;
+    f32 origin[3];
+    u32 res[3];
+    // followed by distance and volume arrays
+};
+
+static inline float BoxDistance( const Vector3F& p, const Vector3F& center, const Vector3F& halfExtents )
+{
+    const Vector3F q = absPerElem( p - center ) - halfExtents;
+    const float outside = length( maxPerElem( q, Vector3F( 0.f ) ) );
+    const float inside = minOfPair( maxOfPair( q.x, maxOfPair( q.y, q.z ) ), 0.f );
+    return outside + inside;
+}
+
+static void CacheFilename( char* dst, u32 dstSize, const BoundaryMapKey& key )
+{
+    const u32 key_hash = murmur3_hash32( &key, sizeof( key ), 0xB0DE5A11 );
+    snprintf( dst, dstSize, "%s/%08x.bmap", CACHE_DIR, key_hash );
+}
+
+static bool ReadFromCache( BoundaryMap* map, const char* absPath, const BoundaryMapKey& key )
+{
+    if( !bxIO::fileExists( absPath ) )
+        return false;
+
+    unsigned char* data = nullptr;
+    size_t size = 0;
+    if( bxIO::readFile( &data, &size, absPath ) != 0 )
+        return false;
+
+    bool ok = false;
+    const BoundaryMapFileHeader* hdr = (const BoundaryMapFileHeader*)data;
+    if( size >= sizeof( BoundaryMapFileHeader ) && hdr->tag == BoundaryMapFileHeader::TAG && hdr->version == BoundaryMapFileHeader::VERSION &&
+        memcmp( &hdr->key, &key, sizeof( key ) ) == 0 )
+    {
+        const u64 num_nodes = (u64)hdr->res[0] * hdr->res[1] * hdr->res[2];
+        if( size == sizeof( BoundaryMapFileHeader ) + num_nodes * sizeof( f32 ) * 2 )
+        {
+            map->origin = Vector3F( hdr->origin[0], hdr->origin[1], hdr->origin[2] );
+            for( u32 i = 0; i < 3; ++i )
+                map->res[i] = hdr->res[i];
+
+            const f32* src = (const f32*)( hdr + 1 );
+            array::resize( map->distance, (u32)num_nodes );
+            array::resize( map->volume, (u32)num_nodes );
+            memcpy( map->distance.begin(), src, num_nodes * sizeof( f32 ) );
+            memcpy( map->volume.begin(), src + num_nodes, num_nodes * sizeof( f32 ) );
+            ok = true;
+        }
+    }
+
+    if( !ok )
+    {
+        bxLogWarning( "fluid: invalid boundary map '%s', rebuilding", absPath );
+    }
+
+    BX_FREE0( bxDefaultAllocator(), data );
+    return ok;
+}
+
+static void WriteToCache( const BoundaryMap& map, const char* absPath, const BoundaryMapKey& key )
+{
+    const u32 num_nodes = map.NumNodes();
+    const size_t size = sizeof( BoundaryMapFileHeader ) + num_nodes * sizeof( f32 ) * 2;
+    u8* data = (u8*)BX_MALLOC( bxDefaultAllocator(), size, 4 );
+
+    BoundaryMapFileHeader* hdr = (BoundaryMapFileHeader*)data;
+    memset( hdr, 0, sizeof( BoundaryMapFileHeader ) );
+    hdr->tag = BoundaryMapFileHeader::TAG;
+    hdr->version = BoundaryMapFileHeader::VERSION;
+    hdr->key = key;
+    hdr->origin[0] = map.origin.x;
+    hdr->origin[1] = map.origin.y;
+    hdr->origin[2] = map.origin.z;
+    for( u32 i = 0; i < 3; ++i )
+        hdr->res[i] = map.res[i];
+
+    f32* dst = (f32*)( hdr + 1 );
+    memcpy( dst, map.distance.begin(), num_nodes * sizeof( f32 ) );
+    memcpy( dst + num_nodes, map.volume.begin(), num_nodes * sizeof( f32 ) );
+
+    if( bxIO::writeFile( absPath, data, size ) != 0 )
+    {
+        bxLogWarning( "fluid: can not write boundary map '%s'", absPath );
+    }
+
+    BX_FREE0( bxDefaultAllocator(), data );
+}
+
+static void Build( BoundaryMap* map, const Vector3F& boxCenter, const Vector3F& boxHalfExtents )
+{
+    const f32 h = map->support_radius;
+    const u32 num_nodes = map->NumNodes();
+    array::resize( map->distance, num_nodes );
+    array::resize( map->volume, num_nodes );
+
+    // kernel weights of quadrature points inside of support sphere. Volume is normalized by sum of all weights,
+    // so quadrature error doesn't show up as density deficit deep inside of boundary
+    struct QuadraturePoint
+    {
+        Vector3F offset;
+        f32 w;
+    };
+    array_t<QuadraturePoint> quadrature;
+    array::reserve( quadrature, VOLUME_QUADRATURE_RES * VOLUME_QUADRATURE_RES * VOLUME_QUADRATURE_RES );
+
+    const f32 q_step = ( 2.f * h ) / VOLUME_QUADRATURE_RES;
+    f32 w_sum = 0.f;
+    for( u32 z = 0; z < VOLUME_QUADRATURE_RES; ++z )
+    {
+        for( u32 y = 0; y < VOLUME_QUADRATURE_RES; ++y )
+        {
+            for( u32 x = 0; x < VOLUME_QUADRATURE_RES; ++x )
+            {
+                const Vector3F offset = Vector3F( x + 0.5f, y + 0.5f, z + 0.5f ) * q_step - Vector3F( h );
+                const f32 w = PBD::Poly6Kernel::W( offset );
+                if( w > 0.f )
+                {
+                    QuadraturePoint qp = { offset, w };
+                    array::push_back( quadrature, qp );
+                    w_sum += w;
+                }
+            }
+        }
+    }
+    const f32 w_sum_inv = 1.f / w_sum;
+
+    const bxGrid grid( map->res[0], map->res[1], map->res[2] );
+    const array_t<QuadraturePoint>* pquadrature = &quadrature;
+    const Vector3F center = boxCenter;
+    const Vector3F half_extents = boxHalfExtents;
+
+    // one job per z slice
+    bxParallel::forRange( map->res[2], 1, [map, grid, pquadrature, center, half_extents, h, w_sum_inv]( u32 begin, u32 end, u32 )
+    {
+        for( u32 z = begin; z < end; ++z )
+        {
+            for( u32 y = 0; y < map->res[1]; ++y )
+            {
+                for( u32 x = 0; x < map->res[0]; ++x )
+                {
+                    const Vector3F pos = map->origin + Vector3F( (f32)x, (f32)y, (f32)z ) * map->cell_size;
+                    const f32 d = BoxDistance( pos, center, half_extents );
+
+                    f32 volume = 0.f;
+                    if( d <= -h )
+                    {
+                        volume = 1.f;
+                    }
+                    else if( d < h )
+                    {
+                        for( const QuadraturePoint& qp : *pquadrature )
+                        {
+                            if( BoxDistance( pos + qp.offset, center, half_extents ) < 0.f )
+                                volume += qp.w;
+                        }
+                        volume *= w_sum_inv;
+                    }
+
+                    const u32 index = grid.index( x, y, z );
+                    map->distance[index] = d;
+                    map->volume[index] = volume;
+                }
+            }
+        }
+    } );
+}
+
+void BoundaryMapCreateBox( BoundaryMap* map, const Vector3F& boxCenterLS, const Vector3F& boxHalfExtents, const Matrix4F& toWS, float supportRadius, float cellSize )
+{
+    SYS_ASSERT( ::fabsf( PBD::Poly6Kernel::getRadius() - supportRadius ) < FLT_EPSILON );
+
+    map->to_ws = toWS;
+    map->to_ls = orthoInverse( toWS );
+    map->cell_size = cellSize;
+    map->cell_size_inv = 1.f / cellSize;
+    map->support_radius = supportRadius;
+
+    // grid covers everything closer to boundary than support radius, plus one cell for interpolation
+    const Vector3F margin( supportRadius + cellSize );
+    const Vector3F size = ( boxHalfExtents + margin ) * 2.f;
+    map->origin = boxCenterLS - boxHalfExtents - margin;
+    map->res[0] = (u32)::ceilf( size.x * map->cell_size_inv ) + 1;
+    map->res[1] = (u32)::ceilf( size.y * map->cell_size_inv ) + 1;
+    map->res[2] = (u32)::ceilf( size.z * map->cell_size_inv ) + 1;
+
+    // map is in local space, so bodies with the same shape share cache file
+    BoundaryMapKey key;
+    memset( &key, 0, sizeof( key ) );
+    key.box_center[0] = boxCenterLS.x;
+    key.box_center[1] = boxCenterLS.y;
+    key.box_center[2] = boxCenterLS.z;
+    key.box_half_extents[0] = boxHalfExtents.x;
+    key.box_half_extents[1] = boxHalfExtents.y;
+    key.box_half_extents[2] = boxHalfExtents.z;
+    key.support_radius = supportRadius;
+    key.cell_size = cellSize;
+    key.quadrature_res = VOLUME_QUADRATURE_RES;
+
+    char filename[64];
+    CacheFilename( filename, sizeof( filename ), key );
+
+    ResourceManager* resource_manager = GResourceManager();
+    const bxFS::Path abs_path = resource_manager->absolutePath( filename );
+    if( ReadFromCache( map, abs_path.name, key ) )
+        return;
+
+    Build( map, boxCenterLS, boxHalfExtents );
+
+    const bxFS::Path abs_dir = resource_manager->absolutePath( CACHE_DIR );
+    bxIO::createDir( abs_dir.name );
+    WriteToCache( *map, abs_path.name, key );
+}
+
+// trilinear interpolation of 8 corner values (c[x + y*2 + z*4]) with gradient in grid space
+static inline void Trilinear( f32* value, Vector3F* grad, const f32 c[8], const Vector3F& t )
+{
+    const f32 x00 = c[0] + ( c[1] - c[0] ) * t.x;
+    const f32 x10 = c[2] + ( c[3] - c[2] ) * t.x;
+    const f32 x01 = c[4] + ( c[5] - c[4] ) * t.x;
+    const f32 x11 = c[6] + ( c[7] - c[6] ) * t.x;
+    const f32 y0 = x00 + ( x10 - x00 ) * t.y;
+    const f32 y1 = x01 + ( x11 - x01 ) * t.y;
+    value[0] = y0 + ( y1 - y0 ) * t.z;
+
+    const f32 dx0 = ( c[1] - c[0] ) + ( ( c[3] - c[2] ) - ( c[1] - c[0] ) ) * t.y;
+    const f32 dx1 = ( c[5] - c[4] ) + ( ( c[7] - c[6] ) - ( c[5] - c[4] ) ) * t.y;
+    const f32 dx = dx0 + ( dx1 - dx0 ) * t.z;
+    const f32 dy = ( x10 - x00 ) + ( ( x11 - x01 ) - ( x10 - x00 ) ) * t.z;
+    const f32 dz = y1 - y0;
+    grad[0] = Vector3F( dx, dy, dz );
+}
+
+bool BoundaryMapSample( BoundarySample* out, const BoundaryMap& map, const Vector3F& posWS )
+{
+    const Vector3F pos_ls = ( map.to_ls * Point3F( posWS ) ).getXYZ();
+    const Vector3F g = ( pos_ls - map.origin ) * map.cell_size_inv;
+    if( g.x < 0.f || g.y < 0.f || g.z < 0.f )
+        return false;
+
+    const u32 ix = (u32)g.x;
+    const u32 iy = (u32)g.y;
+    const u32 iz = (u32)g.z;
+    if( ix + 1 >= map.res[0] || iy + 1 >= map.res[1] || iz + 1 >= map.res[2] )
+        return false;
+
+    const u32 stride_y = map.res[0];
+    const u32 stride_z = map.res[0] * map.res[1];
+    const u32 base = ix + iy * stride_y + iz * stride_z;
+    const u32 corner[8] =
+    {
+        base, base + 1,
+        base + stride_y, base + stride_y + 1,
+        base + stride_z, base + stride_z + 1,
+        base + stride_z + stride_y, base + stride_z + stride_y + 1,
+    };
+
+    f32 d[8], v[8];
+    for( u32 i = 0; i < 8; ++i )
+    {
+        d[i] = map.distance[corner[i]];
+        v[i] = map.volume[corner[i]];
+    }
+
+    const Vector3F t( g.x - ix, g.y - iy, g.z - iz );
+    Vector3F distance_grad, volume_grad;
+    Trilinear( &out->distance, &distance_grad, d, t );
+    Trilinear( &out->volume, &volume_grad, v, t );
+
+    const Matrix3F rot = map.to_ws.getUpper3x3();
+    out->normal = normalizeSafeF( rot * distance_grad );
+    out->volume_grad = rot * ( volume_grad * map.cell_size_inv );
+    return true;
+}
+
+}}//
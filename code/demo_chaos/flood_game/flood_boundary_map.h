@@ -0,0 +1,44 @@
+#pragma once
+
+#include <util/array.h>
+#include <util/vectormath/vectormath.h>
+
+namespace bx{ namespace flood{
+
+// Boundary handling with density maps (Koschier, Bender: Density Maps for Improved SPH Boundary Handling).
+// Signed distance and boundary volume integral are sampled on regular grid around static body (in body local space).
+// Fluid particle gets boundary density and its gradient from one trilinear lookup instead of summing boundary particles.
+struct BoundaryMap
+{
+    Matrix4F to_ws = Matrix4F::identity();
+    Matrix4F to_ls = Matrix4F::identity();
+
+    Vector3F origin{ 0.f };     // local space position of node (0,0,0)
+    f32 cell_size = 0.f;
+    f32 cell_size_inv = 0.f;
+    f32 support_radius = 0.f;
+    u32 res[3] = {};            // number of nodes in each dimension
+
+    array_t<f32> distance;      // signed distance to boundary surface
+    array_t<f32> volume;        // integral of kernel over boundary volume within support radius. 1 deep inside of boundary
+
+    u32 NumNodes() const { return res[0] * res[1] * res[2]; }
+};
+
+struct BoundarySample
+{
+    f32 distance = 0.f;
+    f32 volume = 0.f;
+    Vector3F normal{ 0.f };         // world space, distance gradient
+    Vector3F volume_grad{ 0.f };    // world space
+};
+
+// Box is given in local space of body, toWS has to be rigid transform.
+// Map is loaded from cache directory when possible, otherwise it's built in parallel and written to cache.
+// Kernel used for volume integral is PBD::Poly6Kernel, its radius has to be set to supportRadius.
+void BoundaryMapCreateBox( BoundaryMap* map, const Vector3F& boxCenterLS, const Vector3F& boxHalfExtents, const Matrix4F& toWS, float supportRadius, float cellSize );
+
+// returns false when point is outside of map (further than support radius from boundary)
+bool BoundaryMapSample( BoundarySample* out, const BoundaryMap& map, const Vector3F& posWS );
+
+}}//
@@ -2,13 +2,14 @@
 #include <rdi/rdi_debug_draw.h>
 #include <util/grid.h>
 #include <util/common.h>
-#include <util/hashmap.h>
 
 #include "../imgui/imgui.h"
 
 #include "SPHKernels.h"
+#include "../particle_zorder.h"
 #include "util/time.h"
 #include "util/random.h"
+#include "util/trace.h"
 #include "../profiler/Remotery.h"
 
 
@@ -54,39 +55,25 @@ namespace bx {namespace flood {
         static const u32    ENDL       = UINT32_MAX;
     };
 
-    void ListPushBack( hashmap_t& map, MapCells& cellAllocator, size_t mapKey, u32 pointIndex )
+    void ListPushBack( CellMap& map, MapCells& cellAllocator, u64 mapKey, u32 pointIndex )
     {
-        hashmap_t::cell_t* cell = hashmap::lookup( map, mapKey );
-        if( !cell )
-        {
-            cell = hashmap::insert( map, mapKey );
-            
-            PointListCell list_cell = { 0 };
-            list_cell.point_index = pointIndex;
-            list_cell.next_cell = PointListCell::ENDL;
+        bool inserted = false;
+        u32* list_head = hash_map::find_or_insert( map, mapKey, PointListCell::ENDL, &inserted );
+        SYS_ASSERT( inserted || *list_head < array::sizeu( cellAllocator ) );
 
-            u32 begin_list_idnex = array::push_back( cellAllocator, list_cell.hash );
-            cell->value = begin_list_idnex;
-        }
-        else
-        {
-            SYS_ASSERT( cell->value < (size_t)array::sizeu( cellAllocator ) );
-            PointListCell first;
-            first.hash = { cellAllocator[(u32)cell->value] };
-            
-            PointListCell new_first = { 0 };
-            new_first.point_index = pointIndex;
-            new_first.next_cell = (u32)cell->value;
-            
-            cell->value = array::push_back( cellAllocator, new_first.hash );
-        }
+        // new element becomes head of the list
+        PointListCell new_first = { 0 };
+        new_first.point_index = pointIndex;
+        new_first.next_cell = *list_head;
+
+        *list_head = array::push_back( cellAllocator, new_first.hash );
     }
     
-    PointListCell ListBegin( hashmap_t& map, size_t mapKey, const MapCells& cellAllocator )
+    PointListCell ListBegin( const CellMap& map, u64 mapKey, const MapCells& cellAllocator )
     {
-        hashmap_t::cell_t* cell = hashmap::lookup( map, mapKey );
+        const u32* list_head = hash_map::find( map, mapKey );
         PointListCell result;
-        result.hash = ( cell ) ? cellAllocator[(u32)cell->value] : PointListCell::EMPTY_HASH;
+        result.hash = ( list_head ) ? cellAllocator[*list_head] : PointListCell::EMPTY_HASH;
         return result;
     }
 
@@ -145,20 +132,17 @@ namespace bx {namespace flood {
         return shash;
     }
 
-    void FluidNeighbourSearch::FindNeighbours( const Vector3F* points, u32 numPoints )
+    void FluidNeighbourSearch::BuildCells( const Vector3F* points, u32 numPoints )
     {
         _num_points = numPoints;
-        const __m128 cell_size_inv_vec = _mm_set1_ps( _cell_size_inv );
 
         array::clear( _point_spatial_hash );
-        _point_neighbour_list.clear();
         array::clear( _map_cells );
-        hashmap::clear( _map );
+        hash_map::clear( _map );
 
         array::reserve( _point_spatial_hash, numPoints );
-        _point_neighbour_list.resize( numPoints );
         array::reserve( _map_cells, numPoints );
-        hashmap::reserve( _map, numPoints * 2 );
+        hash_map::reserve( _map, numPoints );
 
         for( u32 i = 0; i < numPoints; ++i )
         {
@@ -166,6 +150,14 @@ namespace bx {namespace flood {
             ListPushBack( _map, _map_cells, hash.hash, i );
             array::push_back( _point_spatial_hash, hash.hash );
         }
+    }
+
+    void FluidNeighbourSearch::FindNeighbours( const Vector3F* points, u32 numPoints )
+    {
+        BuildCells( points, numPoints );
+
+        _point_neighbour_list.clear();
+        _point_neighbour_list.resize( numPoints );
         
         for( u32 i = 0; i < numPoints; ++i )
         {
@@ -215,28 +207,56 @@ namespace bx {namespace flood {
         return _point_neighbour_list[index];
     }
 
-    //////////////////////////////////////////////////////////////////////////
-    const NeighbourIndices StaticBody::GetNeighbours( const Vector3F& posWS ) const
+    // MakeHash truncates towards zero, so cell 0 spans two cell sizes
+    static inline void CellRange( float* lo, float* hi, i32 cell, float cellSize )
     {
-        SpatialHash hash = MakeHash( posWS, _map_cell_size_inv );
-        const hashmap_t::cell_t* cell = hashmap::lookup( _map, hash.hash );
-        if( cell )
-        {
-            SYS_ASSERT( cell->value < _cell_neighbour_list.size() );
-        }
+        *lo = (float)( ( cell > 0 ) ? cell : cell - 1 ) * cellSize;
+        *hi = (float)( ( cell < 0 ) ? cell : cell + 1 ) * cellSize;
+    }
 
-        const Indices* indices = ( cell ) ? &_cell_neighbour_list[cell->value] : nullptr;
+    void FluidNeighbourSearch::GetCellBounds( array_t<Vector3F>* out ) const
+    {
+        const float cell_size = 1.f / _cell_size_inv;
+        hash_map::for_each( _map, [out, cell_size]( const u64& key, const u32& )
+        {
+            SpatialHash hash = { key };
+            Vector3F lo, hi;
+            CellRange( &lo.x, &hi.x, (i32)hash.x, cell_size );
+            CellRange( &lo.y, &hi.y, (i32)hash.y, cell_size );
+            CellRange( &lo.z, &hi.z, (i32)hash.z, cell_size );
+            array::push_back( *out, lo );
+            array::push_back( *out, hi );
+        } );
+    }
 
-        NeighbourIndices result = {};
-        if( indices )
+    void FluidNeighbourSearch::GatherPoints( array_t<u32>* out, const Vector3F& minWS, const Vector3F& maxWS ) const
+    {
+        // truncation is monotonic, so cells overlapping box are in range of box corners hashes
+        const SpatialHash hmin = MakeHash( minWS, _cell_size_inv );
+        const SpatialHash hmax = MakeHash( maxWS, _cell_size_inv );
+        for( i32 z = (i32)hmin.z; z <= (i32)hmax.z; ++z )
         {
-            result.data = indices->begin();
-            result.size = indices->size;
+            for( i32 y = (i32)hmin.y; y <= (i32)hmax.y; ++y )
+            {
+                for( i32 x = (i32)hmin.x; x <= (i32)hmax.x; ++x )
+                {
+                    SpatialHash hash;
+                    hash.x = x;
+                    hash.y = y;
+                    hash.z = z;
+                    hash.w = 1;
+
+                    PointListCell cell = ListBegin( _map, hash.hash, _map_cells );
+                    while( cell.Ok() )
+                    {
+                        array::push_back( *out, cell.point_index );
+                        ListNext( &cell, _map_cells );
+                    }
+                }
+            }
         }
-        return result;
     }
 
-
     void StaticBodyCreateBox( StaticBody* body, u32 countX, u32 countY, u32 countZ, float particleRadius, const Matrix4F& toWS )
     {
         body->_particle_radius = particleRadius;
@@ -245,13 +265,12 @@ namespace bx {namespace flood {
 
         const u32 total_count = countX * countY * countZ;
         array::clear( body->_x );
-        array::clear( body->_boundary_psi );
-
         array::reserve( body->_x, total_count );
-        array::reserve( body->_boundary_psi, total_count );
-        
-        for( u32 i = 0; i < total_count; ++i )
-            body->_boundary_psi[i] = 0.f;
+
+        // particles are placed from -center_shift, so their spheres span [-center_shift - r, center_shift - r]
+        body->_box_center_ls = Vector3F( -particleRadius );
+        body->_box_half_extents = center_shift;
+        body->_to_ws = toWS;
         
         for( u32 iz = 0; iz < countZ; ++iz )
         {
@@ -283,122 +302,9 @@ namespace bx {namespace flood {
 
     }
 
-    void StaticBodyDoNeighbourMap( StaticBody* body, float supportRadius )
-    {
-        const __m128 cell_size_inv_vec = _mm_set1_ps( 1.f / supportRadius );
-        body->_map_cell_size = supportRadius;
-        body->_map_cell_size_inv_vec = cell_size_inv_vec;
-        body->_map_cell_size_inv = cell_size_inv_vec.m128_f32[0];
-        const float cell_size_inv = body->_map_cell_size_inv;
-
-        const u32 num_points = array::sizeu( body->_x );
-
-        hashmap_t tmp_sparse_grid;
-        MapCells tmp_sparse_grid_cells;
-        //array_t <size_t>  tmp_point_spatial_hash;
-
-        hashmap::reserve( tmp_sparse_grid, iceil( num_points * 3, 2 ) );
-        array::reserve( tmp_sparse_grid_cells, num_points );
-        //array::reserve( tmp_point_spatial_hash, num_points );
-
-        for( u32 i = 0; i < num_points; ++i )
-        {
-            SpatialHash hash = MakeHash( body->_x[i], cell_size_inv );
-            ListPushBack( tmp_sparse_grid, tmp_sparse_grid_cells, hash.hash, i );
-            
-            for( int dz = -1; dz <= 1; ++dz )
-            {
-                for( int dy = -1; dy <= 1; ++dy )
-                {
-                    for( int dx = -1; dx <= 1; ++dx )
-                    {
-                        SpatialHash neighbour_hash;
-                        neighbour_hash.x = hash.x + dx;
-                        neighbour_hash.y = hash.y + dy;
-                        neighbour_hash.z = hash.z + dz;
-                        neighbour_hash.w = 1;
-
-                        ListPushBack( tmp_sparse_grid, tmp_sparse_grid_cells, neighbour_hash.hash, UINT32_MAX );
-                    }
-                }
-            }
-
-            //array::push_back( tmp_point_spatial_hash, hash.hash );
-        }
-
-        body->_cell_neighbour_list.resize( hashmap::size( tmp_sparse_grid ) );
-
-        u32 counter = 0;
-        hashmap::iterator map_it( tmp_sparse_grid );
-        while( map_it.next() )
-        {
-            hashmap_t::cell_t* cell = *map_it;
-            SpatialHash hash = { cell->key };
-            Indices& indices = body->_cell_neighbour_list[counter];
-
-            {
-                SYS_ASSERT( hashmap::lookup( body->_map, cell->key ) == nullptr );
-                hashmap_t::cell_t* final_cell = hashmap::insert( body->_map, cell->key );
-                final_cell->value = (size_t)counter;
-            }
-            
-            for( int dz = -1; dz <= 1; ++dz )
-            {
-                for( int dy = -1; dy <= 1; ++dy )
-                {
-                    for( int dx = -1; dx <= 1; ++dx )
-                    {
-                        SpatialHash neighbour_hash;
-                        neighbour_hash.x = hash.x + dx;
-                        neighbour_hash.y = hash.y + dy;
-                        neighbour_hash.z = hash.z + dz;
-                        neighbour_hash.w = 1;
-
-                        PointListCell cell = ListBegin( tmp_sparse_grid, neighbour_hash.hash, tmp_sparse_grid_cells );
-                        while( cell.Ok() )
-                        {
-                            if( cell.point_index != UINT32_MAX )
-                            {
-                                array::push_back( indices, cell.point_index );
-                            }
-                            ListNext( &cell, tmp_sparse_grid_cells );
-                        }
-                    }
-                }
-            }
-            
-            ++counter;
-        }
-    }
-
-    void StaticBodyComputeBoundaryPsi( StaticBody* sbody, float density0 )
+    void StaticBodyCreateBoundaryMap( StaticBody* body, float supportRadius )
     {
-        for( u32 i = 0; i < sbody->_x.size; ++i )
-        {
-            float psi = 0.f;
-            float delta = PBD::Poly6Kernel::W_zero();
-            const Vector3F& xi = sbody->_x[i];
-
-            const NeighbourIndices& nindices = sbody->GetNeighbours( sbody->_x[i] );
-            if( nindices.Ok() )
-            {
-                for( u32 nj = 0; nj < nindices.size; ++nj )
-                {
-                    const u32 j = nindices.data[nj];
-                    if( j == i )
-                        continue;
-
-                    const Vector3F& xj = sbody->GetPosition( j );
-
-                    delta += PBD::Poly6Kernel::W( xi - xj );
-                }
-
-                float volume = 1.f / delta;
-                psi = density0 * volume;
-            }
-
-            sbody->_boundary_psi[i] = psi;
-        }
+        BoundaryMapCreateBox( &body->_boundary_map, body->_box_center_ls, body->_box_half_extents, body->_to_ws, supportRadius, body->_particle_radius );
     }
 
     void StaticBodyDebugDraw( const StaticBody& body, u32 color )
@@ -427,6 +333,12 @@ void FluidClear( Fluid* f )
     array::clear( f->x );
     array::clear( f->p );
     array::clear( f->v );
+    array::clear( f->density );
+    array::clear( f->lambda );
+    array::clear( f->dpos );
+    array::clear( f->boundary_grad );
+    array::clear( f->_order );
+    array::clear( f->_remap );
 }
 
 
@@ -440,6 +352,9 @@ void FluidCreate( Fluid* f, u32 numParticles, float particleRadius )
     array::reserve( f->density, numParticles );
     array::reserve( f->lambda , numParticles );
     array::reserve( f->dpos   , numParticles );
+    array::reserve( f->boundary_grad, numParticles );
+    array::reserve( f->_order , numParticles );
+    array::reserve( f->_remap , numParticles );
 
     f->particle_radius = particleRadius;
     f->support_radius = 4.f * particleRadius;
@@ -457,6 +372,9 @@ void FluidCreate( Fluid* f, u32 numParticles, float particleRadius )
         array::push_back( f->density, 0.f );
         array::push_back( f->lambda, 0.f );
         array::push_back( f->dpos, Vector3F( 0.f ) );
+        array::push_back( f->boundary_grad, Vector3F( 0.f ) );
+        array::push_back( f->_order, i );
+        array::push_back( f->_remap, i );
     }
 }
 
@@ -512,6 +430,35 @@ void FluidCreateBox( Fluid* f, u32 width, u32 height, u32 depth, float particleR
 static float max_lambda = 0.f;
 static int debug_i = 0;
 
+template< typename T >
+static void FluidPermute( Fluid* f, array_t<T>& data )
+{
+    const u32 scratch_size = ( data.size * sizeof( T ) + sizeof( Vector3F ) - 1 ) / sizeof( Vector3F );
+    array::resize( f->_reorder_scratch, scratch_size );
+    PermuteZOrder( data.begin(), (T*)f->_reorder_scratch.begin(), f->_reorder_order.begin(), data.size );
+}
+
+// Sorts particles by Morton code of neighbour search cell, so neighbours are close in memory.
+// Has to be called before neighbour search, because neighbour lists hold storage indices.
+static void FluidReorder( Fluid* f )
+{
+    const u32 n = f->NumParticles();
+    if( !ComputeZOrder( &f->_reorder_order, &f->_reorder_keys, f->x.begin(), n, f->particle_radius * 2.f ) )
+        return;
+
+    FluidPermute( f, f->x );
+    FluidPermute( f, f->p );
+    FluidPermute( f, f->v );
+    FluidPermute( f, f->density );
+    FluidPermute( f, f->lambda );
+    FluidPermute( f, f->dpos );
+    FluidPermute( f, f->boundary_grad );
+    FluidPermute( f, f->_order );
+
+    for( u32 i = 0; i < n; ++i )
+        f->_remap[f->_order[i]] = i;
+}
+
 inline float ComputeSCorr( const Vector3F& xi_xj )
 {
     const float scorr_k = 0.001f;
@@ -533,9 +480,11 @@ void FluidSolvePressure2( Fluid* f, const FluidColliders& colliders, u32 solverI
 
     const u32 num_points = array::sizeu( f->p );
     Vector3F* x = array::begin( f->p );
+    Vector3F* boundary_grad = array::begin( f->boundary_grad );
     
     for( u32 sit = 0; sit < solverIterations; ++sit )
     {
+        u32 num_boundary_samples = 0;
         for( u32 i = 0; i < num_points; ++i )
         {
             const Indices& neighbour_indices = f->_neighbours.GetNeighbours( i );
@@ -559,6 +508,22 @@ void FluidSolvePressure2( Fluid* f, const FluidColliders& colliders, u32 solverI
                 
             }
 
+            // static bodies: density = density0 * volume integral of kernel over boundary.
+            // Boundary gradient is divided by particle volume to match units of grad_sum_i
+            Vector3F grad_b( 0.f );
+            for( u32 bj = 0; bj < colliders.num_static_bodies; ++bj )
+            {
+                BoundarySample sample;
+                if( BoundaryMapSample( &sample, colliders.static_bodies[bj]._boundary_map, x[i] ) && sample.volume > 0.f )
+                {
+                    density += density0 * sample.volume;
+                    grad_b += sample.volume_grad;
+                    ++num_boundary_samples;
+                }
+            }
+            boundary_grad[i] = grad_b;
+            grad_sum_i += grad_b * ( 1.f / pmass_div_density0 );
+
             grad_sum_k += pmass_div_density0 * lengthSqr( grad_sum_i );
 
             const float C = (density / density0) - 1.f;
@@ -590,7 +555,8 @@ void FluidSolvePressure2( Fluid* f, const FluidColliders& colliders, u32 solverI
                 dpos += ( li + lj + scorr ) * grad;
             }
 
-            delta_pos[i] = dpos;
+            // boundary doesn't move, so only lambda of particle contributes
+            delta_pos[i] = dpos + L[i] * boundary_grad[i];
         }
 
         for( u32 i = 0; i < num_points; ++i )
@@ -604,26 +570,48 @@ void FluidSolvePressure2( Fluid* f, const FluidColliders& colliders, u32 solverI
                 Vector3F dpos = -plane.getXYZ() * minOfPair( d, 0.f );
                 xi += dpos;
             }
+            for( u32 bj = 0; bj < colliders.num_static_bodies; ++bj )
+            {
+                BoundarySample sample;
+                if( BoundaryMapSample( &sample, colliders.static_bodies[bj]._boundary_map, xi ) && sample.distance < f->particle_radius )
+                    xi += sample.normal * ( f->particle_radius - sample.distance );
+            }
 
             x[i] = xi + delta_pos[i];
         }
+
+        f->_debug.num_boundary_samples = num_boundary_samples;
     }
 }
 
 void FluidTick( Fluid* f, const FluidSimulationParams& params, const FluidColliders& colliders, float deltaTime )
 {
-    const float fluid_delta_time = params.time_step;
+    BX_TRACE_SCOPE( "FluidTick" );
+    TimeStepParams& step_params = f->_time_step.params;
+    step_params.max_dt = params.time_step;
+    step_params.min_dt = params.time_step * 0.25f;
+    step_params.max_substeps = (u32)maxOfPair( params.max_steps_per_frame, 1 );
+    step_params.cfl = params.cfl;
+    step_params.budget_ms = params.budget_ms;
+
+    const u64 start_us = bxTime::us();
+    const TimeStepPlan plan = f->_time_step.Begin( deltaTime, f->_max_speed, f->particle_radius, (u32)maxOfPair( params.solver_iterations, 1 ) );
+    const float fluid_delta_time = plan.dt;
     const float fluid_delta_time_inv = 1.f / fluid_delta_time;
-    const u32 max_iterations = params.max_steps_per_frame;
-    f->_dt_acc += deltaTime;
 
     const u32 n = f->NumParticles();
     const float pmass_inv = 1.f / f->particle_mass;
 
-    u32 iteration = 0;
 #if 1 
-    while( f->_dt_acc >= fluid_delta_time )
+    for( u32 step = 0; step < plan.num_substeps; ++step )
     {
+        if( params.reorder_interval > 0 && ++f->_reorder_counter >= (u32)params.reorder_interval )
+        {
+            BX_TRACE_SCOPE( "FluidTick::Reorder" );
+            FluidReorder( f );
+            f->_reorder_counter = 0;
+        }
+
         for( u32 i = 0; i < n; ++i )
         {
             Vector3F v = f->v[i] + params.gravity * fluid_delta_time;
@@ -633,28 +621,37 @@ void FluidTick( Fluid* f, const FluidSimulationParams& params, const FluidCollid
             f->p[i] = p;
         }
 
-        f->_neighbours.FindNeighbours( array::begin( f->p ), array::sizeu( f->p ) );
+        {
+            BX_TRACE_SCOPE( "FluidTick::FindNeighbours" );
+            f->_neighbours.FindNeighbours( array::begin( f->p ), array::sizeu( f->p ) );
+        }
 
         {
-            FluidSolvePressure2( f, colliders, params.solver_iterations );
+            BX_TRACE_SCOPE( "FluidTick::SolvePressure" );
+            FluidSolvePressure2( f, colliders, plan.num_iterations );
         }
 
+        float max_speed_sq = 0.f;
         for( u32 i = 0; i < n; ++i )
         {
             f->v[i] = ( f->p[i] - f->x[i] ) * fluid_delta_time_inv;
             f->x[i] = f->p[i];
+            max_speed_sq = maxOfPair( max_speed_sq, lengthSqr( f->v[i] ) );
         }
+        f->_max_speed = sqrtf( max_speed_sq );
+    }
 
-        f->_dt_acc -= fluid_delta_time;
-
-        if( ++iteration >= max_iterations )
-        {
-            f->_dt_acc = 0.f;
-            break;
-        }
-
+    // cells were built from predicted positions before pressure solve moved them. Surface gathers particles from cells, so
+    // they are rebuilt from final positions (neighbour lists are left as they are)
+    if( plan.num_substeps )
+    {
+        BX_TRACE_SCOPE( "FluidTick::BuildCells" );
+        f->_neighbours.BuildCells( array::begin( f->x ), n );
     }
 #endif
+    f->_time_step.End( plan, bxTime::us() - start_us );
+    BX_TRACE_COUNTER( "FluidTick::substeps", plan.num_substeps );
+    BX_TRACE_COUNTER( "FluidTick::iterations", plan.num_iterations );
     //deltaTime = 0.005f;
     
     
@@ -665,18 +662,25 @@ void FluidTick( Fluid* f, const FluidSimulationParams& params, const FluidCollid
         if( ImGui::Begin( "FluidDebug" ) )
         {
             ImGui::InputInt( "particle index", &debug_i );
-            ImGui::Text( "density (%i): %f", debug_i, f->density[debug_i] );
+            ImGui::Text( "density (%i): %f", debug_i, f->density[FluidParticleIndex( *f, debug_i )] );
             ImGui::Text( "lambda(%i): %f", debug_i, max_lambda );
+            ImGui::Text( "boundary samples: %u", f->_debug.num_boundary_samples );
+
+            const TimeStepStats& ts = f->_time_step.stats;
+            ImGui::Text( "steps: %u x %u iterations, dt: %.2f ms", ts.num_substeps, ts.num_iterations, ts.dt * 1000.f );
+            ImGui::Text( "time: %.2f ms, max speed: %.2f", ts.frame_ms, f->_max_speed );
+            ImGui::Text( "dropped: %.3f s", ts.dropped_time );
 
             ImGui::Checkbox( "show density", &f->_debug.show_density );
         }
         ImGui::End();
 
-        if( iteration )
+        if( plan.num_substeps )
         {
             const Vector3 box_ext( f->particle_radius );
-            rdi::debug_draw::AddBox( Matrix4::translation( Vector3( xyz_to_m128( &f->x[debug_i].x ) ) ), box_ext, 0x00FF00FF, 1 );
-            const Indices& neighbours = f->_neighbours.GetNeighbours( debug_i );
+            const u32 debug_index = FluidParticleIndex( *f, debug_i );
+            rdi::debug_draw::AddBox( Matrix4::translation( Vector3( xyz_to_m128( &f->x[debug_index].x ) ) ), box_ext, 0x00FF00FF, 1 );
+            const Indices& neighbours = f->_neighbours.GetNeighbours( debug_index );
             if( neighbours.size )
             {
                 for( u32 j : neighbours )
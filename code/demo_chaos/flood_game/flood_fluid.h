@@ -2,16 +2,20 @@
 
 #include <util/array.h>
 #include <util/vector.h>
+#include <util/hash_map.h>
 #include <util/vectormath/vectormath.h>
 #include "../spatial_hash_grid.h"
+#include "../time_step_controller.h"
 
 #include "flood_helpers.h"
+#include "flood_boundary_map.h"
 
 
 namespace bx{ namespace flood{
 
 typedef array_t<u32> Indices;
 typedef array_t<size_t> MapCells;
+typedef hash_map_t<u64, u32> CellMap; // spatial hash -> index
 
 
 
@@ -21,11 +25,18 @@ typedef array_t<size_t> MapCells;
 struct FluidNeighbourSearch
 {
     void FindNeighbours( const Vector3F* points, u32 numPoints );
+    // only fills cell map (no neighbour lists)
+    void BuildCells( const Vector3F* points, u32 numPoints );
     void SetCellSize( float value );
     const Indices& GetNeighbours( u32 index ) const;
+
+    // world space bounds of non empty cells, two entries (min, max) per cell
+    void GetCellBounds( array_t<Vector3F>* out ) const;
+    // appends indices of points from cells overlapping box
+    void GatherPoints( array_t<u32>* out, const Vector3F& minWS, const Vector3F& maxWS ) const;
     
     f32 _cell_size_inv = 0.f;
-    hashmap_t _map;
+    CellMap   _map;
     MapCells  _map_cells;
 
     vector_t<Indices> _point_neighbour_list;
@@ -40,29 +51,25 @@ struct FluidNeighbourSearch
 //////////////////////////////////////////////////////////////////////////
 struct StaticBody
 {
-    const NeighbourIndices GetNeighbours  ( const Vector3F& posWS ) const;
-    const Vector3F&        GetPosition    ( u32 index )             const { return _x[index]; }
-          float            GetBoundaryPsi ( u32 index )             const { return _boundary_psi[index]; }
+    const Vector3F& GetPosition( u32 index ) const { return _x[index]; }
 
     // ---
-    vec_float4 _map_cell_size_inv_vec;
-    f32 _map_cell_size_inv = 0.f;
     f32 _particle_radius = 0.f;
-    f32 _map_cell_size = 0.f;
 
     array_t<Vector3F> _x;
-    array_t<f32> _boundary_psi;
-    
-    /*
-    * this map maps particle world position to list of neighbors
-    */
-    hashmap_t _map;
-    vector_t<Indices> _cell_neighbour_list;
+
+    // box shape in local space (set by StaticBodyCreateBox)
+    Vector3F _box_center_ls{ 0.f };
+    Vector3F _box_half_extents{ 0.f };
+    Matrix4F _to_ws = Matrix4F::identity();
+
+    // density map used by fluid solver instead of boundary particles
+    BoundaryMap _boundary_map;
 };
 void StaticBodyCreateBox( StaticBody* body, u32 countX, u32 countY, u32 countZ, float particleRadius, const Matrix4F& toWS );
-void StaticBodyDoNeighbourMap( StaticBody* body, float supportRadius );
 void StaticBodyDebugDraw( const StaticBody& body, u32 color );
-void StaticBodyComputeBoundaryPsi( StaticBody* sbody, float density0 );
+// map resolution is particle radius of the body
+void StaticBodyCreateBoundaryMap( StaticBody* body, float supportRadius );
 
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -74,6 +81,7 @@ struct Fluid
     array_t<f32> density;
     array_t<f32> lambda;
     array_t<Vector3F> dpos;
+    array_t<Vector3F> boundary_grad; // gradient of boundary volume from static bodies density maps
 
     f32 particle_radius = 0.025f;
     f32 support_radius = 4.f * 0.025f;
@@ -81,13 +89,23 @@ struct Fluid
     f32 density0 = 1000.f; // 6378.f;
     f32 viscosity = 0.02f;
 
-    f32 _dt_acc = 0.f;
+    TimeStepController _time_step;
+    f32 _max_speed = 0.f; // after last step
+
+    // particles are periodically sorted in Z-order (see FluidReorder), index visible outside is creation order
+    array_t<u32> _order; // storage index -> creation index
+    array_t<u32> _remap; // creation index -> storage index
+    u32 _reorder_counter = 0;
+    array_t<u32> _reorder_order;
+    array_t<u64> _reorder_keys;
+    array_t<Vector3F> _reorder_scratch;
 
     FluidNeighbourSearch _neighbours;
 
     struct Debug
     {
         bool show_density = true;
+        u32 num_boundary_samples = 0; // particles within support radius of static bodies in last iteration
     }_debug;
 
     u32 NumParticles() const { return array::sizeu( x ); }
@@ -104,13 +122,21 @@ struct FluidColliders
 struct FluidSimulationParams
 {
     Vector3F gravity{ 0.f, -9.82f, 0.f };
-    f32 time_step = 0.005f;
-    i32 solver_iterations = 4;
+    f32 time_step = 0.005f;         // upper bound for step, actual step follows CFL condition down to time_step / 4
+    i32 solver_iterations = 4;      // lowered when steps don't fit budget
     i32 max_steps_per_frame = 4;
+    f32 cfl = 0.4f;                 // max particle travel per step in particle radius units
+    f32 budget_ms = 8.f;
+    // Steps between Z-order sorts of particles, 0 disables. Off by default: particles created in a lattice are already
+    // close to Z-order, and a sort (~5 ms per 64k particles) costs more than it saves. Worth enabling when particles
+    // are emitted or mixed in scattered order.
+    i32 reorder_interval = 0;
 };
 
 void FluidCreateBox( Fluid* f, u32 width, u32 height, u32 depth, float particleRadius, const Matrix4F& pose );
 void FluidTick( Fluid* f, const FluidSimulationParams& params, const FluidColliders& colliders, float deltaTime );
+// storage index of particle created as creationIndex
+inline u32 FluidParticleIndex( const Fluid& f, u32 creationIndex ) { return f._remap[creationIndex]; }
 
 
 }}//
\ No newline at end of file
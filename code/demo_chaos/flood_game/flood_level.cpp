@@ -70,24 +70,27 @@ void Level::StartUp( game_gfx::Deffered* gfx, const char* levelName )
         StaticBodyCreateBox( &_boundary[3], num_particles[0], num_particles[1], 1, boundary_particle_radius, Matrix4F::translation( Vector3F( offset_half, 0.f,-depth ) ) );
         StaticBodyCreateBox( &_boundary[4], num_particles[0], num_particles[1], 1, boundary_particle_radius, Matrix4F::translation( Vector3F( offset_half, 0.f, depth + offset ) ) );
 
-        const float neighbour_radius = particle_radius * 2.0f;
-        StaticBodyDoNeighbourMap( &_boundary[0], neighbour_radius );
-        StaticBodyDoNeighbourMap( &_boundary[1], neighbour_radius );
-        StaticBodyDoNeighbourMap( &_boundary[2], neighbour_radius );
-        StaticBodyDoNeighbourMap( &_boundary[3], neighbour_radius );
-        StaticBodyDoNeighbourMap( &_boundary[4], neighbour_radius );
-
+        // fluid samples boundary density maps, so boundary particles don't need neighbour maps and psi
         for( u32 i = 0; i < 5; ++i )
         {
-            StaticBodyComputeBoundaryPsi( &_boundary[i], _fluid.density0 );
+            StaticBodyCreateBoundaryMap( &_boundary[i], _fluid.support_radius );
         }
     }
 
     _fluid_sim_params.gravity = Vector3F( 0.f );
+
+    // container plus space above it where fluid is spawned
+    {
+        const Vector3F margin( _fluid.support_radius );
+        const Vector3F bounds_min = Vector3F( -width, -height, -depth ) - margin;
+        const Vector3F bounds_max = Vector3F( width, 4.f * height + 4.5f, depth ) + margin;
+        FluidSurfaceCreate( &_fluid_surface, bounds_min, bounds_max, particle_radius );
+    }
 }
 
 void Level::ShutDown( game_gfx::Deffered* gfx )
 {
+    FluidSurfaceDestroy( &_fluid_surface );
     gfx->renderer.DestroyScene( &_gfx_scene );
     string::free( (char*)_name );
     _name = nullptr;
@@ -102,6 +105,8 @@ void Level::Tick( const GameTime& time )
     colliders.num_static_bodies = 5;
 
     FluidTick( &_fluid, _fluid_sim_params, colliders, time.DeltaTimeSec() );
+    if( _fluid_surface_enabled )
+        FluidSurfaceUpdate( &_fluid_surface, _fluid );
 
     //StaticBodyDebugDraw( _boundary[0], 0x333333FF );
     //StaticBodyDebugDraw( _boundary[1], 0x333333FF );
@@ -137,6 +142,28 @@ void Level::Tick( const GameTime& time )
             ImGui::InputFloat3( "gravity", &_fluid_sim_params.gravity.x, 3, ImGuiInputTextFlags_EnterReturnsTrue );
             ImGui::InputInt   ( "solverIterations", &_fluid_sim_params.solver_iterations );
             ImGui::InputFloat ( "timeStep", &_fluid_sim_params.time_step );
+            ImGui::InputInt   ( "maxStepsPerFrame", &_fluid_sim_params.max_steps_per_frame );
+            ImGui::InputFloat ( "cfl", &_fluid_sim_params.cfl );
+            ImGui::InputFloat ( "budgetMS", &_fluid_sim_params.budget_ms );
+            ImGui::InputInt   ( "reorderInterval", &_fluid_sim_params.reorder_interval );
+
+            ImGui::Separator();
+            ImGui::Checkbox( "surface", &_fluid_surface_enabled );
+            const FluidSurfaceStats& ss = _fluid_surface._stats;
+            ImGui::Text( "splat: %.2f ms, mesh: %.2f ms", ss.splat_ms, ss.mesh_ms );
+            ImGui::Text( "chunks: %u active, %u splatted, %u changed (of %u)", ss.num_active_chunks, ss.num_splatted_chunks, ss.num_changed_chunks, ss.num_chunks );
+            ImGui::Text( "triangles: %u, vertices: %u", ss.num_triangles, ss.num_vertices );
+            if( ImGui::Button( "surface benchmark" ) )
+            {
+                FluidSurfaceBenchmark( &_fluid_surface_benchmark[0], 100000, _fluid.particle_radius );
+                FluidSurfaceBenchmark( &_fluid_surface_benchmark[1], 500000, _fluid.particle_radius );
+            }
+            for( const FluidSurfaceBenchmarkResult& r : _fluid_surface_benchmark )
+            {
+                if( r.num_particles )
+                    ImGui::Text( "%uk: full %.1f + %.1f ms, unchanged %.1f + %.1f ms, moved %.1f + %.1f ms", r.num_particles / 1000,
+                                 r.full.splat_ms, r.full.mesh_ms, r.unchanged.splat_ms, r.unchanged.mesh_ms, r.moved.splat_ms, r.moved.mesh_ms );
+            }
         ImGui::EndChild();
     }
     ImGui::End();
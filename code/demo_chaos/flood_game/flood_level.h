@@ -2,6 +2,7 @@
 #include "..\renderer_type.h"
 #include "..\game_time.h"
 #include "flood_fluid.h"
+#include "flood_surface.h"
 #include <rdi\rdi_backend.h>
 
 
@@ -42,6 +43,10 @@ struct Level
     FluidSimulationParams _fluid_sim_params = {};
     StaticBody _boundary[6];
 
+    FluidSurface _fluid_surface;
+    bool _fluid_surface_enabled = false;
+    FluidSurfaceBenchmarkResult _fluid_surface_benchmark[2];
+
 };
 
 }}
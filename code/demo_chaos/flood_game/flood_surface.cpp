@@ -0,0 +1,395 @@
+#include "flood_surface.h"
+#include "flood_fluid.h"
+
+#include <util/common.h>
+#include <util/hash_map.h>
+#include <util/debug.h>
+#include <util/random.h>
+#include <util/time.h>
+#include <util/trace.h>
+#include <util/thread/parallel.h>
+#include <util/poly/poly_shape.h>
+
+#include <math.h>
+#include <string.h>
+
+namespace bx{ namespace flood{
+
+namespace
+{
+    enum : u8
+    {
+        eCHUNK_ACTIVE_PREV = 1,
+        eCHUNK_ACTIVE = 2,
+    };
+
+    // the same layout as IsoSurfaceMesher chunks: last chunk owns also the last layer of samples
+    inline u32 ChunkSamplesBegin( u32 chunk )
+    {
+        return chunk * FluidSurface::eCHUNK_CELLS;
+    }
+    inline u32 ChunkSamplesEnd( u32 chunk, u32 numChunks, u32 numSamples )
+    {
+        return ( chunk + 1 == numChunks ) ? numSamples : ( chunk + 1 ) * FluidSurface::eCHUNK_CELLS;
+    }
+
+    // samples in world space range [lo, hi]. Returns false when range is outside of grid
+    inline bool SampleRange( i32* begin, i32* end, float lo, float hi, float origin, float cellSizeInv, u32 numSamples )
+    {
+        *begin = maxOfPair( (i32)ceilf( ( lo - origin ) * cellSizeInv ), 0 );
+        *end = minOfPair( (i32)floorf( ( hi - origin ) * cellSizeInv ) + 1, (i32)numSamples );
+        return *begin < *end;
+    }
+
+    struct ChunkRange
+    {
+        u32 begin[3];
+        u32 end[3];
+    };
+    inline ChunkRange GetChunkRange( const FluidSurface& surf, u32 chunkIndex )
+    {
+        const u32 c[3] =
+        {
+            chunkIndex % surf._num_chunks[0],
+            ( chunkIndex / surf._num_chunks[0] ) % surf._num_chunks[1],
+            chunkIndex / ( surf._num_chunks[0] * surf._num_chunks[1] ),
+        };
+        ChunkRange range;
+        for( u32 i = 0; i < 3; ++i )
+        {
+            range.begin[i] = ChunkSamplesBegin( c[i] );
+            range.end[i] = ChunkSamplesEnd( c[i], surf._num_chunks[i], surf._num_samples[i] );
+        }
+        return range;
+    }
+
+    void MarkNarrowBand( FluidSurface* surf, const Fluid& fluid )
+    {
+        const u32 num_chunks = array::sizeu( surf->_chunk_active );
+        for( u32 i = 0; i < num_chunks; ++i )
+            surf->_chunk_active[i] = ( surf->_chunk_active[i] & eCHUNK_ACTIVE ) ? eCHUNK_ACTIVE_PREV : 0;
+
+        array::clear( surf->_cell_bounds );
+        fluid._neighbours.GetCellBounds( &surf->_cell_bounds );
+
+        const float cell_size_inv = 1.f / surf->_cell_size;
+        const Vector3F radius( surf->_kernel_radius );
+        for( u32 i = 0; i < surf->_cell_bounds.size; i += 2 )
+        {
+            const Vector3F lo = surf->_cell_bounds[i] - radius;
+            const Vector3F hi = surf->_cell_bounds[i + 1] + radius;
+
+            u32 cmin[3], cmax[3];
+            bool inside = true;
+            for( u32 a = 0; a < 3 && inside; ++a )
+            {
+                i32 sbegin, send;
+                inside = SampleRange( &sbegin, &send, lo[a], hi[a], surf->_origin[a], cell_size_inv, surf->_num_samples[a] );
+                cmin[a] = minOfPair( (u32)sbegin / FluidSurface::eCHUNK_CELLS, surf->_num_chunks[a] - 1 );
+                cmax[a] = minOfPair( (u32)( send - 1 ) / FluidSurface::eCHUNK_CELLS, surf->_num_chunks[a] - 1 );
+            }
+            if( !inside )
+                continue;
+
+            for( u32 cz = cmin[2]; cz <= cmax[2]; ++cz )
+                for( u32 cy = cmin[1]; cy <= cmax[1]; ++cy )
+                    for( u32 cx = cmin[0]; cx <= cmax[0]; ++cx )
+                        surf->_chunk_active[( cz * surf->_num_chunks[1] + cy ) * surf->_num_chunks[0] + cx] |= eCHUNK_ACTIVE;
+        }
+    }
+
+    enum : u8
+    {
+        eSPLAT_SKIPPED = 0,
+        eSPLAT_UNCHANGED,
+        eSPLAT_CHANGED,
+    };
+
+    // hash of quantized position only. Signature is a sum of these, so it doesn't depend on
+    // particle indices or gather order (particles can be reordered without dirtying chunks)
+    inline u64 PositionHash( const Vector3F& quantizedPos )
+    {
+        const u64 qx = (u64)(i64)floorf( quantizedPos.x );
+        const u64 qy = (u64)(i64)floorf( quantizedPos.y );
+        const u64 qz = (u64)(i64)floorf( quantizedPos.z );
+        return hash_map::mix64( ( qx * 0x9E3779B97F4A7C15ULL ) ^ ( qy * 0xC2B2AE3D27D4EB4FULL ) ^ ( qz * 0x165667B19E3779F9ULL ) );
+    }
+
+    // splats particles into chunk samples and copies them to field when difference is above tolerance
+    u8 SplatChunk( FluidSurface* surf, const Fluid& fluid, u32 chunkIndex, u32 threadIndex )
+    {
+        const ChunkRange range = GetChunkRange( *surf, chunkIndex );
+        const u32 sx = range.end[0] - range.begin[0];
+        const u32 sy = range.end[1] - range.begin[1];
+        const u32 sz = range.end[2] - range.begin[2];
+
+        const float cs = surf->_cell_size;
+        const float cs_inv = 1.f / cs;
+        const float radius = surf->_kernel_radius;
+        const float radius_sq = radius * radius;
+        const float radius_sq_inv = 1.f / radius_sq;
+        const Vector3F origin = surf->_origin;
+
+        array_t<u32>& gather = surf->_gather[threadIndex];
+        array::clear( gather );
+
+        u64 signature = 0;
+        if( surf->_chunk_active[chunkIndex] & eCHUNK_ACTIVE )
+        {
+            const Vector3F chunk_lo = origin + Vector3F( (f32)range.begin[0], (f32)range.begin[1], (f32)range.begin[2] ) * cs;
+            const Vector3F chunk_hi = origin + Vector3F( (f32)( range.end[0] - 1 ), (f32)( range.end[1] - 1 ), (f32)( range.end[2] - 1 ) ) * cs;
+            fluid._neighbours.GatherPoints( &gather, chunk_lo - Vector3F( radius ), chunk_hi + Vector3F( radius ) );
+
+            const float quantum_inv = cs_inv / maxOfPair( surf->_params.quantization, FLT_EPSILON );
+            u64 position_sum = 0;
+            for( u32 index : gather )
+                position_sum += PositionHash( fluid.x[index] * quantum_inv );
+            signature = hash_map::mix64( position_sum ^ gather.size ) | 1; // 0 is reserved for empty chunk
+        }
+
+        if( signature == surf->_chunk_signature[chunkIndex] )
+            return eSPLAT_SKIPPED;
+
+        surf->_chunk_signature[chunkIndex] = signature;
+
+        array_t<f32>& scratch = surf->_scratch[threadIndex];
+        array::resize( scratch, sx * sy * sz );
+        memset( scratch.begin(), 0, scratch.size * sizeof( f32 ) );
+
+        for( u32 index : gather )
+        {
+            const Vector3F& p = fluid.x[index];
+            i32 b[3], e[3];
+            bool inside = true;
+            for( u32 a = 0; a < 3 && inside; ++a )
+            {
+                inside = SampleRange( &b[a], &e[a], p[a] - radius, p[a] + radius, origin[a], cs_inv, surf->_num_samples[a] );
+                b[a] = maxOfPair( b[a], (i32)range.begin[a] );
+                e[a] = minOfPair( e[a], (i32)range.end[a] );
+                inside = inside && b[a] < e[a];
+            }
+            if( !inside )
+                continue;
+
+            // smooth poly6 shaped kernel normalized to 1 at particle center. Stored negated
+            for( i32 z = b[2]; z < e[2]; ++z )
+            {
+                const float dz = origin.z + z * cs - p.z;
+                for( i32 y = b[1]; y < e[1]; ++y )
+                {
+                    const float dy = origin.y + y * cs - p.y;
+                    const float dyz_sq = dy * dy + dz * dz;
+                    if( dyz_sq >= radius_sq )
+                        continue;
+
+                    f32* row = scratch.begin() + ( ( z - range.begin[2] ) * sy + ( y - range.begin[1] ) ) * sx;
+                    for( i32 x = b[0]; x < e[0]; ++x )
+                    {
+                        const float dx = origin.x + x * cs - p.x;
+                        const float d_sq = dx * dx + dyz_sq;
+                        if( d_sq >= radius_sq )
+                            continue;
+
+                        const float t = 1.f - d_sq * radius_sq_inv;
+                        row[x - range.begin[0]] -= t * t * t;
+                    }
+                }
+            }
+        }
+
+        const u32 nx = surf->_num_samples[0];
+        const u32 ny = surf->_num_samples[1];
+        const float tolerance = surf->_params.tolerance;
+
+        float max_diff = 0.f;
+        for( u32 z = 0; z < sz; ++z )
+        {
+            for( u32 y = 0; y < sy; ++y )
+            {
+                const f32* src = scratch.begin() + ( z * sy + y ) * sx;
+                const f32* dst = surf->_field.begin() + ( ( range.begin[2] + z ) * ny + range.begin[1] + y ) * nx + range.begin[0];
+                for( u32 x = 0; x < sx; ++x )
+                    max_diff = maxOfPair( max_diff, ::fabsf( src[x] - dst[x] ) );
+            }
+        }
+        if( max_diff <= tolerance )
+            return eSPLAT_UNCHANGED;
+
+        for( u32 z = 0; z < sz; ++z )
+        {
+            for( u32 y = 0; y < sy; ++y )
+            {
+                const f32* src = scratch.begin() + ( z * sy + y ) * sx;
+                f32* dst = surf->_field.begin() + ( ( range.begin[2] + z ) * ny + range.begin[1] + y ) * nx + range.begin[0];
+                memcpy( dst, src, sx * sizeof( f32 ) );
+            }
+        }
+        return eSPLAT_CHANGED;
+    }
+}//
+
+void FluidSurfaceCreate( FluidSurface* surf, const Vector3F& boundsMin, const Vector3F& boundsMax, float particleRadius, const FluidSurfaceParams& params )
+{
+    FluidSurfaceDestroy( surf );
+
+    surf->_params = params;
+    surf->_cell_size = particleRadius * params.cell_scale;
+    surf->_kernel_radius = particleRadius * params.kernel_scale;
+    surf->_origin = boundsMin;
+    SYS_ASSERT( surf->_cell_size > FLT_EPSILON );
+
+    const Vector3F size = boundsMax - boundsMin;
+    u32 num_chunks = 1;
+    for( u32 i = 0; i < 3; ++i )
+    {
+        surf->_num_samples[i] = maxOfPair( (u32)ceilf( size[i] / surf->_cell_size ) + 1, 2u );
+        surf->_num_chunks[i] = ( surf->_num_samples[i] - 1 + FluidSurface::eCHUNK_CELLS - 1 ) / FluidSurface::eCHUNK_CELLS;
+        num_chunks *= surf->_num_chunks[i];
+    }
+
+    array::resize( surf->_field, surf->_num_samples[0] * surf->_num_samples[1] * surf->_num_samples[2] );
+    memset( surf->_field.begin(), 0, surf->_field.size * sizeof( f32 ) );
+    array::resize( surf->_chunk_active, num_chunks );
+    array::resize( surf->_chunk_changed, num_chunks );
+    memset( surf->_chunk_active.begin(), 0, num_chunks );
+    memset( surf->_chunk_changed.begin(), 0, num_chunks );
+    array::resize( surf->_chunk_signature, num_chunks );
+    memset( surf->_chunk_signature.begin(), 0, num_chunks * sizeof( u64 ) );
+
+    surf->_mesher.StartUp( surf->_num_samples[0], surf->_num_samples[1], surf->_num_samples[2], surf->_origin, Vector3F( surf->_cell_size ), FluidSurface::eCHUNK_CELLS );
+    SYS_ASSERT( surf->_mesher._num_chunks[0] == surf->_num_chunks[0] && surf->_mesher._num_chunks[1] == surf->_num_chunks[1] && surf->_mesher._num_chunks[2] == surf->_num_chunks[2] );
+
+    surf->_stats = {};
+    surf->_stats.num_chunks = num_chunks;
+}
+
+void FluidSurfaceDestroy( FluidSurface* surf )
+{
+    surf->_mesher.ShutDown();
+    array::clear( surf->_field );
+    array::clear( surf->_chunk_active );
+    array::clear( surf->_chunk_changed );
+    array::clear( surf->_chunk_signature );
+    array::clear( surf->_chunk_list );
+    surf->_stats = {};
+}
+
+void FluidSurfaceUpdate( FluidSurface* surf, const Fluid& fluid )
+{
+    BX_TRACE_SCOPE( "FluidSurfaceUpdate" );
+
+    // cells are built in first simulation step
+    if( fluid._neighbours._num_points != fluid.NumParticles() )
+        return;
+
+    bxTimeQuery time_query = bxTimeQuery::begin();
+    {
+        BX_TRACE_SCOPE( "FluidSurfaceUpdate::NarrowBand" );
+        MarkNarrowBand( surf, fluid );
+    }
+
+    array::clear( surf->_chunk_list );
+    u32 num_active = 0;
+    for( u32 i = 0; i < surf->_chunk_active.size; ++i )
+    {
+        surf->_chunk_changed[i] = 0;
+        if( surf->_chunk_active[i] )
+            array::push_back( surf->_chunk_list, i );
+        num_active += ( surf->_chunk_active[i] & eCHUNK_ACTIVE ) ? 1 : 0;
+    }
+
+    {
+        BX_TRACE_SCOPE( "FluidSurfaceUpdate::Splat" );
+        const u32* chunk_list = surf->_chunk_list.begin();
+        bxParallel::forRange( surf->_chunk_list.size, 1, [surf, &fluid, chunk_list]( u32 begin, u32 end, u32 threadIndex )
+        {
+            SYS_ASSERT( threadIndex < FluidSurface::eMAX_THREADS );
+            for( u32 i = begin; i < end; ++i )
+                surf->_chunk_changed[chunk_list[i]] = SplatChunk( surf, fluid, chunk_list[i], threadIndex );
+        } );
+    }
+
+    u32 num_splatted = 0;
+    u32 num_changed = 0;
+    for( u32 chunk_index : surf->_chunk_list )
+    {
+        num_splatted += ( surf->_chunk_changed[chunk_index] != eSPLAT_SKIPPED ) ? 1 : 0;
+        if( surf->_chunk_changed[chunk_index] != eSPLAT_CHANGED )
+            continue;
+
+        const ChunkRange range = GetChunkRange( *surf, chunk_index );
+        surf->_mesher.MarkDirty( range.begin[0], range.begin[1], range.begin[2], range.end[0] - 1, range.end[1] - 1, range.end[2] - 1 );
+        ++num_changed;
+    }
+    bxTimeQuery::end( &time_query );
+
+    {
+        BX_TRACE_SCOPE( "FluidSurfaceUpdate::Mesh" );
+        surf->_mesher.Update( surf->_field.begin(), -surf->_params.iso_level );
+    }
+
+    const IsoSurfaceMesher::Stats& mesher_stats = surf->_mesher.GetStats();
+    FluidSurfaceStats& stats = surf->_stats;
+    stats.splat_ms = (f32)( time_query.durationUS / 1000.0 );
+    stats.mesh_ms = mesher_stats.update_time_ms;
+    stats.num_active_chunks = num_active;
+    stats.num_splatted_chunks = num_splatted;
+    stats.num_changed_chunks = num_changed;
+    stats.num_vertices = mesher_stats.num_vertices;
+    stats.num_triangles = mesher_stats.num_triangles;
+}
+
+void FluidSurfaceBuildPolyShape( const FluidSurface& surf, bxPolyShape* shape )
+{
+    surf._mesher.BuildPolyShape( shape );
+}
+
+void FluidSurfaceBenchmark( FluidSurfaceBenchmarkResult* result, u32 numParticles, float particleRadius )
+{
+    // particles are not created with FluidCreate, it changes global kernel radius of running fluid
+    Fluid fluid;
+    fluid.particle_radius = particleRadius;
+    fluid._neighbours.SetCellSize( particleRadius * 2.f );
+    array::resize( fluid.x, numParticles );
+
+    const u32 side = maxOfPair( (u32)ceilf( powf( (float)numParticles, 1.f / 3.f ) ), 1u );
+    const float spacing = particleRadius * 2.f;
+    bxRandomGen rnd( 0x5EED );
+    for( u32 i = 0; i < numParticles; ++i )
+    {
+        const Vector3F lattice( (f32)( i % side ), (f32)( ( i / side ) % side ), (f32)( i / ( side * side ) ) );
+        const Vector3F jitter( rnd.getf( -0.1f, 0.1f ), rnd.getf( -0.1f, 0.1f ), rnd.getf( -0.1f, 0.1f ) );
+        fluid.x[i] = ( lattice + jitter ) * spacing;
+    }
+
+    // domain has room for particles moved by benchmark
+    const float margin = particleRadius * 8.f;
+    const Vector3F bounds_min( -margin );
+    const Vector3F bounds_max = Vector3F( (f32)side * spacing ) + Vector3F( margin );
+
+    FluidSurface surf;
+    FluidSurfaceCreate( &surf, bounds_min, bounds_max, particleRadius );
+
+    result->num_particles = numParticles;
+
+    fluid._neighbours.BuildCells( fluid.x.begin(), numParticles );
+    FluidSurfaceUpdate( &surf, fluid );
+    result->full = surf._stats;
+
+    FluidSurfaceUpdate( &surf, fluid );
+    result->unchanged = surf._stats;
+
+    // wave over whole block, every chunk changes
+    for( u32 i = 0; i < numParticles; ++i )
+    {
+        Vector3F& p = fluid.x[i];
+        p.y += particleRadius * ::sinf( p.x * 4.f ) * ::cosf( p.z * 4.f );
+    }
+    fluid._neighbours.BuildCells( fluid.x.begin(), numParticles );
+    FluidSurfaceUpdate( &surf, fluid );
+    result->moved = surf._stats;
+
+    FluidSurfaceDestroy( &surf );
+}
+
+}}//
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <util/array.h>
+#include <util/vectormath/vectormath.h>
+#include <util/poly/iso_surface.h>
+
+struct bxPolyShape;
+
+namespace bx{ namespace flood{
+
+struct Fluid;
+
+// Fluid surface reconstruction.
+// Particle density is splatted into regular grid covering fixed domain and meshed with IsoSurfaceMesher.
+// Grid is split into mesher chunks. Only chunks within kernel radius of fluid cells (narrow band) are splatted,
+// chunks which became empty are cleared once, and only chunks which changed more than tolerance are re-meshed.
+// Chunk with the same particles at the same quantized positions as in previous update is not splatted at all.
+// Each chunk gathers its particles from fluid neighbour search cells, so chunks are splatted in parallel without write conflicts.
+struct FluidSurfaceParams
+{
+    f32 cell_scale = 1.f;       // grid cell size in particle radius units
+    f32 kernel_scale = 2.5f;    // splat kernel radius in particle radius units
+    f32 iso_level = 0.5f;       // isolated particle has density 1 at its center
+    f32 tolerance = 0.01f;      // chunks with smaller density change are not re-meshed
+    f32 quantization = 0.1f;    // in cell size units. Chunk is not splatted again when its particles didn't cross quantization step
+};
+
+struct FluidSurfaceStats
+{
+    f32 splat_ms = 0.f;
+    f32 mesh_ms = 0.f;
+    u32 num_chunks = 0;
+    u32 num_active_chunks = 0;  // in narrow band
+    u32 num_splatted_chunks = 0;
+    u32 num_changed_chunks = 0; // splatted or cleared with change above tolerance
+    u32 num_vertices = 0;
+    u32 num_triangles = 0;
+};
+
+struct FluidSurface
+{
+    enum : u32
+    {
+        eCHUNK_CELLS = IsoSurfaceMesher::eMAX_CHUNK_CELLS,
+        eMAX_THREADS = 64,
+    };
+
+    FluidSurfaceParams _params;
+    FluidSurfaceStats  _stats;
+
+    IsoSurfaceMesher _mesher;
+    array_t<f32> _field;          // negative density, so inside is below iso level like in distance field
+    array_t<u8>  _chunk_active;   // narrow band of last update
+    array_t<u8>  _chunk_changed;  // result of last splat
+    array_t<u64> _chunk_signature; // order independent hash of quantized positions of splatted particles
+    array_t<u32> _chunk_list;
+
+    Vector3F _origin{ 0.f };
+    f32 _cell_size = 0.f;
+    f32 _kernel_radius = 0.f;
+    u32 _num_samples[3] = {};
+    u32 _num_chunks[3] = {};
+
+    // per thread
+    array_t<u32> _gather[eMAX_THREADS];
+    array_t<f32> _scratch[eMAX_THREADS];
+    array_t<Vector3F> _cell_bounds;
+};
+
+// grid covers box [boundsMin, boundsMax]. Particles outside of it are ignored
+void FluidSurfaceCreate( FluidSurface* surf, const Vector3F& boundsMin, const Vector3F& boundsMax, float particleRadius, const FluidSurfaceParams& params = FluidSurfaceParams() );
+void FluidSurfaceDestroy( FluidSurface* surf );
+
+// uses cells of fluid neighbour search, so it has to be called after FluidTick (positions and cells must match).
+// Does nothing until fluid did its first step
+void FluidSurfaceUpdate( FluidSurface* surf, const Fluid& fluid );
+
+// welded triangle mesh with positions and normals. Shape has to be deallocated with bxPolyShape_deallocateShape
+void FluidSurfaceBuildPolyShape( const FluidSurface& surf, bxPolyShape* shape );
+
+// Headless benchmark on jittered block of numParticles particles: full update, update without change
+// and update after moving all particles. Nothing is rendered.
+struct FluidSurfaceBenchmarkResult
+{
+    u32 num_particles = 0;
+    FluidSurfaceStats full;
+    FluidSurfaceStats unchanged;
+    FluidSurfaceStats moved;
+};
+void FluidSurfaceBenchmark( FluidSurfaceBenchmarkResult* result, u32 numParticles, float particleRadius );
+
+}}//
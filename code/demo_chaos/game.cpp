@@ -1,6 +1,7 @@
 #include "game.h"
 #include <util\debug.h>
 #include <util\string_util.h>
+#include <util\trace.h>
 #include <util\memory.h>
 #include <system/window.h>
 #include <rdi\rdi_backend_dx11.h>
@@ -116,6 +117,8 @@ void Game::ShutDown()
 bool Game::Update()
 {
     rmt_ScopedCPUSample( Update, 0 );
+    bxTrace::frameMark();
+    BX_TRACE_SCOPE( "Game::Update" );
 
     if( _time_query.isRunning() )
     {
@@ -182,6 +185,67 @@ bool Game::Update()
         const float dt_inv = ( dt>FLT_EPSILON ) ? 1.f / dt : 0.f;
         ImGui::Text( "DeltaTime: %f", dt );
         ImGui::Text( "FPS: %.2f", dt_inv );
+
+        static int trace_frames = 8;
+        ImGui::SliderInt( "Trace frames", &trace_frames, 1, 120 );
+        if( bxTrace::isCapturing() )
+        {
+            ImGui::Text( "Capturing trace..." );
+        }
+        else if( ImGui::Button( "Capture trace" ) )
+        {
+            bxTrace::captureFrames( (u32)trace_frames, "trace.json" );
+        }
+
+        if( ImGui::CollapsingHeader( "Benchmarks" ) )
+        {
+            if( ImGui::Button( "aabb tree" ) )
+                DynamicAABBTreeBenchmark( &_aabb_tree_benchmark, 100000 );
+
+            const DynamicAABBTreeBenchmarkResult& r = _aabb_tree_benchmark;
+            if( r.num_proxies )
+            {
+                ImGui::Text( "%uk proxies: build %.1f ms, height %d", r.num_proxies / 1000, r.build_ms, r.height );
+                ImGui::Text( "update: small %.2f ms, large %.2f ms (%u reinserted)", r.update_small_ms, r.update_large_ms, r.num_reinserted );
+                ImGui::Text( "frustum: %.3f ms, linear %.3f ms (%u visible)", r.query_frustum_ms, r.linear_frustum_ms, r.num_visible );
+                ImGui::Text( "aabb: %.4f ms, ray: %.4f ms", r.query_aabb_ms, r.ray_cast_ms );
+            }
+
+            if( ImGui::Button( "slot map" ) )
+                SlotMapBenchmark( &_slot_map_benchmark );
+
+            const SlotMapBenchmarkResult& s = _slot_map_benchmark;
+            if( s.num_handles )
+            {
+                static const char* method_names[] = { "id_table", "slots", "slots+lock", "slots concurrent" };
+                ImGui::Text( "%u handles x %u rounds", s.num_handles, s.num_rounds );
+                for( u32 i = 0; i < SlotMapBenchmarkResult::NUM_METHODS; ++i )
+                    ImGui::Text( "%-16s create %.2f ms, lookup %.2f ms, destroy %.2f ms, errors %u", method_names[i], s.create_ms[i], s.lookup_ms[i], s.destroy_ms[i], s.errors[i] );
+            }
+
+            if( ImGui::Button( "hash map" ) )
+                HashMapBenchmark( &_hash_map_benchmark );
+
+            const HashMapBenchmarkResult& hm = _hash_map_benchmark;
+            if( hm.num_keys )
+            {
+                static const char* method_names[] = { "hash_map_t", "hashmap_t" };
+                ImGui::Text( "%u keys x %u rounds", hm.num_keys, hm.num_rounds );
+                for( u32 i = 0; i < HashMapBenchmarkResult::NUM_METHODS; ++i )
+                    ImGui::Text( "%-10s capacity %u, insert %.2f ms, hit %.2f ms, miss %.2f ms, erase %.2f ms, errors %u", method_names[i],
+                                 hm.capacity[i], hm.insert_ms[i], hm.hit_ms[i], hm.miss_ms[i], hm.erase_ms[i], hm.errors[i] );
+            }
+
+            if( ImGui::Button( "debug draw lines" ) )
+                rdi::debug_draw::Benchmark( &_debug_draw_benchmark );
+
+            const rdi::debug_draw::BenchmarkResult& d = _debug_draw_benchmark;
+            if( d.num_lines )
+            {
+                ImGui::Text( "%uk lines from %u threads, %u flushes", d.num_lines / 1024, d.num_threads, d.num_flushes );
+                ImGui::Text( "record %.2f ms (locked %.2f ms), pack %.2f ms, errors %u", d.record_ms, d.record_locked_ms, d.pack_ms, d.errors );
+            }
+        }
     }
     ImGui::End();
 
@@ -194,6 +258,7 @@ void Game::Render()
         return;
     
     rmt_ScopedCPUSample( Render, 0 );
+    BX_TRACE_SCOPE( "Game::Render" );
 
     rdi::CommandQueue* cmdq = nullptr;
     rdi::frame::Begin( &cmdq );
@@ -3,7 +3,11 @@
 #include <vector>
 #include <util/type.h>
 #include <util/camera.h>
+#include <util/dynamic_aabb_tree.h>
+#include <util/slot_map.h>
+#include <util/hash_map.h>
 #include <rdi/rdi_backend.h>
+#include <rdi/rdi_debug_draw.h>
 #include "renderer_camera.h"
 
 #include "game_time.h"
@@ -91,6 +95,11 @@ private:
 
     Remotery* _rmt = nullptr;
 
+    DynamicAABBTreeBenchmarkResult _aabb_tree_benchmark;
+    SlotMapBenchmarkResult _slot_map_benchmark;
+    HashMapBenchmarkResult _hash_map_benchmark;
+    rdi::debug_draw::BenchmarkResult _debug_draw_benchmark;
+
 protected:
     gfx::Camera             _dev_camera = {};
     gfx::CameraInputContext _dev_camera_input_ctx = {};
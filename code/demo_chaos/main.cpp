@@ -2,6 +2,8 @@
 #include <system/window.h>
 
 #include <util/config.h>
+#include <util/thread/parallel.h>
+#include <util/trace.h>
 #include <resource_manager/resource_manager.h>
 
 #include "test_game/test_game.h"
@@ -27,6 +29,8 @@ public:
         bxConfig::global_init( "demo_chaos/global.cfg" );
         const char* assetDir = bxConfig::global_string( "assetDir" );
         bx::ResourceManager::startup( assetDir );
+        bxParallel::startUp();
+        bxTrace::startUp();
         
         bxWindow* win = bxWindow_get();
         rdi::Startup( (uptr)win->hwnd, win->width, win->height, win->full_screen );
@@ -36,13 +40,12 @@ public:
         //    _engine._camera_script_callback->addCallback( &sceneScript );
 
         //const char* sceneName = bxConfig::global_string( "scene" );
-        //bxFS::File scriptFile = _engine.resource_manager->readTextFileSync( sceneName );
-
-        //if( scriptFile.ok() )
+        //if( sceneName )
         //{
-        //    bxScene::script_run( &sceneScript, scriptFile.txt );
+        //    // compiled scene is cached next to .scene file
+        //    const bxFS::Path scenePath = GResourceManager()->absolutePath( sceneName );
+        //    bxScene::script_runFile( &sceneScript, scenePath.name );
         //}
-        //scriptFile.release();
 
         //{
         //    char const* cameraName = bxConfig::global_string( "camera" );
@@ -71,6 +74,8 @@ public:
         BX_DELETE0( bxDefaultAllocator(), _game );
 
         rdi::Shutdown();
+        bxTrace::shutDown();
+        bxParallel::shutDown();
         ResourceManager::shutdown();
         bxConfig::global_deinit();
     }
@@ -0,0 +1,62 @@
+#include "particle_zorder.h"
+#include <util/array.h>
+#include <util/common.h>
+
+#include <algorithm>
+#include <float.h>
+
+namespace bx
+{
+
+static inline u32 SpreadBits10( u32 v )
+{
+    v &= 0x3FF;
+    v = ( v | ( v << 16 ) ) & 0x030000FF;
+    v = ( v | ( v << 8 ) ) & 0x0300F00F;
+    v = ( v | ( v << 4 ) ) & 0x030C30C3;
+    v = ( v | ( v << 2 ) ) & 0x09249249;
+    return v;
+}
+
+u32 MortonCode3( u32 x, u32 y, u32 z )
+{
+    return SpreadBits10( x ) | ( SpreadBits10( y ) << 1 ) | ( SpreadBits10( z ) << 2 );
+}
+
+bool ComputeZOrder( array_t<u32>* order, array_t<u64>* scratch, const Vector3F* points, u32 count, float cellSize )
+{
+    array::clear( *order );
+    array::clear( *scratch );
+    if( count < 2 )
+        return false;
+
+    Vector3F bmin( FLT_MAX );
+    for( u32 i = 0; i < count; ++i )
+        bmin = minPerElem( bmin, points[i] );
+
+    // key: code in high bits, index in low bits, so equal cells keep their relative order
+    array::reserve( *scratch, count );
+    const float cell_size_inv = 1.f / cellSize;
+    for( u32 i = 0; i < count; ++i )
+    {
+        const Vector3F cell = ( points[i] - bmin ) * cell_size_inv;
+        const u32 cx = minOfPair( (u32)cell.x, 1023u );
+        const u32 cy = minOfPair( (u32)cell.y, 1023u );
+        const u32 cz = minOfPair( (u32)cell.z, 1023u );
+        array::push_back( *scratch, ( (u64)MortonCode3( cx, cy, cz ) << 32 ) | i );
+    }
+
+    std::sort( scratch->begin(), scratch->end() );
+
+    array::reserve( *order, count );
+    bool identity = true;
+    for( u32 i = 0; i < count; ++i )
+    {
+        const u32 index = (u32)( (*scratch)[i] & 0xFFFFFFFF );
+        identity &= index == i;
+        array::push_back( *order, index );
+    }
+    return !identity;
+}
+
+}//
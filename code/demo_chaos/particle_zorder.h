@@ -0,0 +1,33 @@
+#pragma once
+
+#include <util/type.h>
+#include <util/containers.h>
+#include <util/vectormath/vectormath.h>
+
+#include <string.h>
+
+namespace bx
+{
+
+// Z-order (Morton) reordering of particle arrays.
+// Particles are sorted by Morton code of their grid cell, so particles close in space are close in memory
+// and neighbour loops touch fewer cache lines. Owner of the arrays permutes all of them with the same order
+// and keeps remap table for indices visible outside.
+
+// 30 bit code, 10 bits per axis
+u32 MortonCode3( u32 x, u32 y, u32 z );
+
+// order[new_index] = old_index. Cells are relative to bounding box of points. scratch is reused between calls.
+// Returns false when points are already in Z-order (order is identity)
+bool ComputeZOrder( array_t<u32>* order, array_t<u64>* scratch, const Vector3F* points, u32 count, float cellSize );
+
+// data[i] = data[order[i]] for all i. scratch has to have space for count elements
+template< typename T >
+inline void PermuteZOrder( T* data, T* scratch, const u32* order, u32 count )
+{
+    for( u32 i = 0; i < count; ++i )
+        scratch[i] = data[order[i]];
+    memcpy( data, scratch, count * sizeof( T ) );
+}
+
+}//
@@ -26,13 +26,19 @@
 // Copyright (c) 2013-2016 NVIDIA Corporation. All rights reserved.
 
 #include "aabbtree.h"
+#include "qbvh.h"
+#include "voxelize.h"
 #include <util/intersect.h>
 #include <util/array.h>
+#include <util/memory.h>
+#include <util/time.h>
+#include <util/common.h>
 //#include "maths.h"
 //#include "platform.h"
 
 #include <algorithm>
 #include <iostream>
+#include <string.h>
 
 
 //using namespace std;
@@ -41,18 +47,37 @@
 _declspec (thread) uint32_t AABBTree::s_traceDepth;
 #endif
 
-AABBTree::AABBTree(const Vector3F* vertices, uint32_t numVerts, const uint32_t* indices, uint32_t numFaces) 
+AABBTree::AABBTree(const Vector3F* vertices, uint32_t numVerts, const uint32_t* indices, uint32_t numFaces, EMode mode) 
     : m_vertices(vertices)
     , m_numVerts(numVerts)
     , m_indices(indices)
     , m_numFaces(numFaces)
+    , m_qbvh(nullptr)
 {
     // build stats
     m_treeDepth = 0;
     m_innerNodes = 0;
     m_leafNodes = 0;
 
-    Build();
+    if (mode == EMode::QBVH)
+        m_qbvh = BX_NEW(bxDefaultAllocator(), QBVH, vertices, numVerts, indices, numFaces);
+    else
+        Build();
+}
+
+AABBTree::~AABBTree()
+{
+    BX_DELETE0(bxDefaultAllocator(), m_qbvh);
+}
+
+Vector3F AABBTree::GetMinExtents() const
+{
+    return (m_qbvh) ? m_qbvh->GetMinExtents() : m_nodes[0].m_minExtents;
+}
+
+Vector3F AABBTree::GetMaxExtents() const
+{
+    return (m_qbvh) ? m_qbvh->GetMaxExtents() : m_nodes[0].m_maxExtents;
 }
 
 namespace
@@ -366,6 +391,9 @@ void AABBTree::BuildRecursive(uint32_t nodeIndex, uint32_t* faces, uint32_t numF
     {
         ++m_innerNodes;        
 
+        // nodes come from array::resize, which doesn't run Node constructor
+        n.m_faces = NULL;
+
         // face counts for each branch
         //const uint32_t leftCount = PartitionMedian(n, faces, numFaces);
         const uint32_t leftCount = PartitionSAH(n, faces, numFaces);
@@ -521,6 +549,9 @@ bool AABBTree::TraceRay(const Vector3F& start, const Vector3F& dir, float& outT,
 {   
     //s_traceDepth = 0;
 
+    if (m_qbvh)
+        return m_qbvh->TraceRay(start, dir, outT, u, v, w, faceSign, faceIndex);
+
     Vector3F rcp_dir(1.0f/dir.x, 1.0f/dir.y, 1.0f/dir.z);
 
     outT = FLT_MAX;
@@ -811,3 +842,190 @@ void AABBTree::DebugDrawRecursive(uint32_t nodeIndex, uint32_t depth)
     }    
     */
 }
+
+namespace
+{
+    inline f32 ElapsedMS( u64 startUS )
+    {
+        return (f32)( ( bxTime::us() - startUS ) * 0.001 );
+    }
+    inline f32 MRaysPerSecond( u32 numRays, u64 startUS )
+    {
+        const u64 dt_us = bxTime::us() - startUS;
+        return ( dt_us ) ? (f32)numRays / (f32)dt_us : 0.f;
+    }
+    inline bool SameHit( float a, float b )
+    {
+        if( a == FLT_MAX || b == FLT_MAX )
+            return a == b;
+        return fabsf( a - b ) <= 1e-3f * maxOfPair( 1.f, fabsf( a ) );
+    }
+}
+
+void AABBTreeBenchmark( AABBTreeBenchmarkResult* result, u32 segments, u32 raysPerSide, u32 voxelResolution )
+{
+    result[0] = AABBTreeBenchmarkResult();
+
+    // --- torus, ring is in xz plane. Vertices are shared, so the mesh is closed
+    const u32 num_major = maxOfPair( segments, 3u );
+    const u32 num_minor = maxOfPair( segments / 2, 3u );
+    const float major_radius = 1.f;
+    const float minor_radius = 0.35f;
+
+    array_t<Vector3F> positions;
+    array_t<u32> index_array;
+    array::reserve( positions, num_major * num_minor );
+    array::reserve( index_array, num_major * num_minor * 6 );
+    for( u32 i = 0; i < num_major; ++i )
+    {
+        const float a = 2.f * PI * i / num_major;
+        for( u32 j = 0; j < num_minor; ++j )
+        {
+            const float b = 2.f * PI * j / num_minor;
+            const float r = major_radius + minor_radius * cosf( b );
+            array::push_back( positions, Vector3F( r * cosf( a ), minor_radius * sinf( b ), r * sinf( a ) ) );
+
+            const u32 i1 = ( i + 1 ) % num_major;
+            const u32 j1 = ( j + 1 ) % num_minor;
+            const u32 quad[4] = { i * num_minor + j, i1 * num_minor + j, i1 * num_minor + j1, i * num_minor + j1 };
+            array::push_back( index_array, quad[0] );
+            array::push_back( index_array, quad[1] );
+            array::push_back( index_array, quad[2] );
+            array::push_back( index_array, quad[0] );
+            array::push_back( index_array, quad[2] );
+            array::push_back( index_array, quad[3] );
+        }
+    }
+
+    const Vector3F* vertices = positions.begin();
+    const u32 numVerts = positions.size;
+    const u32* indices = index_array.begin();
+    const u32 numFaces = index_array.size / 3;
+    result->num_faces = numFaces;
+
+    u64 start_us = bxTime::us();
+    const AABBTree binary( vertices, numVerts, indices, numFaces, AABBTree::EMode::BINARY );
+    result->build_ms_binary = ElapsedMS( start_us );
+
+    start_us = bxTime::us();
+    const AABBTree qbvh_tree( vertices, numVerts, indices, numFaces, AABBTree::EMode::QBVH );
+    result->build_ms_qbvh = ElapsedMS( start_us );
+    const QBVH& qbvh = *qbvh_tree.GetQBVH();
+
+    // --- rays, row by row, so 8 consecutive rays are neighbour pixels
+    const Vector3F center = binary.GetCenter();
+    const float radius = length( binary.GetMaxExtents() - binary.GetMinExtents() ) * 0.5f;
+    const Vector3F eye = center + normalize( Vector3F( 0.3f, 0.4f, 1.f ) ) * radius * 3.f;
+    const Vector3F forward = normalize( center - eye );
+    const Vector3F right = normalize( cross( forward, Vector3F::yAxis() ) );
+    const Vector3F up = cross( right, forward );
+
+    const u32 num_rays = ( raysPerSide * raysPerSide ) & ~7u;
+    result->num_rays = num_rays;
+
+    array_t<Vector3F> dirs;
+    array::resize( dirs, num_rays );
+    for( u32 i = 0; i < num_rays; ++i )
+    {
+        const float sx = ( ( i % raysPerSide ) + 0.5f ) / raysPerSide * 2.f - 1.f;
+        const float sy = ( ( i / raysPerSide ) + 0.5f ) / raysPerSide * 2.f - 1.f;
+        dirs[i] = normalize( forward * 3.f + right * sx + up * sy );
+    }
+
+    array_t<float> t_binary;
+    array::resize( t_binary, num_rays );
+
+    float t, u, v, w, sign;
+    u32 face;
+
+    // --- single rays
+    start_us = bxTime::us();
+    for( u32 i = 0; i < num_rays; ++i )
+    {
+        if( !binary.TraceRay( eye, dirs[i], t, u, v, w, sign, face ) )
+            t = FLT_MAX;
+        t_binary[i] = t;
+    }
+    result->mrays_binary = MRaysPerSecond( num_rays, start_us );
+
+    array_t<u8> mismatch;
+    array::resize( mismatch, num_rays );
+    memset( mismatch.begin(), 0, num_rays );
+
+    start_us = bxTime::us();
+    for( u32 i = 0; i < num_rays; ++i )
+    {
+        if( !qbvh.TraceRay( eye, dirs[i], t, u, v, w, sign, face ) )
+            t = FLT_MAX;
+        mismatch[i] |= !SameHit( t, t_binary[i] );
+    }
+    result->mrays_qbvh = MRaysPerSecond( num_rays, start_us );
+
+    // --- packets
+    QBVH::RayPacket packet;
+    QBVH::HitPacket hits;
+    for( u32 lane = 0; lane < 8; ++lane )
+    {
+        packet.ox[lane] = eye.x;
+        packet.oy[lane] = eye.y;
+        packet.oz[lane] = eye.z;
+        packet.tmax[lane] = FLT_MAX;
+    }
+
+    start_us = bxTime::us();
+    for( u32 i = 0; i < num_rays; i += 4 )
+    {
+        for( u32 lane = 0; lane < 4; ++lane )
+        {
+            packet.dx[lane] = dirs[i + lane].x;
+            packet.dy[lane] = dirs[i + lane].y;
+            packet.dz[lane] = dirs[i + lane].z;
+        }
+        qbvh.TraceRayPacket4( packet, &hits );
+        for( u32 lane = 0; lane < 4; ++lane )
+            mismatch[i + lane] |= !SameHit( hits.t[lane], t_binary[i + lane] );
+    }
+    result->mrays_packet4 = MRaysPerSecond( num_rays, start_us );
+
+    start_us = bxTime::us();
+    for( u32 i = 0; i < num_rays; i += 8 )
+    {
+        for( u32 lane = 0; lane < 8; ++lane )
+        {
+            packet.dx[lane] = dirs[i + lane].x;
+            packet.dy[lane] = dirs[i + lane].y;
+            packet.dz[lane] = dirs[i + lane].z;
+        }
+        qbvh.TraceRayPacket8( packet, &hits );
+        for( u32 lane = 0; lane < 8; ++lane )
+            mismatch[i + lane] |= !SameHit( hits.t[lane], t_binary[i + lane] );
+    }
+    result->mrays_packet8 = MRaysPerSecond( num_rays, start_us );
+
+    for( u32 i = 0; i < num_rays; ++i )
+    {
+        result->num_hits += ( t_binary[i] != FLT_MAX ) ? 1 : 0;
+        result->num_mismatches += mismatch[i];
+    }
+
+    // --- voxelization, bounds are padded by one voxel
+    if( !voxelResolution )
+        return;
+
+    result->voxel_resolution = voxelResolution;
+    const Vector3F size = binary.GetMaxExtents() - binary.GetMinExtents();
+    const Vector3F pad = size * ( 1.f / ( voxelResolution - 2 ) );
+    const Vector3F vmin = binary.GetMinExtents() - pad;
+    const Vector3F vmax = binary.GetMaxExtents() + pad;
+
+    VoxelGrid grid;
+    start_us = bxTime::us();
+    Voxelize( &grid, (const float*)vertices, numVerts, (const int*)indices, numFaces * 3, voxelResolution, voxelResolution, voxelResolution, vmin, vmax, EVoxelizeMode::SOLID );
+    result->voxelize_ms_solid = ElapsedMS( start_us );
+    result->num_voxels_solid = CountVoxels( grid );
+
+    start_us = bxTime::us();
+    Voxelize( &grid, (const float*)vertices, numVerts, (const int*)indices, numFaces * 3, voxelResolution, voxelResolution, voxelResolution, vmin, vmax, EVoxelizeMode::SOLID_RAYS );
+    result->voxelize_ms_rays = ElapsedMS( start_us );
+    result->num_voxels_rays = CountVoxels( grid );
+}
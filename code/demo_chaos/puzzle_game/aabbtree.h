@@ -34,23 +34,34 @@
 #include <util/vectormath/vectormath.h>
 #include <util/containers.h>
 
+class QBVH;
+
 class AABBTree
 {
 	AABBTree(const AABBTree&);
 	AABBTree& operator=(const AABBTree&);
 
 public:
+    enum class EMode
+    {
+        BINARY, // recursive build on calling thread, one ray at a time
+        QBVH,   // parallel binned SAH build, 4-wide nodes and ray packets (see qbvh.h)
+    };
 
-    AABBTree(const Vector3F* vertices, u32 numVerts, const u32* indices, u32 numFaces);
+    AABBTree(const Vector3F* vertices, u32 numVerts, const u32* indices, u32 numFaces, EMode mode = EMode::BINARY);
+    ~AABBTree();
 
 	bool TraceRaySlow(const Vector3F& start, const Vector3F& dir, float& outT, float& u, float& v, float& w, float& faceSign, u32& faceIndex) const;
     bool TraceRay(const Vector3F& start, const Vector3F& dir, float& outT, float& u, float& v, float& w, float& faceSign, u32& faceIndex) const;
 
     void DebugDraw();
     
-    Vector3F GetCenter() const { return (m_nodes[0].m_minExtents+m_nodes[0].m_maxExtents)*0.5f; }
-    Vector3F GetMinExtents() const { return m_nodes[0].m_minExtents; }
-    Vector3F GetMaxExtents() const { return m_nodes[0].m_maxExtents; }
+    Vector3F GetCenter() const { return (GetMinExtents()+GetMaxExtents())*0.5f; }
+    Vector3F GetMinExtents() const;
+    Vector3F GetMaxExtents() const;
+
+    // packet traversal, null in BINARY mode
+    const QBVH* GetQBVH() const { return m_qbvh; }
 	
 #if _WIN32
     // stats (reset each trace)
@@ -146,6 +157,8 @@ private:
     NodeArray m_nodes;
     FaceBoundsArray m_faceBounds;    
 
+    QBVH* m_qbvh;
+
     // stats
     u32 m_treeDepth;
     u32 m_innerNodes;
@@ -155,3 +168,26 @@ private:
    _declspec (thread) static u32 s_traceDepth;
 #endif
 };
+
+// Both modes over the same closed mesh (torus with 2 * segments * segments/2 triangles). Rays are coherent (pinhole camera
+// looking at the mesh), packets are formed from neighbour pixels. Mesh is also voxelized in SOLID and SOLID_RAYS modes,
+// voxel counts should match.
+struct AABBTreeBenchmarkResult
+{
+    u32 num_faces = 0;
+    u32 num_rays = 0;
+    f32 build_ms_binary = 0.f;
+    f32 build_ms_qbvh = 0.f;
+    f32 mrays_binary = 0.f;  // millions of rays per second
+    f32 mrays_qbvh = 0.f;
+    f32 mrays_packet4 = 0.f;
+    f32 mrays_packet8 = 0.f;
+    u32 num_hits = 0;        // binary tree
+    u32 num_mismatches = 0;  // rays where any QBVH query disagrees with binary tree
+    u32 voxel_resolution = 0;
+    f32 voxelize_ms_solid = 0.f;
+    f32 voxelize_ms_rays = 0.f;
+    u32 num_voxels_solid = 0;
+    u32 num_voxels_rays = 0;
+};
+void AABBTreeBenchmark( AABBTreeBenchmarkResult* result, u32 segments = 256, u32 raysPerSide = 512, u32 voxelResolution = 128 );
@@ -7,9 +7,23 @@
 
 #include "puzzle_physics_util.h"
 #include "puzzle_scene.h"
+#include "../imgui/imgui.h"
+
+#include <string.h>
 
 namespace bx { namespace puzzle {
 
+namespace
+{
+    // stored with snapshot of each frame, followed by player state
+    struct FrameInput
+    {
+        bxInput input;
+        Matrix3F input_basis;
+        u64 delta_time_us;
+    };
+}//
+
 void PuzzleGame::StartUpImpl()
 {
     GameSimple::StartUpImpl();
@@ -36,6 +50,7 @@ void LevelState::OnStartUp()
     physics::SetFrequency( _solver, 60 );
     physics::CreateGfx( &_solver_gfx, _solver, _gfx_scene );
     physics::CreateGUI( &_solver_gui, _solver, _solver_gfx );
+    physics::CreateSnapshotRing( &_snapshots );
     
     _CreateTestLevel();
 
@@ -43,6 +58,7 @@ void LevelState::OnStartUp()
 
 void LevelState::OnShutDown()
 {
+    physics::DestroySnapshotRing( &_snapshots );
     physics::DestroyGUI( &_solver_gui );
     physics::DestroyGfx( &_solver_gfx );
     physics::DestroySolver( &_solver );
@@ -59,13 +75,39 @@ void LevelState::OnUpdate( const GameTime& time )
     const gfx::Camera& camera = GetGame()->GetDevCamera();
 
     bxWindow* window = bxWindow_get();
-    const bxInput& input = window->input;
 
-    const Matrix3F player_basis = toMatrix3F( camera.world.getUpper3x3() );
-    PlayerCollectInput( _player, input, player_basis, time.delta_time_us );
+    FrameInput frame_input;
+    frame_input.input = window->input;
+    frame_input.input_basis = toMatrix3F( camera.world.getUpper3x3() );
+    frame_input.delta_time_us = time.delta_time_us;
+    float delta_time = time.DeltaTimeSec();
+
+    // frames dropped by rewind are simulated again exactly as before, without cpu budget
+    physics::SnapshotFrameInfo replay;
+    _replaying = _snapshots_enabled && physics::GetReplayFrame( &replay, _snapshots, _frame ) && replay.user_data_size >= sizeof( FrameInput );
+    if( _replaying )
+    {
+        memcpy( &frame_input, replay.user_data, sizeof( FrameInput ) );
+        delta_time = replay.delta_time;
+    }
+
+    PlayerCollectInput( _player, frame_input.input, frame_input.input_basis, frame_input.delta_time_us );
     
-    PlayerTick( &sctx, time.delta_time_us );
-    physics::Solve( _solver, 4, time.DeltaTimeSec() );
+    PlayerTick( &sctx, frame_input.delta_time_us );
+    if( _replaying )
+        physics::SolveReplay( _solver, delta_time, replay.plan );
+    else
+        physics::Solve( _solver, 4, delta_time );
+
+    if( _snapshots_enabled )
+    {
+        const u32 player_size = PlayerSaveState( nullptr, 0 );
+        array::resize( _snapshot_data, (u32)sizeof( FrameInput ) + player_size );
+        memcpy( _snapshot_data.begin(), &frame_input, sizeof( FrameInput ) );
+        PlayerSaveState( _snapshot_data.begin() + sizeof( FrameInput ), player_size );
+        physics::PushSnapshot( _snapshots, _solver, _frame, delta_time, _snapshot_data.begin(), _snapshot_data.size );
+    }
+    _frame += 1;
     //PlayerPostPhysicsTick( &sctx );
 
     //for( size_t i = 0; i < NUM_ROPES; i++ )
@@ -78,6 +120,86 @@ void LevelState::OnUpdate( const GameTime& time )
 
     physics::DebugDraw( _solver );
     physics::ShowGUI( _solver_gui, camera );
+
+    if( ImGui::Begin( "Snapshots" ) )
+    {
+        ImGui::Checkbox( "enabled", &_snapshots_enabled );
+        const physics::SnapshotRingStats& ss = physics::GetStats( _snapshots );
+        ImGui::Text( "frames: %u, total: %.1f KB", ss.num_frames, ss.total_size / 1024.f );
+        ImGui::Text( "last: %.1f KB raw, %.1f KB stored", ss.raw_size / 1024.f, ss.stored_size / 1024.f );
+        ImGui::Text( "save: %.3f ms, restore: %.3f ms", ss.save_ms, ss.restore_ms );
+        ImGui::Text( "replay: %u verified, %u mismatches", ss.num_verified, ss.num_mismatches );
+        if( ss.num_mismatches )
+            ImGui::Text( "first mismatch: frame %llu", ss.first_mismatch_frame );
+        if( _replaying )
+            ImGui::Text( "replaying frame %llu", _frame - 1 );
+
+        // physics and player, gfx keeps its state
+        u64 oldest, newest;
+        if( ImGui::Button( "rewind 30 frames" ) && physics::GetSnapshotRange( &oldest, &newest, _snapshots ) )
+        {
+            const u64 frame = ( newest - oldest > 30 ) ? newest - 30 : oldest;
+            physics::SnapshotFrameInfo info;
+            if( physics::GetSnapshotFrame( &info, _snapshots, frame ) && physics::RewindSnapshot( _snapshots, _solver, frame ) )
+            {
+                const u8* player_state = (const u8*)info.user_data + sizeof( FrameInput );
+                PlayerRestoreState( player_state, info.user_data_size - (u32)sizeof( FrameInput ) );
+                _frame = frame + 1;
+            }
+        }
+    }
+    ImGui::End();
+
+    if( ImGui::Begin( "Physics tests" ) )
+    {
+        if( ImGui::Button( "deep penetration" ) )
+            physics::DeepPenetrationTest( &_deep_penetration_test );
+
+        const physics::DeepPenetrationTestResult& r = _deep_penetration_test;
+        if( r.num_particles )
+            ImGui::Text( "%s: %u particles, %u zero normals, distance %.2f -> %.2f", ( r.passed ) ? "passed" : "FAILED",
+                         r.num_particles, r.num_zero_normals, r.initial_distance, r.final_distance );
+
+        if( ImGui::Button( "aabb tree / qbvh" ) )
+            AABBTreeBenchmark( &_aabb_tree_benchmark );
+
+        const AABBTreeBenchmarkResult& b = _aabb_tree_benchmark;
+        if( b.num_faces )
+        {
+            ImGui::Text( "%u triangles, build binary %.2f ms, qbvh %.2f ms", b.num_faces, b.build_ms_binary, b.build_ms_qbvh );
+            ImGui::Text( "%u rays (%u hits), Mrays/s: binary %.2f, qbvh %.2f, packet4 %.2f, packet8 %.2f, mismatches %u",
+                         b.num_rays, b.num_hits, b.mrays_binary, b.mrays_qbvh, b.mrays_packet4, b.mrays_packet8, b.num_mismatches );
+            ImGui::Text( "voxelize %u^3: solid %.2f ms (%u voxels), rays %.2f ms (%u voxels)",
+                         b.voxel_resolution, b.voxelize_ms_solid, b.num_voxels_solid, b.voxelize_ms_rays, b.num_voxels_rays );
+        }
+
+        if( ImGui::Button( "shape matching 10k bodies" ) )
+            physics::ShapeMatchingBenchmark( &_shape_matching_benchmark );
+
+        const physics::ShapeMatchingBenchmarkResult& sm = _shape_matching_benchmark;
+        if( sm.num_bodies )
+            ImGui::Text( "%u bodies (%u particles): create %.2f ms, pass %.2f ms, solve %.2f ms",
+                         sm.num_bodies, sm.num_particles, sm.create_ms, sm.pass_ms, sm.solve_ms );
+
+        if( ImGui::Button( "sdf dense / sparse" ) )
+            SDFBenchmark( &_sdf_benchmark );
+
+        const SDFBenchmarkResult& sd = _sdf_benchmark;
+        for( u32 i = 0; i < SDFBenchmarkResult::NUM_RESOLUTIONS && sd.resolution[i]; ++i )
+            ImGui::Text( "%u^3: dense %.1f ms %.1f MB, sparse %.1f ms %.1f MB (%u/%u bricks), band error %.3f",
+                         sd.resolution[i], sd.dense_ms[i], sd.dense_bytes[i] / ( 1024.0 * 1024.0 ), sd.sparse_ms[i], sd.sparse_bytes[i] / ( 1024.0 * 1024.0 ),
+                         sd.num_allocated_bricks[i], sd.num_bricks[i], sd.max_band_error[i] );
+
+        if( ImGui::Button( "sdf marching cubes" ) )
+            SDFMeshBenchmark( &_sdf_mesh_benchmark );
+
+        const SDFMeshBenchmarkResult& mc = _sdf_mesh_benchmark;
+        for( u32 i = 0; i < SDFMeshBenchmarkResult::NUM_RESOLUTIONS && mc.resolution[i]; ++i )
+            ImGui::Text( "%u^3: serial %.1f ms (%u tris), chunked %.1f ms (%u tris, %u chunks), incremental %.1f ms (%u chunks)",
+                         mc.resolution[i], mc.serial_ms[i], mc.serial_triangles[i], mc.chunked_ms[i], mc.chunked_triangles[i], mc.num_chunks[i],
+                         mc.incremental_ms[i], mc.num_remeshed_chunks[i] );
+    }
+    ImGui::End();
 }
 
 void LevelState::OnRender( const GameTime& time, rdi::CommandQueue* cmdq )
@@ -91,6 +213,7 @@ void LevelState::OnRender( const GameTime& time, rdi::CommandQueue* cmdq )
 
     gfx::Scene gfx_scene = _gfx_scene;
 
+    physics::UpdateBounds( _solver_gfx );
     _gfx->PrepareScene( cmdq, gfx_scene, *active_camera );
     
     const gfx::ShadowPass::LightMatrices& lightMatrices = _gfx->shadow_pass.GetMatrices();
@@ -162,7 +285,7 @@ void LevelState::_CreateTestLevel()
         //params.dynamic_friction = 0.8f;
         //physics::SetBodyParams( _solver, _rope[i], params );
 
-        physics::AddBody( _solver_gfx, _rope[i] );
+        physics::AddBody( _solver_gfx, _rope[i], true );
         physics::SetColor( _solver_gfx, _rope[i], 0x0000FFFF );
     }
 
@@ -180,8 +303,8 @@ void LevelState::_CreateTestLevel()
     physics::SetFriction( _solver, _soft1, physics::FrictionParams( 1.f, 0.8f ) );
     physics::SetRestitution( _solver, _soft1, 0.f );
 
-    physics::AddBody( _solver_gfx, _soft0 );
-    physics::AddBody( _solver_gfx, _soft1 );
+    physics::AddBody( _solver_gfx, _soft0, true );
+    physics::AddBody( _solver_gfx, _soft1, true );
     physics::SetColor( _solver_gfx, _soft0, 0xFFFF00FF );
     physics::SetColor( _solver_gfx, _soft1, 0xFFFF00FF );
 
@@ -201,7 +324,7 @@ void LevelState::_CreateTestLevel()
 
         physics::SetFriction( _solver, _rigid[i], physics::FrictionParams( 0.5f, 0.8f ) );
         physics::SetRestitution( _solver, _rigid[i], 0.f );
-        physics::AddBody( _solver_gfx, _rigid[i] );
+        physics::AddBody( _solver_gfx, _rigid[i], true );
         physics::SetColor( _solver_gfx, _rigid[i], 0x00FF00FF );
     }
 }
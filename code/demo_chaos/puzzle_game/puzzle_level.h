@@ -4,6 +4,12 @@
 #include "puzzle_player.h"
 #include "puzzle_physics.h"
 #include "puzzle_physics_gfx.h"
+#include "puzzle_physics_snapshot.h"
+#include "puzzle_physics_asset.h"
+#include "aabbtree.h"
+#include "sdf.h"
+
+#include <util\array.h>
 
 namespace bx { namespace puzzle{
 
@@ -38,6 +44,16 @@ public:
     physics::Solver*     _solver = nullptr;
     physics::Gfx*        _solver_gfx = nullptr;
     physics::GUIContext* _solver_gui = nullptr;
+    physics::SnapshotRing* _snapshots = nullptr;
+    u64 _frame = 0;
+    bool _snapshots_enabled = false; // pushes snapshot every frame, enabled from "Snapshots" window
+    bool _replaying = false;         // frame dropped by rewind is simulated with recorded input and time step
+    array_t<u8> _snapshot_data;      // input and player state pushed with snapshot
+    physics::DeepPenetrationTestResult _deep_penetration_test;
+    AABBTreeBenchmarkResult _aabb_tree_benchmark;
+    physics::ShapeMatchingBenchmarkResult _shape_matching_benchmark;
+    SDFBenchmarkResult _sdf_benchmark;
+    SDFMeshBenchmarkResult _sdf_mesh_benchmark;
     Player _player = {};
 
     // --- test scene data
@@ -1,11 +1,17 @@
 #include "puzzle_physics.h"
 #include "puzzle_physics_internal.h"
 #include "../spatial_hash_grid.h"
+#include "../time_step_controller.h"
+#include "../particle_zorder.h"
 
 #include <util/array.h>
-#include <util/id_table.h>
 #include <util/math.h>
+#include <util/random.h>
+#include <util/slot_map.h>
 #include <util/string_util.h>
+#include <util/time.h>
+#include <util/trace.h>
+#include <util/thread/parallel.h>
 
 #include <rdi/rdi_debug_draw.h>
 #include "puzzle_physics_pbd.h"
@@ -26,14 +32,34 @@ struct Body
 };
 inline bool IsValid( const Body& body ) { return body.count != 0; }
 
+// --- particle storage
+// Particles are allocated in pages. Body takes contiguous run of pages, so body data is still addressed
+// by body.begin. Freed runs go to free list (sorted, adjacent runs are merged) and are reused by next bodies.
+// Holes left by destroyed bodies are closed incrementally by moving bodies from the end of storage (see CompactParticles).
+struct PageRange
+{
+    u32 begin = 0;
+    u32 count = 0;
+};
+namespace EParticleStorage
+{
+    enum E : u32
+    {
+        PAGE_SIZE = 64,
+        COMPACTION_BUDGET = 8 * 1024, // max particles moved per Solve call
+    };
+}
+inline u32 PageCount( u32 numParticles ) { return ( numParticles + EParticleStorage::PAGE_SIZE - 1 ) / EParticleStorage::PAGE_SIZE; }
+
 // --- body id
+// the same layout as SlotHandle of body_slots (id is low bits of slot generation)
 union BodyIdInternal
 {
     u32 i;
     struct
     {
-        u32 id    : 16;
-        u32 index : 16;
+        u32 index : 20;
+        u32 id    : 12;
     };
 };
 static inline bool operator == ( const BodyIdInternal a, const BodyIdInternal b ) { return a.i == b.i; }
@@ -61,9 +87,10 @@ struct BodyName
 
 static inline BodyId         ToBodyId        ( BodyIdInternal idi ) { return{ idi.i }; }
 static inline BodyIdInternal ToBodyIdInternal( BodyId id )          { return{ id.i }; }
+static inline BodyIdInternal ToBodyIdInternal( SlotHandle h )      { return{ h.hash }; }
+static inline SlotHandle     ToSlotHandle    ( BodyIdInternal idi ) { SlotHandle h; h.hash = idi.i; return h; }
 
 
-using IdTable             = id_table_t< EConst::MAX_BODIES, BodyIdInternal >;
 using Vector3Array        = array_t<Vector3F>;
 using Vector4Array        = array_t<Vector4F>;
 using F32Array            = array_t<f32>;
@@ -72,6 +99,7 @@ using U16Array            = array_t<u16>;
 using U8Array             = array_t<u8>;
 
 using PhysicsBodyArray        = array_t<Body>;
+using PageRangeArray          = array_t<PageRange>;
 using BodyIdInternalArray     = array_t<BodyIdInternal>;
 using CollisionCArray         = array_t<PlaneCollisionC>;
 using ParticleCollisionCArray = array_t<ParticleCollisionC>;
@@ -79,6 +107,52 @@ using SDFCollisionCArray      = array_t<SDFCollisionC>;
 using DistanceCArray          = array_t<DistanceC>;
 using BendingCArray           = array_t<BendingC>;
 using ShapeMatchingCArray     = array_t<ShapeMatchingC>;
+using BodyArray               = array_t<Body>;
+using BodyCoMArray            = array_t<BodyCoM>;
+using BodyAABBArray           = array_t<BodyAABB>;
+using BodyNameArray           = array_t<BodyName>;
+
+// staging buffer returned by Map* for reordered body
+namespace EMapStream
+{
+    enum E : u32
+    {
+        INTERPOLATED_POSITION = 0, // read only
+        POSITION,
+        VELOCITY,
+        MASS_INV,
+        COUNT,
+    };
+}
+struct MappedData
+{
+    void* ptr = nullptr;
+    BodyIdInternal idi = { 0 };
+    u32 stream = 0;
+};
+using MappedDataArray = array_t<MappedData>;
+struct StagingBuffers
+{
+    Vector4Array stream[EMapStream::COUNT];
+};
+
+// start of output of one hash grid range in CollisionCBuffers
+struct CollisionCRange
+{
+    u32 begin = 0; // first hash grid cell
+    u32 plane_offset = 0;
+    u32 particle_offset = 0;
+    u32 sdf_offset = 0;
+};
+using CollisionCRangeArray = array_t<CollisionCRange>;
+
+struct CollisionCBuffers
+{
+    CollisionCArray         plane_collision_c;
+    ParticleCollisionCArray particle_collision_c;
+    SDFCollisionCArray      sdf_collision_c;
+    CollisionCRangeArray    ranges;
+};
 
 
 // --- solver
@@ -93,23 +167,26 @@ struct Solver
     U16Array     body_index;
     Vector3Array contact_normal;
     F32Array     collision_r;
+    U32Array     particle_order; // body relative index of particle as seen outside of solver (creation order)
         
-    IdTable    id_tbl;
-    Body       bodies        [EConst::MAX_BODIES];
-    BodyCoM    body_com0     [EConst::MAX_BODIES];
-    BodyCoM    body_com1     [EConst::MAX_BODIES];
-    BodyCoM    body_comi     [EConst::MAX_BODIES];
-    BodyAABB   body_aabb     [EConst::MAX_BODIES];
-    Vector3F   body_ext_force[EConst::MAX_BODIES];
-    u8         body_flags    [EConst::MAX_BODIES];
-    BodyName   body_name     [EConst::MAX_BODIES];
+    // per body data is indexed by slot index of body id and grows with slot high water, see ReserveBodies
+    SlotAllocator body_slots;
+    u32           body_capacity = 0;
+    BodyArray     bodies;
+    BodyCoMArray  body_com0;
+    BodyCoMArray  body_com1;
+    BodyCoMArray  body_comi;
+    BodyAABBArray body_aabb;
+    Vector3Array  body_ext_force;
+    U8Array       body_flags;
+    BodyNameArray body_name;
 
     struct  
     {
-        f32 vdamping   [EConst::MAX_BODIES];
-        f32 sfriction  [EConst::MAX_BODIES];
-        f32 dfriction  [EConst::MAX_BODIES];
-        f32 restitution[EConst::MAX_BODIES];
+        F32Array vdamping;
+        F32Array sfriction;
+        F32Array dfriction;
+        F32Array restitution;
     } body_params;
 
     // constraints where points indices are absolute
@@ -117,23 +194,53 @@ struct Solver
     ParticleCollisionCArray particle_collision_c;
     SDFCollisionCArray      sdf_collision_c;
 
-    Vector4Array            sdf_normal[EConst::MAX_BODIES];
+    array_t<Vector4Array>   sdf_normal;
     // constraints where points indices are relative to body
-    DistanceCArray      distance_c            [EConst::MAX_BODIES];
-    ShapeMatchingCArray shape_matching_c      [EConst::MAX_BODIES];
-    f32                 distance_c_stiff      [EConst::MAX_BODIES] = {};
-    f32                 shape_matching_c_stiff[EConst::MAX_BODIES] = {};
+    array_t<DistanceCArray>      distance_c;
+    array_t<ShapeMatchingCArray> shape_matching_c;
+    F32Array                     distance_c_stiff;
+    F32Array                     shape_matching_c_stiff;
     
-    BodyIdInternal   active_bodies_idi[EConst::MAX_BODIES] = {};
-    u16              active_bodies_count = 0;
+    BodyIdInternalArray active_bodies_idi;
 
     BodyIdInternalArray _to_deallocate;
-
-    HashGridStatic _hash_grid;
-
+    PageRangeArray      _free_pages;
+    u32                 _num_pages = 0;
+
+    HashGridStatic    _hash_grid;
+
+    // Z-order reordering of particles within bodies, see ReorderParticles.
+    // Reordered body is mapped through staging buffers in creation order (see MapStream, Unmap)
+    u32 reorder_interval = 30; // Solve calls between reorders, 0 disables
+    u32 reorder_counter = 0;
+    u32 num_reordered_particles = 0;
+    U32Array          _reorder_order;
+    U32Array          _reorder_remap;
+    array_t<u64>      _reorder_keys;
+    Vector4Array      _reorder_scratch;
+    MappedDataArray   _mapped;
+    array_t<StagingBuffers> _staging; // per body, reused by every Map* of reordered body
+    CollisionCBuffers _collision_buffers[EConst::MAX_COLLISION_THREADS]; // per thread output of GenerateCollisionConstraints
+    U32Array          _collision_range_lookup; // grid range -> thread | range index << 8
+
+    // sleeping, see UpdateSleeping
+    U16Array    body_quiet_steps; // steps in a row with island velocity below threshold
+    f32         sleep_velocity = 0.1f;
+    u32         sleep_steps = 30;
+    SolverStats stats;
+
+    // per body scratch of SolveShapeMatchingConstraints and UpdateSleeping
+    U32Array _scratch_bodies;
+    U32Array _island_parent;
+    F32Array _island_max_vel_sq;
+    U16Array _island_min_quiet;
+    U32Array _island_num_awake;
+
+    // substep size is picked by time_step from frequency range and CFL condition
     u32 frequency = 60;
-    f32 delta_time = 1.f / frequency;
-    f32 delta_time_acc = 0.f;
+    f32 delta_time = 1.f / frequency;   // current substep
+    f32 max_speed = 0.f;                // max particle speed of awake dynamic bodies in last substep
+    TimeStepController time_step;
     f32 particle_radius = 0.1f;
 
     struct
@@ -152,15 +259,89 @@ namespace
 
 static void StartUp( Solver* solver )
 {
-    for( u32 i = 0; i < EConst::MAX_BODIES; ++i )
+    solver->body_slots.StartUp();
+}
+
+static void ShutDown( Solver* solver )
+{
+    array::clear( solver->_mapped );
+
+    // nested arrays are constructed by ReserveBodies
+    for( u32 i = 0; i < solver->body_capacity; ++i )
     {
-        solver->body_ext_force[i] = Vector3F( 0.f );
+        solver->sdf_normal[i].~Vector4Array();
+        solver->distance_c[i].~DistanceCArray();
+        solver->shape_matching_c[i].~ShapeMatchingCArray();
+        solver->_staging[i].~StagingBuffers();
     }
+    solver->body_capacity = 0;
+    solver->body_slots.ShutDown();
 }
 
-static void ShutDown( Solver* solver )
+static void ResetBodyData( Solver* solver, u32 index )
 {
-    
+    solver->bodies                 [index] = {};
+    solver->body_com0              [index] = {};
+    solver->body_com1              [index] = {};
+    solver->body_comi              [index] = {};
+    solver->body_aabb              [index] = {};
+    solver->body_ext_force         [index] = Vector3F(0.f);
+    solver->body_flags             [index] = 0;
+    solver->body_quiet_steps       [index] = 0;
+    solver->body_name              [index].str[0] = 0;
+    solver->body_params.vdamping   [index] = 0.f;
+    solver->body_params.sfriction  [index] = 0.f;
+    solver->body_params.dfriction  [index] = 0.f;
+    solver->body_params.restitution[index] = 0.f;
+
+    array::clear( solver->sdf_normal[index] );
+    // constraints where points indices are relative to body
+    array::clear( solver->distance_c            [index] );
+    array::clear( solver->shape_matching_c      [index] );
+    solver->distance_c_stiff      [index] = 0.f;
+    solver->shape_matching_c_stiff[index] = 0.f;
+}
+
+// per body arrays have body_capacity entries, all initialized. Capacity is doubled, so arrays are reallocated rarely
+static void ReserveBodies( Solver* solver, u32 count )
+{
+    if( count <= solver->body_capacity )
+        return;
+
+    const u32 old_capacity = solver->body_capacity;
+    const u32 capacity = maxOfPair( count, maxOfPair( old_capacity * 2, 64u ) );
+
+    array::resize( solver->bodies, capacity );
+    array::resize( solver->body_com0, capacity );
+    array::resize( solver->body_com1, capacity );
+    array::resize( solver->body_comi, capacity );
+    array::resize( solver->body_aabb, capacity );
+    array::resize( solver->body_ext_force, capacity );
+    array::resize( solver->body_flags, capacity );
+    array::resize( solver->body_name, capacity );
+    array::resize( solver->body_params.vdamping, capacity );
+    array::resize( solver->body_params.sfriction, capacity );
+    array::resize( solver->body_params.dfriction, capacity );
+    array::resize( solver->body_params.restitution, capacity );
+    array::resize( solver->sdf_normal, capacity );
+    array::resize( solver->distance_c, capacity );
+    array::resize( solver->shape_matching_c, capacity );
+    array::resize( solver->distance_c_stiff, capacity );
+    array::resize( solver->shape_matching_c_stiff, capacity );
+    array::resize( solver->_staging, capacity );
+    array::resize( solver->body_quiet_steps, capacity );
+    array::reserve( solver->active_bodies_idi, capacity );
+
+    // arrays are moved by memcpy on grow, only new entries are constructed
+    for( u32 i = old_capacity; i < capacity; ++i )
+    {
+        new( &solver->sdf_normal[i] ) Vector4Array();
+        new( &solver->distance_c[i] ) DistanceCArray();
+        new( &solver->shape_matching_c[i] ) ShapeMatchingCArray();
+        new( &solver->_staging[i] ) StagingBuffers();
+        ResetBodyData( solver, i );
+    }
+    solver->body_capacity = capacity;
 }
 static void ReserveParticles( Solver* solver, u32 count )
 {
@@ -173,43 +354,193 @@ static void ReserveParticles( Solver* solver, u32 count )
     array::reserve( solver->body_index, count );
     array::reserve( solver->collision_r, count );
     array::reserve( solver->contact_normal, count );
+    array::reserve( solver->particle_order, count );
+}
+static void ResizeParticles( Solver* solver, u32 count )
+{
+    array::resize( solver->x , count );
+    array::resize( solver->pp, count );
+    array::resize( solver->p0, count );
+    array::resize( solver->p1, count );
+    array::resize( solver->v , count );
+    array::resize( solver->w , count );
+    array::resize( solver->body_index, count );
+    array::resize( solver->collision_r, count );
+    array::resize( solver->contact_normal, count );
+    array::resize( solver->particle_order, count );
+}
 
+// Unused particles are parked far away, so they don't fill hash grid cells around live particles.
+// Their body_index is UINT16_MAX and they have zero mass inv.
+static const Vector3F PARTICLE_DEAD_POS = Vector3F( -1.0e6f );
+
+static void ResetParticles( Solver* solver, u32 begin, u32 count )
+{
+    const u32 end = begin + count;
+    for( u32 i = begin; i < end; ++i )
+    {
+        solver->x[i] = PARTICLE_DEAD_POS;
+        solver->pp[i] = PARTICLE_DEAD_POS;
+        solver->p0[i] = PARTICLE_DEAD_POS;
+        solver->p1[i] = PARTICLE_DEAD_POS;
+        solver->v[i] = Vector3F( 0.f );
+        solver->w[i] = 0.f;
+        solver->body_index[i] = UINT16_MAX;
+        solver->collision_r[i] = 1.f;
+        solver->contact_normal[i] = Vector3F( 0.f );
+        solver->particle_order[i] = 0;
+    }
+}
+static void CopyParticles( Solver* solver, u32 dst, u32 src, u32 count )
+{
+    memmove( solver->x.begin() + dst, solver->x.begin() + src, count * sizeof( Vector3F ) );
+    memmove( solver->pp.begin() + dst, solver->pp.begin() + src, count * sizeof( Vector3F ) );
+    memmove( solver->p0.begin() + dst, solver->p0.begin() + src, count * sizeof( Vector3F ) );
+    memmove( solver->p1.begin() + dst, solver->p1.begin() + src, count * sizeof( Vector3F ) );
+    memmove( solver->v.begin() + dst, solver->v.begin() + src, count * sizeof( Vector3F ) );
+    memmove( solver->w.begin() + dst, solver->w.begin() + src, count * sizeof( f32 ) );
+    memmove( solver->body_index.begin() + dst, solver->body_index.begin() + src, count * sizeof( u16 ) );
+    memmove( solver->collision_r.begin() + dst, solver->collision_r.begin() + src, count * sizeof( f32 ) );
+    memmove( solver->contact_normal.begin() + dst, solver->contact_normal.begin() + src, count * sizeof( Vector3F ) );
+    memmove( solver->particle_order.begin() + dst, solver->particle_order.begin() + src, count * sizeof( u32 ) );
+}
+
+static void FreePages( Solver* solver, PageRange range )
+{
+    PageRangeArray& free_pages = solver->_free_pages;
+
+    // keep list sorted and merge with neighbours
+    u32 pos = 0;
+    while( pos < free_pages.size && free_pages[pos].begin < range.begin )
+        ++pos;
+
+    array::push_back( free_pages, range );
+    for( u32 i = free_pages.size - 1; i > pos; --i )
+        free_pages[i] = free_pages[i - 1];
+    free_pages[pos] = range;
+
+    if( pos + 1 < free_pages.size && free_pages[pos].begin + free_pages[pos].count == free_pages[pos + 1].begin )
+    {
+        free_pages[pos].count += free_pages[pos + 1].count;
+        array::erase( free_pages, pos + 1 );
+    }
+    if( pos > 0 && free_pages[pos - 1].begin + free_pages[pos - 1].count == free_pages[pos].begin )
+    {
+        free_pages[pos - 1].count += free_pages[pos].count;
+        array::erase( free_pages, pos );
+    }
+
+    // free run at the end of storage shrinks it
+    const PageRange& last = array::back( free_pages );
+    if( last.begin + last.count == solver->_num_pages )
+    {
+        solver->_num_pages = last.begin;
+        array::pop_back( free_pages );
+        ResizeParticles( solver, solver->_num_pages * EParticleStorage::PAGE_SIZE );
+    }
+}
+
+// first fit in free list, storage grows when nothing fits
+static u32 AllocatePages( Solver* solver, u32 numPages )
+{
+    PageRangeArray& free_pages = solver->_free_pages;
+    for( u32 i = 0; i < free_pages.size; ++i )
+    {
+        PageRange& range = free_pages[i];
+        if( range.count < numPages )
+            continue;
+
+        const u32 page = range.begin;
+        range.begin += numPages;
+        range.count -= numPages;
+        if( range.count == 0 )
+            array::erase( free_pages, i );
+
+        return page;
+    }
+
+    const u32 page = solver->_num_pages;
+    const u32 old_size = solver->Size();
+    const u32 new_size = ( page + numPages ) * EParticleStorage::PAGE_SIZE;
+    if( new_size > solver->Capacity() )
+        ReserveParticles( solver, maxOfPair( new_size, solver->Capacity() * 2 ) );
+
+    ResizeParticles( solver, new_size );
+    ResetParticles( solver, old_size, new_size - old_size );
+    solver->_num_pages = page + numPages;
+    return page;
 }
 
 static Body AllocateBody( Solver* solver, u32 particleAmount )
 {
-    if( solver->Size() + particleAmount > solver->Capacity() )
+    if( particleAmount == 0 )
         return{};
 
+    const u32 page = AllocatePages( solver, PageCount( particleAmount ) );
+
     Body body;
-    body.begin = solver->Size();
+    body.begin = page * EParticleStorage::PAGE_SIZE;
     body.count = particleAmount;
 
-    for( u32 i = 0; i < particleAmount; ++i )
+    const u32 body_end = body.begin + body.count;
+    for( u32 i = body.begin; i < body_end; ++i )
     {
-        array::push_back( solver->x, Vector3F( 0.f ) );
-        array::push_back( solver->pp, Vector3F( 0.f ) );
-        array::push_back( solver->p0, Vector3F( 0.f ) );
-        array::push_back( solver->p1, Vector3F( 0.f ) );
-        array::push_back( solver->v, Vector3F( 0.f ) );
-        array::push_back( solver->w, 1.f );
-        array::push_back( solver->body_index, UINT16_MAX );
-        array::push_back( solver->collision_r, 1.f );
-        array::push_back( solver->contact_normal, Vector3F(0.f) );
+        solver->x[i] = Vector3F( 0.f );
+        solver->pp[i] = Vector3F( 0.f );
+        solver->p0[i] = Vector3F( 0.f );
+        solver->p1[i] = Vector3F( 0.f );
+        solver->v[i] = Vector3F( 0.f );
+        solver->w[i] = 1.f;
+        solver->body_index[i] = UINT16_MAX;
+        solver->collision_r[i] = 1.f;
+        solver->contact_normal[i] = Vector3F( 0.f );
+        solver->particle_order[i] = i - body.begin;
     }
     
     return body;
 }
 
+static void DeallocateBody( Solver* solver, const Body& body )
+{
+    const u32 num_pages = PageCount( body.count );
+    ResetParticles( solver, body.begin, num_pages * EParticleStorage::PAGE_SIZE );
+
+    PageRange range;
+    range.begin = body.begin / EParticleStorage::PAGE_SIZE;
+    range.count = num_pages;
+    FreePages( solver, range );
+}
+
 static inline bool IsValid( const Solver* solver, BodyIdInternal idi )
 {
-    return id_table::has( solver->id_tbl, idi );
+    return solver->body_slots.Alive( ToSlotHandle( idi ) );
 }
 static inline const Body& GetBody( const Solver* solver, BodyIdInternal idi )
 {
     SYS_ASSERT( IsValid( solver, idi ) );
     return solver->bodies[idi.index];
 }
+static inline bool IsSleeping( const Solver* solver, u32 index )
+{
+    return ( solver->body_flags[index] & EConst::BODY_SLEEPING ) != 0;
+}
+static void WakeBody( Solver* solver, u32 index )
+{
+    solver->body_flags[index] &= ~EConst::BODY_SLEEPING;
+    solver->body_quiet_steps[index] = 0;
+}
+static void SleepBody( Solver* solver, u32 index )
+{
+    solver->body_flags[index] |= EConst::BODY_SLEEPING;
+
+    const Body& body = solver->bodies[index];
+    const u32 body_end = body.begin + body.count;
+    for( u32 i = body.begin; i < body_end; ++i )
+    {
+        solver->v[i] = Vector3F( 0.f );
+        solver->p1[i] = solver->p0[i];
+    }
+}
 }//
 
 
@@ -237,6 +568,12 @@ void SetFrequency( Solver* solver, u32 freq )
     SYS_ASSERT( freq != 0 );
     solver->frequency = freq;
     solver->delta_time = (f32)( 1.0 / (double)freq );
+
+    // calm scene runs at frequency, fast particles get up to 4x more substeps
+    TimeStepParams& params = solver->time_step.params;
+    params.max_dt = solver->delta_time;
+    params.min_dt = solver->delta_time * 0.25f;
+    params.max_substeps = maxOfPair( 8u, (u32)( freq / 15 ) );
 }
 
 f32 GetFrequency( const Solver* solver )
@@ -247,6 +584,29 @@ float GetParticleRadius( const Solver* solver )
 {
     return solver->particle_radius;
 }
+void SetSleepParams( Solver* solver, float velocityThreshold, u32 numSteps )
+{
+    solver->sleep_velocity = velocityThreshold;
+    solver->sleep_steps = minOfPair( numSteps, (u32)UINT16_MAX - 1 );
+}
+void SetTimeStepParams( Solver* solver, float budgetMS, float cfl )
+{
+    solver->time_step.params.budget_ms = maxOfPair( budgetMS, 0.f );
+    solver->time_step.params.cfl = maxOfPair( cfl, FLT_EPSILON );
+}
+void SetReorderInterval( Solver* solver, u32 numSolveCalls )
+{
+    solver->reorder_interval = numSolveCalls;
+    solver->reorder_counter = 0;
+}
+
+SolverStats GetStats( const Solver* solver )
+{
+    SolverStats stats = solver->stats;
+    stats.time_step = solver->time_step.stats;
+    stats.num_reordered_particles = solver->num_reordered_particles;
+    return stats;
+}
 
 namespace
 {
@@ -257,9 +617,6 @@ void ArrayEraseRange( T* arr, Tsize& arrSize, u32 toEraseBegin, u32 toEraseCount
     const u32 to_erase_end = toEraseBegin + toEraseCount;
     SYS_ASSERT( to_erase_end <= arrSize );
 
-    if( to_erase_end == arrSize )
-        return;
-
     const u32 n = arrSize - to_erase_end;
 
     for( u32 i = 0; i < n; ++i )
@@ -277,67 +634,220 @@ static void RemoveBodyData( Solver* solver, BodyIdInternal idi )
     const u32 index = idi.index;
     const Body& body = GetBody( solver, idi );
     
+    // --- bodies resting on removed one have to fall (aabb is built from particle centers, so contact distance is added)
+    const Vector3F contact_ext( solver->particle_radius * 2.f );
+    const Vector3F aabb_min = solver->body_aabb[index].min - contact_ext;
+    const Vector3F aabb_max = solver->body_aabb[index].max + contact_ext;
+    for( u32 i = 0; i < solver->active_bodies_idi.size; ++i )
+    {
+        const u32 index1 = solver->active_bodies_idi[i].index;
+        if( index1 == index || !IsSleeping( solver, index1 ) )
+            continue;
+
+        const BodyAABB& aabb1 = solver->body_aabb[index1];
+        const bool overlap = aabb_min.x <= aabb1.max.x && aabb_max.x >= aabb1.min.x
+                          && aabb_min.y <= aabb1.max.y && aabb_max.y >= aabb1.min.y
+                          && aabb_min.z <= aabb1.max.z && aabb_max.z >= aabb1.min.z;
+        if( overlap )
+            WakeBody( solver, index1 );
+    }
+
     // --- remove particle data
-    ArrayEraseRange( solver->x.begin(), solver->x.size, body.begin, body.count ); // interpolated positions
-    ArrayEraseRange( solver->pp.begin(), solver->pp.size, body.begin, body.count );// prev positions (stored before each time step)
-    ArrayEraseRange( solver->p0.begin(), solver->p0.size, body.begin, body.count );
-    ArrayEraseRange( solver->p1.begin(), solver->p1.size, body.begin, body.count );
-    ArrayEraseRange( solver->v.begin(), solver->v.size, body.begin, body.count );
-    ArrayEraseRange( solver->w.begin(), solver->w.size, body.begin, body.count );
-    ArrayEraseRange( solver->body_index.begin(), solver->body_index.size, body.begin, body.count );
-    ArrayEraseRange( solver->contact_normal.begin(), solver->contact_normal.size, body.begin, body.count );
-    ArrayEraseRange( solver->collision_r.begin(), solver->collision_r.size, body.begin, body.count );
+    DeallocateBody( solver, body );
 
     // --- remove body data
-    for( u32 i = 0; i < solver->active_bodies_count; ++i )
+    ResetBodyData( solver, index );
+    solver->body_slots.Destroy( ToSlotHandle( idi ) );
+}
+// Moves bodies from the end of storage to the lowest hole they fit in, until budget is used.
+// Constraints use body relative indices, so only body.begin changes.
+static void CompactParticles( Solver* solver, u32 budget )
+{
+    while( solver->_free_pages.size )
     {
-        BodyIdInternal idi1 = solver->active_bodies_idi[i];
-        if( solver->bodies[idi1.index].begin > body.begin )
+        // body placed last in storage
+        u32 last_index = UINT32_MAX;
+        for( u32 i = 0; i < solver->active_bodies_idi.size; ++i )
         {
-            SYS_ASSERT( solver->bodies[idi1.index].begin >= body.count );
-            solver->bodies[idi1.index].begin -= body.count;
+            const u32 index = solver->active_bodies_idi[i].index;
+            if( last_index == UINT32_MAX || solver->bodies[index].begin > solver->bodies[last_index].begin )
+                last_index = index;
         }
-    }
-    
-    solver->bodies                 [index] = {};
-    solver->body_com0              [index] = {};
-    solver->body_com1              [index] = {};
-    solver->body_comi              [index] = {};
-    solver->body_aabb              [index] = {};
-    solver->body_ext_force         [index] = Vector3F(0.f);
-    solver->body_flags             [index] = 0;
-    solver->body_name              [index].str[0] = 0;
-    solver->body_params.vdamping   [index] = 0.f;
-    solver->body_params.sfriction  [index] = 0.f;
-    solver->body_params.dfriction  [index] = 0.f;
-    solver->body_params.restitution[index] = 0.f;
+        if( last_index == UINT32_MAX )
+            break;
 
-    array::clear( solver->sdf_normal[index] );
-    // constraints where points indices are relative to body
-    array::clear( solver->distance_c            [index] );
-    array::clear( solver->shape_matching_c      [index] );
-    solver->distance_c_stiff      [index] = 0.f;
-    solver->shape_matching_c_stiff[index] = 0.f;
+        Body& body = solver->bodies[last_index];
+        const u32 num_pages = PageCount( body.count );
+        const u32 body_page = body.begin / EParticleStorage::PAGE_SIZE;
+        if( body.count > budget )
+            break;
+
+        u32 dst_page = UINT32_MAX;
+        for( const PageRange& range : solver->_free_pages )
+        {
+            if( range.begin >= body_page )
+                break;
+            if( range.count >= num_pages )
+            {
+                dst_page = range.begin;
+                break;
+            }
+        }
+        if( dst_page == UINT32_MAX )
+            break;
+
+        const u32 dst_page_allocated = AllocatePages( solver, num_pages );
+        SYS_ASSERT( dst_page_allocated == dst_page );
 
-    id_table::destroy( solver->id_tbl, idi );
+        const Body old_body = body;
+        body.begin = dst_page * EParticleStorage::PAGE_SIZE;
+        CopyParticles( solver, body.begin, old_body.begin, body.count );
+        DeallocateBody( solver, old_body );
+
+        budget -= body.count;
+    }
 }
+
 static void GarbageCollector( Solver* solver )
 {
     for( BodyIdInternal idi : solver->_to_deallocate )
     {
-        for( u32 iactive = 0; iactive < solver->active_bodies_count; ++iactive )
+        for( u32 iactive = 0; iactive < solver->active_bodies_idi.size; ++iactive )
         {
             if( idi == solver->active_bodies_idi[iactive] )
             {
                 RemoveBodyData( solver, idi );
-                ArrayEraseRange( solver->active_bodies_idi, solver->active_bodies_count, iactive, 1 );
-                
-                //const u32 last_index = --solver->active_bodies_count;
-                solver->active_bodies_idi[solver->active_bodies_count].i = 0;
+                ArrayEraseRange( solver->active_bodies_idi.begin(), solver->active_bodies_idi.size, iactive, 1 );
                 break;
             }
         }
     }
+    array::clear( solver->_to_deallocate );
+
+    CompactParticles( solver, EParticleStorage::COMPACTION_BUDGET );
+}
+
+// --- particle order
+template< typename T >
+static void PermuteParticles( Solver* solver, array_t<T>& data, u32 begin, u32 count )
+{
+    const u32 scratch_size = ( count * sizeof( T ) + sizeof( Vector4F ) - 1 ) / sizeof( Vector4F );
+    if( solver->_reorder_scratch.size < scratch_size )
+        array::resize( solver->_reorder_scratch, scratch_size );
+
+    PermuteZOrder( data.begin() + begin, (T*)solver->_reorder_scratch.begin(), solver->_reorder_order.begin(), count );
+}
+
+// Sorts particles of body by Morton code of their cell, so collision detection and constraints
+// touch memory in spatial order. Body range doesn't change. Per particle data and constraints with
+// body relative indices are permuted, particle_order keeps creation order for Map* and Set* functions.
+static bool ReorderParticles( Solver* solver, u32 index )
+{
+    const Body& body = solver->bodies[index];
+    const float cell_size = solver->particle_radius * 2.f;
+    if( !ComputeZOrder( &solver->_reorder_order, &solver->_reorder_keys, solver->p0.begin() + body.begin, body.count, cell_size ) )
+        return false;
+
+    // body_index is the same for all particles of body
+    PermuteParticles( solver, solver->x             , body.begin, body.count );
+    PermuteParticles( solver, solver->pp            , body.begin, body.count );
+    PermuteParticles( solver, solver->p0            , body.begin, body.count );
+    PermuteParticles( solver, solver->p1            , body.begin, body.count );
+    PermuteParticles( solver, solver->v             , body.begin, body.count );
+    PermuteParticles( solver, solver->w             , body.begin, body.count );
+    PermuteParticles( solver, solver->contact_normal, body.begin, body.count );
+    PermuteParticles( solver, solver->collision_r   , body.begin, body.count );
+    PermuteParticles( solver, solver->particle_order, body.begin, body.count );
+
+    if( solver->shape_matching_c[index].size == body.count )
+        PermuteParticles( solver, solver->shape_matching_c[index], 0, body.count );
+    if( solver->sdf_normal[index].size == body.count )
+        PermuteParticles( solver, solver->sdf_normal[index], 0, body.count );
+
+    // old relative index -> new relative index
+    U32Array& remap = solver->_reorder_remap;
+    array::resize( remap, body.count );
+    for( u32 i = 0; i < body.count; ++i )
+        remap[solver->_reorder_order[i]] = i;
+
+    for( DistanceC& c : solver->distance_c[index] )
+    {
+        c.i0 = remap[c.i0];
+        c.i1 = remap[c.i1];
+    }
+
+    solver->body_flags[index] |= EConst::BODY_REORDERED;
+    return true;
+}
+
+static void ReorderParticles( Solver* solver )
+{
+    if( !solver->reorder_interval || ++solver->reorder_counter < solver->reorder_interval )
+        return;
+
+    // staging buffers are scattered back by index, so order can't change while anything is mapped
+    if( !array::empty( solver->_mapped ) )
+        return;
+
+    solver->reorder_counter = 0;
+    solver->num_reordered_particles = 0;
+    for( u32 i = 0; i < solver->active_bodies_idi.size; ++i )
+    {
+        const u32 index = solver->active_bodies_idi[i].index;
+        if( IsSleeping( solver, index ) )
+            continue;
+
+        // static body doesn't change its shape, so it's sorted once
+        if( ( solver->body_flags[index] & EConst::BODY_STATIC ) && ( solver->body_flags[index] & EConst::BODY_REORDERED ) )
+            continue;
+
+        if( ReorderParticles( solver, index ) )
+            solver->num_reordered_particles += solver->bodies[index].count;
+    }
+}
+
+// internal -> creation order
+template< typename T >
+static T* MapStream( Solver* solver, BodyIdInternal idi, array_t<T>& data, u32 stream )
+{
+    const Body& body = GetBody( solver, idi );
+    T* internal = data.begin() + body.begin;
+    if( !( solver->body_flags[idi.index] & EConst::BODY_REORDERED ) )
+        return internal;
+
+    // stream mapped more than once shares the buffer, it's filled only by first Map to keep not yet unmapped writes
+    bool is_mapped = false;
+    for( const MappedData& mapped : solver->_mapped )
+        is_mapped |= mapped.idi == idi && mapped.stream == stream;
+
+    Vector4Array& buffer = solver->_staging[idi.index].stream[stream];
+    if( !is_mapped )
+        array::resize( buffer, (int)( ( body.count * sizeof( T ) + sizeof( Vector4F ) - 1 ) / sizeof( Vector4F ) ) );
+
+    T* staging = (T*)buffer.begin();
+    if( !is_mapped )
+    {
+        const u32* order = solver->particle_order.begin() + body.begin;
+        for( u32 i = 0; i < body.count; ++i )
+            staging[order[i]] = internal[i];
+    }
+
+    MappedData mapped;
+    mapped.ptr = staging;
+    mapped.idi = idi;
+    mapped.stream = stream;
+    array::push_back( solver->_mapped, mapped );
+    return staging;
+}
+// creation order -> internal
+template< typename T >
+static void UnmapStream( Solver* solver, const Body& body, array_t<T>& data, const void* ptr )
+{
+    const T* staging = (const T*)ptr;
+    T* internal = data.begin() + body.begin;
+    const u32* order = solver->particle_order.begin() + body.begin;
+    for( u32 i = 0; i < body.count; ++i )
+        internal[i] = staging[order[i]];
 }
 
 static void PredictPositions( Solver* solver, const Body& body, f32 vdamping, const Vector3F& gravityAcc, const Vector3F& extForce, float deltaTime )
@@ -410,7 +920,7 @@ static void UpdateVelocities( Solver* solver, float deltaTime )
 static void WritePrevData( Solver* solver )
 {
     memcpy( solver->pp.begin(), solver->p0.begin(), solver->Size() * sizeof( Vector3F ) );
-    const u32 n_active = solver->active_bodies_count;
+    const u32 n_active = solver->active_bodies_idi.size;
     for( u32 i = 0; i < n_active; ++i )
     {
         const BodyIdInternal idi = solver->active_bodies_idi[i];
@@ -419,7 +929,7 @@ static void WritePrevData( Solver* solver )
 }
 static void InterpolatePositions( Solver* solver )
 {
-    const float t = solver->delta_time_acc / solver->delta_time;
+    const float t = minOfPair( solver->time_step.acc / solver->delta_time, 1.f );
 
     const u32 pbegin = 0;
     const u32 pend = solver->Size();
@@ -431,7 +941,7 @@ static void InterpolatePositions( Solver* solver )
         solver->x[i] = lerp( t, pp, p0 );
     }
 
-    const u32 n_active = solver->active_bodies_count;
+    const u32 n_active = solver->active_bodies_idi.size;
     for( u32 i = 0; i < n_active; ++i )
     {
         const BodyIdInternal idi = solver->active_bodies_idi[i];
@@ -446,7 +956,7 @@ static void InterpolatePositions( Solver* solver )
 }
 static void ComputeAABB( Solver* solver )
 {
-    const u32 n_active = solver->active_bodies_count;
+    const u32 n_active = solver->active_bodies_idi.size;
     for( u32 i = 0; i < n_active; ++i )
     {
         const BodyIdInternal idi = solver->active_bodies_idi[i];
@@ -463,121 +973,226 @@ static void ComputeAABB( Solver* solver )
         solver->body_aabb[idi.index] = aabb;
     }
 }
-static void GenerateCollisionConstraints( Solver* solver )
+// forward half of 3x3x3 neighbourhood. Each pair of neighbour cells is visited once,
+// pairs inside of the same cell are taken with ip0 < ip1 ordering
+static const i32 HALF_STENCIL[13][3] =
+{
+    {  1, 0, 0 },
+    { -1, 1, 0 }, {  0, 1, 0 }, {  1, 1, 0 },
+    { -1,-1, 1 }, {  0,-1, 1 }, {  1,-1, 1 },
+    { -1, 0, 1 }, {  0, 0, 1 }, {  1, 0, 1 },
+    { -1, 1, 1 }, {  0, 1, 1 }, {  1, 1, 1 },
+};
+
+static void GeneratePairConstraint( CollisionCBuffers* out, const Solver* solver, u32 ip0, u32 ip1 )
 {
-    const float pradius2 = solver->particle_radius*2.f;
-    const float pradius2_sqr = pradius2*pradius2;
+    const u32 body_i0 = solver->body_index[ip0];
+    const u32 body_i1 = solver->body_index[ip1];
+    const bool has_sdf0 = solver->sdf_normal[body_i0].size > 0;
+    const bool has_sdf1 = solver->sdf_normal[body_i1].size > 0;
 
-    const Vector3F* points = solver->p1.begin();
-    const u32 n = solver->p1.size;
-    const u32 hash_grid_size = n * 4;
+    if( has_sdf0 && has_sdf1 )
+    {
+        if( body_i0 == body_i1 )
+            return;
+
+        const Body& body0 = solver->bodies[body_i0];
+        const Body& body1 = solver->bodies[body_i1];
+        SYS_ASSERT( ip0 >= body0.begin );
+        SYS_ASSERT( ip1 >= body1.begin );
+
+        const u32 ip0_rel = ip0 - body0.begin;
+        const u32 ip1_rel = ip1 - body1.begin;
+
+        SYS_ASSERT( ip0_rel < solver->sdf_normal[body_i0].size );
+        SYS_ASSERT( ip1_rel < solver->sdf_normal[body_i1].size );
+
+        const Vector4F& sdf0 = solver->sdf_normal[body_i0][ip0_rel];
+        const Vector4F& sdf1 = solver->sdf_normal[body_i1][ip1_rel];
+
+        // normal of particle closer to its surface (smaller penetration), deeper one would push along its own body
+        SDFCollisionC c;
+        c.n = ( sdf0.w > sdf1.w ) ? sdf0.getXYZ() : -sdf1.getXYZ();
+        c.d = maxOfPair( sdf0.w, sdf1.w );
+        c.i0 = ip0;
+        c.i1 = ip1;
+        array::push_back( out->sdf_collision_c, c );
+    }
+    else
+    {
+        if( body_i0 == body_i1 && ( solver->body_flags[body_i0] & EConst::DISABLE_BODY_SELF_COLLISION ) )
+            return;
 
-    array::reserve( solver->plane_collision_c, n * 2 );
-    array::reserve( solver->particle_collision_c, n * 2 );
-    array::reserve( solver->sdf_collision_c, n * 2 );
-    array::clear( solver->plane_collision_c );
-    array::clear( solver->particle_collision_c );
-    array::clear( solver->sdf_collision_c );
+        ParticleCollisionC c;
+        c.i0 = ip0;
+        c.i1 = ip1;
+        array::push_back( out->particle_collision_c, c );
+    }
+}
 
-    Build( &solver->_hash_grid, nullptr, points, n, hash_grid_size, pradius2 );
+// Goes over particles in hash grid order (so neighbour lookups are coherent) and visits half of neighbour stencil.
+// Sleeping particles are not visited, so pairs with them are taken from awake side over the whole stencil.
+static void GenerateCollisionConstraints( CollisionCBuffers* out, const Solver* solver, u32 begin, u32 end, bool anySleeping )
+{
+    const HashGridStatic& grid = solver->_hash_grid;
+    const float pradius = solver->particle_radius;
+    const float pradius2 = pradius*2.f;
+    const float collision_threshold = pradius2*pradius2 - FLT_EPSILON;
+    const Vector4F ground_plane = makePlane( Vector3F::yAxis(), Vector3F( 0.f ) );
 
-    const float collision_threshold = pradius2_sqr - FLT_EPSILON;
-    const u32 n_active = solver->active_bodies_count;
-    for( u32 iactive = 0; iactive < n_active; ++iactive )
+    for( u32 igrid = begin; igrid < end; ++igrid )
     {
-        const BodyIdInternal idi = solver->active_bodies_idi[iactive];
-        const u32 i = idi.index;
+        const u32 ip0 = grid._data[igrid];
+        const u32 body_i0 = solver->body_index[ip0];
+        if( body_i0 == UINT16_MAX || IsSleeping( solver, body_i0 ) )
+            continue;
 
-        const Body& body = solver->bodies[i];
-        const u32 body_end = body.begin + body.count;
+        const float w0 = solver->w[ip0];
+        const Vector3F& p0 = solver->p1[ip0];
+        const i32x3 p0_grid = grid.ComputeGridPos( p0 );
+
+        auto Test = [out, solver, &grid, ip0, w0, &p0, collision_threshold]( u32 ip1, const i32x3& cell )
+        {
+            if( w0 + solver->w[ip1] < FLT_EPSILON )
+                return;
+
+            const Vector3F& p1 = solver->p1[ip1];
+            if( lengthSqr( p1 - p0 ) >= collision_threshold )
+                return;
 
-        for( u32 ip0 = body.begin; ip0 < body_end; ++ip0 )
+            // different cells can share hash bucket. Pair is accepted only from cell where ip1 really is,
+            // otherwise it would be generated twice
+            const i32x3 p1_grid = grid.ComputeGridPos( p1 );
+            if( p1_grid.x != cell.x || p1_grid.y != cell.y || p1_grid.z != cell.z )
+                return;
+
+            GeneratePairConstraint( out, solver, ip0, ip1 );
+        };
+
+        for( u32 ip1 : grid.Lookup( p0_grid ) )
+        {
+            const u32 body_i1 = solver->body_index[ip1];
+            if( body_i1 == UINT16_MAX || ( ip1 <= ip0 && !IsSleeping( solver, body_i1 ) ) )
+                continue;
+
+            Test( ip1, p0_grid );
+        }
+        for( u32 ioffset = 0; ioffset < 13; ++ioffset )
+        {
+            const i32* offset = HALF_STENCIL[ioffset];
+            const i32x3 cell( p0_grid.x + offset[0], p0_grid.y + offset[1], p0_grid.z + offset[2] );
+            for( u32 ip1 : grid.Lookup( cell ) )
+            {
+                if( solver->body_index[ip1] != UINT16_MAX )
+                    Test( ip1, cell );
+            }
+        }
+        if( anySleeping )
         {
-            const Vector3F& p0 = solver->p1[ip0];
-            const i32x3 p0_grid = solver->_hash_grid.ComputeGridPos( p0 );
-            for( i32 dz = -1; dz <= 1; ++dz )
+            for( u32 ioffset = 0; ioffset < 13; ++ioffset )
             {
-                for( i32 dy = -1; dy <= 1; ++dy )
+                const i32* offset = HALF_STENCIL[ioffset];
+                const i32x3 cell( p0_grid.x - offset[0], p0_grid.y - offset[1], p0_grid.z - offset[2] );
+                for( u32 ip1 : grid.Lookup( cell ) )
                 {
-                    for( i32 dx = -1; dx <= 1; ++dx )
-                    {
-                        const i32x3 lookup_pos_grid( p0_grid.x + dx, p0_grid.y + dy, p0_grid.z + dz );
-                        const HashGridStatic::Indices indices = solver->_hash_grid.Lookup( lookup_pos_grid );
-                        for( u32 ip1 : indices )
-                        {
-                            if( ip1 == ip0 )
-                                continue;
-
-                            const float w0 = solver->w[ip0];
-                            const float w1 = solver->w[ip1];
-                            const float wsum = w0 + w1;
-                            if( wsum < FLT_EPSILON )
-                                continue;
-                            
-                            const Vector3F& p1 = solver->p1[ip1];
-                            const Vector3F v = p1 - p0;
-                            const float len_sqr = lengthSqr( v );
-                            if( len_sqr >= collision_threshold )
-                                continue;
-
-                            const u32 body_i0 = solver->body_index[ip0];
-                            const u32 body_i1 = solver->body_index[ip1];
-                            const bool has_sdf0 = solver->sdf_normal[body_i0].size > 0;
-                            const bool has_sdf1 = solver->sdf_normal[body_i1].size > 0;
-
-                            if( has_sdf0 && has_sdf1 )
-                            {
-                                if( body_i0 != body_i1 )
-                                {
-                                    const Body& body0 = solver->bodies[body_i0];
-                                    const Body& body1 = solver->bodies[body_i1];
-                                    SYS_ASSERT( ip0 >= body0.begin );
-                                    SYS_ASSERT( ip1 >= body1.begin );
-
-                                    const u32 ip0_rel = ip0 - body0.begin;
-                                    const u32 ip1_rel = ip1 - body1.begin;
-
-                                    SYS_ASSERT( ip0_rel < solver->sdf_normal[body_i0].size );
-                                    SYS_ASSERT( ip1_rel < solver->sdf_normal[body_i1].size );
-
-                                    const Vector4F& sdf0 = solver->sdf_normal[body_i0][ip0_rel];
-                                    const Vector4F& sdf1 = solver->sdf_normal[body_i1][ip1_rel];
-
-                                    SDFCollisionC c;
-                                    c.n = ( sdf0.w < sdf1.w ) ? sdf0.getXYZ() : -sdf1.getXYZ();
-                                    c.d = minOfPair( sdf0.w, sdf1.w );
-                                    c.i0 = ip0;
-                                    c.i1 = ip1;
-                                    array::push_back( solver->sdf_collision_c, c );
-                                }
-
-                            }
-                            else
-                            {
-                                bool push_constraints = true;
-                                if( body_i0 == body_i1 )
-                                    push_constraints = (solver->body_flags[body_i0] & EConst::DISABLE_BODY_SELF_COLLISION) == 0;
-
-                                if( push_constraints )
-                                {
-                                    ParticleCollisionC c;
-                                    c.i0 = ip0;
-                                    c.i1 = ip1;
-                                    array::push_back( solver->particle_collision_c, c );
-                                }
-                            }
-                        }// ip1
-                    }// dx
-                }// dy
-            }// dz
-        
-            // --temp for testing
+                    const u32 body_i1 = solver->body_index[ip1];
+                    if( body_i1 != UINT16_MAX && IsSleeping( solver, body_i1 ) )
+                        Test( ip1, cell );
+                }
+            }
+        }
+
+        // ground contact only when particle is close enough to hit the plane during this step
+        if( dot( ground_plane, Vector4F( p0, 1.f ) ) < pradius2 )
+        {
             PlaneCollisionC c;
             c.i = ip0;
-            c.plane = makePlane( Vector3F::yAxis(), Vector3F( 0.f ) );
-            array::push_back( solver->plane_collision_c, c );
-        }// ip0
-    }// iactive
+            c.plane = ground_plane;
+            array::push_back( out->plane_collision_c, c );
+        }
+    }
+}
+
+template< typename T >
+static void AppendArray( array_t<T>& dst, const array_t<T>& src, u32 begin, u32 end )
+{
+    if( begin >= end )
+        return;
+
+    const u32 offset = dst.size;
+    array::resize( dst, offset + ( end - begin ) );
+    memcpy( dst.begin() + offset, src.begin() + begin, ( end - begin ) * sizeof( T ) );
+}
+
+static void GenerateCollisionConstraints( Solver* solver )
+{
+    const float pradius2 = solver->particle_radius*2.f;
+
+    const Vector3F* points = solver->p1.begin();
+    const u32 n = solver->p1.size;
+    const u32 hash_grid_size = n * 4;
+
+    Build( &solver->_hash_grid, nullptr, points, n, hash_grid_size, pradius2 );
+
+    const u32 num_threads = minOfPair( bxParallel::numThreads(), (u32)EConst::MAX_COLLISION_THREADS );
+    for( u32 i = 0; i < num_threads; ++i )
+    {
+        CollisionCBuffers& buffers = solver->_collision_buffers[i];
+        array::clear( buffers.plane_collision_c );
+        array::clear( buffers.particle_collision_c );
+        array::clear( buffers.sdf_collision_c );
+        array::clear( buffers.ranges );
+    }
+
+    bool any_sleeping = false;
+    for( u32 i = 0; i < solver->active_bodies_idi.size; ++i )
+        any_sleeping |= IsSleeping( solver, solver->active_bodies_idi[i].index );
+
+    // ranges of hash grid data are contiguous cell ranges, so each thread works on its own part of space
+    static const u32 GRAIN = 1024;
+    Solver* s = solver;
+    bxParallel::forRange( solver->_hash_grid._data.size, GRAIN, [s, num_threads, any_sleeping]( u32 begin, u32 end, u32 threadIndex )
+    {
+        SYS_ASSERT( threadIndex < num_threads );
+        CollisionCBuffers* out = &s->_collision_buffers[threadIndex];
+
+        CollisionCRange range;
+        range.begin = begin;
+        range.plane_offset = out->plane_collision_c.size;
+        range.particle_offset = out->particle_collision_c.size;
+        range.sdf_offset = out->sdf_collision_c.size;
+        array::push_back( out->ranges, range );
+
+        GenerateCollisionConstraints( out, s, begin, end, any_sleeping );
+    } );
+
+    // ranges are merged in grid order, so constraint order doesn't depend on which thread took which range (determinism)
+    const u32 num_ranges = ( solver->_hash_grid._data.size + GRAIN - 1 ) / GRAIN;
+    U32Array& lookup = solver->_collision_range_lookup;
+    array::resize( lookup, num_ranges );
+    for( u32 i = 0; i < num_threads; ++i )
+    {
+        const CollisionCRangeArray& ranges = solver->_collision_buffers[i].ranges;
+        for( u32 j = 0; j < ranges.size; ++j )
+            lookup[ranges[j].begin / GRAIN] = i | ( j << 8 );
+    }
+
+    array::clear( solver->plane_collision_c );
+    array::clear( solver->particle_collision_c );
+    array::clear( solver->sdf_collision_c );
+    for( u32 entry : lookup )
+    {
+        const CollisionCBuffers& buffers = solver->_collision_buffers[entry & 0xFF];
+        const u32 j = entry >> 8;
+        const CollisionCRange& range = buffers.ranges[j];
+        const bool last = j + 1 == buffers.ranges.size;
+        const u32 plane_end    = ( last ) ? buffers.plane_collision_c.size    : buffers.ranges[j + 1].plane_offset;
+        const u32 particle_end = ( last ) ? buffers.particle_collision_c.size : buffers.ranges[j + 1].particle_offset;
+        const u32 sdf_end      = ( last ) ? buffers.sdf_collision_c.size      : buffers.ranges[j + 1].sdf_offset;
+        AppendArray( solver->plane_collision_c   , buffers.plane_collision_c   , range.plane_offset   , plane_end );
+        AppendArray( solver->particle_collision_c, buffers.particle_collision_c, range.particle_offset, particle_end );
+        AppendArray( solver->sdf_collision_c     , buffers.sdf_collision_c     , range.sdf_offset     , sdf_end );
+    }
 }
 
 
@@ -608,7 +1223,7 @@ static inline void ComputeFriction( Vector3F frictionDpos[2], Solver* solver, u3
 static void SolveCollisionConstraints( Solver* solver )
 {
     {// clear collisions data
-        const u32 n = solver->active_bodies_count;
+        const u32 n = solver->active_bodies_idi.size;
         for( u32 i = 0; i < n; ++i )
         {
             const BodyIdInternal idi = solver->active_bodies_idi[i];
@@ -745,11 +1360,13 @@ static void SolveCollisionConstraints( Solver* solver )
 
 static void SolveDistanceConstraints( Solver* solver, float solverIterationsRcp )
 {
-    const u32 n_active = solver->active_bodies_count;
+    const u32 n_active = solver->active_bodies_idi.size;
     for( u32 iactive = 0; iactive < n_active; ++iactive )
     {
         const BodyIdInternal idi = solver->active_bodies_idi[iactive];
         const u32 i = idi.index;
+        if( IsSleeping( solver, i ) )
+            continue;
 
         const Body& body = solver->bodies[i];
         float stiffness = solver->distance_c_stiff[i];
@@ -777,42 +1394,201 @@ static void SolveDistanceConstraints( Solver* solver, float solverIterationsRcp
     }
 }
 
+static void SolveShapeMatchingConstraints( Solver* solver, u32 bodyIndex, float solverIterationsRcp )
+{
+    const u32 i = bodyIndex;
+    const ShapeMatchingCArray& shape_matching_c = solver->shape_matching_c[i];
+    const Body& body = solver->bodies[i];
+        
+    float stiffness = solver->shape_matching_c_stiff[i];
+    stiffness = 1.f - ::powf( 1.f - stiffness, solverIterationsRcp );
+        
+    Vector3F* pos = solver->p1.begin() + body.begin;
+    SYS_ASSERT( shape_matching_c.size == body.count );
+
+    // rotation from previous iteration (or previous step) is starting point for extraction
+    BodyCoM& com = solver->body_com1[i];
+    SoftBodyUpdatePose1( &com.rot, &com.pos, pos, shape_matching_c.begin(), body.count );
+
+    for( u32 j = 0; j < body.count; ++j )
+    {
+        Vector3F dpos;
+        SolveShapeMatchingC( &dpos, com.rot, com.pos, shape_matching_c[j].rest_pos, pos[j], stiffness );
+        pos[j] += dpos;
+    }
+}
 static void SolveShapeMatchingConstraints( Solver* solver, float solverIterationsRcp )
 {
-    const u32 n_active = solver->active_bodies_count;
+    // bodies don't share particles, so they can be solved in parallel
+    U32Array& bodies = solver->_scratch_bodies;
+    array::clear( bodies );
+
+    const u32 n_active = solver->active_bodies_idi.size;
     for( u32 iactive = 0; iactive < n_active; ++iactive )
     {
-        const BodyIdInternal idi = solver->active_bodies_idi[iactive];
-        const u32 i = idi.index;
-        const ShapeMatchingCArray& shape_matching_c = solver->shape_matching_c[i];
-        if( array::empty( shape_matching_c ) )
+        const u32 i = solver->active_bodies_idi[iactive].index;
+        if( !array::empty( solver->shape_matching_c[i] ) && !IsSleeping( solver, i ) )
+            array::push_back( bodies, i );
+    }
+
+    const u32 num_bodies = bodies.size;
+    const u32* pbodies = bodies.begin();
+    bxParallel::forRange( num_bodies, 4, [solver, pbodies, solverIterationsRcp]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+            SolveShapeMatchingConstraints( solver, pbodies[i], solverIterationsRcp );
+    } );
+}
+
+
+static u32 FindIsland( u32* parent, u32 i )
+{
+    while( parent[i] != i )
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Islands are bodies connected by contacts (union-find over collision constraints), static bodies don't connect them.
+// Island falls asleep when velocity of all its particles stays below threshold for sleep_steps.
+// Island with sleeping bodies is woken when awake body pushes them, so sleeping particles get velocity.
+static void UpdateSleeping( Solver* solver )
+{
+    array::resize( solver->_island_parent, solver->body_capacity );
+    array::resize( solver->_island_max_vel_sq, solver->body_capacity );
+    array::resize( solver->_island_min_quiet, solver->body_capacity );
+    array::resize( solver->_island_num_awake, solver->body_capacity );
+    u32* parent     = solver->_island_parent.begin();
+    f32* max_vel_sq = solver->_island_max_vel_sq.begin();
+    u16* min_quiet  = solver->_island_min_quiet.begin();
+    u32* num_awake  = solver->_island_num_awake.begin();
+
+    f32 max_speed_sq = 0.f;
+    const u32 n_active = solver->active_bodies_idi.size;
+    for( u32 i = 0; i < n_active; ++i )
+    {
+        const u32 index = solver->active_bodies_idi[i].index;
+        parent[index] = index;
+        max_vel_sq[index] = 0.f;
+        min_quiet[index] = UINT16_MAX;
+        num_awake[index] = 0;
+
+        if( IsSleeping( solver, index ) )
             continue;
 
-        const Body&     body = solver->bodies[i];
-        
-        float stiffness = solver->shape_matching_c_stiff[i];
-        stiffness = 1.f - ::powf( 1.f - stiffness, solverIterationsRcp );
-        
-        const Vector3F* pos = solver->p1.begin() + body.begin;
-        SYS_ASSERT( shape_matching_c.size == body.count );
+        // mass can be changed by user at any time, so static flag is refreshed for awake bodies only
+        const Body& body = solver->bodies[index];
+        const u32 body_end = body.begin + body.count;
+        f32 vel_sq = 0.f;
+        f32 w_max = 0.f;
+        for( u32 j = body.begin; j < body_end; ++j )
+        {
+            vel_sq = maxOfPair( vel_sq, lengthSqr( solver->v[j] ) );
+            w_max = maxOfPair( w_max, solver->w[j] );
+        }
+        max_vel_sq[index] = vel_sq;
+        if( w_max > 0.f )
+        {
+            solver->body_flags[index] &= ~EConst::BODY_STATIC;
+            max_speed_sq = maxOfPair( max_speed_sq, vel_sq );
+        }
+        else
+            solver->body_flags[index] |= EConst::BODY_STATIC;
+    }
 
-        BodyCoM& com = solver->body_com1[i];
-        SoftBodyUpdatePose1( &com.rot, &com.pos, pos, shape_matching_c.begin(), body.count );
+    auto Union = [solver, parent]( u32 ip0, u32 ip1 )
+    {
+        const u32 b0 = solver->body_index[ip0];
+        const u32 b1 = solver->body_index[ip1];
+        if( b0 == b1 || ( solver->body_flags[b0] & EConst::BODY_STATIC ) || ( solver->body_flags[b1] & EConst::BODY_STATIC ) )
+            return;
+
+        const u32 r0 = FindIsland( parent, b0 );
+        const u32 r1 = FindIsland( parent, b1 );
+        if( r0 != r1 )
+            parent[r1] = r0;
+    };
+    for( const ParticleCollisionC& c : solver->particle_collision_c )
+        Union( c.i0, c.i1 );
+    for( const SDFCollisionC& c : solver->sdf_collision_c )
+        Union( c.i0, c.i1 );
 
-        for( u32 i = 0; i < body.count; ++i )
+    for( u32 i = 0; i < n_active; ++i )
+    {
+        const u32 index = solver->active_bodies_idi[i].index;
+        if( IsSleeping( solver, index ) )
+            continue;
+
+        const u32 root = FindIsland( parent, index );
+        num_awake[root] += 1;
+        max_vel_sq[root] = maxOfPair( max_vel_sq[root], max_vel_sq[index] );
+    }
+
+    // sleeping bodies touched by awake island (they were skipped above)
+    for( u32 i = 0; i < n_active; ++i )
+    {
+        const u32 index = solver->active_bodies_idi[i].index;
+        const u32 root = FindIsland( parent, index );
+        if( !IsSleeping( solver, index ) || num_awake[root] == 0 )
+            continue;
+
+        const Body& body = solver->bodies[index];
+        const u32 body_end = body.begin + body.count;
+        for( u32 j = body.begin; j < body_end; ++j )
+            max_vel_sq[root] = maxOfPair( max_vel_sq[root], lengthSqr( solver->v[j] ) );
+    }
+
+    const f32 threshold_sq = solver->sleep_velocity * solver->sleep_velocity;
+    for( u32 i = 0; i < n_active; ++i )
+    {
+        const u32 index = solver->active_bodies_idi[i].index;
+        if( IsSleeping( solver, index ) )
+            continue;
+
+        const u32 root = FindIsland( parent, index );
+        u16& quiet = solver->body_quiet_steps[index];
+        quiet = ( max_vel_sq[root] < threshold_sq ) ? minOfPair<u16>( quiet + 1, UINT16_MAX - 1 ) : 0;
+        min_quiet[root] = minOfPair( min_quiet[root], quiet );
+    }
+
+    solver->max_speed = sqrtf( max_speed_sq );
+
+    SolverStats& stats = solver->stats;
+    stats = {};
+    for( u32 i = 0; i < n_active; ++i )
+    {
+        const u32 index = solver->active_bodies_idi[i].index;
+        const u32 root = FindIsland( parent, index );
+        if( num_awake[root] )
         {
-            const u32 pindex = body.begin + i;
-            const Vector3F& p = solver->p1[pindex];
-            const ShapeMatchingC& c = shape_matching_c[i];
+            if( max_vel_sq[root] >= threshold_sq )
+            {
+                if( IsSleeping( solver, index ) )
+                    WakeBody( solver, index );
+            }
+            else if( min_quiet[root] >= solver->sleep_steps && !IsSleeping( solver, index ) )
+            {
+                SleepBody( solver, index );
+            }
+            stats.num_islands += ( root == index ) ? 1 : 0;
+        }
 
-            Vector3F dpos;
-            SolveShapeMatchingC( &dpos, com.rot, com.pos, c.rest_pos, p, stiffness );
-            solver->p1[pindex] += dpos;
+        const u32 count = solver->bodies[index].count;
+        if( IsSleeping( solver, index ) )
+        {
+            stats.num_sleeping_bodies += 1;
+            stats.num_sleeping_particles += count;
+        }
+        else
+        {
+            stats.num_awake_bodies += 1;
+            stats.num_awake_particles += count;
         }
     }
 }
 
-
 static void SolveInternal( Solver* solver, u32 numIterations )
 {
     const float deltaTime = solver->delta_time;
@@ -822,15 +1598,21 @@ static void SolveInternal( Solver* solver, u32 numIterations )
 
     const Vector3F gravity_acc( 0.f, -9.82f, 0.f );
 
-    const u32 n_active = solver->active_bodies_count;
-    for( u32 i = 0; i < n_active; ++i )
+    const u32 n_active = solver->active_bodies_idi.size;
     {
-        const BodyIdInternal idi = solver->active_bodies_idi[i];
-        const Body& body = GetBody( solver, idi );
-        const f32 vdamping = solver->body_params.vdamping[idi.index];
-        const Vector3F& ext_force = solver->body_ext_force[idi.index];
+        BX_TRACE_SCOPE( "physics::PredictPositions" );
+        for( u32 i = 0; i < n_active; ++i )
+        {
+            const BodyIdInternal idi = solver->active_bodies_idi[i];
+            if( IsSleeping( solver, idi.index ) )
+                continue;
 
-        PredictPositions( solver, body, vdamping, gravity_acc, ext_force, deltaTime );
+            const Body& body = GetBody( solver, idi );
+            const f32 vdamping = solver->body_params.vdamping[idi.index];
+            const Vector3F& ext_force = solver->body_ext_force[idi.index];
+
+            PredictPositions( solver, body, vdamping, gravity_acc, ext_force, deltaTime );
+        }
     }
 
     for( u32 i = 0; i < n_active; ++i )
@@ -841,6 +1623,7 @@ static void SolveInternal( Solver* solver, u32 numIterations )
 
     // collision detection
     {
+        BX_TRACE_SCOPE( "physics::GenerateCollisionConstraints" );
         GenerateCollisionConstraints( solver );
     }
 
@@ -848,33 +1631,79 @@ static void SolveInternal( Solver* solver, u32 numIterations )
     const float num_iterations_rcp = 1.f / (float)numIterations;
     for( u32 sit = 0; sit < numIterations; ++sit )
     {
-        SolveDistanceConstraints( solver, num_iterations_rcp );
-        SolveShapeMatchingConstraints( solver, num_iterations_rcp );
-        SolveCollisionConstraints( solver );
+        {
+            BX_TRACE_SCOPE( "physics::SolveDistanceConstraints" );
+            SolveDistanceConstraints( solver, num_iterations_rcp );
+        }
+        {
+            BX_TRACE_SCOPE( "physics::SolveShapeMatchingConstraints" );
+            SolveShapeMatchingConstraints( solver, num_iterations_rcp );
+        }
+        {
+            BX_TRACE_SCOPE( "physics::SolveCollisionConstraints" );
+            SolveCollisionConstraints( solver );
+        }
     }
 
-    UpdateVelocities( solver, deltaTime );
+    {
+        BX_TRACE_SCOPE( "physics::UpdateVelocities" );
+        UpdateVelocities( solver, deltaTime );
+    }
+    {
+        BX_TRACE_SCOPE( "physics::UpdateSleeping" );
+        UpdateSleeping( solver );
+    }
 }
 
 }//
 
-void Solve( Solver* solver, u32 numIterations, float deltaTime )
+namespace
+{
+static void BeginSolve( Solver* solver )
 {
     GarbageCollector( solver );
-
-    //solver->delta_time = 0.001f;
-    solver->delta_time_acc += deltaTime;
-    solver->delta_time_acc = clamp( solver->delta_time_acc, 0.f, 0.5f );
-    while( solver->delta_time_acc >= solver->delta_time )
+    {
+        BX_TRACE_SCOPE( "physics::ReorderParticles" );
+        ReorderParticles( solver );
+    }
+}
+static void SolvePlan( Solver* solver, const TimeStepPlan& plan, u64 startUS )
+{
+    solver->delta_time = plan.dt;
+    for( u32 i = 0; i < plan.num_substeps; ++i )
     {
         WritePrevData( solver );
-        SolveInternal( solver, numIterations );
-        solver->delta_time_acc -= solver->delta_time;
+        SolveInternal( solver, plan.num_iterations );
     }
+    solver->time_step.End( plan, bxTime::us() - startUS );
 
     InterpolatePositions( solver );
     ComputeAABB( solver );
+    BX_TRACE_COUNTER( "physics::active_bodies", solver->active_bodies_idi.size );
+    BX_TRACE_COUNTER( "physics::awake_particles", solver->stats.num_awake_particles );
+    BX_TRACE_COUNTER( "physics::sleeping_particles", solver->stats.num_sleeping_particles );
+    BX_TRACE_COUNTER( "physics::substeps", plan.num_substeps );
+    BX_TRACE_COUNTER( "physics::iterations", plan.num_iterations );
+}
+}//
+
+void Solve( Solver* solver, u32 numIterations, float deltaTime )
+{
+    BX_TRACE_SCOPE( "physics::Solve" );
+    BeginSolve( solver );
+
+    const u64 start_us = bxTime::us();
+    const TimeStepPlan plan = solver->time_step.Begin( deltaTime, solver->max_speed, solver->particle_radius, numIterations );
+    SolvePlan( solver, plan, start_us );
+}
+
+void SolveReplay( Solver* solver, float deltaTime, const TimeStepPlan& plan )
+{
+    BX_TRACE_SCOPE( "physics::SolveReplay" );
+    BeginSolve( solver );
 
+    const u64 start_us = bxTime::us();
+    SolvePlan( solver, solver->time_step.BeginReplay( deltaTime, plan ), start_us );
 }
 
 namespace
@@ -885,7 +1714,11 @@ namespace
         if( !IsValid( body ) )
             return{ 0 };
         
-        BodyIdInternal idi = id_table::create( solver->id_tbl );
+        BodyIdInternal idi = ToBodyIdInternal( solver->body_slots.Create() );
+        ReserveBodies( solver, solver->body_slots.HighWater() );
+
+        // particle body_index is u16, UINT16_MAX marks dead particle
+        SYS_ASSERT( idi.index < UINT16_MAX );
         
         solver->bodies[idi.index] = body;
         for( u32 i = body.begin; i < body.begin + numParticles; ++i )
@@ -894,10 +1727,7 @@ namespace
         solver->body_ext_force[idi.index] = Vector3F( 0.f );
         solver->body_flags[idi.index] = 0;
 
-        const u32 index = solver->active_bodies_count++;
-        solver->active_bodies_idi[index] = idi;
-        
-
+        array::push_back( solver->active_bodies_idi, idi );
 
         return idi;
     }
@@ -926,20 +1756,19 @@ void DestroyBody( Solver* solver, BodyId id )
 {
     BodyIdInternal idi = ToBodyIdInternal( id );
 
-    if( !id_table::has( solver->id_tbl, idi ) )
+    if( !IsValid( solver, idi ) )
         return;
 
     const Body& body = GetBody( solver, idi );
     SYS_ASSERT( IsValid( body ) );
 
-    //id_table::destroy( solver->id_tbl, idi );
     array::push_back( solver->_to_deallocate, idi );
 }
 
 bool IsBodyAlive( Solver * solver, BodyId id )
 {
     BodyIdInternal idi = ToBodyIdInternal( id );
-    return id_table::has( solver->id_tbl, idi );
+    return IsValid( solver, idi );
 }
 
 
@@ -974,13 +1803,25 @@ BodyAABB GetAABB( Solver * solver, BodyId id )
     return solver->body_aabb[idi.index];
 }
 
+bool IsSleeping( Solver* solver, BodyId id )
+{
+    PHYSICS_VALIDATE_ID( false );
+    return IsSleeping( solver, ToBodyIdInternal( id ).index );
+}
+
+void WakeUp( Solver* solver, BodyId id )
+{
+    PHYSICS_VALIDATE_ID_NO_RETURN;
+    WakeBody( solver, ToBodyIdInternal( id ).index );
+}
+
 u32 GetNbBodies( Solver* solver )
 {
-    return solver->active_bodies_count;
+    return solver->active_bodies_idi.size;
 }
 BodyId GetBodyId( Solver* solver, u32 index )
 {
-    if( index >= solver->active_bodies_count )
+    if( index >= solver->active_bodies_idi.size )
         return BodyIdInvalid();
     return ToBodyId( solver->active_bodies_idi[index] );
 }
@@ -1017,17 +1858,28 @@ void SetDistanceConstraints( Solver* solver, BodyId id, const DistanceCInfo* con
     DistanceCArray& outArray = solver->distance_c[idi.index];
     solver->distance_c_stiff[idi.index] = stiffness;
 
+    // indices are in creation order
+    const bool reordered = ( solver->body_flags[idi.index] & EConst::BODY_REORDERED ) != 0;
+    U32Array& remap = solver->_reorder_remap;
+    if( reordered )
+    {
+        array::resize( remap, body.count );
+        for( u32 i = 0; i < body.count; ++i )
+            remap[solver->particle_order[body.begin + i]] = i;
+    }
+
     for( u32 i = 0; i < numConstraints; ++i )
     {
         const DistanceCInfo& info = constraints[i];
 
-        const u32 relative_i0 = info.i0;
-        const u32 relative_i1 = info.i1;
-        const u32 absolute_i0 = body.begin + relative_i0;
-        const u32 absolute_i1 = body.begin + relative_i1;
+        const u32 absolute_i0 = body.begin + info.i0;
+        const u32 absolute_i1 = body.begin + info.i1;
 
         if( IsInRange( body, absolute_i0 ) && IsInRange( body, absolute_i1 ) )
         {
+            const u32 relative_i0 = ( reordered ) ? remap[info.i0] : info.i0;
+            const u32 relative_i1 = ( reordered ) ? remap[info.i1] : info.i1;
+
             DistanceC c;
             ComputeConstraint( &c, solver->p0.begin() + body.begin, relative_i0, relative_i1 );
             array::push_back( outArray, c );
@@ -1089,9 +1941,11 @@ void SetSDFData( Solver* solver, BodyId id, const Vector4F* sdfData, u32 count )
     array::clear( sdf_out_array );
     array::reserve( sdf_out_array, body.count );
 
+    // data is in creation order
+    const u32* order = solver->particle_order.begin() + body.begin;
     for( u32 i = 0; i < count; ++i )
     {
-        array::push_back( sdf_out_array, sdfData[i] );
+        array::push_back( sdf_out_array, sdfData[order[i]] );
     }
 }
 
@@ -1137,31 +1991,28 @@ u32 GetNbParticles( Solver* solver, BodyId id )
 Vector3F* MapInterpolatedPositions( Solver* solver, BodyId id )
 {
     PHYSICS_VALIDATE_ID( nullptr );
-    Body body = GetBody( solver, ToBodyIdInternal( id ) );
-    return solver->x.begin() + body.begin;
+    return MapStream( solver, ToBodyIdInternal( id ), solver->x, EMapStream::INTERPOLATED_POSITION );
 }
 
 Vector3F* MapPosition( Solver* solver, BodyId id )
 {
     PHYSICS_VALIDATE_ID( nullptr );
-    Body body = GetBody( solver, ToBodyIdInternal( id ) );
-    return solver->p0.begin() + body.begin;
+    WakeBody( solver, ToBodyIdInternal( id ).index );
+    return MapStream( solver, ToBodyIdInternal( id ), solver->p0, EMapStream::POSITION );
 }
 
 Vector3F* MapVelocity( Solver* solver, BodyId id )
 {
     PHYSICS_VALIDATE_ID( nullptr );
-
-    Body body = GetBody( solver, ToBodyIdInternal( id ) );
-    return solver->v.begin() + body.begin;
+    WakeBody( solver, ToBodyIdInternal( id ).index );
+    return MapStream( solver, ToBodyIdInternal( id ), solver->v, EMapStream::VELOCITY );
 }
 
 f32* MapMassInv( Solver* solver, BodyId id )
 {
     PHYSICS_VALIDATE_ID( nullptr );
-
-    Body body = GetBody( solver, ToBodyIdInternal( id ) );
-    return solver->w.begin() + body.begin;
+    WakeBody( solver, ToBodyIdInternal( id ).index );
+    return MapStream( solver, ToBodyIdInternal( id ), solver->w, EMapStream::MASS_INV );
 }
 
 Vector3F* MapRestPosition( Solver* solver, BodyId id )
@@ -1171,8 +2022,338 @@ Vector3F* MapRestPosition( Solver* solver, BodyId id )
 
 void Unmap( Solver* solver, void* ptr )
 {
-    ( void )solver;
-    // TODO: implement
+    // pointers to not reordered bodies point directly to solver data
+    for( u32 i = 0; i < solver->_mapped.size; ++i )
+    {
+        MappedData& mapped = solver->_mapped[i];
+        if( mapped.ptr != ptr )
+            continue;
+
+        if( IsValid( solver, mapped.idi ) )
+        {
+            const Body& body = GetBody( solver, mapped.idi );
+            switch( mapped.stream )
+            {
+            case EMapStream::POSITION: UnmapStream( solver, body, solver->p0, ptr ); break;
+            case EMapStream::VELOCITY: UnmapStream( solver, body, solver->v , ptr ); break;
+            case EMapStream::MASS_INV: UnmapStream( solver, body, solver->w , ptr ); break;
+            default: break;
+            }
+        }
+        array::erase_swap( solver->_mapped, i );
+        return;
+    }
+}
+
+void ShapeMatchingBenchmark( ShapeMatchingBenchmarkResult* result, u32 numBodies, u32 numPasses )
+{
+    result[0] = ShapeMatchingBenchmarkResult();
+    
+    Solver* solver = nullptr;
+    const f32 particle_radius = 0.05f;
+    CreateSolver( &solver, numBodies * 64, particle_radius );
+
+    bxRandomGen rnd( 0x5A9E );
+    u64 start_us = bxTime::us();
+    for( u32 b = 0; b < numBodies; ++b )
+    {
+        const u32 num_particles = 8 + rnd.get0n( 57 );
+        const BodyId id = CreateBody( solver, num_particles );
+        
+        const Vector3F offset( rnd.getf( -100.f, 100.f ), rnd.getf( -100.f, 100.f ), rnd.getf( -100.f, 100.f ) );
+        // first num_particles cells of 4x4x4 lattice, like voxelized body
+        Vector3F* pos = MapPosition( solver, id );
+        for( u32 i = 0; i < num_particles; ++i )
+            pos[i] = offset + Vector3F( (f32)( i % 4 ), (f32)( ( i / 4 ) % 4 ), (f32)( i / 16 ) ) * particle_radius * 2.f;
+        Unmap( solver, pos );
+
+        CalculateLocalPositions( solver, id, 1.f );
+        result->num_particles += num_particles;
+    }
+    result->create_ms = (f32)( ( bxTime::us() - start_us ) * 0.001 );
+    result->num_bodies = numBodies;
+
+    // rotated and jittered pose is the same for every pass, extraction is warm started from previous pass
+    Vector3Array deformed;
+    array::resize( deformed, solver->Size() );
+    for( u32 iactive = 0; iactive < solver->active_bodies_idi.size; ++iactive )
+    {
+        const Body& body = solver->bodies[solver->active_bodies_idi[iactive].index];
+        const QuatF rot = normalize( QuatF( rnd.getf( -1.f, 1.f ), rnd.getf( -1.f, 1.f ), rnd.getf( -1.f, 1.f ), 1.f ) );
+        const u32 body_end = body.begin + body.count;
+        Vector3F center( 0.f );
+        for( u32 i = body.begin; i < body_end; ++i )
+            center += solver->p0[i];
+        center /= (f32)body.count;
+
+        for( u32 i = body.begin; i < body_end; ++i )
+        {
+            const Vector3F jitter( rnd.getf( -0.01f, 0.01f ), rnd.getf( -0.01f, 0.01f ), rnd.getf( -0.01f, 0.01f ) );
+            deformed[i] = center + rotate( rot, solver->p0[i] - center ) + jitter;
+        }
+    }
+
+    u64 pass_us = 0;
+    for( u32 ipass = 0; ipass < numPasses; ++ipass )
+    {
+        memcpy( solver->p1.begin(), deformed.begin(), deformed.size * sizeof( Vector3F ) );
+        start_us = bxTime::us();
+        SolveShapeMatchingConstraints( solver, 1.f / 4.f );
+        pass_us += bxTime::us() - start_us;
+    }
+    result->pass_ms = (f32)( pass_us * 0.001 / maxOfPair( numPasses, 1u ) );
+
+    start_us = bxTime::us();
+    Solve( solver, 4, 1.f / 60.f );
+    result->solve_ms = (f32)( ( bxTime::us() - start_us ) * 0.001 );
+
+    DestroySolver( &solver );
+}
+
+// --- snapshot
+namespace
+{
+    // Snapshot is a sequence of raw sections, so it's valid only for the same build. Sections are padded to 4 bytes
+    // (padding is zeroed), so snapshots can be compared word by word.
+    static const u32 SNAPSHOT_TAG = 0x50414E53; // 'SNAP'
+    static const u32 SNAPSHOT_VERSION = 2;
+
+    struct SnapshotWriter
+    {
+        u8* data = nullptr;
+        u32 capacity = 0;
+        u32 size = 0;
+        u32 quantize_mask = UINT32_MAX; // applied to 32 bit words of quantized streams
+
+        // size is counted even when data doesn't fit, so writer without buffer measures snapshot
+        void Bytes( const void* src, u32 bytes )
+        {
+            const u32 padded = ( bytes + 3 ) & ~3;
+            if( size + padded <= capacity )
+            {
+                memcpy( data + size, src, bytes );
+                memset( data + size + bytes, 0, padded - bytes );
+            }
+            size += padded;
+        }
+        template< typename T > void Value( const T& value )            { Bytes( &value, sizeof( T ) ); }
+        template< typename T > void Fixed( const T* values, u32 count ) { Bytes( values, count * sizeof( T ) ); }
+        template< typename T > void Array( const array_t<T>& arr )
+        {
+            Value( arr.size );
+            Bytes( arr.begin(), arr.size * sizeof( T ) );
+        }
+        // particle stream, size is in header
+        template< typename T > void Stream( const array_t<T>& arr, bool quantized )
+        {
+            const u32 bytes = arr.size * sizeof( T );
+            if( !quantized || quantize_mask == UINT32_MAX || size + bytes > capacity )
+            {
+                Bytes( arr.begin(), bytes );
+                return;
+            }
+
+            SYS_ASSERT( sizeof( T ) % 4 == 0 );
+            const u32* src = (const u32*)arr.begin();
+            u32* dst = (u32*)( data + size );
+            for( u32 i = 0; i < bytes / 4; ++i )
+                dst[i] = src[i] & quantize_mask;
+            size += bytes;
+        }
+    };
+
+    struct SnapshotReader
+    {
+        const u8* data = nullptr;
+        u32 size = 0;
+        u32 offset = 0;
+        bool ok = true;
+
+        void Bytes( void* dst, u32 bytes )
+        {
+            const u32 padded = ( bytes + 3 ) & ~3;
+            ok &= offset + padded <= size;
+            if( !ok )
+                return;
+
+            memcpy( dst, data + offset, bytes );
+            offset += padded;
+        }
+        template< typename T > void Value( T& value )            { Bytes( &value, sizeof( T ) ); }
+        template< typename T > void Fixed( T* values, u32 count ) { Bytes( values, count * sizeof( T ) ); }
+        template< typename T > void Array( array_t<T>& arr )
+        {
+            u32 count = 0;
+            Value( count );
+            if( !ok )
+                return;
+
+            array::resize( arr, count );
+            Bytes( arr.begin(), count * sizeof( T ) );
+        }
+        template< typename T > void Stream( array_t<T>& arr, bool )
+        {
+            Bytes( arr.begin(), arr.size * sizeof( T ) );
+        }
+    };
+
+    // body slots go first, reader grows per body arrays to slot high water before they are read
+    static void SerializeBodySlots( SnapshotWriter& s, const Solver* solver )
+    {
+        U32Array state;
+        array::resize( state, solver->body_slots.StateSize() );
+        solver->body_slots.SaveState( state.begin() );
+        s.Array( state );
+    }
+    static void SerializeBodySlots( SnapshotReader& s, Solver* solver )
+    {
+        U32Array state;
+        s.Array( state );
+        s.ok = s.ok && solver->body_slots.LoadState( state.begin(), state.size );
+        if( !s.ok )
+            return;
+
+        ReserveBodies( solver, solver->body_slots.HighWater() );
+        for( u32 i = solver->body_slots.HighWater(); i < solver->body_capacity; ++i )
+            ResetBodyData( solver, i );
+    }
+
+    // the same function reads and writes, so section order can't diverge.
+    // Everything what survives between Solve calls is stored. Collision constraints and hash grid are rebuilt each substep.
+    template< typename TStream, typename TSolver >
+    static void SerializeSnapshot( TStream& s, TSolver* solver )
+    {
+        s.Stream( solver->x , true );
+        s.Stream( solver->pp, true );
+        s.Stream( solver->p0, true );
+        s.Stream( solver->p1, true );
+        s.Stream( solver->v , true );
+        s.Stream( solver->w , false );
+        s.Stream( solver->body_index, false );
+        s.Stream( solver->contact_normal, false );
+        s.Stream( solver->collision_r, false );
+        s.Stream( solver->particle_order, false );
+
+        SerializeBodySlots( s, solver );
+        const u32 num_bodies = solver->body_slots.HighWater();
+
+        s.Fixed( solver->bodies.begin()        , num_bodies );
+        s.Fixed( solver->body_com0.begin()     , num_bodies );
+        s.Fixed( solver->body_com1.begin()     , num_bodies );
+        s.Fixed( solver->body_comi.begin()     , num_bodies );
+        s.Fixed( solver->body_aabb.begin()     , num_bodies );
+        s.Fixed( solver->body_ext_force.begin(), num_bodies );
+        s.Fixed( solver->body_flags.begin()    , num_bodies );
+        s.Fixed( solver->body_name.begin()     , num_bodies );
+        s.Fixed( solver->body_params.vdamping.begin()   , num_bodies );
+        s.Fixed( solver->body_params.sfriction.begin()  , num_bodies );
+        s.Fixed( solver->body_params.dfriction.begin()  , num_bodies );
+        s.Fixed( solver->body_params.restitution.begin(), num_bodies );
+
+        for( u32 i = 0; i < num_bodies; ++i )
+        {
+            s.Array( solver->sdf_normal[i] );
+            s.Array( solver->distance_c[i] );
+            s.Array( solver->shape_matching_c[i] );
+        }
+        s.Fixed( solver->distance_c_stiff.begin(), num_bodies );
+        s.Fixed( solver->shape_matching_c_stiff.begin(), num_bodies );
+
+        s.Array( solver->active_bodies_idi );
+        s.Array( solver->_to_deallocate );
+        s.Array( solver->_free_pages );
+        s.Value( solver->_num_pages );
+
+        s.Fixed( solver->body_quiet_steps.begin(), num_bodies );
+        s.Value( solver->sleep_velocity );
+        s.Value( solver->sleep_steps );
+        s.Value( solver->frequency );
+        s.Value( solver->delta_time );
+        s.Value( solver->max_speed );
+        s.Value( solver->time_step );
+        s.Value( solver->particle_radius );
+        s.Value( solver->reorder_interval );
+        s.Value( solver->reorder_counter );
+    }
+
+    struct SnapshotHeader
+    {
+        u32 tag = SNAPSHOT_TAG;
+        u32 version = SNAPSHOT_VERSION;
+        u32 size = 0;
+        u32 num_particles = 0;
+    };
+}//
+
+u32 SaveSnapshot( const Solver* solver, void* buffer, u32 bufferSize, u32 quantizeBits )
+{
+    SnapshotWriter w;
+    w.data = (u8*)buffer;
+    w.capacity = ( buffer ) ? bufferSize : 0;
+    w.quantize_mask = UINT32_MAX << minOfPair( quantizeBits, 23u ); // mantissa bits only
+
+    SnapshotHeader header;
+    header.num_particles = solver->Size();
+    w.Value( header );
+    SerializeSnapshot( w, solver );
+
+    if( w.size <= w.capacity )
+    {
+        header.size = w.size;
+        memcpy( buffer, &header, sizeof( header ) );
+    }
+    return w.size;
+}
+
+bool RestoreSnapshot( Solver* solver, const void* buffer, u32 size )
+{
+    // staging buffers would be scattered to different state
+    SYS_ASSERT( array::empty( solver->_mapped ) );
+    if( !array::empty( solver->_mapped ) )
+        return false;
+
+    SnapshotReader r;
+    r.data = (const u8*)buffer;
+    r.size = size;
+
+    SnapshotHeader header;
+    r.Value( header );
+    if( !r.ok || header.tag != SNAPSHOT_TAG || header.version != SNAPSHOT_VERSION || header.size != size )
+        return false;
+
+    if( header.num_particles > solver->Capacity() )
+        ReserveParticles( solver, header.num_particles );
+    ResizeParticles( solver, header.num_particles );
+
+    SerializeSnapshot( r, solver );
+    SYS_ASSERT( r.ok && r.offset == size );
+    return r.ok;
+}
+
+u64 ComputeChecksum( const Solver* solver )
+{
+    // positions, velocities and masses define next step, divergence anywhere else shows up in them within a step
+    u64 hash = 0xCBF29CE484222325ULL;
+    auto L_add = [&hash]( f32 value )
+    {
+        u32 bits;
+        memcpy( &bits, &value, sizeof( bits ) );
+        hash = ( hash ^ bits ) * 0x100000001B3ULL;
+    };
+
+    const u32 n = solver->Size();
+    for( u32 i = 0; i < n; ++i )
+    {
+        const Vector3F& p = solver->p0[i];
+        const Vector3F& v = solver->v[i];
+        L_add( p.x ); L_add( p.y ); L_add( p.z );
+        L_add( v.x ); L_add( v.y ); L_add( v.z );
+        L_add( solver->w[i] );
+    }
+    for( u32 i = 0; i < solver->active_bodies_idi.size; ++i )
+        hash = ( hash ^ solver->body_flags[solver->active_bodies_idi[i].index] ) * 0x100000001B3ULL;
+
+    return hash;
 }
 
 //bool GetBodyParams( BodyParams* params, const Solver* solver, BodyId id )
@@ -1252,6 +2433,8 @@ void SetExternalForce( Solver* solver, BodyId id, const Vector3F& force )
     PHYSICS_VALIDATE_ID_NO_RETURN;
     const BodyIdInternal idi = ToBodyIdInternal( id );
     solver->body_ext_force[idi.index] = force;
+    if( lengthSqr( force ) > 0.f )
+        WakeBody( solver, idi.index );
 }
 
 void AddExternalForce( Solver* solver, BodyId id, const Vector3F& force )
@@ -1259,6 +2442,8 @@ void AddExternalForce( Solver* solver, BodyId id, const Vector3F& force )
     PHYSICS_VALIDATE_ID_NO_RETURN;
     const BodyIdInternal idi = ToBodyIdInternal( id );
     solver->body_ext_force[idi.index] += force;
+    if( lengthSqr( force ) > 0.f )
+        WakeBody( solver, idi.index );
 }
 
 void SetBodySelfCollisions( Solver* solver, BodyId id, bool value )
@@ -1340,13 +2525,23 @@ void DebugDraw( Solver* solver )
     if( ImGui::Begin( "Solver" ) )
     {
         ImGui::Checkbox( "Show axes", &solver->_debug.show_axes );
+        const SolverStats& stats = solver->stats;
+        ImGui::Text( "islands: %u", stats.num_islands );
+        ImGui::Text( "awake: %u bodies, %u particles", stats.num_awake_bodies, stats.num_awake_particles );
+        ImGui::Text( "sleeping: %u bodies, %u particles", stats.num_sleeping_bodies, stats.num_sleeping_particles );
+
+        const TimeStepStats& ts = solver->time_step.stats;
+        ImGui::Text( "substeps: %u x %u iterations, dt: %.2f ms", ts.num_substeps, ts.num_iterations, ts.dt * 1000.f );
+        ImGui::Text( "time: %.2f / %.2f ms, max speed: %.2f", ts.frame_ms, solver->time_step.params.budget_ms, solver->max_speed );
+        ImGui::Text( "dropped: %.3f s", ts.dropped_time );
+        ImGui::Text( "reordered: %u particles every %u steps", solver->num_reordered_particles, solver->reorder_interval );
     }
     ImGui::End();
 
 
     if( solver->_debug.show_axes )
     {
-        const u32 n = solver->active_bodies_count;
+        const u32 n = solver->active_bodies_idi.size;
         for( u32 i = 0; i < n; ++i )
         {
             const BodyIdInternal idi = solver->active_bodies_idi[i];
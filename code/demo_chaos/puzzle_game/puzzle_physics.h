@@ -4,6 +4,7 @@
 #include <util/bbox.h>
 
 #include "puzzle_physics_type.h"
+#include "../time_step_controller.h"
 
 namespace bx { namespace puzzle {
 
@@ -29,6 +30,17 @@ struct BodyCoM // center of mass
 };
 using BodyAABB = AABBF;
 
+struct SolverStats
+{
+    u32 num_islands = 0;            // islands with at least one awake body
+    u32 num_awake_bodies = 0;
+    u32 num_sleeping_bodies = 0;
+    u32 num_awake_particles = 0;
+    u32 num_sleeping_particles = 0;
+    u32 num_reordered_particles = 0; // in last reorder
+    TimeStepStats time_step;
+};
+
 
 struct DistanceCInfo
 {
@@ -42,13 +54,24 @@ struct ShapeMatchingCInfo
     f32 mass = 1.f;
 };
 
-// ---
+// --- maxParticles is initial capacity only, particle storage grows when needed
 void  CreateSolver     ( Solver** solver, u32 maxParticles, float particleRadius = 0.1f );
 void  DestroySolver    ( Solver** solver );
 void  SetFrequency     ( Solver* solver, u32 freq );
 f32   GetFrequency     ( const Solver* solver );
 float GetParticleRadius( const Solver* solver );
 void  Solve            ( Solver* solver, u32 numIterations, float deltaTime );
+// Solve with substeps and iterations recorded from original frame (GetStats().time_step after its Solve) instead of
+// cpu budget. Replay from snapshot with the same deltaTime and plan gives bit exact result
+void  SolveReplay      ( Solver* solver, float deltaTime, const TimeStepPlan& plan );
+// island goes to sleep when max particle velocity stays below threshold for numSteps solver steps
+void  SetSleepParams   ( Solver* solver, float velocityThreshold, u32 numSteps );
+// substeps and iterations are reduced to keep Solve within budgetMS. cfl is max particle travel per substep in radius units
+void  SetTimeStepParams( Solver* solver, float budgetMS, float cfl );
+// particles of awake bodies are sorted in Z-order every numSolveCalls calls to Solve, 0 disables.
+// Indices and data passed to and from solver stay in creation order
+void  SetReorderInterval( Solver* solver, u32 numSolveCalls );
+SolverStats GetStats   ( const Solver* solver );
 
 // --- 
 BodyId      CreateBody ( Solver* solver, u32 numParticles, const char* name = nullptr );
@@ -57,6 +80,8 @@ bool        IsBodyAlive( Solver* solver, BodyId id );
 void        SetName    ( Solver* solver, BodyId id, const char* name );
 const char* GetName    ( Solver* solver, BodyId id );
 BodyAABB    GetAABB    ( Solver* solver, BodyId id );
+bool        IsSleeping ( Solver* solver, BodyId id );
+void        WakeUp     ( Solver* solver, BodyId id );
 
 u32         GetNbBodies( Solver* solver );
 BodyId      GetBodyId  ( Solver* solver, u32 index );
@@ -66,7 +91,8 @@ void     SetDistanceConstraints ( Solver* solver, BodyId id, const DistanceCInfo
 void     CalculateLocalPositions( Solver* solver, BodyId id, float stiffness = 1.f );
 void     SetSDFData             ( Solver* solver, BodyId id, const Vector4F* sdfData, u32 count );
 
-// --- 
+// --- data is in creation order. Reordered body is mapped through staging buffer, so every Map has to be followed by Unmap
+// (writes are applied in Unmap) before next Solve
 u32       GetNbParticles          ( Solver* solver, BodyId id );
 Vector3F* MapInterpolatedPositions( Solver* solver, BodyId id );
 Vector3F* MapPosition             ( Solver* solver, BodyId id );
@@ -74,6 +100,29 @@ Vector3F* MapVelocity             ( Solver* solver, BodyId id );
 f32*      MapMassInv              ( Solver* solver, BodyId id );
 void      Unmap                   ( Solver* solver, void* ptr );
 
+// --- snapshot of complete solver state (particles, bodies, constraints, sleeping and time step state).
+// Restore gives bit exact continuation when snapshot is not quantized. Format is valid only for the same build.
+// Ids held outside of solver are not valid after restore when bodies were created or destroyed in between.
+// Returns snapshot size. Data is written only when it fits in bufferSize, so buffer can be null to query size.
+// quantizeBits low mantissa bits are dropped from particle positions and velocities (lossy, better delta compression)
+u32  SaveSnapshot   ( const Solver* solver, void* buffer, u32 bufferSize, u32 quantizeBits = 0 );
+// copies snapshot into solver. Nothing can be mapped. Returns false when data is not a snapshot of this build
+bool RestoreSnapshot( Solver* solver, const void* buffer, u32 size );
+// hash of simulated state for determinism checks
+u64  ComputeChecksum( const Solver* solver );
+
+// Headless benchmark of shape matching on numBodies rigid bodies of 8-64 particles in their own solver.
+// Bodies are spread up to 100 m from origin, then rotated and jittered away from rest shape before every pass.
+struct ShapeMatchingBenchmarkResult
+{
+    u32 num_bodies = 0;
+    u32 num_particles = 0;
+    f32 create_ms = 0.f; // CreateBody and CalculateLocalPositions of all bodies
+    f32 pass_ms = 0.f;   // one shape matching pass over all bodies (parallel), average of numPasses
+    f32 solve_ms = 0.f;  // one Solve call with 4 iterations, collisions included
+};
+void ShapeMatchingBenchmark( ShapeMatchingBenchmarkResult* result, u32 numBodies = 10000, u32 numPasses = 16 );
+
 
 //bool      GetBodyParams( BodyParams* params, const Solver* solver, BodyId id );
 //void      SetBodyParams( Solver* solver, BodyId id, const BodyParams& params );
@@ -0,0 +1,482 @@
+#include "puzzle_physics_asset.h"
+#include "sdf.h"
+#include "voxelize.h"
+
+#include <util/array.h>
+#include <util/bbox.h>
+#include <util/hash.h>
+#include <util/random.h>
+#include <util/memory.h>
+#include <util/debug.h>
+#include <resource_manager/resource_manager.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace bx{ namespace puzzle{
+namespace physics{
+
+static const char CACHE_DIR[] = "physics_cache";
+
+static AABBF ComputeAABB( const Vector3F* points, u32 numPoints )
+{
+    AABBF aabb = AABBF::prepare();
+    for( u32 i = 0; i < numPoints; ++i )
+        aabb = AABBF::extend( aabb, points[i] );
+    return aabb;
+}
+
+static inline u32 AlignOffset( u32 offset )
+{
+    return ( offset + 15 ) & ~15;
+}
+
+static void CacheFilename( char* dst, u32 dstSize, const BodyAssetKey& key )
+{
+    const u32 key_hash = murmur3_hash32( &key, sizeof( key ), 0xB0D1A55E );
+    snprintf( dst, dstSize, "%s/%016llx%08x.pbody", CACHE_DIR, (unsigned long long)key.mesh_hash, key_hash );
+}
+
+static bool IsValid( const BodyAsset* asset, size_t size, const BodyAssetKey& key )
+{
+    if( size < sizeof( BodyAsset ) )
+        return false;
+    if( asset->tag != BodyAsset::TAG || asset->version != BodyAsset::VERSION || asset->size != size )
+        return false;
+    if( memcmp( &asset->key, &key, sizeof( key ) ) != 0 )
+        return false;
+
+    const u64 rest_pos_end = (u64)asset->offset_rest_pos + (u64)asset->num_particles * sizeof( Vector3F );
+    const u64 sdf_end = (u64)asset->offset_sdf + (u64)asset->num_particles * sizeof( Vector4F );
+    const u64 distance_c_end = (u64)asset->offset_distance_c + (u64)asset->num_distance_c * sizeof( DistanceCInfo );
+    if( rest_pos_end > size || sdf_end > size || distance_c_end > size )
+        return false;
+
+    const DistanceCInfo* distance_c = asset->DistanceC();
+    for( u32 i = 0; i < asset->num_distance_c; ++i )
+    {
+        if( distance_c[i].i0 >= asset->num_particles || distance_c[i].i1 >= asset->num_particles )
+            return false;
+    }
+    return true;
+}
+
+// Narrow band SDF is clamped to +/- band, so particles deeper than band have no gradient (zero normal) and
+// wrong distance. They take them from neighbours closer to surface, one voxel layer at a time:
+// distance grows by neighbour offset (chamfer distance) and normal is average of neighbour normals.
+static void PropagateDeepSDF( Vector4F* sdfData, const u32* particleCell, u32 numParticles, const u32* cellParticle, int dim, float band, float voxelSize )
+{
+    array_t<u8>  resolved;
+    array_t<u32> pending;
+    array_t<u32> done;
+    array::resize( resolved, numParticles );
+
+    for( u32 i = 0; i < numParticles; ++i )
+    {
+        const Vector4F& sdf = sdfData[i];
+        const bool deep = sdf.w <= -band * 0.999f || lengthSqr( sdf.getXYZ() ) < FLT_EPSILON;
+        resolved[i] = ( deep ) ? 0 : 1;
+        if( deep )
+            array::push_back( pending, i );
+    }
+
+    while( pending.size )
+    {
+        array::clear( done );
+        u32 num_pending = 0;
+        for( u32 i : pending )
+        {
+            const int cell = (int)particleCell[i];
+            const int x = cell % dim;
+            const int y = ( cell / dim ) % dim;
+            const int z = cell / ( dim*dim );
+
+            Vector3F n_sum( 0.f );
+            Vector3F n_closest( 0.f );
+            float depth = FLT_MAX;
+            for( int k = maxOfPair( z - 1, 0 ); k <= minOfPair( z + 1, dim - 1 ); ++k )
+            {
+                for( int j = maxOfPair( y - 1, 0 ); j <= minOfPair( y + 1, dim - 1 ); ++j )
+                {
+                    for( int l = maxOfPair( x - 1, 0 ); l <= minOfPair( x + 1, dim - 1 ); ++l )
+                    {
+                        const u32 neighbour = cellParticle[k*dim*dim + j*dim + l];
+                        if( neighbour == UINT32_MAX || !resolved[neighbour] )
+                            continue;
+
+                        const Vector3F offset( (f32)( l - x ), (f32)( j - y ), (f32)( k - z ) );
+                        const float neighbour_depth = -sdfData[neighbour].w + length( offset ) * voxelSize;
+                        n_sum += sdfData[neighbour].getXYZ();
+                        if( neighbour_depth < depth )
+                        {
+                            depth = neighbour_depth;
+                            n_closest = sdfData[neighbour].getXYZ();
+                        }
+                    }
+                }
+            }
+
+            if( depth == FLT_MAX )
+            {
+                pending[num_pending++] = i;
+                continue;
+            }
+
+            // opposite normals cancel out in the middle of symmetric body
+            const Vector3F n = ( lengthSqr( n_sum ) > FLT_EPSILON ) ? normalizeSafeF( n_sum ) : n_closest;
+            sdfData[i] = Vector4F( n, -depth );
+            array::push_back( done, i );
+        }
+        array::resize( pending, num_pending );
+
+        // isolated deep particles (no band at all) keep zero normal
+        if( !done.size )
+            break;
+
+        // resolved after whole layer is processed, so result doesn't depend on particle order
+        for( u32 i : done )
+            resolved[i] = 1;
+    }
+}
+
+BodyAssetKey MakeBodyAssetKey( const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, const Vector3F& scale, float spacing, float jitter, EVoxelizeMode voxelizeMode )
+{
+    // x64 variant explicitly, so cache names don't depend on build platform
+    u64 hashes[4];
+    murmur3_128x64_hash( hashes + 0, srcPos, numPositions * sizeof( *srcPos ), 0 );
+    murmur3_128x64_hash( hashes + 2, srcIndices, numIndices * sizeof( *srcIndices ), 0 );
+
+    u64 mesh_hash[2];
+    murmur3_128x64_hash( mesh_hash, hashes, sizeof( hashes ), 0 );
+
+    BodyAssetKey key;
+    key.mesh_hash = mesh_hash[0];
+    key.num_positions = numPositions;
+    key.num_indices = numIndices;
+    key.scale[0] = scale.x;
+    key.scale[1] = scale.y;
+    key.scale[2] = scale.z;
+    key.spacing = spacing;
+    key.jitter = jitter;
+    key.voxelize_mode = (u32)voxelizeMode;
+    return key;
+}
+
+BodyAsset* BakeBodyAsset( const BodyAssetKey& key, const Vector3F* srcPos, const u32* srcIndices )
+{
+    bxRandomGen rnd( 0xDEADCEE1 );
+
+    const u32 numPositions = key.num_positions;
+    const u32 numIndices = key.num_indices;
+    const Vector3F scale( key.scale[0], key.scale[1], key.scale[2] );
+
+    array_t<Vector3F> positions;
+    array::resize( positions, numPositions );
+
+    // --- prepare positions
+    for( u32 i = 0; i < numPositions; ++i )
+        positions[i] = srcPos[i];
+
+    AABBF local_aabb         = ComputeAABB( positions.begin(), numPositions );
+    Vector3F local_aabb_size = AABBF::size( local_aabb );
+    float max_edge           = maxElem( local_aabb_size );
+
+    // put mesh at the origin and scale to specified size
+    const Matrix4F xform = Matrix4F::scale( scale * ( 1.f / max_edge ) );
+    for( u32 i = 0; i < numPositions; ++i )
+        positions[i] = ( xform * Point3F( positions[i] ) ).getXYZ();
+
+    // recompute bounds
+    local_aabb      = ComputeAABB( positions.begin(), numPositions );
+    local_aabb_size = AABBF::size( local_aabb );
+    max_edge        = maxElem( local_aabb_size );
+
+
+    // tweak spacing to avoid edge cases for particles laying on the boundary
+    // just covers the case where an edge is a whole multiple of the spacing.
+    const float spacing = key.spacing;
+    const float spacing_eps = spacing * ( 1.0f - 1e-4f );
+
+    // make sure to have at least one particle in each dimension
+    int dx, dy, dz;
+    dx = spacing > local_aabb_size.x ? 1 : int( local_aabb_size.x / spacing_eps );
+    dy = spacing > local_aabb_size.y ? 1 : int( local_aabb_size.y / spacing_eps );
+    dz = spacing > local_aabb_size.z ? 1 : int( local_aabb_size.z / spacing_eps );
+    int max_dim = maxOfPair( maxOfPair( dx, dy ), dz );
+
+    // used to arrange particle
+    const Vector3F spacing_fine = divPerElem( local_aabb_size, Vector3F( (f32)dx, (f32)dy, (f32)dz ) );
+
+    // expand border by two voxels to ensure adequate sampling at edges
+    local_aabb.min -= 2.0f*Vector3F( spacing );
+    local_aabb.max += 2.0f*Vector3F( spacing );
+    max_dim += 4;
+
+    const u32 max_dim_pow3 = max_dim*max_dim*max_dim;
+
+    VoxelGrid voxels;
+
+    // we shift the voxelization bounds so that the voxel centers
+    // lie symmetrically to the center of the object. this reduces the
+    // chance of missing features, and also better aligns the particles
+    // with the mesh
+    Vector3F meshOffset;
+    meshOffset.x = 0.5f * ( spacing - ( local_aabb_size.x - ( dx - 1 )*spacing ) );
+    meshOffset.y = 0.5f * ( spacing - ( local_aabb_size.y - ( dy - 1 )*spacing ) );
+    meshOffset.z = 0.5f * ( spacing - ( local_aabb_size.z - ( dz - 1 )*spacing ) );
+    local_aabb.min -= meshOffset;
+
+    // --- voxelize
+    Voxelize( &voxels,
+        (const float*)positions.begin(), numPositions, (const int*)srcIndices, numIndices,
+        max_dim, max_dim, max_dim, local_aabb.min, local_aabb.min + Vector3F( max_dim*spacing ),
+        (EVoxelizeMode)key.voxelize_mode
+        );
+    // ---
+
+    // --- make sdf
+    array_t<u32> indices;
+    array::resize( indices, max_dim_pow3 );
+
+    SparseSDF sdf;
+    MakeSDF( &sdf, voxels );
+    // ---
+
+    const u32 num_particles = CountVoxels( voxels );
+
+    array_t<Vector3F> rest_pos;
+    array_t<Vector4F> sdf_data;
+    array_t<u32>      particle_cell;
+    array::reserve( rest_pos, num_particles );
+    array::reserve( sdf_data, num_particles );
+    array::reserve( particle_cell, num_particles );
+
+    for( int x = 0; x < max_dim; ++x )
+    {
+        for( int y = 0; y < max_dim; ++y )
+        {
+            for( int z = 0; z < max_dim; ++z )
+            {
+                const int index = z*max_dim*max_dim + y*max_dim + x;
+                indices[index] = UINT32_MAX;
+                if( !voxels.Get( x, y, z ) )
+                    continue;
+
+                const Vector3F grid_pos = Vector3F( float( x ) + 0.5f, float( y ) + 0.5f, float( z ) + 0.5f );
+                const Vector3F jitter_pos = bxRand::unitVector( rnd ) * key.jitter;
+                const Vector3F pos_ls = local_aabb.min + mulPerElem( spacing_fine, grid_pos ) + jitter_pos;
+
+                // normalize the sdf value and transform to world scale
+                Vector3F sdf_grad;
+                SampleSDFGrad( &sdf_grad.x, sdf, x, y, z );
+                const Vector3F n = normalizeSafeF( sdf_grad );
+                const float d = SampleSDF( sdf, x, y, z ) * max_edge;
+
+                indices[index] = rest_pos.size;
+                array::push_back( rest_pos, pos_ls );
+                array::push_back( sdf_data, Vector4F( n, d ) );
+                array::push_back( particle_cell, (u32)index );
+            }
+        }
+    }
+    SYS_ASSERT( num_particles == rest_pos.size );
+
+    PropagateDeepSDF( sdf_data.begin(), particle_cell.begin(), num_particles, indices.begin(), max_dim, sdf.band * max_edge, max_edge / max_dim );
+
+    // construct cross link springs to occupied cells
+    array_t<DistanceCInfo> cinfo_array;
+    for( int x = 0; x < max_dim; ++x )
+    {
+        for( int y = 0; y < max_dim; ++y )
+        {
+            for( int z = 0; z < max_dim; ++z )
+            {
+                if( !voxels.Get( x, y, z ) )
+                    continue;
+
+                const int centerCell = z*max_dim*max_dim + y*max_dim + x;
+                const int width = 1;
+
+                // create springs to all the neighbors within the width
+                for( int i = x - width; i <= x + width; ++i )
+                {
+                    for( int j = y - width; j <= y + width; ++j )
+                    {
+                        for( int k = z - width; k <= z + width; ++k )
+                        {
+                            const int neighborCell = k*max_dim*max_dim + j*max_dim + i;
+                            const bool in_grid = i >= 0 && i < max_dim && j >= 0 && j < max_dim && k >= 0 && k < max_dim;
+
+                            if( in_grid && voxels.Get( i, j, k ) && neighborCell != centerCell )
+                            {
+                                DistanceCInfo cinfo;
+                                cinfo.i0 = indices[centerCell];
+                                cinfo.i1 = indices[neighborCell];
+                                array::push_back( cinfo_array, cinfo );
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // --- pack
+    u32 offset = AlignOffset( sizeof( BodyAsset ) );
+    const u32 offset_rest_pos = offset;
+    offset = AlignOffset( offset + num_particles * sizeof( Vector3F ) );
+    const u32 offset_sdf = offset;
+    offset = AlignOffset( offset + num_particles * sizeof( Vector4F ) );
+    const u32 offset_distance_c = offset;
+    offset = AlignOffset( offset + cinfo_array.size * sizeof( DistanceCInfo ) );
+
+    BodyAsset* asset = (BodyAsset*)BX_MALLOC( bxDefaultAllocator(), offset, 16 );
+    memset( asset, 0x00, offset );
+    asset->tag = BodyAsset::TAG;
+    asset->version = BodyAsset::VERSION;
+    asset->size = offset;
+    asset->key = key;
+    asset->num_particles = num_particles;
+    asset->num_distance_c = cinfo_array.size;
+    asset->offset_rest_pos = offset_rest_pos;
+    asset->offset_sdf = offset_sdf;
+    asset->offset_distance_c = offset_distance_c;
+    memcpy( (u8*)asset + offset_rest_pos, rest_pos.begin(), num_particles * sizeof( Vector3F ) );
+    memcpy( (u8*)asset + offset_sdf, sdf_data.begin(), num_particles * sizeof( Vector4F ) );
+    memcpy( (u8*)asset + offset_distance_c, cinfo_array.begin(), cinfo_array.size * sizeof( DistanceCInfo ) );
+
+    return asset;
+}
+
+const BodyAsset* LoadBodyAsset( const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, const Vector3F& scale, float spacing, float jitter, EVoxelizeMode voxelizeMode )
+{
+    const BodyAssetKey key = MakeBodyAssetKey( srcPos, numPositions, srcIndices, numIndices, scale, spacing, jitter, voxelizeMode );
+
+    char filename[64];
+    CacheFilename( filename, sizeof( filename ), key );
+
+    ResourceManager* resource_manager = GResourceManager();
+    const ResourceID resource_id = ResourceManager::createResourceID( filename );
+
+    // already loaded or baked by this session
+    if( const BodyAsset* asset = (const BodyAsset*)resource_manager->acquireResource( resource_id ) )
+        return asset;
+
+    const bxFS::Path abs_path = resource_manager->absolutePath( filename );
+    if( bxIO::fileExists( abs_path.name ) )
+    {
+        ResourceLoadResult result = resource_manager->loadResource( filename, EResourceFileType::BINARY );
+        if( result.ok() )
+        {
+            if( IsValid( (const BodyAsset*)result.ptr, result.size, key ) )
+                return (const BodyAsset*)result.ptr;
+
+            bxLogWarning( "physics: invalid body asset '%s', rebaking", filename );
+            resource_manager->unloadResource( &result.ptr );
+        }
+    }
+
+    BodyAsset* asset = BakeBodyAsset( key, srcPos, srcIndices );
+
+    const bxFS::Path abs_dir = resource_manager->absolutePath( CACHE_DIR );
+    bxIO::createDir( abs_dir.name );
+    if( bxIO::writeFile( abs_path.name, (unsigned char*)asset, asset->size ) != 0 )
+    {
+        bxLogWarning( "physics: can not write body asset '%s'", filename );
+    }
+
+    resource_manager->insertResource( resource_id, asset );
+    return asset;
+}
+
+void UnloadBodyAsset( const BodyAsset** asset )
+{
+    if( !asset[0] )
+        return;
+
+    GResourceManager()->unloadResource( (ResourcePtr*)asset );
+}
+
+BodyId CreateFromAsset( Solver* solver, const Matrix4F& pose, const BodyAsset* asset, float particleMass )
+{
+    const u32 num_particles = asset->num_particles;
+    BodyId id = CreateBody( solver, num_particles );
+
+    const f32 particle_mass_inv = ( particleMass > FLT_EPSILON ) ? 1.f / particleMass : 0.f;
+    Vector3F* body_pos = MapPosition( solver, id );
+    f32*      body_mass_inv = MapMassInv( solver, id );
+
+    const Vector3F* rest_pos = asset->RestPos();
+    for( u32 i = 0; i < num_particles; ++i )
+    {
+        body_pos[i] = ( pose * Point3F( rest_pos[i] ) ).getXYZ();
+        body_mass_inv[i] = particle_mass_inv;
+    }
+
+    if( asset->num_distance_c )
+    {
+        SetDistanceConstraints( solver, id, asset->DistanceC(), asset->num_distance_c, 1.f );
+    }
+
+    CalculateLocalPositions( solver, id );
+    SetSDFData( solver, id, asset->SDF(), num_particles );
+
+    Unmap( solver, body_mass_inv );
+    Unmap( solver, body_pos );
+
+    return id;
+}
+
+void DeepPenetrationTest( DeepPenetrationTestResult* result, float size, float overlap, u32 numFrames )
+{
+    const Vector3F cube_pos[8] =
+    {
+        Vector3F( -1.f, -1.f, -1.f ), Vector3F( 1.f, -1.f, -1.f ), Vector3F( 1.f, 1.f, -1.f ), Vector3F( -1.f, 1.f, -1.f ),
+        Vector3F( -1.f, -1.f,  1.f ), Vector3F( 1.f, -1.f,  1.f ), Vector3F( 1.f, 1.f,  1.f ), Vector3F( -1.f, 1.f,  1.f ),
+    };
+    const u32 cube_indices[36] =
+    {
+        0, 2, 1, 0, 3, 2, // -z
+        4, 5, 6, 4, 6, 7, // +z
+        0, 1, 5, 0, 5, 4, // -y
+        3, 6, 2, 3, 7, 6, // +y
+        0, 4, 7, 0, 7, 3, // -x
+        1, 2, 6, 1, 6, 5, // +x
+    };
+
+    const float particle_radius = 0.05f;
+    const BodyAssetKey key = MakeBodyAssetKey( cube_pos, 8, cube_indices, 36, Vector3F( size ), particle_radius * 1.5f, 0.f );
+    BodyAsset* asset = BakeBodyAsset( key, cube_pos, cube_indices );
+
+    result[0] = {};
+    result->num_particles = asset->num_particles;
+    const Vector4F* sdf = asset->SDF();
+    for( u32 i = 0; i < asset->num_particles; ++i )
+    {
+        if( lengthSqr( sdf[i].getXYZ() ) < FLT_EPSILON )
+            result->num_zero_normals += 1;
+    }
+
+    Solver* solver = nullptr;
+    CreateSolver( &solver, asset->num_particles * 2, particle_radius );
+    SetFrequency( solver, 60 );
+    SetSleepParams( solver, 0.f, UINT32_MAX );
+
+    const float offset = size * ( 1.f - overlap );
+    const BodyId body0 = CreateFromAsset( solver, Matrix4F::identity(), asset, 1.f );
+    const BodyId body1 = CreateFromAsset( solver, Matrix4F::translation( Vector3F( offset, 0.f, 0.f ) ), asset, 1.f );
+
+    // bodies fall together, so only horizontal distance is measured
+    result->initial_distance = offset;
+    for( u32 i = 0; i < numFrames; ++i )
+        Solve( solver, 4, 1.f / 60.f );
+    result->final_distance = GetBodyCoM( solver, body1 ).pos.x - GetBodyCoM( solver, body0 ).pos.x;
+
+    // particle layers overlap by one radius at rest
+    result->passed = result->num_zero_normals == 0 && result->final_distance > size - particle_radius * 2.f;
+
+    DestroySolver( &solver );
+    BX_FREE( bxDefaultAllocator(), asset );
+}
+
+}}}//
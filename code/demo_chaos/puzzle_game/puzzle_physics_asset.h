@@ -0,0 +1,71 @@
+#pragma once
+
+#include "puzzle_physics_type.h"
+#include "puzzle_physics.h"
+#include "voxelize.h"
+
+namespace bx{ namespace puzzle{
+namespace physics{
+
+// Particle body baked from triangle mesh (voxelize + sdf). Everything that depends on the mesh only is
+// stored here, so spawning a body is a copy into the solver.
+struct BodyAssetKey
+{
+    u64 mesh_hash = 0;      // positions and indices
+    u32 num_positions = 0;
+    u32 num_indices = 0;
+    f32 scale[3] = {};
+    f32 spacing = 0.f;      // particle radius * spacing factor
+    f32 jitter = 0.f;
+    u32 voxelize_mode = 0;  // EVoxelizeMode. SOLID is 0, so keys baked before the field existed stay valid
+};
+
+// Relocatable blob, all arrays are addressed by offsets from asset begin
+struct BodyAsset
+{
+    enum : u32
+    {
+        TAG = 0x30424450, // PDB0
+        VERSION = 5,
+    };
+
+    u32 tag;
+    u32 version;
+    u32 size;
+    BodyAssetKey key;
+    u32 num_particles;
+    u32 num_distance_c;
+    u32 offset_rest_pos;    // Vector3F, local space (pose is applied on spawn)
+    u32 offset_sdf;         // Vector4F, local normal and distance
+    u32 offset_distance_c;  // DistanceCInfo
+
+    const Vector3F*      RestPos()     const { return (const Vector3F*)( (const u8*)this + offset_rest_pos ); }
+    const Vector4F*      SDF()         const { return (const Vector4F*)( (const u8*)this + offset_sdf ); }
+    const DistanceCInfo* DistanceC()   const { return (const DistanceCInfo*)( (const u8*)this + offset_distance_c ); }
+};
+
+BodyAssetKey MakeBodyAssetKey( const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, const Vector3F& scale, float spacing, float jitter, EVoxelizeMode voxelizeMode = EVoxelizeMode::SOLID );
+
+// Bakes asset in memory. Returned asset has to be released with BX_FREE( bxDefaultAllocator(), ... )
+BodyAsset* BakeBodyAsset( const BodyAssetKey& key, const Vector3F* srcPos, const u32* srcIndices );
+
+// Looks for asset in ResourceManager, then in cache directory and bakes it (and writes to cache) on miss.
+const BodyAsset* LoadBodyAsset( const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, const Vector3F& scale, float spacing, float jitter, EVoxelizeMode voxelizeMode = EVoxelizeMode::SOLID );
+void             UnloadBodyAsset( const BodyAsset** asset );
+
+BodyId CreateFromAsset( Solver* solver, const Matrix4F& pose, const BodyAsset* asset, float particleMass );
+
+// Headless check of deep penetration. Two cubes of size 'size' are baked and spawned overlapping by
+// 'overlap' fraction of their size, then simulated in their own solver. Passes when every particle
+// has SDF normal and bodies are pushed apart.
+struct DeepPenetrationTestResult
+{
+    u32 num_particles = 0;    // per body
+    u32 num_zero_normals = 0;
+    f32 initial_distance = 0.f; // between centers of mass
+    f32 final_distance = 0.f;
+    bool passed = false;
+};
+void DeepPenetrationTest( DeepPenetrationTestResult* result, float size = 1.6f, float overlap = 0.75f, u32 numFrames = 120 );
+
+}}}//
@@ -5,6 +5,8 @@
 #include <resource_manager\resource_manager.h>
 #include <util/color.h>
 #include <util/camera.h>
+#include <util/vertex_pack.h>
+#include <util/array.h>
 
 namespace bx { namespace puzzle {
 namespace physics
@@ -27,17 +29,20 @@ struct GfxFrameData
 struct GfxMaterialData
 {
     Vector4F color;
+    Vector4F position_offset;
 };
 
 struct Gfx
 {
-    gfx::ActorID            id_scene  [EConst::MAX_BODIES] = {};
-    BodyId                  id_body   [EConst::MAX_BODIES] = {};
-    u32                     color     [EConst::MAX_BODIES] = {};
-    rdi::ResourceDescriptor gpu_rdesc [EConst::MAX_BODIES] = {};
-    rdi::BufferRO           gpu_buffer[EConst::MAX_BODIES] = {};
-    GfxDrawData             draw_data [EConst::MAX_BODIES] = {};
-    u32                     size = 0;
+    array_t<gfx::ActorID>            id_scene;
+    array_t<BodyId>                  id_body;
+    array_t<u32>                     color;
+    array_t<u8>                      half_pos;
+    array_t<Vector4F>                pos_offset;
+    array_t<rdi::ResourceDescriptor> gpu_rdesc;
+    array_t<rdi::BufferRO>           gpu_buffer;
+    array_t<GfxDrawData*>            draw_data; // scene callback keeps pointer, so entries are allocated separately
+    u32                              size = 0;
     
     gfx::Scene   scene  = nullptr;
     Solver*      solver = nullptr;
@@ -65,7 +70,7 @@ namespace GfxGpuResource
     static const rdi::ResourceBinding bindings_mdata[] =
     {
         rdi::ResourceBinding( "_particle_data", rdi::EBindingType::READ_ONLY ).Slot( SLOT_INSTANCE_PARTICLE_DATA ).StageMask( rdi::EStage::VERTEX_MASK ),
-        rdi::ResourceBinding( "MaterialData", rdi::EBindingType::UNIFORM ).Slot( SLOT_MATERIAL_DATA ).StageMask( rdi::EStage::PIXEL_MASK ),
+        rdi::ResourceBinding( "MaterialData", rdi::EBindingType::UNIFORM ).Slot( SLOT_MATERIAL_DATA ).StageMask( rdi::EStage::PIXEL_MASK|rdi::EStage::VERTEX_MASK ),
     };
     static const u32 bindings_mdata_count = sizeof( bindings_mdata ) / sizeof( *bindings_mdata );
 }//
@@ -117,6 +122,9 @@ static void ShutDown( Gfx* gfx )
         rdi::DestroyResourceDescriptor( &gfx->gpu_rdesc[i] );
         bxLogError( "Unreleased physics::Gfx entity!!" );
     }
+    for( GfxDrawData* ddata : gfx->draw_data )
+        BX_DELETE( bxDefaultAllocator(), ddata );
+    array::clear( gfx->draw_data );
 }
 
 static void DrawCallback( rdi::CommandQueue* cmdq, u32 flags, void* userData )
@@ -129,12 +137,13 @@ static void DrawCallback( rdi::CommandQueue* cmdq, u32 flags, void* userData )
     BodyId id = gfx->id_body[index];
     const u32 num_particles = GetNbParticles( solver, id );
     
+    GfxMaterialData mdata;
+    bxColor::u32ToFloat4( gfx->color[index], &mdata.color.mX );
+    mdata.position_offset = gfx->pos_offset[index];
+    rdi::context::UpdateCBuffer( cmdq, gfx->cbuffer_mdata, &mdata );
+
     if( flags & gfx::ESceneDrawFlag::COLOR )
     {
-        Vector4F color_4f;
-        bxColor::u32ToFloat4( gfx->color[index], &color_4f.mX );
-        rdi::context::UpdateCBuffer( cmdq, gfx->cbuffer_mdata, &color_4f );
-
         rdi::BindPipeline( cmdq, gfx->pipeline, false );
         rdi::BindResources( cmdq, gfx->rdesc_fdata );
     }
@@ -168,33 +177,38 @@ void DestroyGfx( Gfx** gfx )
     BX_DELETE0( bxDefaultAllocator(), gfx[0] );
 }
 
-static u32 AddInternal( Gfx* gfx, const char* name, u32 numParticles )
+static u32 AddInternal( Gfx* gfx, const char* name, u32 numParticles, bool halfPositions )
 {
-    SYS_ASSERT( gfx->size < EConst::MAX_BODIES );
-
     const u32 index = gfx->size++;
 
-    rdi::BufferRO gpu_buffer = rdi::device::CreateBufferRO( numParticles, rdi::Format( rdi::EDataType::FLOAT, 3 ), rdi::ECpuAccess::WRITE, rdi::EGpuAccess::READ );
-    gfx->gpu_buffer[index] = gpu_buffer;
+    // half positions are stored relative to body bounds center, which is updated with every upload
+    const rdi::Format format = ( halfPositions ) ? rdi::Format( rdi::EDataType::HALF, 4 ) : rdi::Format( rdi::EDataType::FLOAT, 3 );
+    rdi::BufferRO gpu_buffer = rdi::device::CreateBufferRO( numParticles, format, rdi::ECpuAccess::WRITE, rdi::EGpuAccess::READ );
+    array::push_back( gfx->gpu_buffer, gpu_buffer );
+    array::push_back( gfx->half_pos, (u8)( ( halfPositions ) ? 1 : 0 ) );
+    array::push_back( gfx->pos_offset, Vector4F( 0.f ) );
+    array::push_back( gfx->color, 0u );
+    array::push_back( gfx->id_body, BodyIdInvalid() );
 
     rdi::ResourceDescriptor rdesc = rdi::CreateResourceDescriptor( gfx->rlayout_mdata );
     rdi::SetResourceRO( rdesc, "_particle_data", &gpu_buffer );
     rdi::SetConstantBuffer( rdesc, "MaterialData", &gfx->cbuffer_mdata );
-    gfx->gpu_rdesc[index] = rdesc;
+    array::push_back( gfx->gpu_rdesc, rdesc );
 
 
-    GfxDrawData& ddata = gfx->draw_data[index];
-    ddata.gfx = gfx;
-    ddata.index = index;
+    GfxDrawData* ddata = BX_NEW( bxDefaultAllocator(), GfxDrawData );
+    ddata->gfx = gfx;
+    ddata->index = index;
+    array::push_back( gfx->draw_data, ddata );
 
     gfx::ActorID scene_id = gfx->scene->Add( name, 1 );
-    gfx->scene->SetSceneCallback( scene_id, DrawCallback, &ddata );
-    gfx->id_scene[index] = scene_id;
+    gfx->scene->SetSceneCallback( scene_id, DrawCallback, ddata );
+    array::push_back( gfx->id_scene, scene_id );
 
     return index;
 }
 
-u32 AddBody( Gfx* gfx, BodyId id )
+u32 AddBody( Gfx* gfx, BodyId id, bool halfPositions )
 {
     if( !IsBodyAlive( gfx->solver, id ) )
         return UINT32_MAX;
@@ -204,18 +218,18 @@ u32 AddBody( Gfx* gfx, BodyId id )
     char name[64];
     snprintf( name, 64, "PhysicsBody%u", gfx->size );
    
-    const u32 index = AddInternal( gfx, name, num_particles );
+    const u32 index = AddInternal( gfx, name, num_particles, halfPositions );
     gfx->id_body[index] = id;
 
     return index;
 }
 
-u32 AddActor( Gfx* gfx, u32 numParticles, u32 colorRGBA /*= 0xFFFFFFFF */ )
+u32 AddActor( Gfx* gfx, u32 numParticles, u32 colorRGBA /*= 0xFFFFFFFF */, bool halfPositions /*= false */ )
 {
     char name[64];
     snprintf( name, 64, "PhysicsBody%u", gfx->size );
 
-    const u32 index = AddInternal( gfx, name, numParticles );
+    const u32 index = AddInternal( gfx, name, numParticles, halfPositions );
     gfx->color[index] = colorRGBA;
 
     gfx->id_body[index].i = 0;
@@ -244,6 +258,34 @@ void SetColor( Gfx* gfx, BodyId id, u32 colorRGBA )
         gfx->color[index] = colorRGBA;
 }
 
+static void UploadPositions( Gfx* gfx, u32 index, u8* gpuMappedData, const Vector3F* pdata, u32 count )
+{
+    if( !gfx->half_pos[index] )
+    {
+        SYS_ASSERT( sizeof( *pdata ) == gfx->gpu_buffer[index].format.ByteWidth() );
+        memcpy( gpuMappedData, pdata, count * sizeof( *pdata ) );
+        return;
+    }
+
+    f32 bmin[3], bmax[3];
+    bxVertexPack_bounds( bmin, bmax, &pdata[0].x, sizeof( *pdata ), count );
+    const f32 center[3] = 
+    {
+        ( count ) ? ( bmin[0] + bmax[0] ) * 0.5f : 0.f,
+        ( count ) ? ( bmin[1] + bmax[1] ) * 0.5f : 0.f,
+        ( count ) ? ( bmin[2] + bmax[2] ) * 0.5f : 0.f,
+    };
+    bxVertexPack_positions( (u16*)gpuMappedData, &pdata[0].x, sizeof( *pdata ), count, center );
+    gfx->pos_offset[index] = Vector4F( center[0], center[1], center[2], 0.f );
+}
+
+static void SetSceneBounds( Gfx* gfx, u32 index, const Vector3F& bmin, const Vector3F& bmax )
+{
+    // actor matrix is identity, particles are drawn as points of particle radius
+    const Vector3 margin( GetParticleRadius( gfx->solver ) );
+    gfx->scene->SetLocalAABB( gfx->id_scene[index], bxAABB( toVector3( bmin ) - margin, toVector3( bmax ) + margin ) );
+}
+
 void SetParticleData( Gfx* gfx, rdi::CommandQueue* cmdq, u32 index, const Vector3F* pdata, u32 count )
 {
     if( index >= gfx->size )
@@ -256,12 +298,30 @@ void SetParticleData( Gfx* gfx, rdi::CommandQueue* cmdq, u32 index, const Vector
     const u32 gpu_buffer_size = rdi::util::GetNumElements( gpu_buffer );
     const u32 elements_to_copy = minOfPair( gpu_buffer_size, count );
     
-    SYS_ASSERT( sizeof( *pdata ) == gpu_buffer.format.ByteWidth() );
-    const u32 bytes_to_copy = elements_to_copy * gpu_buffer.format.ByteWidth();
-
     u8* gpu_mapped_data = rdi::context::Map( cmdq, gpu_buffer, 0, rdi::EMapType::WRITE );
-        memcpy( gpu_mapped_data, pdata, bytes_to_copy );
+        UploadPositions( gfx, index, gpu_mapped_data, pdata, elements_to_copy );
     rdi::context::Unmap( cmdq, gpu_buffer );
+
+    if( elements_to_copy )
+    {
+        f32 bmin[3], bmax[3];
+        bxVertexPack_bounds( bmin, bmax, &pdata[0].x, sizeof( *pdata ), elements_to_copy );
+        SetSceneBounds( gfx, index, Vector3F( bmin[0], bmin[1], bmin[2] ), Vector3F( bmax[0], bmax[1], bmax[2] ) );
+    }
+}
+
+void UpdateBounds( Gfx* gfx )
+{
+    Solver* solver = gfx->solver;
+    for( u32 i = 0; i < gfx->size; ++i )
+    {
+        BodyId body_id = gfx->id_body[i];
+        if( !IsBodyAlive( solver, body_id ) || !GetNbParticles( solver, body_id ) )
+            continue;
+
+        const BodyAABB aabb = GetAABB( solver, body_id );
+        SetSceneBounds( gfx, i, aabb.min, aabb.max );
+    }
 }
 
 void Tick( Gfx* gfx, rdi::CommandQueue* cmdq, const gfx::Camera& camera, const Matrix4& lightWorld, const Matrix4& lightProj )
@@ -299,7 +359,7 @@ void Tick( Gfx* gfx, rdi::CommandQueue* cmdq, const gfx::Camera& camera, const M
             Vector3F* particle_data = MapInterpolatedPositions( solver, body_id );
             u8* gpu_mapped_data = rdi::context::Map( cmdq, gpu_buffer, 0, rdi::EMapType::WRITE );
             
-            memcpy( gpu_mapped_data, particle_data, num_particles * sizeof( *particle_data ) );            
+            UploadPositions( gfx, i, gpu_mapped_data, particle_data, num_particles );
             
             rdi::context::Unmap( cmdq, gpu_buffer );
             Unmap( solver, particle_data );
@@ -12,14 +12,17 @@ namespace physics
 void CreateGfx( Gfx** gfx, Solver* solver, gfx::Scene scene );
 void DestroyGfx( Gfx** gfx );
 
-u32  AddBody( Gfx* gfx, BodyId id );
-u32  AddActor( Gfx* gfx, u32 numParticles, u32 colorRGBA = 0xFFFFFFFF );
+// halfPositions: particle positions are uploaded as half4 relative to body bounds center (8 bytes instead of 12)
+u32  AddBody( Gfx* gfx, BodyId id, bool halfPositions = false );
+u32  AddActor( Gfx* gfx, u32 numParticles, u32 colorRGBA = 0xFFFFFFFF, bool halfPositions = false );
 
 u32  FindBody( Gfx* gfx, BodyId id );
 void SetColor( Gfx* gfx, BodyId id, u32 colorRGBA );
 void SetColor( Gfx* gfx, u32 idnex, u32 colorRGBA );
 void SetParticleData( Gfx* gfx, rdi::CommandQueue* cmdq, u32 index, const Vector3F* pdata, u32 count );
 
+// pushes body bounds to scene actors, so they are culled correctly. Call after Solve, before scene is prepared for drawing
+void UpdateBounds( Gfx* gfx );
 void Tick( Gfx* gfx, rdi::CommandQueue* cmdq, const gfx::Camera& camera, const Matrix4& lightWorld, const Matrix4& lightProj );
 
 
@@ -7,12 +7,15 @@ namespace EConst
 {
     enum E
     {
-        MAX_BODIES = 64,
+        MAX_COLLISION_THREADS = 64, // calling thread + max bxParallel workers
     };
 
     enum F
     {
         DISABLE_BODY_SELF_COLLISION = 1 << 0,
+        BODY_SLEEPING = 1 << 1,
+        BODY_STATIC = 1 << 2, // all particles have zero mass inv, body doesn't connect islands
+        BODY_REORDERED = 1 << 3, // particles are not in creation order, see particle_order in Solver
     };
 }//
 }}}//
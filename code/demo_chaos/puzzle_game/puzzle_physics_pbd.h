@@ -2,6 +2,7 @@
 
 #include <util/vectormath/vectormath.h>
 #include <util/math.h>
+#include <xmmintrin.h>
 
 namespace bx{ namespace puzzle{ namespace physics
 {
@@ -92,9 +93,12 @@ static inline Vector3F ComputeFrictionDeltaPos( const Vector3F& tangent, const V
 //////////////////////////////////////////////////////////////////////////
 
 // --- http://matthias-mueller-fischer.ch/publications/stablePolarDecomp.pdf
-inline void extractRotation( QuatF &q, const Matrix3F &A, unsigned maxIter )
+// q is initial guess. Shape matching passes rotation from previous iteration, so usually only few iterations are needed.
+// Iterations stop when rotation correction angle drops below tolerance.
+inline u32 extractRotation( QuatF &q, const Matrix3F &A, unsigned maxIter, float tolerance = 1.0e-9f )
 {
-    for( unsigned int iter = 0; iter < maxIter; iter++ )
+    unsigned int iter = 0;
+    for( ; iter < maxIter; iter++ )
     {
         Matrix3F R( q );
         
@@ -109,7 +113,7 @@ inline void extractRotation( QuatF &q, const Matrix3F &A, unsigned maxIter )
 
         const Vector3F omega = ( a + b + c ) * demon;
         const float w = length( omega );
-        if( w < 1.0e-9 )
+        if( w < tolerance )
             break;
 
         q = QuatF::rotation( w, ( 1.0f / w ) * omega ) * q;
@@ -127,35 +131,150 @@ inline void extractRotation( QuatF &q, const Matrix3F &A, unsigned maxIter )
         q.normalize();
     #endif
     }
+    return iter;
 }
-inline void SoftBodyUpdatePose1( QuatF* rotation, Vector3F* centerOfMass, const Vector3F* pos, const ShapeMatchingC* shapeMatchingC, int nPoints )
+
+static inline float HorizontalSum( __m128 v )
 {
-    Vector3F com( 0.f );
-    f32 totalMass( 0.f );
-    for( int ipoint = 0; ipoint < nPoints; ++ipoint )
+    const __m128 t = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+    return _mm_cvtss_f32( _mm_add_ss( t, _mm_shuffle_ps( t, t, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ) );
+}
+
+// Loads 4 vectors and transposes them to SoA. Vector3F is packed (12 bytes) with MSVC and padded to 16 bytes with gcc.
+static inline void LoadTransposed4( __m128* x, __m128* y, __m128* z, const Vector3F* src )
+{
+    if( sizeof( Vector3F ) == 12 )
     {
-        const f32 mass = shapeMatchingC[ipoint].mass;
-        com += pos[ipoint] * mass;
-        totalMass += mass;
+        // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+        const float* f = (const float*)src;
+        const __m128 a = _mm_loadu_ps( f + 0 );
+        const __m128 b = _mm_loadu_ps( f + 4 );
+        const __m128 c = _mm_loadu_ps( f + 8 );
+        const __m128 bc  = _mm_shuffle_ps( b, c, _MM_SHUFFLE( 1, 1, 2, 2 ) );
+        const __m128 ab0 = _mm_shuffle_ps( a, b, _MM_SHUFFLE( 0, 0, 1, 1 ) );
+        const __m128 bc1 = _mm_shuffle_ps( b, c, _MM_SHUFFLE( 2, 2, 3, 3 ) );
+        const __m128 ab1 = _mm_shuffle_ps( a, b, _MM_SHUFFLE( 1, 1, 2, 2 ) );
+        const __m128 cc  = _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 0, 0 ) );
+        x[0] = _mm_shuffle_ps( a, bc, _MM_SHUFFLE( 2, 0, 3, 0 ) );
+        y[0] = _mm_shuffle_ps( ab0, bc1, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+        z[0] = _mm_shuffle_ps( ab1, cc, _MM_SHUFFLE( 2, 0, 2, 0 ) );
     }
-    com /= totalMass;
-    centerOfMass[0] = com;
+    else
+    {
+        const u8* b = (const u8*)src;
+        __m128 r0 = _mm_loadu_ps( (const float*)( b + 0 * sizeof( Vector3F ) ) );
+        __m128 r1 = _mm_loadu_ps( (const float*)( b + 1 * sizeof( Vector3F ) ) );
+        __m128 r2 = _mm_loadu_ps( (const float*)( b + 2 * sizeof( Vector3F ) ) );
+        __m128 r3 = _mm_loadu_ps( (const float*)( b + 3 * sizeof( Vector3F ) ) );
+        _MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+        x[0] = r0;
+        y[0] = r1;
+        z[0] = r2;
+    }
+}
+
+// Center of mass and Apq covariance in single pass. Particles are processed in groups of 4 in SoA form.
+// Positions are taken relative to first particle, so precision doesn't depend on distance from origin.
+inline void ShapeMatchingCovariance( Vector3F* centerOfMass, Matrix3F* Apq, const Vector3F* pos, const ShapeMatchingC* shapeMatchingC, int nPoints )
+{
+    const Vector3F ref = pos[0];
+    const __m128 ref_x = _mm_set1_ps( ref.x );
+    const __m128 ref_y = _mm_set1_ps( ref.y );
+    const __m128 ref_z = _mm_set1_ps( ref.z );
+
+    __m128 sum_m = _mm_setzero_ps();
+    __m128 sum_px = _mm_setzero_ps(), sum_py = _mm_setzero_ps(), sum_pz = _mm_setzero_ps();
+    __m128 sum_qx = _mm_setzero_ps(), sum_qy = _mm_setzero_ps(), sum_qz = _mm_setzero_ps();
+    __m128 a00 = _mm_setzero_ps(), a01 = _mm_setzero_ps(), a02 = _mm_setzero_ps(); // a[row][col] = sum( m * p[row] * q[col] )
+    __m128 a10 = _mm_setzero_ps(), a11 = _mm_setzero_ps(), a12 = _mm_setzero_ps();
+    __m128 a20 = _mm_setzero_ps(), a21 = _mm_setzero_ps(), a22 = _mm_setzero_ps();
 
-    Vector3F col0( FLT_EPSILON, 0.f, 0.f );
-    Vector3F col1( 0.f, FLT_EPSILON * 2.f, 0.f );
-    Vector3F col2( 0.f, 0.f, FLT_EPSILON * 4.f );
-    for( int ipoint = 0; ipoint < nPoints; ++ipoint )
+    int ipoint = 0;
+    for( ; ipoint + 4 <= nPoints; ipoint += 4 )
+    {
+        __m128 px, py, pz;
+        LoadTransposed4( &px, &py, &pz, pos + ipoint );
+        px = _mm_sub_ps( px, ref_x );
+        py = _mm_sub_ps( py, ref_y );
+        pz = _mm_sub_ps( pz, ref_z );
+
+        __m128 qx, qy, qz, m;
+        if( sizeof( ShapeMatchingC ) == 16 )
+        {
+            // rest_pos and mass form one xyzm row
+            qx = _mm_loadu_ps( (const float*)( shapeMatchingC + ipoint + 0 ) );
+            qy = _mm_loadu_ps( (const float*)( shapeMatchingC + ipoint + 1 ) );
+            qz = _mm_loadu_ps( (const float*)( shapeMatchingC + ipoint + 2 ) );
+            m  = _mm_loadu_ps( (const float*)( shapeMatchingC + ipoint + 3 ) );
+            _MM_TRANSPOSE4_PS( qx, qy, qz, m );
+        }
+        else
+        {
+            const ShapeMatchingC* c = shapeMatchingC + ipoint;
+            const Vector3F rest[4] = { c[0].rest_pos, c[1].rest_pos, c[2].rest_pos, c[3].rest_pos };
+            LoadTransposed4( &qx, &qy, &qz, rest );
+            m = _mm_setr_ps( c[0].mass, c[1].mass, c[2].mass, c[3].mass );
+        }
+
+        const __m128 mpx = _mm_mul_ps( px, m );
+        const __m128 mpy = _mm_mul_ps( py, m );
+        const __m128 mpz = _mm_mul_ps( pz, m );
+
+        sum_m = _mm_add_ps( sum_m, m );
+        sum_px = _mm_add_ps( sum_px, mpx );
+        sum_py = _mm_add_ps( sum_py, mpy );
+        sum_pz = _mm_add_ps( sum_pz, mpz );
+        sum_qx = _mm_add_ps( sum_qx, _mm_mul_ps( qx, m ) );
+        sum_qy = _mm_add_ps( sum_qy, _mm_mul_ps( qy, m ) );
+        sum_qz = _mm_add_ps( sum_qz, _mm_mul_ps( qz, m ) );
+
+        a00 = _mm_add_ps( a00, _mm_mul_ps( mpx, qx ) );
+        a01 = _mm_add_ps( a01, _mm_mul_ps( mpx, qy ) );
+        a02 = _mm_add_ps( a02, _mm_mul_ps( mpx, qz ) );
+        a10 = _mm_add_ps( a10, _mm_mul_ps( mpy, qx ) );
+        a11 = _mm_add_ps( a11, _mm_mul_ps( mpy, qy ) );
+        a12 = _mm_add_ps( a12, _mm_mul_ps( mpy, qz ) );
+        a20 = _mm_add_ps( a20, _mm_mul_ps( mpz, qx ) );
+        a21 = _mm_add_ps( a21, _mm_mul_ps( mpz, qy ) );
+        a22 = _mm_add_ps( a22, _mm_mul_ps( mpz, qz ) );
+    }
+
+    f32 total_mass = HorizontalSum( sum_m );
+    Vector3F mp( HorizontalSum( sum_px ), HorizontalSum( sum_py ), HorizontalSum( sum_pz ) );
+    Vector3F mq( HorizontalSum( sum_qx ), HorizontalSum( sum_qy ), HorizontalSum( sum_qz ) );
+    Vector3F col0( HorizontalSum( a00 ), HorizontalSum( a10 ), HorizontalSum( a20 ) );
+    Vector3F col1( HorizontalSum( a01 ), HorizontalSum( a11 ), HorizontalSum( a21 ) );
+    Vector3F col2( HorizontalSum( a02 ), HorizontalSum( a12 ), HorizontalSum( a22 ) );
+
+    for( ; ipoint < nPoints; ++ipoint )
     {
         const f32 mass = shapeMatchingC[ipoint].mass;
         const Vector3F& q = shapeMatchingC[ipoint].rest_pos;
-        const Vector3F p = ( pos[ipoint] - com ) * mass;
+        const Vector3F p = ( pos[ipoint] - ref ) * mass;
+        total_mass += mass;
+        mp += p;
+        mq += q * mass;
         col0 += p * q.getX();
         col1 += p * q.getY();
         col2 += p * q.getZ();
     }
-    Matrix3F Apq( col0, col1, col2 );
-    extractRotation( rotation[0], Apq, 16 );
 
+    // sum( m * (p - com) * q ) = sum( m * p * q ) - com * sum( m * q )
+    const Vector3F com = mp / total_mass;
+    centerOfMass[0] = ref + com;
+
+    col0 += Vector3F( FLT_EPSILON, 0.f, 0.f ) - com * mq.getX();
+    col1 += Vector3F( 0.f, FLT_EPSILON * 2.f, 0.f ) - com * mq.getY();
+    col2 += Vector3F( 0.f, 0.f, FLT_EPSILON * 4.f ) - com * mq.getZ();
+    Apq[0] = Matrix3F( col0, col1, col2 );
+}
+
+// rotation is warm started from value passed in
+inline void SoftBodyUpdatePose1( QuatF* rotation, Vector3F* centerOfMass, const Vector3F* pos, const ShapeMatchingC* shapeMatchingC, int nPoints )
+{
+    Matrix3F Apq;
+    ShapeMatchingCovariance( centerOfMass, &Apq, pos, shapeMatchingC, nPoints );
+    extractRotation( rotation[0], Apq, 16, 1.0e-5f );
 }
 static inline void SolveShapeMatchingC( Vector3F* result, const QuatF& R, const Vector3F& com, const Vector3F& restPos, const Vector3F& pos, float shapeStiffness )
 {
@@ -0,0 +1,331 @@
+#include "puzzle_physics_snapshot.h"
+
+#include <util/array.h>
+#include <util/common.h>
+#include <util/time.h>
+#include <util/trace.h>
+
+#include <string.h>
+
+namespace bx { namespace puzzle {
+namespace physics
+{
+
+struct SnapshotFrame
+{
+    u64 frame = 0;
+    u64 checksum = 0;
+    u32 raw_size = 0;
+    bool key = false;
+    f32 delta_time = 0.f;
+    TimeStepPlan plan;
+    array_t<u8> data; // whole snapshot for key frame, delta against previous frame otherwise
+    array_t<u8> user_data;
+};
+
+struct SnapshotRing
+{
+    enum : u32
+    {
+        MAX_FRAMES = 1024,
+    };
+
+    SnapshotRingParams params;
+    SnapshotRingStats  stats;
+
+    SnapshotFrame _frames[MAX_FRAMES];
+    u32 _first = 0;     // slot of oldest frame
+    u32 _count = 0;
+    u32 _since_key = 0; // frames after newest key frame
+    u32 _num_replay = 0;// frames dropped by rewind, they stay in slots after _count until pushed again
+
+    array_t<u8> _prev;  // newest frame decoded, base for next delta
+    array_t<u8> _scratch;
+
+    u32 Slot( u32 i ) const { return ( _first + i ) % params.num_frames; }
+    SnapshotFrame&       Frame( u32 i )       { return _frames[Slot( i )]; }
+    const SnapshotFrame& Frame( u32 i ) const { return _frames[Slot( i )]; }
+};
+
+namespace
+{
+    static void CopyArray( array_t<u8>& dst, const u8* src, u32 size )
+    {
+        array::resize( dst, size );
+        memcpy( dst.begin(), src, size );
+    }
+
+    // [u32 equal words][u32 literal words][literal words xor previous] ...
+    // Literal run continues over single equal word, so header is written at most once per 3 words.
+    static void EncodeDelta( array_t<u8>* out, const u32* cur, const u32* prev, u32 numWords )
+    {
+        array::resize( *out, numWords * 8 + 8 );
+        u32* dst = (u32*)out->begin();
+
+        u32 i = 0;
+        while( i < numWords )
+        {
+            const u32 equal_begin = i;
+            while( i < numWords && cur[i] == prev[i] )
+                ++i;
+
+            const u32 literal_begin = i;
+            while( i < numWords && ( cur[i] != prev[i] || ( i + 1 < numWords && cur[i + 1] != prev[i + 1] ) ) )
+                ++i;
+
+            *dst++ = literal_begin - equal_begin;
+            *dst++ = i - literal_begin;
+            for( u32 j = literal_begin; j < i; ++j )
+                *dst++ = cur[j] ^ prev[j];
+        }
+        array::resize( *out, (u32)( (u8*)dst - out->begin() ) );
+    }
+    // state holds previous frame and becomes frame of delta
+    static void DecodeDelta( u32* state, const u8* delta, u32 deltaSize )
+    {
+        const u32* src = (const u32*)delta;
+        const u32* src_end = src + deltaSize / 4;
+        u32* dst = state;
+        while( src < src_end )
+        {
+            dst += src[0];
+            const u32 n = src[1];
+            src += 2;
+            for( u32 i = 0; i < n; ++i )
+                dst[i] ^= src[i];
+
+            dst += n;
+            src += n;
+        }
+    }
+
+    static void PopFront( SnapshotRing* ring )
+    {
+        array::clear( ring->Frame( 0 ).data );
+        ring->_first = ring->Slot( 1 );
+        ring->_count -= 1;
+    }
+    static u32 FindFrame( const SnapshotRing* ring, u64 frame )
+    {
+        for( u32 i = 0; i < ring->_count; ++i )
+        {
+            if( ring->Frame( i ).frame == frame )
+                return i;
+        }
+        return UINT32_MAX;
+    }
+    // frame to be pushed is compared with frame from before rewind in the same slot
+    static void VerifyReplay( SnapshotRing* ring, u64 frame, u64 checksum )
+    {
+        if( !ring->_num_replay )
+            return;
+
+        const SnapshotFrame& f = ring->Frame( ring->_count );
+        if( f.frame != frame )
+        {
+            ring->_num_replay = 0;
+            return;
+        }
+
+        SnapshotRingStats& stats = ring->stats;
+        stats.num_verified += 1;
+        if( f.checksum != checksum )
+        {
+            stats.num_mismatches += 1;
+            stats.first_mismatch_frame = minOfPair( stats.first_mismatch_frame, frame );
+        }
+        ring->_num_replay -= 1;
+    }
+    static void FillInfo( SnapshotFrameInfo* info, const SnapshotFrame& f )
+    {
+        info->frame = f.frame;
+        info->delta_time = f.delta_time;
+        info->plan = f.plan;
+        info->user_data = f.user_data.begin();
+        info->user_data_size = f.user_data.size;
+    }
+}//
+
+void CreateSnapshotRing( SnapshotRing** ring, const SnapshotRingParams& params )
+{
+    SnapshotRing* r = BX_NEW( bxDefaultAllocator(), SnapshotRing );
+    r->params = params;
+    r->params.num_frames = clamp( params.num_frames, 1u, (u32)SnapshotRing::MAX_FRAMES );
+    r->params.key_interval = maxOfPair( params.key_interval, 1u );
+    ring[0] = r;
+}
+void DestroySnapshotRing( SnapshotRing** ring )
+{
+    if( !ring[0] )
+        return;
+
+    BX_DELETE0( bxDefaultAllocator(), ring[0] );
+}
+
+u64 PushSnapshot( SnapshotRing* ring, const Solver* solver, u64 frame, float deltaTime, const void* userData, u32 userDataSize )
+{
+    BX_TRACE_SCOPE( "physics::PushSnapshot" );
+    SYS_ASSERT( ring->_count == 0 || ring->Frame( ring->_count - 1 ).frame < frame );
+    const u64 start_us = bxTime::us();
+
+    const u32 quantize_bits = ring->params.quantize_bits;
+    const u32 raw_size = SaveSnapshot( solver, nullptr, 0, quantize_bits );
+    array::resize( ring->_scratch, raw_size );
+    SaveSnapshot( solver, ring->_scratch.begin(), raw_size, quantize_bits );
+    const u64 checksum = ComputeChecksum( solver );
+    VerifyReplay( ring, frame, checksum );
+
+    // whole key group is dropped, so every frame in ring has its key frame
+    if( ring->_count == ring->params.num_frames )
+    {
+        do
+        {
+            PopFront( ring );
+        } while( ring->_count && !ring->Frame( 0 ).key );
+    }
+
+    const bool key = ring->_count == 0 || ring->_since_key + 1 >= ring->params.key_interval || raw_size != ring->_prev.size;
+
+    SnapshotFrame& f = ring->Frame( ring->_count++ );
+    f.frame = frame;
+    f.checksum = checksum;
+    f.raw_size = raw_size;
+    f.key = key;
+
+    const TimeStepStats& ts = GetStats( solver ).time_step;
+    f.delta_time = deltaTime;
+    f.plan.num_substeps = ts.num_substeps;
+    f.plan.num_iterations = ts.num_iterations;
+    f.plan.dt = ts.dt;
+    CopyArray( f.user_data, (const u8*)userData, userDataSize );
+
+    if( key )
+    {
+        CopyArray( f.data, ring->_scratch.begin(), raw_size );
+        ring->_since_key = 0;
+    }
+    else
+    {
+        EncodeDelta( &f.data, (const u32*)ring->_scratch.begin(), (const u32*)ring->_prev.begin(), raw_size / 4 );
+        ring->_since_key += 1;
+    }
+    array::swap( ring->_prev, ring->_scratch );
+
+    SnapshotRingStats& stats = ring->stats;
+    stats.num_frames = ring->_count;
+    stats.raw_size = raw_size;
+    stats.stored_size = f.data.size;
+    stats.total_size = 0;
+    for( u32 i = 0; i < ring->_count; ++i )
+        stats.total_size += ring->Frame( i ).data.size;
+    stats.save_ms = (f32)( ( bxTime::us() - start_us ) * 0.001 );
+
+    return checksum;
+}
+
+bool RewindSnapshot( SnapshotRing* ring, Solver* solver, u64 frame )
+{
+    BX_TRACE_SCOPE( "physics::RewindSnapshot" );
+    const u32 index = FindFrame( ring, frame );
+    if( index == UINT32_MAX )
+        return false;
+
+    const u64 start_us = bxTime::us();
+
+    u32 key_index = index;
+    while( !ring->Frame( key_index ).key )
+        --key_index;
+
+    // newest frame is already decoded
+    const bool newest = index + 1 == ring->_count;
+    if( !newest )
+    {
+        const SnapshotFrame& key = ring->Frame( key_index );
+        CopyArray( ring->_scratch, key.data.begin(), key.data.size );
+        for( u32 i = key_index + 1; i <= index; ++i )
+        {
+            const SnapshotFrame& f = ring->Frame( i );
+            DecodeDelta( (u32*)ring->_scratch.begin(), f.data.begin(), f.data.size );
+        }
+    }
+
+    const array_t<u8>& raw = ( newest ) ? ring->_prev : ring->_scratch;
+    if( !RestoreSnapshot( solver, raw.begin(), raw.size ) )
+        return false;
+
+    // newer frames (and frames still waiting from previous rewind) are simulated again,
+    // their checksums are verified in PushSnapshot
+    ring->_num_replay = ring->_count + ring->_num_replay - ( index + 1 );
+    ring->_count = index + 1;
+    ring->_since_key = index - key_index;
+    if( !newest )
+        array::swap( ring->_prev, ring->_scratch );
+
+    SnapshotRingStats& stats = ring->stats;
+    stats.num_frames = ring->_count;
+    stats.restore_ms = (f32)( ( bxTime::us() - start_us ) * 0.001 );
+    return true;
+}
+
+void ClearSnapshots( SnapshotRing* ring )
+{
+    while( ring->_count )
+        PopFront( ring );
+
+    ring->_first = 0;
+    ring->_since_key = 0;
+    ring->_num_replay = 0;
+    array::clear( ring->_prev );
+    ring->stats = {};
+}
+
+bool GetSnapshotChecksum( u64* checksum, const SnapshotRing* ring, u64 frame )
+{
+    const u32 index = FindFrame( ring, frame );
+    if( index == UINT32_MAX )
+        return false;
+
+    checksum[0] = ring->Frame( index ).checksum;
+    return true;
+}
+
+bool GetSnapshotFrame( SnapshotFrameInfo* info, const SnapshotRing* ring, u64 frame )
+{
+    const u32 index = FindFrame( ring, frame );
+    if( index == UINT32_MAX )
+        return false;
+
+    FillInfo( info, ring->Frame( index ) );
+    return true;
+}
+
+bool GetReplayFrame( SnapshotFrameInfo* info, const SnapshotRing* ring, u64 frame )
+{
+    for( u32 i = ring->_count; i < ring->_count + ring->_num_replay; ++i )
+    {
+        if( ring->Frame( i ).frame == frame )
+        {
+            FillInfo( info, ring->Frame( i ) );
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GetSnapshotRange( u64* oldest, u64* newest, const SnapshotRing* ring )
+{
+    if( !ring->_count )
+        return false;
+
+    oldest[0] = ring->Frame( 0 ).frame;
+    newest[0] = ring->Frame( ring->_count - 1 ).frame;
+    return true;
+}
+
+const SnapshotRingStats& GetStats( const SnapshotRing* ring )
+{
+    return ring->stats;
+}
+
+}//
+}}//
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "puzzle_physics.h"
+
+// --- snapshot ring
+// Keeps solver snapshots of last frames for rollback and replay.
+// Every key_interval-th frame is stored whole, frames in between as delta against previous frame
+// (32 bit words xor-ed with previous snapshot, runs of zero words are skipped).
+// Oldest key frame is dropped with its deltas, so ring holds at least num_frames - key_interval + 1 frames.
+// Each frame keeps checksum of solver state and what is needed to simulate it again: delta time passed to Solve,
+// time step plan used by that Solve and caller data (eg. game input).
+// Frames dropped by RewindSnapshot wait for replay (see GetReplayFrame, SolveReplay). When they are pushed again
+// their checksums are compared with ones from before rewind, so non deterministic step is reported in stats.
+namespace bx { namespace puzzle {
+namespace physics
+{
+struct SnapshotRingParams
+{
+    u32 num_frames = 64;
+    u32 key_interval = 16;
+    u32 quantize_bits = 0; // see SaveSnapshot. Replay from quantized snapshot is not bit exact
+};
+struct SnapshotRingStats
+{
+    u32 num_frames = 0;
+    u32 raw_size = 0;       // last snapshot uncompressed
+    u32 stored_size = 0;    // last snapshot as stored in ring
+    u32 total_size = 0;     // all frames in ring
+    f32 save_ms = 0.f;      // last push (save, checksum, delta)
+    f32 restore_ms = 0.f;   // last rewind (delta decoding, restore)
+    u32 num_verified = 0;   // replayed frames compared with checksum from before rewind
+    u32 num_mismatches = 0;
+    u64 first_mismatch_frame = UINT64_MAX;
+};
+struct SnapshotFrameInfo
+{
+    u64 frame = 0;
+    f32 delta_time = 0.f;
+    TimeStepPlan plan;
+    const void* user_data = nullptr; // valid until next push, rewind or clear
+    u32 user_data_size = 0;
+};
+
+void CreateSnapshotRing ( SnapshotRing** ring, const SnapshotRingParams& params = SnapshotRingParams() );
+void DestroySnapshotRing( SnapshotRing** ring );
+
+// saves state after Solve as frame. deltaTime is value passed to Solve (plan is taken from solver stats),
+// userData is copied. Frame numbers have to increase. Returns checksum of state
+u64  PushSnapshot  ( SnapshotRing* ring, const Solver* solver, u64 frame, float deltaTime, const void* userData = nullptr, u32 userDataSize = 0 );
+// restores state of frame and drops newer frames. Returns false when frame is not in ring
+bool RewindSnapshot( SnapshotRing* ring, Solver* solver, u64 frame );
+void ClearSnapshots( SnapshotRing* ring );
+
+bool GetSnapshotChecksum( u64* checksum, const SnapshotRing* ring, u64 frame );
+bool GetSnapshotFrame   ( SnapshotFrameInfo* info, const SnapshotRing* ring, u64 frame );
+// frame dropped by rewind, which is not pushed again yet. Returns false when frame doesn't wait for replay
+bool GetReplayFrame     ( SnapshotFrameInfo* info, const SnapshotRing* ring, u64 frame );
+// oldest and newest frame in ring. Returns false when ring is empty
+bool GetSnapshotRange   ( u64* oldest, u64* newest, const SnapshotRing* ring );
+const SnapshotRingStats& GetStats( const SnapshotRing* ring );
+
+}//
+}}//
@@ -1,9 +1,7 @@
 #include "puzzle_physics_util.h"
 #include "puzzle_physics.h"
 #include "puzzle_physics_pbd.h"
-
-#include "sdf.h"
-#include "voxelize.h"
+#include "puzzle_physics_asset.h"
 
 #include <util/array.h>
 #include <util/bbox.h>
@@ -161,197 +159,12 @@ BodyId CreateSoftBox( Solver* solver, const Matrix4F& pose, float width, float d
 }
 #endif
 
-static AABBF ComputeAABB( const Vector3F* points, u32 numPoints )
-{
-    AABBF aabb = AABBF::prepare();
-    for( u32 i = 0; i < numPoints; ++i )
-        aabb = AABBF::extend( aabb, points[i] );
-    return aabb;
-}
-
-BodyId CreateFromShape( Solver* solver, const Matrix4F& pose, const Vector3F& scale, const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, float particleMass, float spacingFactor, float jitter )
+BodyId CreateFromShape( Solver* solver, const Matrix4F& pose, const Vector3F& scale, const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, float particleMass, float spacingFactor, float jitter, EVoxelizeMode voxelizeMode )
 {
-    bxRandomGen rnd( 0xDEADCEE1 );
-
-    array_t<Vector3F> positions;
-    array::reserve( positions, numPositions );
-    
-    // --- prepare positions
-    for( u32 i = 0; i < numPositions; ++i )
-        positions[i] = srcPos[i];
-
-    AABBF local_aabb         = ComputeAABB( positions.begin(), numPositions );
-    Vector3F local_aabb_size = AABBF::size( local_aabb );
-    float max_edge           = maxElem( local_aabb_size );
-
-    // put mesh at the origin and scale to specified size
-    const Matrix4F xform = Matrix4F::scale( scale * ( 1.f / max_edge ) ); // prependScale( scale * ( 1.f / max_edge ), Matrix4F::translation( -local_aabb.min ) );
-    for( u32 i = 0; i < numPositions; ++i )
-        positions[i] = ( xform * Point3F( positions[i] ) ).getXYZ();
-
-    // recompute bounds
-    local_aabb      = ComputeAABB( positions.begin(), numPositions );
-    local_aabb_size = AABBF::size( local_aabb );
-    max_edge        = maxElem( local_aabb_size );
-    
-
-    // tweak spacing to avoid edge cases for particles laying on the boundary
-    // just covers the case where an edge is a whole multiple of the spacing.
-    const float pradius = GetParticleRadius( solver );
-    const float spacing = pradius * spacingFactor;
-    const float spacing_eps = spacing * ( 1.0f - 1e-4f );
-
-    // make sure to have at least one particle in each dimension
-    int dx, dy, dz;
-    dx = spacing > local_aabb_size.x ? 1 : int( local_aabb_size.x / spacing_eps );
-    dy = spacing > local_aabb_size.y ? 1 : int( local_aabb_size.y / spacing_eps );
-    dz = spacing > local_aabb_size.z ? 1 : int( local_aabb_size.z / spacing_eps );
-    int max_dim = maxOfPair( maxOfPair( dx, dy ), dz );
-    
-    // used to arrange particle 
-    const Vector3F spacing_fine = divPerElem( local_aabb_size, Vector3F( (f32)dx, (f32)dy, (f32)dz ) );
-
-    // expand border by two voxels to ensure adequate sampling at edges
-    local_aabb.min -= 2.0f*Vector3F( spacing );
-    local_aabb.max += 2.0f*Vector3F( spacing );
-    max_dim += 4;
-
-    const u32 max_dim_pow3 = max_dim*max_dim*max_dim;
-
-    array_t<u32> voxels;
-    array::reserve( voxels, max_dim_pow3 );
-
-    // we shift the voxelization bounds so that the voxel centers
-    // lie symmetrically to the center of the object. this reduces the 
-    // chance of missing features, and also better aligns the particles
-    // with the mesh
-    Vector3F meshOffset;
-    meshOffset.x = 0.5f * ( spacing - ( local_aabb_size.x - ( dx - 1 )*spacing ) );
-    meshOffset.y = 0.5f * ( spacing - ( local_aabb_size.y - ( dy - 1 )*spacing ) );
-    meshOffset.z = 0.5f * ( spacing - ( local_aabb_size.z - ( dz - 1 )*spacing ) );
-    local_aabb.min -= meshOffset;
-
-    // --- voxelize
-    Voxelize( 
-        (const float*)positions.begin(), numPositions, (const int*)srcIndices, numIndices, 
-        max_dim, max_dim, max_dim, &voxels[0], local_aabb.min, local_aabb.min + Vector3F( max_dim*spacing ) 
-        );
-    // --- 
-
-    // --- make sdf
-    array_t<i32> indices;
-    array_t<f32> sdf;
-    array::reserve( indices, max_dim_pow3 );
-    array::reserve( sdf, max_dim_pow3 );
-
-    MakeSDF( &voxels[0], max_dim, max_dim, max_dim, &sdf[0] );
-    // --- 
-
-    u32 num_particles = 0;
-    for( u32 i = 0; i < voxels.capacity; ++i )
-        num_particles += ( voxels[i] ) ? 1 : 0;
-
-    BodyId id = CreateBody( solver, num_particles );
-
-    const f32 particle_mass_inv = ( particleMass > FLT_EPSILON ) ? 1.f / particleMass : 0.f;
-    Vector3F* body_pos = MapPosition( solver, id );
-    f32*      body_mass_inv = MapMassInv( solver, id );
-
-    array_t<Vector4F> sdf_data;
-    
-    u32 body_particle_index = 0;
-    const Vector3F translation = pose.getTranslation();
-    for( int x = 0; x < max_dim; ++x )
-    {
-        for( int y = 0; y < max_dim; ++y )
-        {
-            for( int z = 0; z < max_dim; ++z )
-            {
-                const int index = z*max_dim*max_dim + y*max_dim + x;
-                indices[index] = UINT32_MAX;
-                if( !voxels[index] )
-                    continue;
-
-                const Vector3F grid_pos = Vector3F( float( x ) + 0.5f, float( y ) + 0.5f, float( z ) + 0.5f );
-                const Vector3F jitter_pos = bxRand::unitVector( rnd ) * jitter;
-                //const Vector3F pos_ls = local_aabb.min + spacing*grid_pos + jitter_pos;
-                const Vector3F pos_ls = local_aabb.min + mulPerElem( spacing_fine, grid_pos ) + jitter_pos;
-                const Vector3F pos_ws = (pose * Point3F(pos_ls)).getXYZ();
-
-                // normalize the sdf value and transform to world scale
-                Vector3F sdf_grad;
-                SampleSDFGrad( &sdf_grad.x, sdf.begin(), max_dim, x, y, z );
-                const Vector3F n = normalizeSafeF( sdf_grad );
-                const float d = sdf[index] * max_edge;
-                const Vector4F nrm_ls( n, d );
-
-                body_pos[body_particle_index] = pos_ws;
-                body_mass_inv[body_particle_index] = particle_mass_inv;
-                
-                array::push_back( sdf_data, nrm_ls );
-                indices[index] = body_particle_index;
-
-                body_particle_index += 1;
-            }
-        }
-    }
-
-
-    const float springStiffness = 1.f;
-    if( springStiffness > 0.0f )
-    {
-        array_t<DistanceCInfo> cinfo_array;
-        // construct cross link springs to occupied cells
-        for( int x = 0; x < max_dim; ++x )
-        {
-            for( int y = 0; y < max_dim; ++y )
-            {
-                for( int z = 0; z < max_dim; ++z )
-                {
-                    const int centerCell = z*max_dim*max_dim + y*max_dim + x;
-
-                    // if voxel is marked as occupied the add a particle
-                    if( voxels[centerCell] )
-                    {
-                        const int width = 1;
-
-                        // create springs to all the neighbors within the width
-                        for( int i = x - width; i <= x + width; ++i )
-                        {
-                            for( int j = y - width; j <= y + width; ++j )
-                            {
-                                for( int k = z - width; k <= z + width; ++k )
-                                {
-                                    const int neighborCell = k*max_dim*max_dim + j*max_dim + i;
-
-                                    if( neighborCell > 0 && neighborCell < int( voxels.capacity ) && voxels[neighborCell] && neighborCell != centerCell )
-                                    {
-                                        DistanceCInfo cinfo;
-                                        cinfo.i0 = indices[centerCell];
-                                        cinfo.i1 = indices[neighborCell];
-                                        array::push_back( cinfo_array, cinfo );
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        if( cinfo_array.size )
-        {
-            SetDistanceConstraints( solver, id, cinfo_array.begin(), cinfo_array.size, springStiffness );
-        }
-    }
-
-    SYS_ASSERT( num_particles == body_particle_index );
-
-    CalculateLocalPositions( solver, id );
-    SetSDFData( solver, id, sdf_data.begin(), sdf_data.size );
-
-    Unmap( solver, body_mass_inv );
-    Unmap( solver, body_pos );
+    const float spacing = GetParticleRadius( solver ) * spacingFactor;
+    const BodyAsset* asset = LoadBodyAsset( srcPos, numPositions, srcIndices, numIndices, scale, spacing, jitter, voxelizeMode );
+    BodyId id = CreateFromAsset( solver, pose, asset, particleMass );
+    UnloadBodyAsset( &asset );
 
     return id;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "puzzle_physics_type.h"
+#include "voxelize.h"
 #include <util\vectormath\vectormath.h>
 #include "../renderer_camera.h"
 
@@ -14,7 +15,9 @@ BodyId CreateRope( Solver* solver, const Vector3F& attach, const Vector3F& axis,
 BodyId CreateCloth( Solver* solver, const Vector3F& attach, const Vector3F& axis, float width, float height, float particleMass );
 //BodyId CreateSoftBox( Solver* solver, const Matrix4F& pose, float width, float depth, float height, float particleMass, bool shell = false );
 
-BodyId CreateFromShape( Solver* solver, const Matrix4F& pose, const Vector3F& scale, const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, float particleMass, float spacingFactor = 2.f, float jitter = 0.005f );
+// voxelization and sdf are baked once per mesh, scale, spacing and voxelize mode and cached on disk (see puzzle_physics_asset.h)
+// EVoxelizeMode::SOLID_RAYS voxelizes with QBVH ray packets (see aabbtree.h)
+BodyId CreateFromShape( Solver* solver, const Matrix4F& pose, const Vector3F& scale, const Vector3F* srcPos, u32 numPositions, const u32* srcIndices, u32 numIndices, float particleMass, float spacingFactor = 2.f, float jitter = 0.005f, EVoxelizeMode voxelizeMode = EVoxelizeMode::SOLID );
 //BodyId CreateFromPolyShape( Solver* solver, const Matrix4F& pose, const Vector3F& scale, const bxPolyShape& shape, float particleMass, float spacingFactor, float jitter );
 
 BodyId CreateBox( Solver* solver, const Matrix4F& pose, const Vector3F& extents, float particleMass );
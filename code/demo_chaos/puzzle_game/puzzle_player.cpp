@@ -15,6 +15,8 @@
 
 #include "../imgui/imgui.h"
 
+#include <string.h>
+
 namespace bx { namespace puzzle {
 
 
@@ -160,6 +162,27 @@ bool IsAlive( Player pl )
     return gData.IsAlive( id );
 }
 
+u32 PlayerSaveState( void* buffer, u32 bufferSize )
+{
+    const u32 size = (u32)sizeof( PlayerData );
+    if( bufferSize >= size )
+        memcpy( buffer, &gData, size );
+
+    return size;
+}
+bool PlayerRestoreState( const void* buffer, u32 size )
+{
+    if( size != sizeof( PlayerData ) )
+        return false;
+
+    // names are owned by current state
+    char* names[Const::MAX_PLAYERS];
+    memcpy( names, gData._name, sizeof( names ) );
+    memcpy( &gData, buffer, size );
+    memcpy( gData._name, names, sizeof( names ) );
+    return true;
+}
+
 void PlayerCollectInput( Player pl, const bxInput& input, const Matrix3F& basis, u64 deltaTimeUS )
 {
     id_t id = { pl.i };
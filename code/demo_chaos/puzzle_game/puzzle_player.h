@@ -21,6 +21,11 @@ Player PlayerCreate( SceneCtx* sctx, const char* name, const Matrix4F& pose );
 void PlayerDestroy( Player pl );
 bool IsAlive( Player pl );
 
+// copies state of all players (poses, velocities, input, time) for rewind together with physics snapshot.
+// Players created or destroyed in between are not handled. Returns size needed when buffer is too small
+u32  PlayerSaveState   ( void* buffer, u32 bufferSize );
+bool PlayerRestoreState( const void* buffer, u32 size );
+
 void PlayerCollectInput( Player pl, const bxInput& input, const Matrix3F& basis, u64 deltaTimeUS );
 void PlayerTick( SceneCtx* sctx, u64 deltaTimeUS );
 void PlayerPostPhysicsTick( SceneCtx* sctx );
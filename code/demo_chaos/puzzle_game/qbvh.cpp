@@ -0,0 +1,729 @@
+#include "qbvh.h"
+#include <util/array.h>
+#include <util/common.h>
+#include <util/time.h>
+#include <util/thread/parallel.h>
+
+#include <algorithm>
+
+namespace qbvh_internal
+{
+    enum
+    {
+        eNUM_BINS = 16,
+        eMAX_LEAF_SIZE = 4,
+        eMAX_SAH_DEPTH = 48,   // deeper than that falls back to median split, keeps traversal stack bounded
+        eSTACK_SIZE = 256,
+    };
+
+    struct BuildRef
+    {
+        Vector3F bmin;
+        Vector3F bmax;
+        u32 face;
+
+        inline float Centroid( u32 axis ) const { return ( bmin[axis] + bmax[axis] ) * 0.5f; }
+    };
+
+    struct BuildNode
+    {
+        Vector3F bmin;
+        Vector3F bmax;
+        u32 left;
+        u32 right;
+        u32 begin;
+        u32 count;  // > 0 for leaves
+
+        bool IsLeaf() const { return count > 0; }
+    };
+
+    struct BuildTask
+    {
+        u32 node;
+        u32 begin;
+        u32 end;
+        u32 depth;
+        u32 node_offset;
+    };
+
+    struct BuildContext
+    {
+        BuildRef* refs = nullptr;
+        array_t<BuildNode> nodes;
+        array_t<BuildTask> tasks;
+        u32 task_threshold = 0; // when > 0 subtrees smaller than this are deferred
+    };
+
+    inline float SurfaceArea( const Vector3F& bmin, const Vector3F& bmax )
+    {
+        const Vector3F e = bmax - bmin;
+        return 2.0f * ( e.x*e.y + e.x*e.z + e.y*e.z );
+    }
+
+    inline u32 LongestAxis( const Vector3F& v )
+    {
+        if( v.x > v.y && v.x > v.z )
+            return 0;
+        else
+            return ( v.y > v.z ) ? 1 : 2;
+    }
+
+    // returns index of first element of right partition
+    static u32 FindSplitAndPartition( BuildRef* refs, u32 begin, u32 end, u32 depth, const Vector3F& cmin, const Vector3F& cmax )
+    {
+        const u32 count = end - begin;
+        const Vector3F cextent = cmax - cmin;
+
+        if( depth < eMAX_SAH_DEPTH )
+        {
+            float best_cost = FLT_MAX;
+            u32 best_axis = UINT32_MAX;
+            u32 best_split = 0;
+
+            for( u32 axis = 0; axis < 3; ++axis )
+            {
+                if( cextent[axis] < 1e-12f )
+                    continue;
+
+                u32 bin_count[eNUM_BINS] = {};
+                Vector3F bin_min[eNUM_BINS];
+                Vector3F bin_max[eNUM_BINS];
+                for( u32 b = 0; b < eNUM_BINS; ++b )
+                {
+                    bin_min[b] = Vector3F( FLT_MAX );
+                    bin_max[b] = Vector3F( -FLT_MAX );
+                }
+
+                const float scale = eNUM_BINS * ( 1.f - 1e-6f ) / cextent[axis];
+                for( u32 i = begin; i < end; ++i )
+                {
+                    const BuildRef& ref = refs[i];
+                    const u32 b = minOfPair( (u32)( ( ref.Centroid( axis ) - cmin[axis] ) * scale ), (u32)eNUM_BINS - 1 );
+                    bin_count[b] += 1;
+                    bin_min[b] = minPerElem( bin_min[b], ref.bmin );
+                    bin_max[b] = maxPerElem( bin_max[b], ref.bmax );
+                }
+
+                // sweep from right to collect right side costs
+                float right_cost[eNUM_BINS];
+                Vector3F rmin( FLT_MAX ), rmax( -FLT_MAX );
+                u32 rcount = 0;
+                for( u32 b = eNUM_BINS - 1; b > 0; --b )
+                {
+                    rmin = minPerElem( rmin, bin_min[b] );
+                    rmax = maxPerElem( rmax, bin_max[b] );
+                    rcount += bin_count[b];
+                    right_cost[b] = ( rcount ) ? SurfaceArea( rmin, rmax ) * rcount : 0.f;
+                }
+
+                Vector3F lmin( FLT_MAX ), lmax( -FLT_MAX );
+                u32 lcount = 0;
+                for( u32 b = 0; b < eNUM_BINS - 1; ++b )
+                {
+                    lmin = minPerElem( lmin, bin_min[b] );
+                    lmax = maxPerElem( lmax, bin_max[b] );
+                    lcount += bin_count[b];
+                    if( lcount == 0 || lcount == count )
+                        continue;
+
+                    const float cost = SurfaceArea( lmin, lmax ) * lcount + right_cost[b + 1];
+                    if( cost < best_cost )
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = b;
+                    }
+                }
+            }
+
+            if( best_axis != UINT32_MAX )
+            {
+                const float scale = eNUM_BINS * ( 1.f - 1e-6f ) / cextent[best_axis];
+                const float offset = cmin[best_axis];
+                BuildRef* mid = std::partition( refs + begin, refs + end, [best_axis, best_split, scale, offset]( const BuildRef& ref )
+                {
+                    const u32 b = minOfPair( (u32)( ( ref.Centroid( best_axis ) - offset ) * scale ), (u32)eNUM_BINS - 1 );
+                    return b <= best_split;
+                } );
+
+                const u32 split = (u32)( mid - refs );
+                if( split != begin && split != end )
+                    return split;
+            }
+        }
+
+        // median split along the longest axis
+        const u32 axis = LongestAxis( cextent );
+        const u32 mid = begin + count / 2;
+        std::nth_element( refs + begin, refs + mid, refs + end, [axis]( const BuildRef& a, const BuildRef& b )
+        {
+            return a.Centroid( axis ) < b.Centroid( axis );
+        } );
+        return mid;
+    }
+
+    // nodes are written into preallocated range when 'nextNode' is not null (parallel phase),
+    // otherwise they are appended to context array
+    static void BuildRecursive( BuildContext* ctx, BuildNode* nodes, u32* nextNode, u32 nodeIndex, u32 begin, u32 end, u32 depth )
+    {
+        BuildRef* refs = ctx->refs;
+
+        Vector3F bmin( FLT_MAX ), bmax( -FLT_MAX );
+        Vector3F cmin( FLT_MAX ), cmax( -FLT_MAX );
+        for( u32 i = begin; i < end; ++i )
+        {
+            const Vector3F c = ( refs[i].bmin + refs[i].bmax ) * 0.5f;
+            bmin = minPerElem( bmin, refs[i].bmin );
+            bmax = maxPerElem( bmax, refs[i].bmax );
+            cmin = minPerElem( cmin, c );
+            cmax = maxPerElem( cmax, c );
+        }
+
+        const u32 count = end - begin;
+        BuildNode* node = ( nodes ) ? &nodes[nodeIndex] : &ctx->nodes[nodeIndex];
+        node->bmin = bmin;
+        node->bmax = bmax;
+        node->left = 0;
+        node->right = 0;
+        node->begin = begin;
+        node->count = 0;
+
+        if( count <= eMAX_LEAF_SIZE )
+        {
+            node->count = count;
+            return;
+        }
+
+        if( !nodes && ctx->task_threshold && count <= ctx->task_threshold )
+        {
+            BuildTask task;
+            task.node = nodeIndex;
+            task.begin = begin;
+            task.end = end;
+            task.depth = depth;
+            task.node_offset = 0;
+            array::push_back( ctx->tasks, task );
+            return;
+        }
+
+        const u32 split = FindSplitAndPartition( refs, begin, end, depth, cmin, cmax );
+
+        u32 left, right;
+        if( nodes )
+        {
+            left = ( *nextNode )++;
+            right = ( *nextNode )++;
+            nodes[nodeIndex].left = left;
+            nodes[nodeIndex].right = right;
+        }
+        else
+        {
+            left = array::push_back( ctx->nodes, BuildNode() );
+            right = array::push_back( ctx->nodes, BuildNode() );
+            ctx->nodes[nodeIndex].left = left;
+            ctx->nodes[nodeIndex].right = right;
+        }
+
+        BuildRecursive( ctx, nodes, nextNode, left, begin, split, depth + 1 );
+        BuildRecursive( ctx, nodes, nextNode, right, split, end, depth + 1 );
+    }
+
+    struct CollapseContext
+    {
+        const BuildNode* bnodes;
+        const BuildRef* refs;
+        const Vector3F* vertices;
+        const u32* indices;
+        array_t<QBVH::Node>* nodes;
+        array_t<QBVH::Triangle>* tris;
+        u32 num_leaves;
+    };
+
+    static u32 CollapseRecursive( CollapseContext* ctx, u32 bnodeIndex )
+    {
+        const BuildNode* bnodes = ctx->bnodes;
+
+        u32 children[4];
+        u32 num_children = 0;
+        const BuildNode& root = bnodes[bnodeIndex];
+        if( root.IsLeaf() )
+        {
+            children[num_children++] = bnodeIndex;
+        }
+        else
+        {
+            children[num_children++] = root.left;
+            children[num_children++] = root.right;
+        }
+
+        // open the biggest inner child until we have 4 of them
+        while( num_children < 4 )
+        {
+            u32 best = UINT32_MAX;
+            float best_area = -1.f;
+            for( u32 i = 0; i < num_children; ++i )
+            {
+                const BuildNode& c = bnodes[children[i]];
+                if( c.IsLeaf() )
+                    continue;
+
+                const float area = SurfaceArea( c.bmin, c.bmax );
+                if( area > best_area )
+                {
+                    best_area = area;
+                    best = i;
+                }
+            }
+            if( best == UINT32_MAX )
+                break;
+
+            const BuildNode& c = bnodes[children[best]];
+            children[best] = c.left;
+            children[num_children++] = c.right;
+        }
+
+        const u32 node_index = array::push_back( *ctx->nodes, QBVH::Node() );
+        u32 child_value[4] = { QBVH::EMPTY_CHILD, QBVH::EMPTY_CHILD, QBVH::EMPTY_CHILD, QBVH::EMPTY_CHILD };
+        u32 child_tris[4] = {};
+
+        for( u32 i = 0; i < num_children; ++i )
+        {
+            const BuildNode& c = bnodes[children[i]];
+            if( c.IsLeaf() )
+            {
+                child_value[i] = ctx->tris->size;
+                child_tris[i] = c.count;
+                for( u32 j = c.begin; j < c.begin + c.count; ++j )
+                {
+                    const u32 face = ctx->refs[j].face;
+                    const Vector3F& a = ctx->vertices[ctx->indices[face * 3 + 0]];
+                    const Vector3F& b = ctx->vertices[ctx->indices[face * 3 + 1]];
+                    const Vector3F& cc = ctx->vertices[ctx->indices[face * 3 + 2]];
+
+                    QBVH::Triangle tri;
+                    tri.a = a;
+                    tri.ab = b - a;
+                    tri.ac = cc - a;
+                    tri.n = cross( tri.ab, tri.ac );
+                    tri.face = face;
+                    array::push_back( *ctx->tris, tri );
+                }
+                ctx->num_leaves += 1;
+            }
+            else
+            {
+                child_value[i] = CollapseRecursive( ctx, children[i] );
+            }
+        }
+
+        // array could be reallocated during recursion
+        QBVH::Node& node = ( *ctx->nodes )[node_index];
+        for( u32 i = 0; i < 4; ++i )
+        {
+            node.child[i] = child_value[i];
+            node.num_tris[i] = child_tris[i];
+            if( i < num_children )
+            {
+                const BuildNode& c = bnodes[children[i]];
+                node.bmin_x[i] = c.bmin.x; node.bmin_y[i] = c.bmin.y; node.bmin_z[i] = c.bmin.z;
+                node.bmax_x[i] = c.bmax.x; node.bmax_y[i] = c.bmax.y; node.bmax_z[i] = c.bmax.z;
+            }
+            else
+            {
+                // inverted box, never hit
+                node.bmin_x[i] = node.bmin_y[i] = node.bmin_z[i] = FLT_MAX;
+                node.bmax_x[i] = node.bmax_y[i] = node.bmax_z[i] = -FLT_MAX;
+            }
+        }
+        return node_index;
+    }
+
+    inline Vector3F SafeRcp( const Vector3F& dir )
+    {
+        const float eps = 1e-20f;
+        const float dx = ( fabsf( dir.x ) < eps ) ? copysignf( eps, dir.x ) : dir.x;
+        const float dy = ( fabsf( dir.y ) < eps ) ? copysignf( eps, dir.y ) : dir.y;
+        const float dz = ( fabsf( dir.z ) < eps ) ? copysignf( eps, dir.z ) : dir.z;
+        return Vector3F( 1.f / dx, 1.f / dy, 1.f / dz );
+    }
+
+    // same as IntersectRayTriTwoSided, but with precomputed edges
+    inline bool IntersectTri( const QBVH::Triangle& tri, const Vector3F& p, const Vector3F& dir, float& t, float& u, float& v, float& w, float& sign )
+    {
+        const float d = dot( -dir, tri.n );
+        const float ood = 1.0f / d;
+        const Vector3F ap = p - tri.a;
+
+        t = dot( ap, tri.n ) * ood;
+        if( t < 0.0f )
+            return false;
+
+        const Vector3F e = cross( -dir, ap );
+        v = dot( tri.ac, e ) * ood;
+        if( v < 0.0f || v > 1.0f )
+            return false;
+        w = -dot( tri.ab, e ) * ood;
+        if( w < 0.0f || v + w > 1.0f )
+            return false;
+
+        u = 1.0f - v - w;
+        sign = d;
+        return true;
+    }
+}//
+
+using namespace qbvh_internal;
+
+QBVH::QBVH( const Vector3F* vertices, u32 numVerts, const u32* indices, u32 numFaces )
+{
+    (void)numVerts;
+    Build( vertices, indices, numFaces );
+}
+
+QBVH::~QBVH()
+{}
+
+void QBVH::Build( const Vector3F* vertices, const u32* indices, u32 numFaces )
+{
+    SYS_ASSERT( numFaces > 0 );
+    bxTimeQuery time_query = bxTimeQuery::begin();
+
+    array_t<BuildRef> refs;
+    array::resize( refs, numFaces );
+    bxParallel::forRange( numFaces, 4096, [&refs, vertices, indices]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+        {
+            const Vector3F& a = vertices[indices[i * 3 + 0]];
+            const Vector3F& b = vertices[indices[i * 3 + 1]];
+            const Vector3F& c = vertices[indices[i * 3 + 2]];
+
+            BuildRef& ref = refs[i];
+            ref.bmin = minPerElem( a, minPerElem( b, c ) );
+            ref.bmax = maxPerElem( a, maxPerElem( b, c ) );
+            ref.face = i;
+        }
+    } );
+
+    // top of the tree is built serially until subtrees are small enough to be distributed over threads
+    BuildContext ctx;
+    ctx.refs = refs.begin();
+    const u32 num_threads = bxParallel::numThreads();
+    ctx.task_threshold = ( num_threads > 1 ) ? maxOfPair( numFaces / ( num_threads * 8 ), 256u ) : 0;
+
+    array::reserve( ctx.nodes, numFaces * 2 );
+    array::push_back( ctx.nodes, BuildNode() );
+    BuildRecursive( &ctx, nullptr, nullptr, 0, 0, numFaces, 0 );
+
+    // reserve node ranges for deferred subtrees. Subtree with n refs has at most 2n-1 nodes
+    u32 num_nodes = ctx.nodes.size;
+    for( BuildTask& task : ctx.tasks )
+    {
+        task.node_offset = num_nodes;
+        num_nodes += 2 * ( task.end - task.begin ) - 2;
+    }
+    array::resize( ctx.nodes, num_nodes );
+
+    BuildContext* pctx = &ctx;
+    bxParallel::forRange( ctx.tasks.size, 1, [pctx]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+        {
+            const BuildTask& task = pctx->tasks[i];
+            u32 next_node = task.node_offset;
+            BuildRecursive( pctx, pctx->nodes.begin(), &next_node, task.node, task.begin, task.end, task.depth );
+            SYS_ASSERT( next_node <= task.node_offset + 2 * ( task.end - task.begin ) - 2 );
+        }
+    } );
+
+    // collapse binary tree to 4-wide tree. Triangles are stored in leaf order
+    array::clear( m_nodes );
+    array::clear( m_tris );
+    array::reserve( m_nodes, ( num_nodes / 3 ) + 1 );
+    array::reserve( m_tris, numFaces );
+
+    CollapseContext cctx;
+    cctx.bnodes = ctx.nodes.begin();
+    cctx.refs = refs.begin();
+    cctx.vertices = vertices;
+    cctx.indices = indices;
+    cctx.nodes = &m_nodes;
+    cctx.tris = &m_tris;
+    cctx.num_leaves = 0;
+    CollapseRecursive( &cctx, 0 );
+
+    m_minExtents = ctx.nodes[0].bmin;
+    m_maxExtents = ctx.nodes[0].bmax;
+
+    bxTimeQuery::end( &time_query );
+    m_stats.build_time_ms = (f32)( time_query.durationUS / 1000.0 );
+    m_stats.num_binary_nodes = num_nodes;
+    m_stats.num_nodes = m_nodes.size;
+    m_stats.num_leaves = cctx.num_leaves;
+    m_stats.num_build_tasks = ctx.tasks.size;
+}
+
+bool QBVH::TraceRay( const Vector3F& start, const Vector3F& dir, float& outT, float& outU, float& outV, float& outW, float& faceSign, u32& faceIndex ) const
+{
+    const Vector3F rcp_dir = SafeRcp( dir );
+
+    const __m128 ox = _mm_set1_ps( start.x );
+    const __m128 oy = _mm_set1_ps( start.y );
+    const __m128 oz = _mm_set1_ps( start.z );
+    const __m128 rdx = _mm_set1_ps( rcp_dir.x );
+    const __m128 rdy = _mm_set1_ps( rcp_dir.y );
+    const __m128 rdz = _mm_set1_ps( rcp_dir.z );
+    const __m128 zero = _mm_setzero_ps();
+
+    float best_t = FLT_MAX;
+
+    struct StackEntry
+    {
+        u32 node;
+        float t;
+    };
+    StackEntry stack[eSTACK_SIZE];
+    u32 stack_size = 0;
+    stack[stack_size++] = { 0, 0.f };
+
+    const Node* nodes = m_nodes.begin();
+    const Triangle* tris = m_tris.begin();
+
+    while( stack_size )
+    {
+        const StackEntry entry = stack[--stack_size];
+        if( entry.t > best_t )
+            continue;
+
+        const Node& node = nodes[entry.node];
+
+        const __m128 tx0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bmin_x ), ox ), rdx );
+        const __m128 tx1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bmax_x ), ox ), rdx );
+        const __m128 ty0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bmin_y ), oy ), rdy );
+        const __m128 ty1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bmax_y ), oy ), rdy );
+        const __m128 tz0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bmin_z ), oz ), rdz );
+        const __m128 tz1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.bmax_z ), oz ), rdz );
+
+        __m128 tmin = _mm_max_ps( _mm_max_ps( _mm_min_ps( tx0, tx1 ), _mm_min_ps( ty0, ty1 ) ), _mm_max_ps( _mm_min_ps( tz0, tz1 ), zero ) );
+        __m128 tmax = _mm_min_ps( _mm_min_ps( _mm_max_ps( tx0, tx1 ), _mm_max_ps( ty0, ty1 ) ), _mm_min_ps( _mm_max_ps( tz0, tz1 ), _mm_set1_ps( best_t ) ) );
+        const u32 mask = (u32)_mm_movemask_ps( _mm_cmple_ps( tmin, tmax ) );
+        if( !mask )
+            continue;
+
+        BIT_ALIGNMENT_16 float tmin_arr[4];
+        _mm_store_ps( tmin_arr, tmin );
+
+        // push inner children far to near, leaves are intersected right away
+        u32 inner[4];
+        u32 num_inner = 0;
+        for( u32 i = 0; i < 4; ++i )
+        {
+            // empty slot bounds overflow to infinite slabs, so they pass the box test
+            if( ( mask & ( 1 << i ) ) == 0 || node.child[i] == EMPTY_CHILD )
+                continue;
+
+            if( node.num_tris[i] )
+            {
+                const u32 first = node.child[i];
+                const u32 last = first + node.num_tris[i];
+                for( u32 itri = first; itri < last; ++itri )
+                {
+                    float t, u, v, w, s;
+                    if( IntersectTri( tris[itri], start, dir, t, u, v, w, s ) && t < best_t )
+                    {
+                        best_t = t;
+                        outU = u;
+                        outV = v;
+                        outW = w;
+                        faceSign = s;
+                        faceIndex = tris[itri].face;
+                    }
+                }
+            }
+            else
+            {
+                inner[num_inner++] = i;
+            }
+        }
+
+        // tiny insertion sort by distance, farthest first
+        for( u32 a = 1; a < num_inner; ++a )
+        {
+            const u32 key = inner[a];
+            u32 b = a;
+            while( b > 0 && tmin_arr[inner[b - 1]] < tmin_arr[key] )
+            {
+                inner[b] = inner[b - 1];
+                --b;
+            }
+            inner[b] = key;
+        }
+        for( u32 a = 0; a < num_inner; ++a )
+        {
+            SYS_ASSERT( stack_size < eSTACK_SIZE );
+            stack[stack_size++] = { node.child[inner[a]], tmin_arr[inner[a]] };
+        }
+    }
+
+    outT = best_t;
+    return ( best_t != FLT_MAX );
+}
+
+template< int N >
+void QBVH::TraceRayPacket( const RayPacket& rays, HitPacket* hits ) const
+{
+    __m128 ox[N], oy[N], oz[N];
+    __m128 dx[N], dy[N], dz[N];
+    __m128 rdx[N], rdy[N], rdz[N];
+    __m128 best_t[N], best_u[N], best_v[N], best_w[N], best_s[N];
+    __m128i best_face[N];
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.f );
+    const __m128 eps = _mm_set1_ps( 1e-20f );
+    const __m128 sign_mask = _mm_set1_ps( -0.f );
+
+    for( int k = 0; k < N; ++k )
+    {
+        ox[k] = _mm_load_ps( rays.ox + k * 4 );
+        oy[k] = _mm_load_ps( rays.oy + k * 4 );
+        oz[k] = _mm_load_ps( rays.oz + k * 4 );
+        dx[k] = _mm_load_ps( rays.dx + k * 4 );
+        dy[k] = _mm_load_ps( rays.dy + k * 4 );
+        dz[k] = _mm_load_ps( rays.dz + k * 4 );
+
+        // avoid 0 * inf in slab test
+        const __m128 sdx = _mm_or_ps( _mm_max_ps( _mm_andnot_ps( sign_mask, dx[k] ), eps ), _mm_and_ps( sign_mask, dx[k] ) );
+        const __m128 sdy = _mm_or_ps( _mm_max_ps( _mm_andnot_ps( sign_mask, dy[k] ), eps ), _mm_and_ps( sign_mask, dy[k] ) );
+        const __m128 sdz = _mm_or_ps( _mm_max_ps( _mm_andnot_ps( sign_mask, dz[k] ), eps ), _mm_and_ps( sign_mask, dz[k] ) );
+        rdx[k] = _mm_div_ps( one, sdx );
+        rdy[k] = _mm_div_ps( one, sdy );
+        rdz[k] = _mm_div_ps( one, sdz );
+
+        best_t[k] = _mm_load_ps( rays.tmax + k * 4 );
+        best_u[k] = best_v[k] = best_w[k] = best_s[k] = zero;
+        best_face[k] = _mm_setzero_si128();
+    }
+
+    u32 stack[eSTACK_SIZE];
+    u32 stack_size = 0;
+    stack[stack_size++] = 0;
+
+    const Node* nodes = m_nodes.begin();
+    const Triangle* tris = m_tris.begin();
+
+    while( stack_size )
+    {
+        const Node& node = nodes[stack[--stack_size]];
+
+        for( u32 i = 0; i < 4; ++i )
+        {
+            if( node.child[i] == EMPTY_CHILD )
+                continue;
+
+            const __m128 bminx = _mm_set1_ps( node.bmin_x[i] );
+            const __m128 bminy = _mm_set1_ps( node.bmin_y[i] );
+            const __m128 bminz = _mm_set1_ps( node.bmin_z[i] );
+            const __m128 bmaxx = _mm_set1_ps( node.bmax_x[i] );
+            const __m128 bmaxy = _mm_set1_ps( node.bmax_y[i] );
+            const __m128 bmaxz = _mm_set1_ps( node.bmax_z[i] );
+
+            int any_hit = 0;
+            for( int k = 0; k < N; ++k )
+            {
+                const __m128 tx0 = _mm_mul_ps( _mm_sub_ps( bminx, ox[k] ), rdx[k] );
+                const __m128 tx1 = _mm_mul_ps( _mm_sub_ps( bmaxx, ox[k] ), rdx[k] );
+                const __m128 ty0 = _mm_mul_ps( _mm_sub_ps( bminy, oy[k] ), rdy[k] );
+                const __m128 ty1 = _mm_mul_ps( _mm_sub_ps( bmaxy, oy[k] ), rdy[k] );
+                const __m128 tz0 = _mm_mul_ps( _mm_sub_ps( bminz, oz[k] ), rdz[k] );
+                const __m128 tz1 = _mm_mul_ps( _mm_sub_ps( bmaxz, oz[k] ), rdz[k] );
+
+                const __m128 tmin = _mm_max_ps( _mm_max_ps( _mm_min_ps( tx0, tx1 ), _mm_min_ps( ty0, ty1 ) ), _mm_max_ps( _mm_min_ps( tz0, tz1 ), zero ) );
+                const __m128 tmax = _mm_min_ps( _mm_min_ps( _mm_max_ps( tx0, tx1 ), _mm_max_ps( ty0, ty1 ) ), _mm_min_ps( _mm_max_ps( tz0, tz1 ), best_t[k] ) );
+                any_hit |= _mm_movemask_ps( _mm_cmple_ps( tmin, tmax ) );
+            }
+            if( !any_hit )
+                continue;
+
+            if( node.num_tris[i] == 0 )
+            {
+                SYS_ASSERT( stack_size < eSTACK_SIZE );
+                stack[stack_size++] = node.child[i];
+                continue;
+            }
+
+            const u32 first = node.child[i];
+            const u32 last = first + node.num_tris[i];
+            for( u32 itri = first; itri < last; ++itri )
+            {
+                const Triangle& tri = tris[itri];
+                const __m128 ax = _mm_set1_ps( tri.a.x ), ay = _mm_set1_ps( tri.a.y ), az = _mm_set1_ps( tri.a.z );
+                const __m128 abx = _mm_set1_ps( tri.ab.x ), aby = _mm_set1_ps( tri.ab.y ), abz = _mm_set1_ps( tri.ab.z );
+                const __m128 acx = _mm_set1_ps( tri.ac.x ), acy = _mm_set1_ps( tri.ac.y ), acz = _mm_set1_ps( tri.ac.z );
+                const __m128 nx = _mm_set1_ps( tri.n.x ), ny = _mm_set1_ps( tri.n.y ), nz = _mm_set1_ps( tri.n.z );
+                const __m128i face = _mm_set1_epi32( (int)tri.face );
+
+                for( int k = 0; k < N; ++k )
+                {
+                    // d = dot( -dir, n )
+                    const __m128 d = _mm_sub_ps( zero, _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx[k], nx ), _mm_mul_ps( dy[k], ny ) ), _mm_mul_ps( dz[k], nz ) ) );
+                    const __m128 ood = _mm_div_ps( one, d );
+
+                    const __m128 apx = _mm_sub_ps( ox[k], ax );
+                    const __m128 apy = _mm_sub_ps( oy[k], ay );
+                    const __m128 apz = _mm_sub_ps( oz[k], az );
+
+                    const __m128 t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( apx, nx ), _mm_mul_ps( apy, ny ) ), _mm_mul_ps( apz, nz ) ), ood );
+
+                    // e = cross( -dir, ap )
+                    const __m128 ex = _mm_sub_ps( _mm_mul_ps( dz[k], apy ), _mm_mul_ps( dy[k], apz ) );
+                    const __m128 ey = _mm_sub_ps( _mm_mul_ps( dx[k], apz ), _mm_mul_ps( dz[k], apx ) );
+                    const __m128 ez = _mm_sub_ps( _mm_mul_ps( dy[k], apx ), _mm_mul_ps( dx[k], apy ) );
+
+                    const __m128 v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( acx, ex ), _mm_mul_ps( acy, ey ) ), _mm_mul_ps( acz, ez ) ), ood );
+                    const __m128 w = _mm_sub_ps( zero, _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( abx, ex ), _mm_mul_ps( aby, ey ) ), _mm_mul_ps( abz, ez ) ), ood ) );
+
+                    __m128 mask = _mm_cmpge_ps( t, zero );
+                    mask = _mm_and_ps( mask, _mm_cmplt_ps( t, best_t[k] ) );
+                    mask = _mm_and_ps( mask, _mm_cmpge_ps( v, zero ) );
+                    mask = _mm_and_ps( mask, _mm_cmpge_ps( w, zero ) );
+                    mask = _mm_and_ps( mask, _mm_cmple_ps( _mm_add_ps( v, w ), one ) );
+                    if( _mm_movemask_ps( mask ) == 0 )
+                        continue;
+
+                    const __m128 u = _mm_sub_ps( _mm_sub_ps( one, v ), w );
+                    best_t[k] = _mm_or_ps( _mm_and_ps( mask, t ), _mm_andnot_ps( mask, best_t[k] ) );
+                    best_u[k] = _mm_or_ps( _mm_and_ps( mask, u ), _mm_andnot_ps( mask, best_u[k] ) );
+                    best_v[k] = _mm_or_ps( _mm_and_ps( mask, v ), _mm_andnot_ps( mask, best_v[k] ) );
+                    best_w[k] = _mm_or_ps( _mm_and_ps( mask, w ), _mm_andnot_ps( mask, best_w[k] ) );
+                    best_s[k] = _mm_or_ps( _mm_and_ps( mask, d ), _mm_andnot_ps( mask, best_s[k] ) );
+                    const __m128i imask = _mm_castps_si128( mask );
+                    best_face[k] = _mm_or_si128( _mm_and_si128( imask, face ), _mm_andnot_si128( imask, best_face[k] ) );
+                }
+            }
+        }
+    }
+
+    for( int k = 0; k < N; ++k )
+    {
+        // lanes which didn't hit anything report FLT_MAX
+        const __m128 tmax = _mm_load_ps( rays.tmax + k * 4 );
+        const __m128 miss = _mm_cmpeq_ps( best_t[k], tmax );
+        _mm_store_ps( hits->t + k * 4, _mm_or_ps( _mm_and_ps( miss, _mm_set1_ps( FLT_MAX ) ), _mm_andnot_ps( miss, best_t[k] ) ) );
+        _mm_store_ps( hits->u + k * 4, best_u[k] );
+        _mm_store_ps( hits->v + k * 4, best_v[k] );
+        _mm_store_ps( hits->w + k * 4, best_w[k] );
+        _mm_store_ps( hits->sign + k * 4, best_s[k] );
+        _mm_store_si128( (__m128i*)( hits->face + k * 4 ), best_face[k] );
+    }
+}
+
+void QBVH::TraceRayPacket4( const RayPacket& rays, HitPacket* hits ) const
+{
+    TraceRayPacket<1>( rays, hits );
+}
+
+void QBVH::TraceRayPacket8( const RayPacket& rays, HitPacket* hits ) const
+{
+    TraceRayPacket<2>( rays, hits );
+}
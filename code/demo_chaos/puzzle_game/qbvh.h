@@ -0,0 +1,86 @@
+#pragma once
+
+#include <util/type.h>
+#include <util/vectormath/vectormath.h>
+#include <util/containers.h>
+
+// 4-wide bounding volume hierarchy over triangle mesh.
+// Binary tree is built with binned SAH (subtrees are built in parallel) and then collapsed to 4-wide nodes.
+// Each node keeps bounds of its children in SoA layout, so single node visit tests 4 boxes at once.
+// Supports single ray queries ( same interface as AABBTree ) and 4/8 ray packets.
+class QBVH
+{
+    QBVH( const QBVH& );
+    QBVH& operator=( const QBVH& );
+
+public:
+    QBVH( const Vector3F* vertices, u32 numVerts, const u32* indices, u32 numFaces );
+    ~QBVH();
+
+    bool TraceRay( const Vector3F& start, const Vector3F& dir, float& outT, float& u, float& v, float& w, float& faceSign, u32& faceIndex ) const;
+
+    // rays in SoA layout. t == FLT_MAX means miss
+    struct BIT_ALIGNMENT_16 RayPacket
+    {
+        float ox[8], oy[8], oz[8];
+        float dx[8], dy[8], dz[8];
+        float tmax[8];
+    };
+    struct BIT_ALIGNMENT_16 HitPacket
+    {
+        float t[8], u[8], v[8], w[8], sign[8];
+        u32 face[8];
+    };
+    void TraceRayPacket4( const RayPacket& rays, HitPacket* hits ) const; // uses first 4 lanes
+    void TraceRayPacket8( const RayPacket& rays, HitPacket* hits ) const;
+
+    Vector3F GetMinExtents() const { return m_minExtents; }
+    Vector3F GetMaxExtents() const { return m_maxExtents; }
+    Vector3F GetCenter() const { return ( m_minExtents + m_maxExtents ) * 0.5f; }
+
+    struct Stats
+    {
+        f32 build_time_ms = 0.f;
+        u32 num_binary_nodes = 0;
+        u32 num_nodes = 0;
+        u32 num_leaves = 0;
+        u32 num_build_tasks = 0;
+    };
+    const Stats& GetStats() const { return m_stats; }
+
+    //////////////////////////////////////////////////////////////////////////
+    enum : u32
+    {
+        EMPTY_CHILD = UINT32_MAX,
+    };
+
+    struct BIT_ALIGNMENT_16 Node
+    {
+        float bmin_x[4], bmin_y[4], bmin_z[4];
+        float bmax_x[4], bmax_y[4], bmax_z[4];
+        u32 child[4];    // node index or first triangle when leaf
+        u32 num_tris[4]; // 0 for inner nodes
+    };
+
+    struct Triangle
+    {
+        Vector3F a;
+        Vector3F ab;
+        Vector3F ac;
+        Vector3F n;
+        u32 face;
+    };
+
+private:
+    void Build( const Vector3F* vertices, const u32* indices, u32 numFaces );
+
+    template< int N >
+    void TraceRayPacket( const RayPacket& rays, HitPacket* hits ) const;
+
+    array_t<Node>     m_nodes;
+    array_t<Triangle> m_tris;
+
+    Vector3F m_minExtents;
+    Vector3F m_maxExtents;
+    Stats    m_stats;
+};
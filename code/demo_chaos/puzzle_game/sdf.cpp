@@ -504,3 +504,515 @@ void MakeSDF(const uint32_t* img, uint32_t w, uint32_t h, float* output)
 	}
 }
 */
+
+//////////////////////////////////////////////////////////////////////////
+// sparse narrow band SDF
+#include <util/array.h>
+#include <util/time.h>
+#include <util/thread/parallel.h>
+#include <util/poly/iso_surface.h>
+#include <util/poly/marching_cubes/CIsoSurface.h>
+
+namespace
+{
+    struct SparseBuildContext
+    {
+        const VoxelGrid* img;
+        uint32_t w, h, d;
+        int band;
+        float scale;
+
+        SparseSDF* sdf;
+        array_t<u8> brick_surface;  // 1 if brick has at least one surface voxel
+        array_t<u32> active_bricks; // bricks which need distance computation
+    };
+
+    inline bool Sample( const VoxelGrid& grid, int x, int y, int z )
+    {
+        return grid.Get( Clamp( x, 0, grid.width - 1 ), Clamp( y, 0, grid.height - 1 ), Clamp( z, 0, grid.depth - 1 ) );
+    }
+
+    // same as EdgeDetect for dense input
+    bool EdgeDetect( const VoxelGrid& grid, int x, int y, int z, float& dist )
+    {
+        const bool center = Sample( grid, x, y, z );
+        float min_dist = FLT_MAX;
+        for( int k = z - 1; k <= z + 1; ++k )
+        {
+            for( int j = y - 1; j <= y + 1; ++j )
+            {
+                for( int i = x - 1; i <= x + 1; ++i )
+                {
+                    if( Sample( grid, i, j, k ) != center )
+                    {
+                        const int dx = x - i;
+                        const int dy = y - j;
+                        const int dz = z - k;
+                        min_dist = min( sqrtf( float( dx*dx + dy*dy + dz*dz ) )*0.5f, min_dist );
+                    }
+                }
+            }
+        }
+        dist = min_dist;
+        return min_dist != FLT_MAX;
+    }
+
+    inline u32 BrickIndex( const SparseSDF& sdf, u32 bx, u32 by, u32 bz )
+    {
+        return ( bz * sdf.bricks_y + by ) * sdf.bricks_x + bx;
+    }
+    inline void BrickCoords( const SparseSDF& sdf, u32 index, int& bx, int& by, int& bz )
+    {
+        bx = int( index % sdf.bricks_x );
+        by = int( ( index / sdf.bricks_x ) % sdf.bricks_y );
+        bz = int( index / ( sdf.bricks_x * sdf.bricks_y ) );
+    }
+
+    void ClassifyBricks( SparseBuildContext* ctx, u32 begin, u32 end )
+    {
+        SparseSDF* sdf = ctx->sdf;
+        const int B = SparseSDF::BRICK_SIZE;
+
+        for( u32 ib = begin; ib < end; ++ib )
+        {
+            int bx, by, bz;
+            BrickCoords( *sdf, ib, bx, by, bz );
+
+            const int x0 = bx * B, x1 = min( x0 + B, int( ctx->w ) );
+            const int y0 = by * B, y1 = min( y0 + B, int( ctx->h ) );
+            const int z0 = bz * B, z1 = min( z0 + B, int( ctx->d ) );
+
+            u8 surface = 0;
+            for( int z = z0; z < z1 && !surface; ++z )
+            {
+                for( int y = y0; y < y1 && !surface; ++y )
+                {
+                    for( int x = x0; x < x1 && !surface; ++x )
+                    {
+                        float dist;
+                        surface = EdgeDetect( *ctx->img, x, y, z, dist ) ? 1 : 0;
+                    }
+                }
+            }
+
+            // brick without surface voxels is either fully inside or fully outside
+            ctx->brick_surface[ib] = surface;
+            sdf->brick_index[ib] = Sample( *ctx->img, x0, y0, z0 ) ? SparseSDF::EMPTY_INSIDE : SparseSDF::EMPTY_OUTSIDE;
+        }
+    }
+
+    // fast marching limited to brick extended by band width. Propagation stops once distance exceeds the band
+    void ComputeBrick( SparseBuildContext* ctx, u32 brickIndex, std::vector<float>& dist, std::vector<Coord3D>& queue )
+    {
+        const SparseSDF& sdf = *ctx->sdf;
+        const int B = SparseSDF::BRICK_SIZE;
+        const int band = ctx->band;
+
+        int bx, by, bz;
+        BrickCoords( sdf, brickIndex, bx, by, bz );
+
+        const int rx0 = max( bx*B - band, 0 ), rx1 = min( bx*B + B + band, int( ctx->w ) );
+        const int ry0 = max( by*B - band, 0 ), ry1 = min( by*B + B + band, int( ctx->h ) );
+        const int rz0 = max( bz*B - band, 0 ), rz1 = min( bz*B + B + band, int( ctx->d ) );
+        const int lw = rx1 - rx0;
+        const int lh = ry1 - ry0;
+        const int ld = rz1 - rz0;
+
+        dist.assign( lw*lh*ld, FLT_MAX );
+        queue.clear();
+
+        for( int z = 0; z < ld; ++z )
+        {
+            for( int y = 0; y < lh; ++y )
+            {
+                for( int x = 0; x < lw; ++x )
+                {
+                    float seed_dist;
+                    if( EdgeDetect( *ctx->img, x + rx0, y + ry0, z + rz0, seed_dist ) )
+                    {
+                        Coord3D c = { x, y, z, seed_dist, x, y, z };
+                        queue.push_back( c );
+                    }
+                }
+            }
+        }
+        std::make_heap( queue.begin(), queue.end() );
+
+        const float max_dist = float( band ) + 1.0f;
+        while( !queue.empty() )
+        {
+            std::pop_heap( queue.begin(), queue.end() );
+            const Coord3D c = queue.back();
+            queue.pop_back();
+
+            float& frozen = dist[( c.k*lh + c.j )*lw + c.i];
+            if( frozen != FLT_MAX )
+                continue;
+
+            frozen = c.d;
+
+            const int xmin = max( c.i - 1, 0 ), xmax = min( c.i + 1, lw - 1 );
+            const int ymin = max( c.j - 1, 0 ), ymax = min( c.j + 1, lh - 1 );
+            const int zmin = max( c.k - 1, 0 ), zmax = min( c.k + 1, ld - 1 );
+            const float seed_dist = dist[( c.sk*lh + c.sj )*lw + c.si];
+
+            for( int z = zmin; z <= zmax; ++z )
+            {
+                for( int y = ymin; y <= ymax; ++y )
+                {
+                    for( int x = xmin; x <= xmax; ++x )
+                    {
+                        if( dist[( z*lh + y )*lw + x] != FLT_MAX )
+                            continue;
+
+                        const int dx = x - c.si;
+                        const int dy = y - c.sj;
+                        const int dz = z - c.sk;
+                        const float nd = sqrtf( float( dx*dx + dy*dy + dz*dz ) ) + seed_dist;
+                        if( nd > max_dist )
+                            continue;
+
+                        Coord3D newc = { x, y, z, nd, c.si, c.sj, c.sk };
+                        queue.push_back( newc );
+                        std::push_heap( queue.begin(), queue.end() );
+                    }
+                }
+            }
+        }
+
+        // copy brick part of the region to output
+        float* output = ctx->sdf->brick_data.begin() + sdf.brick_index[brickIndex];
+        const float band_f = float( band );
+        for( int z = 0; z < B; ++z )
+        {
+            for( int y = 0; y < B; ++y )
+            {
+                for( int x = 0; x < B; ++x )
+                {
+                    // voxels past the volume edge repeat the border, same as clamped sampling
+                    const int gx = min( bx*B + x, int( ctx->w ) - 1 );
+                    const int gy = min( by*B + y, int( ctx->h ) - 1 );
+                    const int gz = min( bz*B + z, int( ctx->d ) - 1 );
+
+                    const float value = min( dist[( ( gz - rz0 )*lh + ( gy - ry0 ) )*lw + ( gx - rx0 )], band_f );
+                    const float sign = ( ctx->img->Get( gx, gy, gz ) ) ? -1.0f : 1.0f;
+                    output[( z*B + y )*B + x] = value * sign * ctx->scale;
+                }
+            }
+        }
+    }
+}
+
+void MakeSDF( SparseSDF* sdf, const VoxelGrid& input, u32 bandWidth )
+{
+    SYS_ASSERT( bandWidth > 0 && bandWidth <= SparseSDF::MAX_BAND_WIDTH );
+    bxTimeQuery time_query = bxTimeQuery::begin();
+
+    const u32 width = input.width;
+    const u32 height = input.height;
+    const u32 depth = input.depth;
+
+    const u32 B = SparseSDF::BRICK_SIZE;
+    const float scale = 1.0f / max( max( width, height ), depth );
+
+    sdf->width = width;
+    sdf->height = height;
+    sdf->depth = depth;
+    sdf->bricks_x = ( width + B - 1 ) / B;
+    sdf->bricks_y = ( height + B - 1 ) / B;
+    sdf->bricks_z = ( depth + B - 1 ) / B;
+    sdf->band = bandWidth * scale;
+
+    const u32 num_bricks = sdf->bricks_x * sdf->bricks_y * sdf->bricks_z;
+    ::array::clear( sdf->brick_index );
+    ::array::clear( sdf->brick_data );
+    ::array::resize( sdf->brick_index, num_bricks );
+
+    SparseBuildContext ctx;
+    ctx.img = &input;
+    ctx.w = width;
+    ctx.h = height;
+    ctx.d = depth;
+    ctx.band = (int)bandWidth;
+    ctx.scale = scale;
+    ctx.sdf = sdf;
+    ::array::resize( ctx.brick_surface, num_bricks );
+
+    SparseBuildContext* pctx = &ctx;
+    bxParallel::forRange( num_bricks, 4, [pctx]( u32 begin, u32 end, u32 )
+    {
+        ClassifyBricks( pctx, begin, end );
+    } );
+
+    // band never exceeds brick size, so only direct neighbours of surface bricks can be in the band
+    for( u32 ib = 0; ib < num_bricks; ++ib )
+    {
+        int bx, by, bz;
+        BrickCoords( *sdf, ib, bx, by, bz );
+
+        bool active = false;
+        for( int z = max( bz - 1, 0 ); z <= min( bz + 1, int( sdf->bricks_z ) - 1 ) && !active; ++z )
+            for( int y = max( by - 1, 0 ); y <= min( by + 1, int( sdf->bricks_y ) - 1 ) && !active; ++y )
+                for( int x = max( bx - 1, 0 ); x <= min( bx + 1, int( sdf->bricks_x ) - 1 ) && !active; ++x )
+                    active = ctx.brick_surface[BrickIndex( *sdf, x, y, z )] != 0;
+
+        if( active )
+        {
+            sdf->brick_index[ib] = ctx.active_bricks.size * SparseSDF::BRICK_SIZE3;
+            ::array::push_back( ctx.active_bricks, ib );
+        }
+    }
+
+    ::array::resize( sdf->brick_data, ctx.active_bricks.size * SparseSDF::BRICK_SIZE3 );
+    bxParallel::forRange( ctx.active_bricks.size, 1, [pctx]( u32 begin, u32 end, u32 )
+    {
+        std::vector<float> dist;
+        std::vector<Coord3D> queue;
+        for( u32 i = begin; i < end; ++i )
+            ComputeBrick( pctx, pctx->active_bricks[i], dist, queue );
+    } );
+
+    bxTimeQuery::end( &time_query );
+    sdf->stats.build_time_ms = (f32)( time_query.durationUS / 1000.0 );
+    sdf->stats.num_bricks = num_bricks;
+    sdf->stats.num_allocated_bricks = ctx.active_bricks.size;
+    sdf->stats.memory_bytes = sdf->brick_index.size * sizeof( u32 ) + sdf->brick_data.size * sizeof( f32 );
+    sdf->stats.dense_memory_bytes = width * height * depth * sizeof( f32 );
+}
+
+float SampleSDF( const SparseSDF& sdf, int x, int y, int z )
+{
+    const u32 B = SparseSDF::BRICK_SIZE;
+    const u32 cx = (u32)Clamp( x, 0, sdf.width - 1 );
+    const u32 cy = (u32)Clamp( y, 0, sdf.height - 1 );
+    const u32 cz = (u32)Clamp( z, 0, sdf.depth - 1 );
+
+    const u32 entry = sdf.brick_index[BrickIndex( sdf, cx / B, cy / B, cz / B )];
+    if( entry == SparseSDF::EMPTY_OUTSIDE )
+        return sdf.band;
+    if( entry == SparseSDF::EMPTY_INSIDE )
+        return -sdf.band;
+
+    return sdf.brick_data[entry + ( ( cz % B )*B + ( cy % B ) )*B + ( cx % B )];
+}
+
+void SampleSDFGrad( float grad[3], const SparseSDF& sdf, int x, int y, int z )
+{
+    const int x0 = max( x - 1, 0 ), x1 = min( x + 1, int( sdf.width ) - 1 );
+    const int y0 = max( y - 1, 0 ), y1 = min( y + 1, int( sdf.height ) - 1 );
+    const int z0 = max( z - 1, 0 ), z1 = min( z + 1, int( sdf.depth ) - 1 );
+    const float dim = (float)max( max( sdf.width, sdf.height ), sdf.depth );
+
+    grad[0] = ( SampleSDF( sdf, x1, y, z ) - SampleSDF( sdf, x0, y, z ) )*( dim*0.5f );
+    grad[1] = ( SampleSDF( sdf, x, y1, z ) - SampleSDF( sdf, x, y0, z ) )*( dim*0.5f );
+    grad[2] = ( SampleSDF( sdf, x, y, z1 ) - SampleSDF( sdf, x, y, z0 ) )*( dim*0.5f );
+}
+
+namespace
+{
+    inline void GatherCell( float c[8], float t[3], const SparseSDF& sdf, float x, float y, float z )
+    {
+        const float fx = floorf( x ), fy = floorf( y ), fz = floorf( z );
+        const int ix = int( fx ), iy = int( fy ), iz = int( fz );
+        t[0] = x - fx;
+        t[1] = y - fy;
+        t[2] = z - fz;
+
+        c[0] = SampleSDF( sdf, ix    , iy    , iz     );
+        c[1] = SampleSDF( sdf, ix + 1, iy    , iz     );
+        c[2] = SampleSDF( sdf, ix    , iy + 1, iz     );
+        c[3] = SampleSDF( sdf, ix + 1, iy + 1, iz     );
+        c[4] = SampleSDF( sdf, ix    , iy    , iz + 1 );
+        c[5] = SampleSDF( sdf, ix + 1, iy    , iz + 1 );
+        c[6] = SampleSDF( sdf, ix    , iy + 1, iz + 1 );
+        c[7] = SampleSDF( sdf, ix + 1, iy + 1, iz + 1 );
+    }
+    inline float Lerp( float a, float b, float t ) { return a + ( b - a ) * t; }
+}
+
+float SampleSDF( const SparseSDF& sdf, float x, float y, float z )
+{
+    float c[8], t[3];
+    GatherCell( c, t, sdf, x, y, z );
+
+    const float c00 = Lerp( c[0], c[1], t[0] );
+    const float c10 = Lerp( c[2], c[3], t[0] );
+    const float c01 = Lerp( c[4], c[5], t[0] );
+    const float c11 = Lerp( c[6], c[7], t[0] );
+    return Lerp( Lerp( c00, c10, t[1] ), Lerp( c01, c11, t[1] ), t[2] );
+}
+
+void SampleSDFGrad( float grad[3], const SparseSDF& sdf, float x, float y, float z )
+{
+    float c[8], t[3];
+    GatherCell( c, t, sdf, x, y, z );
+
+    // analytic derivative of trilinear interpolation, scaled like the central difference version
+    const float dim = (float)max( max( sdf.width, sdf.height ), sdf.depth );
+
+    const float dx00 = c[1] - c[0], dx10 = c[3] - c[2], dx01 = c[5] - c[4], dx11 = c[7] - c[6];
+    grad[0] = Lerp( Lerp( dx00, dx10, t[1] ), Lerp( dx01, dx11, t[1] ), t[2] ) * dim;
+
+    const float dy00 = c[2] - c[0], dy10 = c[3] - c[1], dy01 = c[6] - c[4], dy11 = c[7] - c[5];
+    grad[1] = Lerp( Lerp( dy00, dy10, t[0] ), Lerp( dy01, dy11, t[0] ), t[2] ) * dim;
+
+    const float dz00 = c[4] - c[0], dz10 = c[5] - c[1], dz01 = c[6] - c[2], dz11 = c[7] - c[3];
+    grad[2] = Lerp( Lerp( dz00, dz10, t[0] ), Lerp( dz01, dz11, t[0] ), t[1] ) * dim;
+}
+
+//////////////////////////////////////////////////////////////////////////
+namespace
+{
+    // solid sphere touching 80% of volume. voxels are optional
+    void _VoxelizeBenchmarkSphere( VoxelGrid* grid, array_t<u32>* voxels, u32 dim )
+    {
+        const float center = ( dim - 1 ) * 0.5f;
+        const float radius_sq = ( dim * 0.4f ) * ( dim * 0.4f );
+
+        AllocateVoxelGrid( grid, dim, dim, dim );
+        if( voxels )
+            ::array::resize( *voxels, dim * dim * dim );
+
+        for( u32 z = 0; z < dim; ++z )
+        {
+            for( u32 y = 0; y < dim; ++y )
+            {
+                for( u32 x = 0; x < dim; ++x )
+                {
+                    const float dx = x - center, dy = y - center, dz = z - center;
+                    const bool inside = dx*dx + dy*dy + dz*dz <= radius_sq;
+                    if( voxels )
+                        ( *voxels )[( z * dim + y ) * dim + x] = ( inside ) ? 1 : 0;
+                    if( inside )
+                        grid->Set( x, y, z );
+                }
+            }
+        }
+    }
+}
+
+void SDFBenchmark( SDFBenchmarkResult* result, u32 bandWidth )
+{
+    result[0] = SDFBenchmarkResult();
+    result->band_width = bandWidth;
+
+    for( u32 ires = 0; ires < SDFBenchmarkResult::NUM_RESOLUTIONS; ++ires )
+    {
+        const u32 dim = 64u << ires;
+        result->resolution[ires] = dim;
+
+        // the same voxels in both layouts
+        const u32 num_voxels = dim * dim * dim;
+        VoxelGrid grid;
+        array_t<u32> voxels;
+        _VoxelizeBenchmarkSphere( &grid, &voxels, dim );
+
+        array_t<f32> dense;
+        ::array::resize( dense, num_voxels );
+        bxTimeQuery time_query = bxTimeQuery::begin();
+        MakeSDF( voxels.begin(), dim, dim, dim, dense.begin() );
+        bxTimeQuery::end( &time_query );
+        result->dense_ms[ires] = (f32)( time_query.durationUS / 1000.0 );
+        result->dense_bytes[ires] = (u64)num_voxels * ( sizeof( u32 ) + sizeof( f32 ) );
+
+        SparseSDF sparse;
+        MakeSDF( &sparse, grid, bandWidth );
+        result->sparse_ms[ires] = sparse.stats.build_time_ms;
+        result->sparse_bytes[ires] = (u64)grid.bits.size * sizeof( u32 ) + sparse.stats.memory_bytes;
+        result->num_bricks[ires] = sparse.stats.num_bricks;
+        result->num_allocated_bricks[ires] = sparse.stats.num_allocated_bricks;
+
+        // values inside the band have to match
+        float max_error = 0.f;
+        for( u32 z = 0; z < dim; ++z )
+        {
+            for( u32 y = 0; y < dim; ++y )
+            {
+                for( u32 x = 0; x < dim; ++x )
+                {
+                    const float d = dense[( z * dim + y ) * dim + x];
+                    if( fabsf( d ) < sparse.band )
+                        max_error = max( max_error, fabsf( d - SampleSDF( sparse, (int)x, (int)y, (int)z ) ) );
+                }
+            }
+        }
+        result->max_band_error[ires] = max_error * dim;
+    }
+}
+
+void SDFMeshBenchmark( SDFMeshBenchmarkResult* result, u32 bandWidth )
+{
+    result[0] = SDFMeshBenchmarkResult();
+
+    for( u32 ires = 0; ires < SDFMeshBenchmarkResult::NUM_RESOLUTIONS; ++ires )
+    {
+        const u32 dim = 128u << ires;
+        result->resolution[ires] = dim;
+
+        VoxelGrid grid;
+        _VoxelizeBenchmarkSphere( &grid, nullptr, dim );
+        SparseSDF sdf;
+        MakeSDF( &sdf, grid, bandWidth );
+
+        array_t<f32> field;
+        ::array::resize( field, dim * dim * dim );
+        for( u32 z = 0; z < dim; ++z )
+        {
+            for( u32 y = 0; y < dim; ++y )
+            {
+                for( u32 x = 0; x < dim; ++x )
+                    field[( z * dim + y ) * dim + x] = SampleSDF( sdf, (int)x, (int)y, (int)z );
+            }
+        }
+
+        const float cell_size = 1.f / dim;
+        {
+            CIsoSurface<float> ciso;
+            bxTimeQuery time_query = bxTimeQuery::begin();
+            ciso.GenerateSurface( field.begin(), 0.f, dim - 1, dim - 1, dim - 1, cell_size, cell_size, cell_size );
+            bxTimeQuery::end( &time_query );
+            result->serial_ms[ires] = (f32)( time_query.durationUS / 1000.0 );
+            result->serial_triangles[ires] = ciso.m_nTriangles;
+        }
+
+        bx::IsoSurfaceMesher mesher;
+        mesher.StartUp( dim, dim, dim, Vector3F( 0.f ), Vector3F( cell_size ) );
+        {
+            bxTimeQuery time_query = bxTimeQuery::begin();
+            mesher.Update( field.begin(), 0.f );
+            bxTimeQuery::end( &time_query );
+            result->chunked_ms[ires] = (f32)( time_query.durationUS / 1000.0 );
+            result->chunked_triangles[ires] = mesher.NumTriangles();
+            result->num_chunks[ires] = mesher.GetStats().num_chunks;
+        }
+
+        // carve sphere of dim/16 radius centered on the surface, distances are scaled by 1/dim as in MakeSDF
+        const int center = (int)( dim / 2 + dim * 0.4f );
+        const int radius = (int)dim / 16;
+        const int lo = center - radius;
+        const int hi = minOfPair( center + radius, (int)dim - 1 );
+        const int mid = (int)dim / 2;
+        for( int z = mid - radius; z <= mid + radius; ++z )
+        {
+            for( int y = mid - radius; y <= mid + radius; ++y )
+            {
+                for( int x = lo; x <= hi; ++x )
+                {
+                    const float dx = (float)( x - center ), dy = (float)( y - mid ), dz = (float)( z - mid );
+                    const float carve = ( radius - sqrtf( dx*dx + dy*dy + dz*dz ) ) * cell_size;
+                    f32& value = field[( z * dim + y ) * dim + x];
+                    value = max( value, carve );
+                }
+            }
+        }
+        mesher.MarkDirty( lo, mid - radius, mid - radius, hi, mid + radius, mid + radius );
+        {
+            bxTimeQuery time_query = bxTimeQuery::begin();
+            mesher.Update( field.begin(), 0.f );
+            bxTimeQuery::end( &time_query );
+            result->incremental_ms[ires] = (f32)( time_query.durationUS / 1000.0 );
+            result->num_remeshed_chunks[ires] = mesher.GetStats().num_meshed_chunks;
+        }
+        mesher.ShutDown();
+    }
+}
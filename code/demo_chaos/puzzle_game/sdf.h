@@ -30,6 +30,8 @@
 //#include "core.h"
 //#include "maths.h"
 #include <util/type.h>
+#include <util/containers.h>
+#include "voxelize.h"
 
 // 2d and 3d signed distance field computation using fast marching method (FMM), output array
 // should be the same size as input, non-zero input pixels will have distance < 0.0f, resulting 
@@ -39,3 +41,86 @@ void MakeSDF( const u32* input, u32 width, u32 height, u32 depth, float* output
 
 float SampleSDF( const float* sdf, int dim, int x, int y, int z );
 void  SampleSDFGrad( float grad[3], const float* sdf, int dim, int x, int y, int z );
+
+//////////////////////////////////////////////////////////////////////////
+// narrow band SDF stored in 8^3 bricks. Only bricks close to the surface are allocated,
+// remaining bricks keep just the sign and return +/- band when sampled.
+// Bricks are computed in parallel, each one runs fast marching over its own region extended by band width.
+
+struct SparseSDF
+{
+    enum : u32
+    {
+        BRICK_SIZE = 8,
+        BRICK_SIZE3 = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE,
+        MAX_BAND_WIDTH = BRICK_SIZE,
+
+        EMPTY_OUTSIDE = UINT32_MAX,
+        EMPTY_INSIDE = UINT32_MAX - 1,
+    };
+
+    u32 width = 0;
+    u32 height = 0;
+    u32 depth = 0;
+    u32 bricks_x = 0;
+    u32 bricks_y = 0;
+    u32 bricks_z = 0;
+    f32 band = 0.f; // scaled the same way as distance values
+
+    array_t<u32> brick_index; // one entry per brick: offset in brick_data or EMPTY_xxx
+    array_t<f32> brick_data;
+
+    struct Stats
+    {
+        f32 build_time_ms = 0.f;
+        u32 num_bricks = 0;
+        u32 num_allocated_bricks = 0;
+        u32 memory_bytes = 0;
+        u32 dense_memory_bytes = 0;
+    } stats;
+};
+
+// same scaling as dense version. bandWidth is in voxels and can't exceed MAX_BAND_WIDTH
+void MakeSDF( SparseSDF* sdf, const VoxelGrid& input, u32 bandWidth = 4 );
+
+// voxel lookup. Coordinates are clamped to volume
+float SampleSDF( const SparseSDF& sdf, int x, int y, int z );
+void  SampleSDFGrad( float grad[3], const SparseSDF& sdf, int x, int y, int z );
+
+// trilinear filtering, coordinates are in voxel space ( voxel centers at integer coords )
+float SampleSDF( const SparseSDF& sdf, float x, float y, float z );
+void  SampleSDFGrad( float grad[3], const SparseSDF& sdf, float x, float y, float z );
+
+// dense fast marching vs sparse narrow band on voxelized solid sphere at 64, 128 and 256 resolution.
+// Dense memory is input voxels (u32 each) + output distances (fast marching heap not included), sparse is input bit grid + bricks.
+// Dense 256^3 build takes minutes
+struct SDFBenchmarkResult
+{
+    enum : u32 { NUM_RESOLUTIONS = 3 };
+    u32 band_width = 0;
+    u32 resolution          [NUM_RESOLUTIONS] = {};
+    f32 dense_ms            [NUM_RESOLUTIONS] = {};
+    f32 sparse_ms           [NUM_RESOLUTIONS] = {};
+    u64 dense_bytes         [NUM_RESOLUTIONS] = {};
+    u64 sparse_bytes        [NUM_RESOLUTIONS] = {};
+    u32 num_bricks          [NUM_RESOLUTIONS] = {};
+    u32 num_allocated_bricks[NUM_RESOLUTIONS] = {};
+    f32 max_band_error      [NUM_RESOLUTIONS] = {}; // in voxels, should be 0
+};
+void SDFBenchmark( SDFBenchmarkResult* result, u32 bandWidth = 4 );
+
+// marching cubes of the same sphere at 128 and 256 resolution. Sparse SDF is resampled to dense field first (not timed).
+// Serial CIsoSurface vs chunked IsoSurfaceMesher, then mesher re-meshes field after small sphere is carved out of the surface.
+struct SDFMeshBenchmarkResult
+{
+    enum : u32 { NUM_RESOLUTIONS = 2 };
+    u32 resolution         [NUM_RESOLUTIONS] = {};
+    f32 serial_ms          [NUM_RESOLUTIONS] = {};
+    f32 chunked_ms         [NUM_RESOLUTIONS] = {};
+    f32 incremental_ms     [NUM_RESOLUTIONS] = {};
+    u32 serial_triangles   [NUM_RESOLUTIONS] = {};
+    u32 chunked_triangles  [NUM_RESOLUTIONS] = {}; // has to match serial
+    u32 num_chunks         [NUM_RESOLUTIONS] = {};
+    u32 num_remeshed_chunks[NUM_RESOLUTIONS] = {}; // in incremental update
+};
+void SDFMeshBenchmark( SDFMeshBenchmarkResult* result, u32 bandWidth = 4 );
@@ -25,73 +25,457 @@
 //
 // Copyright (c) 2013-2016 NVIDIA Corporation. All rights reserved.
 
+#include "voxelize.h"
 #include "aabbtree.h"
+#include "qbvh.h"
+#include <util/array.h>
+#include <util/debug.h>
+#include <util/thread/parallel.h>
+
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
+#include <float.h>
+#include <intrin.h>
 #include <algorithm>
 
-void Voxelize(const float* vertices, int numVertices, const int* indices, int numTriangleIndices, uint32_t width, uint32_t height, uint32_t depth, uint32_t* volume, const Vector3F& minExtents, const Vector3F& maxExtents)
+void AllocateVoxelGrid( VoxelGrid* grid, u32 width, u32 height, u32 depth )
+{
+    grid->width = width;
+    grid->height = height;
+    grid->depth = depth;
+    grid->row_words = ( width + 31 ) / 32;
+
+    const u32 num_words = grid->row_words * height * depth;
+    array::clear( grid->bits );
+    array::resize( grid->bits, num_words );
+    memset( grid->bits.begin(), 0, num_words * sizeof( u32 ) );
+}
+
+u32 CountVoxels( const VoxelGrid& grid )
+{
+    u32 count = 0;
+    for( u32 word : grid.bits )
+        count += __popcnt( word );
+
+    return count;
+}
+
+namespace
 {
-	memset(volume, 0, sizeof(uint32_t)*width*height*depth);
-
-	// build an aabb tree of the mesh
-	AABBTree tree((const Vector3F*)vertices, numVertices, (const uint32_t*)indices, numTriangleIndices/3); 
-
-	// parity count method, single pass
-	const Vector3F extents(maxExtents-minExtents);
-	const Vector3F delta(extents.x/width, extents.y/height, extents.z/depth);
-	const Vector3F offset(0.5f*delta.x, 0.5f*delta.y, 0.5f*delta.z);
-	
-	// this is the bias we apply to step 'off' a triangle we hit, not very robust
-	const float eps = 0.00001f*extents.z;
-
-	for (uint32_t x=0; x < width; ++x)
-	{
-		for (uint32_t y=0; y < height; ++y)
-		{
-			bool inside = false;
-
-			Vector3F rayDir = Vector3F(0.0f, 0.0f, 1.0f);
-			Vector3F rayStart = minExtents + Vector3F(x*delta.x + offset.x, y*delta.y + offset.y, 0.0f);
-
-			uint32_t lastTri = uint32_t(-1);
-			for (;;)
-			{
-				// calculate ray start
-				float t, u, v, w, s;
-				uint32_t tri;
-
-				if (tree.TraceRaySlow(rayStart, rayDir, t, u, v, w, s, tri))
-				{
-					// calculate cell in which intersection occurred
-					const float zpos = rayStart.z + t*rayDir.z;
-					const float zhit = (zpos-minExtents.z)/delta.z;
-					
-					uint32_t z = uint32_t(floorf((rayStart.z-minExtents.z)/delta.z + 0.5f));
-					uint32_t zend = std::min(uint32_t(floorf(zhit + 0.5f)), depth-1);
-
-					if (inside)
-					{
-						// march along column setting bits 
-						for (uint32_t k=z; k < zend; ++k)
-							volume[k*width*height + y*width + x] = uint32_t(-1);
-					}
-					
-					//
-                    inside = !inside;
-
-					// we hit the tri we started from
-					if (tri == lastTri)
-						printf("Error self-intersect\n");
-					lastTri = tri;
-
-					rayStart += rayDir*(t+eps);
-
-				}
-				else
-					break;
-			}
-		}
-	}	
+    enum
+    {
+        eSLAB_ROWS = 4,
+    };
+
+    struct VoxelizeTriangle
+    {
+        Vector3F v[3]; // in voxel space
+        i32 min[3];
+        i32 max[3];
+    };
+
+    struct VoxelizeContext
+    {
+        VoxelGrid* grid;
+        EVoxelizeMode mode;
+
+        array_t<VoxelizeTriangle> triangles;
+        array_t<u32> slab_begin; // num_slabs + 1 entries
+        array_t<u32> slab_triangles;
+    };
+
+    struct ColumnHit
+    {
+        u32 x;
+        f32 z;
+
+        bool operator < ( const ColumnHit& other ) const { return ( x == other.x ) ? z < other.z : x < other.x; }
+    };
+
+    // edge function in the form which doesn't depend on edge direction, so edges shared by two triangles
+    // evaluate to exactly the same value (with opposite sign). Together with top-left rule it gives watertight parity test.
+    struct Edge2D
+    {
+        f32 ox, oy;
+        f32 dx, dy;
+        f32 sign;
+        bool top_left;
+    };
+
+    inline Edge2D MakeEdge( const Vector3F& a, const Vector3F& b )
+    {
+        const bool swap = ( b.x < a.x ) || ( b.x == a.x && b.y < a.y );
+        const Vector3F& p0 = ( swap ) ? b : a;
+        const Vector3F& p1 = ( swap ) ? a : b;
+
+        Edge2D e;
+        e.ox = p0.x;
+        e.oy = p0.y;
+        e.dx = p1.x - p0.x;
+        e.dy = p1.y - p0.y;
+        e.sign = ( swap ) ? -1.f : 1.f;
+
+        const f32 dx = b.x - a.x;
+        const f32 dy = b.y - a.y;
+        e.top_left = ( dy > 0.f ) || ( dy == 0.f && dx < 0.f );
+        return e;
+    }
+
+    inline __m128 EvalEdge( const Edge2D& e, const __m128 px, const __m128 py )
+    {
+        const __m128 w = _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( e.dx ), _mm_sub_ps( py, _mm_set1_ps( e.oy ) ) ), _mm_mul_ps( _mm_set1_ps( e.dy ), _mm_sub_ps( px, _mm_set1_ps( e.ox ) ) ) );
+        return _mm_mul_ps( w, _mm_set1_ps( e.sign ) );
+    }
+
+    inline __m128 EdgeInside( const Edge2D& e, const __m128 w )
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 on_edge = ( e.top_left ) ? _mm_cmpeq_ps( w, zero ) : zero;
+        return _mm_or_ps( _mm_cmpgt_ps( w, zero ), on_edge );
+    }
+
+    void VoxelizeSlabSolid( VoxelizeContext* ctx, u32 slab, array_t<ColumnHit>& hits )
+    {
+        VoxelGrid* grid = ctx->grid;
+        const u32 row_begin = slab * eSLAB_ROWS;
+        const u32 row_end = minOfPair( row_begin + eSLAB_ROWS, grid->height );
+
+        const u32* slab_tris = ctx->slab_triangles.begin() + ctx->slab_begin[slab];
+        const u32 num_slab_tris = ctx->slab_begin[slab + 1] - ctx->slab_begin[slab];
+
+        const __m128 lane_offset = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f );
+
+        for( u32 y = row_begin; y < row_end; ++y )
+        {
+            array::clear( hits );
+            const __m128 py = _mm_set1_ps( y + 0.5f );
+
+            for( u32 itri = 0; itri < num_slab_tris; ++itri )
+            {
+                const VoxelizeTriangle& tri = ctx->triangles[slab_tris[itri]];
+                if( (i32)y < tri.min[1] || (i32)y > tri.max[1] )
+                    continue;
+
+                Vector3F a = tri.v[0];
+                Vector3F b = tri.v[1];
+                Vector3F c = tri.v[2];
+
+                const f32 area = ( b.x - a.x )*( c.y - a.y ) - ( b.y - a.y )*( c.x - a.x );
+                if( area == 0.f )
+                    continue;
+
+                // make it counter clockwise in xy
+                if( area < 0.f )
+                    std::swap( b, c );
+
+                const Edge2D e0 = MakeEdge( b, c );
+                const Edge2D e1 = MakeEdge( c, a );
+                const Edge2D e2 = MakeEdge( a, b );
+                const __m128 za = _mm_set1_ps( a.z );
+                const __m128 zb = _mm_set1_ps( b.z );
+                const __m128 zc = _mm_set1_ps( c.z );
+
+                for( i32 x = tri.min[0]; x <= tri.max[0]; x += 4 )
+                {
+                    const __m128 px = _mm_add_ps( _mm_set1_ps( (f32)x ), lane_offset );
+                    const __m128 w0 = EvalEdge( e0, px, py );
+                    const __m128 w1 = EvalEdge( e1, px, py );
+                    const __m128 w2 = EvalEdge( e2, px, py );
+
+                    const __m128 inside = _mm_and_ps( _mm_and_ps( EdgeInside( e0, w0 ), EdgeInside( e1, w1 ) ), EdgeInside( e2, w2 ) );
+                    const int mask = _mm_movemask_ps( inside );
+                    if( !mask )
+                        continue;
+
+                    const __m128 wsum = _mm_add_ps( _mm_add_ps( w0, w1 ), w2 );
+                    const __m128 z = _mm_div_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( w0, za ), _mm_mul_ps( w1, zb ) ), _mm_mul_ps( w2, zc ) ), wsum );
+                    BIT_ALIGNMENT_16 f32 z_arr[4];
+                    _mm_store_ps( z_arr, z );
+
+                    for( i32 lane = 0; lane < 4; ++lane )
+                    {
+                        if( ( mask & ( 1 << lane ) ) && x + lane <= tri.max[0] )
+                        {
+                            ColumnHit hit = { u32( x + lane ), z_arr[lane] };
+                            array::push_back( hits, hit );
+                        }
+                    }
+                }
+            }
+
+            std::sort( hits.begin(), hits.end() );
+
+            // fill voxels which centers are between pairs of hits
+            for( u32 i = 0; i + 1 < hits.size; )
+            {
+                if( hits[i].x != hits[i + 1].x )
+                {
+                    // odd number of hits, mesh is not closed
+                    ++i;
+                    continue;
+                }
+
+                const u32 x = hits[i].x;
+                const i32 z0 = maxOfPair( (i32)ceilf( hits[i].z - 0.5f ), 0 );
+                const i32 z1 = minOfPair( (i32)ceilf( hits[i + 1].z - 0.5f ), (i32)grid->depth );
+                for( i32 z = z0; z < z1; ++z )
+                    grid->Set( x, y, z );
+
+                i += 2;
+            }
+        }
+    }
+
+    // rays along z through voxel centers, 8 neighbour columns per packet. Ray is restarted behind every hit,
+    // so hit shared by two triangles is counted once
+    void VoxelizeRowsRays( VoxelGrid* grid, const QBVH& bvh, u32 rowBegin, u32 rowEnd, const Vector3F& minExtents, const Vector3F& delta )
+    {
+        const f32 inv_delta_z = 1.f / delta.z;
+        const f32 eps = 0.00001f * delta.z * grid->depth;
+
+        QBVH::RayPacket rays;
+        QBVH::HitPacket hits;
+        f32 enter_z[8];
+        for( u32 y = rowBegin; y < rowEnd; ++y )
+        {
+            for( u32 x0 = 0; x0 < grid->width; x0 += 8 )
+            {
+                u32 active = 0;
+                u32 inside = 0;
+                for( u32 lane = 0; lane < 8; ++lane )
+                {
+                    const bool in_grid = x0 + lane < grid->width;
+                    rays.ox[lane] = minExtents.x + ( x0 + lane + 0.5f ) * delta.x;
+                    rays.oy[lane] = minExtents.y + ( y + 0.5f ) * delta.y;
+                    rays.oz[lane] = minExtents.z - delta.z;
+                    rays.dx[lane] = 0.f;
+                    rays.dy[lane] = 0.f;
+                    rays.dz[lane] = 1.f;
+                    rays.tmax[lane] = ( in_grid ) ? FLT_MAX : -1.f;
+                    active |= ( in_grid ) ? 1u << lane : 0u;
+                }
+
+                while( active )
+                {
+                    bvh.TraceRayPacket8( rays, &hits );
+                    for( u32 lane = 0; lane < 8; ++lane )
+                    {
+                        const u32 bit = 1u << lane;
+                        if( !( active & bit ) )
+                            continue;
+
+                        if( hits.t[lane] == FLT_MAX )
+                        {
+                            active &= ~bit;
+                            rays.tmax[lane] = -1.f;
+                            continue;
+                        }
+
+                        const f32 z = rays.oz[lane] + hits.t[lane];
+                        const f32 zv = ( z - minExtents.z ) * inv_delta_z;
+                        if( inside & bit )
+                        {
+                            // voxels which centers are between enter and exit
+                            const i32 z0 = maxOfPair( (i32)ceilf( enter_z[lane] - 0.5f ), 0 );
+                            const i32 z1 = minOfPair( (i32)ceilf( zv - 0.5f ), (i32)grid->depth );
+                            for( i32 iz = z0; iz < z1; ++iz )
+                                grid->Set( x0 + lane, y, iz );
+                        }
+                        else
+                        {
+                            enter_z[lane] = zv;
+                        }
+                        inside ^= bit;
+                        rays.oz[lane] = z + eps;
+                    }
+                }
+            }
+        }
+    }
+
+    // separating axis for 4 unit boxes at once
+    struct SATAxis
+    {
+        Vector3F axis;
+        f32 pmin, pmax;
+        f32 radius;
+    };
+
+    inline SATAxis MakeAxis( const Vector3F& axis, const Vector3F v[3] )
+    {
+        SATAxis a;
+        a.axis = axis;
+        const f32 p0 = dot( axis, v[0] );
+        const f32 p1 = dot( axis, v[1] );
+        const f32 p2 = dot( axis, v[2] );
+        a.pmin = minOfPair( p0, minOfPair( p1, p2 ) );
+        a.pmax = maxOfPair( p0, maxOfPair( p1, p2 ) );
+        a.radius = 0.5f * ( ::fabsf( axis.x ) + ::fabsf( axis.y ) + ::fabsf( axis.z ) );
+        return a;
+    }
+
+    // returns mask of lanes for which axis doesn't separate
+    inline __m128 TestAxis( const SATAxis& a, const __m128 cx, f32 cyz )
+    {
+        const __m128 c = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( a.axis.x ), cx ), _mm_set1_ps( cyz ) );
+        const __m128 r = _mm_set1_ps( a.radius );
+        const __m128 lo = _mm_sub_ps( _mm_set1_ps( a.pmin ), c );
+        const __m128 hi = _mm_sub_ps( _mm_set1_ps( a.pmax ), c );
+        return _mm_and_ps( _mm_cmple_ps( lo, r ), _mm_cmpge_ps( hi, _mm_sub_ps( _mm_setzero_ps(), r ) ) );
+    }
+
+    void VoxelizeSlabSurface( VoxelizeContext* ctx, u32 slab )
+    {
+        VoxelGrid* grid = ctx->grid;
+        const i32 row_begin = slab * eSLAB_ROWS;
+        const i32 row_end = minOfPair( row_begin + (i32)eSLAB_ROWS, (i32)grid->height ) - 1;
+
+        const u32* slab_tris = ctx->slab_triangles.begin() + ctx->slab_begin[slab];
+        const u32 num_slab_tris = ctx->slab_begin[slab + 1] - ctx->slab_begin[slab];
+
+        const __m128 lane_offset = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f );
+        const Vector3F unit[3] = { Vector3F( 1.f, 0.f, 0.f ), Vector3F( 0.f, 1.f, 0.f ), Vector3F( 0.f, 0.f, 1.f ) };
+
+        for( u32 itri = 0; itri < num_slab_tris; ++itri )
+        {
+            const VoxelizeTriangle& tri = ctx->triangles[slab_tris[itri]];
+
+            // triangle plane and 9 edge cross products. Box face axes are handled by iteration range
+            const Vector3F edges[3] = { tri.v[1] - tri.v[0], tri.v[2] - tri.v[1], tri.v[0] - tri.v[2] };
+            SATAxis axes[10];
+            axes[0] = MakeAxis( cross( edges[0], edges[1] ), tri.v );
+            for( u32 i = 0; i < 3; ++i )
+                for( u32 j = 0; j < 3; ++j )
+                    axes[1 + i * 3 + j] = MakeAxis( cross( unit[j], edges[i] ), tri.v );
+
+            const i32 y0 = maxOfPair( tri.min[1], row_begin );
+            const i32 y1 = minOfPair( tri.max[1], row_end );
+            for( i32 z = tri.min[2]; z <= tri.max[2]; ++z )
+            {
+                const f32 cz = z + 0.5f;
+                for( i32 y = y0; y <= y1; ++y )
+                {
+                    const f32 cy = y + 0.5f;
+                    for( i32 x = tri.min[0]; x <= tri.max[0]; x += 4 )
+                    {
+                        const __m128 cx = _mm_add_ps( _mm_set1_ps( (f32)x ), lane_offset );
+
+                        __m128 overlap = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+                        for( u32 i = 0; i < 10; ++i )
+                        {
+                            const f32 cyz = axes[i].axis.y * cy + axes[i].axis.z * cz;
+                            overlap = _mm_and_ps( overlap, TestAxis( axes[i], cx, cyz ) );
+                        }
+
+                        const int mask = _mm_movemask_ps( overlap );
+                        for( i32 lane = 0; lane < 4; ++lane )
+                        {
+                            if( ( mask & ( 1 << lane ) ) && x + lane <= tri.max[0] )
+                                grid->Set( x + lane, y, z );
+                        }
+                    }
+                }
+            }
+        }
+    }
+}//
+
+void Voxelize( VoxelGrid* grid, const float* vertices, int numVertices, const int* indices, int numTriangleIndices, u32 width, u32 height, u32 depth, const Vector3F& minExtents, const Vector3F& maxExtents, EVoxelizeMode mode )
+{
+    AllocateVoxelGrid( grid, width, height, depth );
+
+    const u32 num_triangles = numTriangleIndices / 3;
+    if( !num_triangles )
+        return;
+
+    const Vector3F extents( maxExtents - minExtents );
+    if( mode == EVoxelizeMode::SOLID_RAYS )
+    {
+        const AABBTree tree( (const Vector3F*)vertices, numVertices, (const u32*)indices, num_triangles, AABBTree::EMode::QBVH );
+        const QBVH* bvh = tree.GetQBVH();
+        const Vector3F delta( extents.x / width, extents.y / height, extents.z / depth );
+
+        // rows (y) are split between threads, every row of voxel grid belongs to single y
+        bxParallel::forRange( height, eSLAB_ROWS, [grid, bvh, minExtents, delta]( u32 begin, u32 end, u32 )
+        {
+            VoxelizeRowsRays( grid, *bvh, begin, end, minExtents, delta );
+        } );
+        return;
+    }
+
+    VoxelizeContext ctx;
+    ctx.grid = grid;
+    ctx.mode = mode;
+    array::resize( ctx.triangles, num_triangles );
+
+    // --- transform to voxel space
+    const Vector3F inv_delta( width / extents.x, height / extents.y, depth / extents.z );
+    const Vector3F* positions = (const Vector3F*)vertices;
+    const i32 grid_max[3] = { (i32)width - 1, (i32)height - 1, (i32)depth - 1 };
+
+    VoxelizeContext* pctx = &ctx;
+    bxParallel::forRange( num_triangles, 1024, [pctx, positions, indices, minExtents, inv_delta, &grid_max]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+        {
+            VoxelizeTriangle& tri = pctx->triangles[i];
+            for( u32 k = 0; k < 3; ++k )
+                tri.v[k] = mulPerElem( positions[indices[i * 3 + k]] - minExtents, inv_delta );
+
+            const Vector3F bmin = minPerElem( tri.v[0], minPerElem( tri.v[1], tri.v[2] ) );
+            const Vector3F bmax = maxPerElem( tri.v[0], maxPerElem( tri.v[1], tri.v[2] ) );
+            for( u32 k = 0; k < 3; ++k )
+            {
+                tri.min[k] = maxOfPair( (i32)floorf( bmin[k] ), 0 );
+                tri.max[k] = minOfPair( (i32)floorf( bmax[k] ), grid_max[k] );
+            }
+        }
+    } );
+
+    // --- bin triangles per slab
+    const u32 num_slabs = ( height + eSLAB_ROWS - 1 ) / eSLAB_ROWS;
+    array::resize( ctx.slab_begin, num_slabs + 1 );
+    memset( ctx.slab_begin.begin(), 0, ( num_slabs + 1 ) * sizeof( u32 ) );
+
+    for( const VoxelizeTriangle& tri : ctx.triangles )
+    {
+        if( tri.min[1] > tri.max[1] || tri.min[0] > tri.max[0] || tri.min[2] > tri.max[2] )
+            continue;
+
+        for( i32 s = tri.min[1] / eSLAB_ROWS; s <= tri.max[1] / eSLAB_ROWS; ++s )
+            ctx.slab_begin[s + 1] += 1;
+    }
+    for( u32 s = 0; s < num_slabs; ++s )
+        ctx.slab_begin[s + 1] += ctx.slab_begin[s];
+
+    array::resize( ctx.slab_triangles, ctx.slab_begin[num_slabs] );
+    {
+        array_t<u32> slab_fill;
+        array::resize( slab_fill, num_slabs );
+        memcpy( slab_fill.begin(), ctx.slab_begin.begin(), num_slabs * sizeof( u32 ) );
+
+        for( u32 i = 0; i < num_triangles; ++i )
+        {
+            const VoxelizeTriangle& tri = ctx.triangles[i];
+            if( tri.min[1] > tri.max[1] || tri.min[0] > tri.max[0] || tri.min[2] > tri.max[2] )
+                continue;
+
+            for( i32 s = tri.min[1] / eSLAB_ROWS; s <= tri.max[1] / eSLAB_ROWS; ++s )
+                ctx.slab_triangles[slab_fill[s]++] = i;
+        }
+    }
+
+    // --- slabs write disjoint rows, so no synchronization is needed
+    bxParallel::forRange( num_slabs, 1, [pctx]( u32 begin, u32 end, u32 )
+    {
+        array_t<ColumnHit> hits;
+        for( u32 slab = begin; slab < end; ++slab )
+        {
+            if( pctx->mode == EVoxelizeMode::SOLID )
+                VoxelizeSlabSolid( pctx, slab, hits );
+            else
+                VoxelizeSlabSurface( pctx, slab );
+        }
+    } );
 }
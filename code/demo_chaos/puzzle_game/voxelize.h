@@ -29,7 +29,33 @@
 
 //struct Mesh;
 #include <util/type.h>
+#include <util/containers.h>
 #include <util/vectormath/vectormath.h>
 
-// voxelizes a mesh using a single pass parity algorithm
-void Voxelize(const float* vertices, int numVertices, const int* indices, int numTriangleIndices, u32 width, u32 height, u32 depth, u32* volume, const Vector3F& minExtents, const Vector3F& maxExtents);
\ No newline at end of file
+// 1 bit per voxel, x is the fastest changing axis. Each (y,z) row starts at word boundary.
+struct VoxelGrid
+{
+    u32 width = 0;
+    u32 height = 0;
+    u32 depth = 0;
+    u32 row_words = 0;
+    array_t<u32> bits;
+
+    u32  RowOffset( u32 y, u32 z ) const { return ( z * height + y ) * row_words; }
+    bool Get( u32 x, u32 y, u32 z ) const { return ( ( bits[RowOffset( y, z ) + ( x >> 5 )] >> ( x & 31 ) ) & 1 ) != 0; }
+    void Set( u32 x, u32 y, u32 z )       { bits[RowOffset( y, z ) + ( x >> 5 )] |= 1u << ( x & 31 ); }
+};
+
+void AllocateVoxelGrid( VoxelGrid* grid, u32 width, u32 height, u32 depth );
+u32  CountVoxels( const VoxelGrid& grid );
+
+enum class EVoxelizeMode
+{
+    SOLID,      // parity test along z for each column. Mesh has to be closed
+    SURFACE,    // conservative, every voxel overlapping with a triangle is set
+    SOLID_RAYS, // same parity test with rays cast through QBVH in 8 ray packets. Reference for SOLID, mesh has to be closed
+};
+
+// voxelizes a mesh into width x height x depth grid spanning given extents.
+// Work is split into slabs along y axis. Triangles are binned per slab and slabs are processed in parallel.
+void Voxelize( VoxelGrid* grid, const float* vertices, int numVertices, const int* indices, int numTriangleIndices, u32 width, u32 height, u32 depth, const Vector3F& minExtents, const Vector3F& maxExtents, EVoxelizeMode mode = EVoxelizeMode::SOLID );
@@ -90,11 +90,11 @@ void Renderer::StartUp( const RendererDesc& desc, ResourceManager* resourceManag
     {//// poly shapes
         bxPolyShape polyShape;
         bxPolyShape_createBox( &polyShape, 1 );
-        rdi::RenderSource rsource_box = rdi::CreateRenderSourceFromPolyShape( polyShape );
+        rdi::RenderSource rsource_box = rdi::CreateRenderSourceFromPolyShape( polyShape, true );
         bxPolyShape_deallocateShape( &polyShape );
 
         bxPolyShape_createShpere( &polyShape, 11 );
-        rdi::RenderSource rsource_sphere = rdi::CreateRenderSourceFromPolyShape( polyShape );
+        rdi::RenderSource rsource_sphere = rdi::CreateRenderSourceFromPolyShape( polyShape, true );
         bxPolyShape_deallocateShape( &polyShape );
 
         MeshHandle hmesh = GMeshManager()->Add( ":sphere" );
@@ -404,7 +404,7 @@ bool ShadowPass::PrepareScene( rdi::CommandQueue* cmdq, Scene scene, const Camer
         rdi::ClearCommandBuffer( _cmd_buffer );
         rdi::BeginCommandBuffer( _cmd_buffer );
         
-        scene->BuildCommandBufferShadow( _cmd_buffer, &_vertex_transform_data, _pipeline_depth, _matrices.world, lightFrustum );
+        scene->BuildCommandBufferShadow( _cmd_buffer, &_vertex_transform_data, _pipeline_depth, _pipeline_depth_packed, _matrices.world, lightFrustum );
 
         rdi::EndCommandBuffer( _cmd_buffer );
 
@@ -480,6 +480,12 @@ void ShadowPass::_StartUp( ShadowPass* pass, const RendererDesc& rndDesc, u32 sh
     rdesc = rdi::GetResourceDescriptor( pass->_pipeline_depth );
     rdi::SetConstantBuffer( rdesc, "MaterialData", &pass->_cbuffer );
 
+    pipeline_desc.PackedVertices( 1 );
+    pass->_pipeline_depth_packed = rdi::CreatePipeline( pipeline_desc );
+    rdesc = rdi::GetResourceDescriptor( pass->_pipeline_depth_packed );
+    rdi::SetConstantBuffer( rdesc, "MaterialData", &pass->_cbuffer );
+    pipeline_desc.PackedVertices( 0 );
+
     pipeline_desc.Shader( shf, "resolve" );
     pass->_pipeline_resolve = rdi::CreatePipeline( pipeline_desc );
     rdesc = rdi::GetResourceDescriptor( pass->_pipeline_resolve );
@@ -506,6 +512,7 @@ void ShadowPass::_ShutDown( ShadowPass* pass )
     rdi::device::DestroyConstantBuffer( &pass->_cbuffer );
 
     rdi::DestroyPipeline( &pass->_pipeline_resolve );
+    rdi::DestroyPipeline( &pass->_pipeline_depth_packed );
     rdi::DestroyPipeline( &pass->_pipeline_depth );
 
     rdi::device::DestroyTexture( &pass->_shadow_map );
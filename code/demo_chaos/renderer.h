@@ -142,6 +142,7 @@ private:
     rdi::Sampler      _sampler_shadow = {};
 
     rdi::Pipeline _pipeline_depth   = BX_RDI_NULL_HANDLE;
+    rdi::Pipeline _pipeline_depth_packed = BX_RDI_NULL_HANDLE;
     rdi::Pipeline _pipeline_resolve = BX_RDI_NULL_HANDLE;
 
     rdi::ConstantBuffer      _cbuffer    = {};
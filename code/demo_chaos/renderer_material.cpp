@@ -246,6 +246,7 @@ MaterialHandle MaterialManager::Create( const char* name, const MaterialDesc& de
 
         const rdi::ResourceLayout* resource_layout = ( use_textures) ? &material_resource_layout::laytout_tex  : &material_resource_layout::laytout_notex;
         const rdi::Pipeline pipeline = (use_textures) ? _pipeline_tex : _pipeline_notex;
+        const rdi::Pipeline pipeline_packed = (use_textures) ? _pipeline_tex_packed : _pipeline_notex_packed;
 
         MaterialTextureHandles& htexture = _textures[id.index];
         if( use_textures )
@@ -258,6 +259,7 @@ MaterialHandle MaterialManager::Create( const char* name, const MaterialDesc& de
 
         MaterialPipeline& material_pipeline = _material_pipeline[id.index];
         material_pipeline.pipeline = pipeline;
+        material_pipeline.pipeline_packed = pipeline_packed;
         material_pipeline.resource_desc = rdi::CreateResourceDescriptor( *resource_layout );
         
         rdi::SetConstantBuffer( material_pipeline.resource_desc, "MaterialData", &_data_cbuffer[id.index] );
@@ -369,6 +371,15 @@ void MaterialManager::_StartUp()
     g_material_manager->_pipeline_tex = rdi::CreatePipeline( pipeline_desc );
     SYS_ASSERT( g_material_manager->_pipeline_tex != BX_RDI_NULL_HANDLE );
 
+    pipeline_desc.PackedVertices( 1 );
+    pipeline_desc.Shader( sfile, "geometry_notexture_packed" );
+    g_material_manager->_pipeline_notex_packed = rdi::CreatePipeline( pipeline_desc );
+    SYS_ASSERT( g_material_manager->_pipeline_notex_packed != BX_RDI_NULL_HANDLE );
+
+    pipeline_desc.Shader( sfile, "geometry_texture_packed" );
+    g_material_manager->_pipeline_tex_packed = rdi::CreatePipeline( pipeline_desc );
+    SYS_ASSERT( g_material_manager->_pipeline_tex_packed != BX_RDI_NULL_HANDLE );
+
     rdi::ShaderFileUnload( &sfile, GResourceManager() );
 }
 
@@ -387,6 +398,8 @@ void MaterialManager::_ShutDown()
     }
     
     {
+        rdi::DestroyPipeline( &g_material_manager->_pipeline_tex_packed );
+        rdi::DestroyPipeline( &g_material_manager->_pipeline_notex_packed );
         rdi::DestroyPipeline( &g_material_manager->_pipeline_tex );
         rdi::DestroyPipeline( &g_material_manager->_pipeline_notex );
     }
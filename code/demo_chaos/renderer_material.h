@@ -57,6 +57,7 @@ struct MaterialDesc
 struct MaterialPipeline
 {
     rdi::Pipeline pipeline = BX_RDI_NULL_HANDLE;
+    rdi::Pipeline pipeline_packed = BX_RDI_NULL_HANDLE; // for render sources with packed vertices
     rdi::ResourceDescriptor resource_desc = BX_RDI_NULL_HANDLE;
 };
 
@@ -91,6 +92,8 @@ private:
 
     rdi::Pipeline _pipeline_tex   = BX_RDI_NULL_HANDLE;
     rdi::Pipeline _pipeline_notex = BX_RDI_NULL_HANDLE;
+    rdi::Pipeline _pipeline_tex_packed   = BX_RDI_NULL_HANDLE;
+    rdi::Pipeline _pipeline_notex_packed = BX_RDI_NULL_HANDLE;
 
     bxBenaphore _lock;
 };
@@ -3,12 +3,15 @@
 #include <util/id_array.h>
 #include <util/string_util.h>
 #include <util/queue.h>
+#include <util/trace.h>
 #include "util/buffer_utils.h"
 
 #include "renderer.h"
 #include "renderer_scene_actor.h"
 #include "util/camera.h"
 #include "util/ring_buffer.h"
+#include <util/array.h>
+#include <algorithm>
 
 namespace bx{ namespace gfx{
 
@@ -29,11 +32,38 @@ Matrix4* getMatrixPtr( MeshMatrix& m, u32 numInstances )
     SYS_ASSERT( numInstances > 0 );
     return ( numInstances == 1 ) ? (Matrix4*)m._single : m._multi;
 }
+u32* getProxyPtr( MeshProxy& p, u32 numInstances )
+{
+    SYS_ASSERT( numInstances > 0 );
+    return ( numInstances == 1 ) ? &p._single : p._multi;
+}
+
+namespace renderer_scene_internal
+{
+    // bvh leaf user data. actor index in high bits, so sorted query results are grouped by actor
+    union ProxyData
+    {
+        u64 hash = 0;
+        struct
+        {
+            u32 instance;
+            u32 actor_index;
+        };
+    };
+    inline u64 MakeProxyData( u32 actorIndex, u32 instance )
+    {
+        ProxyData pdata;
+        pdata.instance = instance;
+        pdata.actor_index = actorIndex;
+        return pdata.hash;
+    }
+}///
 
 void SceneImpl::Prepare( const char* name, bxAllocator* allocator )
 {
     _name = string::duplicate( nullptr, name );
     _allocator = ( allocator ) ? allocator : bxDefaultAllocator();
+    _bvh.StartUp( 0.1f, 256, _allocator );
 }
 void SceneImpl::Unprepare()
 {
@@ -50,6 +80,7 @@ void SceneImpl::Unprepare()
         Remove( &last_id );
     }
     BX_FREE0( _allocator, _mesh_data._memory_handle );
+    _bvh.ShutDown();
     
     _allocator = nullptr;
     string::free_and_null( (char**)&_name );
@@ -81,6 +112,7 @@ ActorID SceneImpl::Add( const char* name, u32 numInstances )
     {
         u32 mem_size = numInstances * sizeof( Matrix4 );
         _mesh_data.matrices[index]._multi = (Matrix4*)BX_MALLOC( bxDefaultAllocator(), mem_size, 16 );
+        _mesh_data.proxies[index]._multi = (u32*)BX_MALLOC( bxDefaultAllocator(), numInstances * sizeof( u32 ), 4 );
     }
 
     Matrix4* matrices = getMatrixPtr( _mesh_data.matrices[index], numInstances );
@@ -91,7 +123,14 @@ ActorID SceneImpl::Add( const char* name, u32 numInstances )
     _mesh_data.local_aabb[index] = bxAABB( Vector3( -0.5f ), Vector3( 0.5f ) );
     _mesh_data.flags[index] = 0;
 
-    _scene_aabb_dirty = 1;
+    u32* proxies = getProxyPtr( _mesh_data.proxies[index], numInstances );
+    const bxAABB& local_aabb = _mesh_data.local_aabb[index];
+    for( u32 i = 0; i < numInstances; ++i )
+    {
+        const bxAABB world_aabb = bxAABB::transform( matrices[i], local_aabb );
+        proxies[i] = _bvh.CreateProxy( world_aabb, renderer_scene_internal::MakeProxyData( index, i ) );
+    }
+
     return mi;
 }
 
@@ -110,10 +149,28 @@ void SceneImpl::Remove( ActorID* mi )
 
     string::free_and_null( &_mesh_data.names[index] );
 
+    {
+        const u32 num_instances = _mesh_data.num_instances[index];
+        u32* proxies = getProxyPtr( _mesh_data.proxies[index], num_instances );
+        for( u32 i = 0; i < num_instances; ++i )
+        {
+            _bvh.DestroyProxy( proxies[i] );
+        }
+        if( num_instances > 1 )
+        {
+            BX_FREE( bxDefaultAllocator(), _mesh_data.proxies[index]._multi );
+            BX_FREE( bxDefaultAllocator(), _mesh_data.matrices[index]._multi );
+        }
+        _mesh_data.proxies[index] = {};
+        _mesh_data.matrices[index] = {};
+        _mesh_data.num_instances[index] = 0;
+    }
+
     if( index != last_index )
     {
 
         _mesh_data.matrices[index]      = _mesh_data.matrices[last_index];
+        _mesh_data.proxies[index]       = _mesh_data.proxies[last_index];
         _mesh_data.local_aabb[index]    = _mesh_data.local_aabb[last_index];
         _mesh_data.mesh_source[index]   = _mesh_data.mesh_source[last_index];
         _mesh_data.materials[index]     = _mesh_data.materials[last_index];
@@ -123,7 +180,15 @@ void SceneImpl::Remove( ActorID* mi )
         _mesh_data.flags[index]         = _mesh_data.flags[last_index];
         _handle_manager->setData( _mesh_data.actor_id[index], this, index );
 
+        const u32 num_instances = _mesh_data.num_instances[index];
+        const u32* proxies = getProxyPtr( _mesh_data.proxies[index], num_instances );
+        for( u32 i = 0; i < num_instances; ++i )
+        {
+            _bvh.SetUserData( proxies[i], renderer_scene_internal::MakeProxyData( index, i ) );
+        }
+
         _mesh_data.matrices[last_index]      = {};
+        _mesh_data.proxies[last_index]       = {};
         _mesh_data.mesh_source[last_index]   = {};
         _mesh_data.materials[last_index]     = {};
         _mesh_data.num_instances[last_index] = 0;
@@ -131,7 +196,6 @@ void SceneImpl::Remove( ActorID* mi )
         _mesh_data.names[last_index]         = nullptr;
         _mesh_data.flags[last_index]         = 0;
     }
-    _scene_aabb_dirty = 1;
 }
 
 ActorID SceneImpl::Find( const char* name )
@@ -189,7 +253,7 @@ void SceneImpl::SetMatrices( ActorID mi, const Matrix4* matrices, u32 count, u32
         data[startIndex + i] = matrices[i];
     }
 
-    _scene_aabb_dirty = 1;
+    _UpdateProxies( index, startIndex, count );
 }
 
 void SceneImpl::SetLocalAABB( ActorID mi, const bxAABB& aabb )
@@ -197,7 +261,7 @@ void SceneImpl::SetLocalAABB( ActorID mi, const bxAABB& aabb )
     const u32 index = _GetIndex( mi );
     _mesh_data.local_aabb[index] = aabb;
 
-    _scene_aabb_dirty = 1;
+    _UpdateProxies( index, 0, _mesh_data.num_instances[index] );
 }
 
 namespace renderer_scene_internal
@@ -224,160 +288,262 @@ namespace renderer_scene_internal
         return flags;
     }
 
+    // packed positions are relative to offset kept in render source, offset is folded into world matrix
+    inline bool GetPackedOffset( Matrix4* offset, rdi::RenderSource rsource )
+    {
+        if( !rsource || !rdi::HasPackedVertices( rsource ) )
+            return false;
+
+        const f32* xyz = rdi::GetPositionOffset( rsource );
+        offset[0] = Matrix4::translation( Vector3( xyz[0], xyz[1], xyz[2] ) );
+        return true;
+    }
+
 }///
 
 void SceneImpl::BuildCommandBuffer( rdi::CommandBuffer cmdb, VertexTransformData* vtransform, rdi::ResourceDescriptor frameDataRDesc, const Camera& camera )
 {
-    for( u32 i = 0; i < _mesh_data.size; ++i )
+    BX_TRACE_SCOPE( "SceneImpl::BuildCommandBuffer" );
+    const ViewFrustum frustum = viewFrustumExtract( camera.proj * camera.view );
+
+    array::clear( _bvh_query_result );
+    _bvh.QueryFrustum( &_bvh_query_result, frustum );
+    std::sort( _bvh_query_result.begin(), _bvh_query_result.end() );
+
+    u32 current_index = UINT32_MAX;
+    Matrix4* matrices = nullptr;
+    MeshSource::Callback callback = {};
+    rdi::RenderSource rsource = {};
+    MaterialPipeline material_pipeline = {};
+    Matrix4 packed_offset = Matrix4::identity();
+    bool packed = false;
+
+    for( u64 key : _bvh_query_result )
     {
-        const u32 num_instances = _mesh_data.num_instances[i];
-        Matrix4* matrices = getMatrixPtr( _mesh_data.matrices[i], num_instances );
-
-        //MeshHandle hmesh = _mesh_data.meshes[i];
-        //rdi::RenderSource rsource = GMeshManager()->RenderSource( hmesh );
+        renderer_scene_internal::ProxyData pdata;
+        pdata.hash = key;
 
-        MeshSource::Callback callback = {};
-        rdi::RenderSource rsource = {};
-        renderer_scene_internal::GetRenderSource( &rsource, &callback, _mesh_data.mesh_source[i], _mesh_data.flags[i] );
-        if( callback.function_ptr )
+        const u32 i = pdata.actor_index;
+        if( i != current_index )
         {
-            for( u32 imatrix = 0; imatrix < num_instances; ++imatrix )
+            current_index = i;
+            matrices = getMatrixPtr( _mesh_data.matrices[i], _mesh_data.num_instances[i] );
+            
+            callback = {};
+            rsource = {};
+            renderer_scene_internal::GetRenderSource( &rsource, &callback, _mesh_data.mesh_source[i], _mesh_data.flags[i] );
+            packed = renderer_scene_internal::GetPackedOffset( &packed_offset, rsource );
+            if( !callback.function_ptr )
             {
-                const Matrix4& matrix = matrices[imatrix];
-                const float depth = cameraDepth( camera.world, matrix.getTranslation() ).getAsFloat();
-
-                const u32 batch_offset = vtransform->AddBatch( &matrix, 1 );
-
-                renderer_scene_internal::SortKey skey;
-                skey.depth = TypeReinterpert( depth ).u;
-                skey.material = _mesh_data.materials[i].i;
-
-                rdi::Command* instance_cmd = vtransform->SetCurrent( cmdb, batch_offset, nullptr );
-
-                rdi::DrawCallbackCmd* cb_cmd = rdi::AllocateCommand< rdi::DrawCallbackCmd >( cmdb, instance_cmd );
-                cb_cmd->ptr = callback.function_ptr;
-                cb_cmd->user_data = callback.udata;
-                cb_cmd->flags = ESceneDrawFlag::COLOR;
-
-                rdi::SubmitCommand( cmdb, instance_cmd, skey.hash );
+                material_pipeline = GMaterialManager()->Pipeline( _mesh_data.materials[i] );
             }
-            continue;
         }
 
+        const Matrix4& matrix = matrices[pdata.instance];
+        const float depth = cameraDepth( camera.world, matrix.getTranslation() ).getAsFloat();
 
-        MaterialPipeline material_pipeline = GMaterialManager()->Pipeline( _mesh_data.materials[i] );
-
-        for( u32 imatrix = 0; imatrix < num_instances; ++imatrix )
-        {
-            const Matrix4& matrix = matrices[imatrix];
-            const float depth = cameraDepth( camera.world, matrix.getTranslation() ).getAsFloat();
+        const Matrix4 draw_matrix = ( packed ) ? matrix * packed_offset : matrix;
+        const u32 batch_offset = vtransform->AddBatch( &draw_matrix, 1 );
 
-            const u32 batch_offset = vtransform->AddBatch( &matrix, 1 );
+        renderer_scene_internal::SortKey skey;
+        skey.depth = TypeReinterpert( depth ).u;
+        skey.material = _mesh_data.materials[i].i;
 
-            renderer_scene_internal::SortKey skey;
-            skey.depth = TypeReinterpert( depth ).u;
-            skey.material = _mesh_data.materials[i].i;
+        rdi::Command* instance_cmd = vtransform->SetCurrent( cmdb, batch_offset, nullptr );
 
-            rdi::Command* instance_cmd = vtransform->SetCurrent( cmdb, batch_offset, nullptr );
-            
+        if( callback.function_ptr )
+        {
+            rdi::DrawCallbackCmd* cb_cmd = rdi::AllocateCommand< rdi::DrawCallbackCmd >( cmdb, instance_cmd );
+            cb_cmd->ptr = callback.function_ptr;
+            cb_cmd->user_data = callback.udata;
+            cb_cmd->flags = ESceneDrawFlag::COLOR;
+        }
+        else
+        {
             rdi::SetPipelineCmd* pipeline_cmd = rdi::AllocateCommand<rdi::SetPipelineCmd>( cmdb, instance_cmd );
-            pipeline_cmd->pipeline = material_pipeline.pipeline;
+            pipeline_cmd->pipeline = ( packed ) ? material_pipeline.pipeline_packed : material_pipeline.pipeline;
 
             rdi::SetResourcesCmd* resources_cmd_fdata = rdi::AllocateCommand<rdi::SetResourcesCmd>( cmdb, pipeline_cmd );
             resources_cmd_fdata->desc = frameDataRDesc;
 
             rdi::SetResourcesCmd* resources_cmd = rdi::AllocateCommand<rdi::SetResourcesCmd>( cmdb, resources_cmd_fdata );
             resources_cmd->desc = material_pipeline.resource_desc;
-            
+
             rdi::DrawCmd* draw_cmd = rdi::AllocateCommand< rdi::DrawCmd >( cmdb, resources_cmd );
             draw_cmd->rsource = rsource;
             draw_cmd->num_instances = 1;
-
-            rdi::SubmitCommand( cmdb, instance_cmd, skey.hash );
         }
+
+        rdi::SubmitCommand( cmdb, instance_cmd, skey.hash );
     }
 }
 
-void SceneImpl::BuildCommandBufferShadow( rdi::CommandBuffer cmdb, VertexTransformData* vtransform, rdi::Pipeline depthPipeline, const Matrix4& lightWorld, const ViewFrustum& lightFrustum )
+void SceneImpl::BuildCommandBufferShadow( rdi::CommandBuffer cmdb, VertexTransformData* vtransform, rdi::Pipeline depthPipeline, rdi::Pipeline depthPipelinePacked, const Matrix4& lightWorld, const ViewFrustum& lightFrustum )
 {
-    bxAABB aabb = bxAABB::prepare();
-
-    const u32 n = _mesh_data.size;
-    for( u32 i = 0; i < n; ++i )
+    array::clear( _bvh_query_result );
+    _bvh.QueryFrustum( &_bvh_query_result, lightFrustum );
+    std::sort( _bvh_query_result.begin(), _bvh_query_result.end() );
+
+    u32 current_index = UINT32_MAX;
+    Matrix4* matrices = nullptr;
+    MeshSource::Callback callback = {};
+    rdi::RenderSource rsource = {};
+    Matrix4 packed_offset = Matrix4::identity();
+    bool packed = false;
+
+    for( u64 key : _bvh_query_result )
     {
-        const u32 num_instances   = _mesh_data.num_instances[i];
-        Matrix4* matrices         = getMatrixPtr( _mesh_data.matrices[i], num_instances );
-        MeshSource::Callback callback = {};
-        rdi::RenderSource rsource = {};
-        renderer_scene_internal::GetRenderSource( &rsource, &callback, _mesh_data.mesh_source[i], _mesh_data.flags[i] );
-        //MeshHandle hmesh          = _mesh_data.meshes[i];
-        //rdi::RenderSource rsource = GMeshManager()->RenderSource( hmesh );
-
-        for( u32 imatrix = 0; imatrix < num_instances; ++imatrix )
+        renderer_scene_internal::ProxyData pdata;
+        pdata.hash = key;
+
+        const u32 i = pdata.actor_index;
+        if( i != current_index )
         {
-            const Matrix4& matrix = matrices[imatrix];
-            const float depth = cameraDepth( lightWorld, matrix.getTranslation() ).getAsFloat();
+            current_index = i;
+            matrices = getMatrixPtr( _mesh_data.matrices[i], _mesh_data.num_instances[i] );
 
-            const u32 batch_offset = vtransform->AddBatch( &matrix, 1 );
+            callback = {};
+            rsource = {};
+            renderer_scene_internal::GetRenderSource( &rsource, &callback, _mesh_data.mesh_source[i], _mesh_data.flags[i] );
+            packed = renderer_scene_internal::GetPackedOffset( &packed_offset, rsource );
+        }
 
-            renderer_scene_internal::SortKey skey;
-            skey.depth = TypeReinterpert( depth ).u;
-            skey.material = 0;
+        const Matrix4& matrix = matrices[pdata.instance];
+        const float depth = cameraDepth( lightWorld, matrix.getTranslation() ).getAsFloat();
 
-            rdi::Command* instance_cmd = vtransform->SetCurrent( cmdb, batch_offset, nullptr );
+        const Matrix4 draw_matrix = ( packed ) ? matrix * packed_offset : matrix;
+        const u32 batch_offset = vtransform->AddBatch( &draw_matrix, 1 );
 
-            if( callback.function_ptr )
-            {
-                rdi::DrawCallbackCmd* cb_cmd = rdi::AllocateCommand< rdi::DrawCallbackCmd >( cmdb, instance_cmd );
-                cb_cmd->ptr = callback.function_ptr;
-                cb_cmd->user_data = callback.udata;
-                cb_cmd->flags = ESceneDrawFlag::SHADOW;
-            }
-            else
-            {
-                rdi::SetPipelineCmd* pipeline_cmd = rdi::AllocateCommand< rdi::SetPipelineCmd >( cmdb, instance_cmd );
-                pipeline_cmd->pipeline = depthPipeline;
-                pipeline_cmd->bindResources = 1;
+        renderer_scene_internal::SortKey skey;
+        skey.depth = TypeReinterpert( depth ).u;
+        skey.material = 0;
 
-                rdi::DrawCmd* draw_cmd = rdi::AllocateCommand< rdi::DrawCmd >( cmdb, pipeline_cmd );
-                draw_cmd->rsource = rsource;
-                draw_cmd->num_instances = 1;
-            }
+        rdi::Command* instance_cmd = vtransform->SetCurrent( cmdb, batch_offset, nullptr );
 
+        if( callback.function_ptr )
+        {
+            rdi::DrawCallbackCmd* cb_cmd = rdi::AllocateCommand< rdi::DrawCallbackCmd >( cmdb, instance_cmd );
+            cb_cmd->ptr = callback.function_ptr;
+            cb_cmd->user_data = callback.udata;
+            cb_cmd->flags = ESceneDrawFlag::SHADOW;
+        }
+        else
+        {
+            rdi::SetPipelineCmd* pipeline_cmd = rdi::AllocateCommand< rdi::SetPipelineCmd >( cmdb, instance_cmd );
+            pipeline_cmd->pipeline = ( packed ) ? depthPipelinePacked : depthPipeline;
+            pipeline_cmd->bindResources = 1;
 
-            rdi::SubmitCommand( cmdb, instance_cmd, skey.hash );
+            rdi::DrawCmd* draw_cmd = rdi::AllocateCommand< rdi::DrawCmd >( cmdb, pipeline_cmd );
+            draw_cmd->rsource = rsource;
+            draw_cmd->num_instances = 1;
         }
+
+        rdi::SubmitCommand( cmdb, instance_cmd, skey.hash );
     }
 }
 
 void SceneImpl::ComputeAABB( bxAABB* sceneWorldAABB )
 {
-    if( !_scene_aabb_dirty )
+    // root of bvh is always up to date. It's slightly bigger than exact bounds because leaves are fattened.
+    if( !_bvh.RootAABB( sceneWorldAABB ) )
     {
-        sceneWorldAABB[0] = _scene_aabb;
+        sceneWorldAABB[0] = bxAABB::prepare();
     }
-    else
+}
+
+u32 SceneImpl::QueryAABB( array_t<ActorInstance>* result, const bxAABB& worldAABB )
+{
+    array::clear( _bvh_query_result );
+    _bvh.QueryAABB( &_bvh_query_result, worldAABB );
+
+    u32 count = 0;
+    for( u64 key : _bvh_query_result )
     {
-        _scene_aabb_dirty = 0;
+        renderer_scene_internal::ProxyData pdata;
+        pdata.hash = key;
+
+        const u32 i = pdata.actor_index;
+        const Matrix4* matrices = getMatrixPtr( _mesh_data.matrices[i], _mesh_data.num_instances[i] );
+        const bxAABB world_aabb = bxAABB::transform( matrices[pdata.instance], _mesh_data.local_aabb[i] );
+        
+        // bvh leaves are fat. Reject instances which don't touch query box.
+        const bxAABB overlap( maxPerElem( world_aabb.min, worldAABB.min ), minPerElem( world_aabb.max, worldAABB.max ) );
+        if( _mm_movemask_ps( vec_cmpgt( overlap.min.get128(), overlap.max.get128() ) ) & 0x7 )
+            continue;
 
-        _scene_aabb = bxAABB::prepare();
+        ActorInstance ai;
+        ai.id = _mesh_data.actor_id[i];
+        ai.instance = pdata.instance;
+        array::push_back( *result, ai );
+        ++count;
+    }
+    return count;
+}
 
-        const u32 n = _mesh_data.size;
-        for( u32 i = 0; i < n; ++i )
-        {
-            const u32 num_instances = _mesh_data.num_instances[i];
-            Matrix4* matrices = getMatrixPtr( _mesh_data.matrices[i], num_instances );
-            const bxAABB& local_aabb = _mesh_data.local_aabb[i];
+namespace renderer_scene_internal
+{
+    struct RayCastData
+    {
+        MeshMatrix* matrices;
+        bxAABB* local_aabb;
+        u32* num_instances;
 
-            for( u32 imatrix = 0; imatrix < num_instances; ++imatrix )
-            {
-                const Matrix4& matrix = matrices[imatrix];
-                const bxAABB world_aabb = bxAABB::transform( matrix, local_aabb );
-                _scene_aabb = bxAABB::merge( _scene_aabb, world_aabb );
-            }
-        }
-        sceneWorldAABB[0] = _scene_aabb;
+        u64 hit_key;
+        f32 hit_t;
+    };
+
+    static float RayCastInstance( void* udata, u64 userData, const Vector3& origin, const Vector3& dir, float maxT )
+    {
+        RayCastData* data = (RayCastData*)udata;
+        ProxyData pdata;
+        pdata.hash = userData;
+
+        const u32 i = pdata.actor_index;
+        const Matrix4* matrices = getMatrixPtr( data->matrices[i], data->num_instances[i] );
+        const bxAABB& local_aabb = data->local_aabb[i];
+
+        // ray vs oriented box in instance local space
+        const Matrix4 world_inv = inverse( matrices[pdata.instance] );
+        const Vector3 local_origin = ( world_inv * Point3( origin ) ).getXYZ();
+        const Vector3 local_dir = ( world_inv * dir ).getXYZ();
+        const Vector3 rcp_dir = divPerElem( Vector3( 1.f ), local_dir );
+
+        const Vector3 t0 = mulPerElem( local_aabb.min - local_origin, rcp_dir );
+        const Vector3 t1 = mulPerElem( local_aabb.max - local_origin, rcp_dir );
+        const float tmin = maxElem( minPerElem( t0, t1 ) ).getAsFloat();
+        const float tmax = minElem( maxPerElem( t0, t1 ) ).getAsFloat();
+        
+        const float t = maxOfPair( tmin, 0.f );
+        if( tmax < t || t > maxT )
+            return maxT;
+
+        data->hit_key = userData;
+        data->hit_t = t;
+        
+        // clip the ray. Keep it alive when hit is exactly at origin
+        return maxOfPair( t, FLT_EPSILON );
     }
+}///
+
+bool SceneImpl::RayCast( ActorInstance* result, f32* t, const Vector3& origin, const Vector3& dir, f32 maxT )
+{
+    renderer_scene_internal::RayCastData data;
+    data.matrices = _mesh_data.matrices;
+    data.local_aabb = _mesh_data.local_aabb;
+    data.num_instances = _mesh_data.num_instances;
+    data.hit_key = UINT64_MAX;
+    data.hit_t = maxT;
+    
+    _bvh.RayCast( origin, dir, maxT, renderer_scene_internal::RayCastInstance, &data );
+    if( data.hit_key == UINT64_MAX )
+        return false;
+
+    renderer_scene_internal::ProxyData pdata;
+    pdata.hash = data.hit_key;
+    result->id = _mesh_data.actor_id[pdata.actor_index];
+    result->instance = pdata.instance;
+    t[0] = data.hit_t;
+    return true;
 }
 
 void SceneImpl::EnableSunSkyLight( const SunSkyLight& data /*= SunSkyLight() */ )
@@ -412,8 +578,10 @@ void SceneImpl::_SetToDefaults( u32 index )
     if( _mesh_data.num_instances[index] > 1 )
     {
         BX_FREE( bxDefaultAllocator(), _mesh_data.matrices[index]._multi );
+        BX_FREE( bxDefaultAllocator(), _mesh_data.proxies[index]._multi );
         memset( &_mesh_data.matrices[index], 0x00, sizeof( MeshMatrix ) );
     }
+    _mesh_data.proxies[index] = {};
     _mesh_data.num_instances[index] = 0;
 }
 
@@ -428,6 +596,7 @@ void SceneImpl::_AllocateMeshData( u32 newCapacity, bxAllocator* allocator )
     mem_size += newCapacity * sizeof( *_mesh_data.actor_id );
     mem_size += newCapacity * sizeof( *_mesh_data.names );
     mem_size += newCapacity * sizeof( *_mesh_data.flags );
+    mem_size += newCapacity * sizeof( *_mesh_data.proxies );
 
     void* mem = BX_MALLOC( allocator, mem_size, 16 );
     memset( mem, 0x00, mem_size );
@@ -447,6 +616,7 @@ void SceneImpl::_AllocateMeshData( u32 newCapacity, bxAllocator* allocator )
     new_data.num_instances  = chunker.add< u32 >( newCapacity );
     new_data.actor_id       = chunker.add< ActorID >( newCapacity );
     new_data.names          = chunker.add< char* >( newCapacity );
+    new_data.proxies        = chunker.add< MeshProxy >( newCapacity );
     chunker.check();
 
     if( _mesh_data.size )
@@ -459,6 +629,7 @@ void SceneImpl::_AllocateMeshData( u32 newCapacity, bxAllocator* allocator )
         BX_CONTAINER_COPY_DATA( &new_data, &_mesh_data, num_instances );
         BX_CONTAINER_COPY_DATA( &new_data, &_mesh_data, actor_id );
         BX_CONTAINER_COPY_DATA( &new_data, &_mesh_data, names );
+        BX_CONTAINER_COPY_DATA( &new_data, &_mesh_data, proxies );
     }
 
     BX_FREE( allocator, _mesh_data._memory_handle );
@@ -473,6 +644,21 @@ u32 SceneImpl::_GetIndex( ActorID mi )
     return index;
 }
 
+void SceneImpl::_UpdateProxies( u32 index, u32 begin, u32 count )
+{
+    const u32 num_instances = _mesh_data.num_instances[index];
+    SYS_ASSERT( begin + count <= num_instances );
+
+    const Matrix4* matrices = getMatrixPtr( _mesh_data.matrices[index], num_instances );
+    const u32* proxies = getProxyPtr( _mesh_data.proxies[index], num_instances );
+    const bxAABB& local_aabb = _mesh_data.local_aabb[index];
+    for( u32 i = begin; i < begin + count; ++i )
+    {
+        const bxAABB world_aabb = bxAABB::transform( matrices[i], local_aabb );
+        _bvh.MoveProxy( proxies[i], world_aabb );
+    }
+}
+
 }}///
 
 namespace bx { namespace gfx {
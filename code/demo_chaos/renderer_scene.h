@@ -5,6 +5,7 @@
 #include <util/containers.h>
 #include <util/view_frustum.h>
 #include <util/bbox.h>
+#include <util/dynamic_aabb_tree.h>
 
 #include "renderer_type.h"
 #include "renderer_camera.h"
@@ -19,6 +20,18 @@ union MeshMatrix
     Matrix4* _multi;
 };
 
+// --- bvh proxy per actor instance
+union MeshProxy
+{
+    u32 _single = DynamicAABBTree::eNULL_NODE;
+    u32* _multi;
+};
+
+struct ActorInstance
+{
+    ActorID id = {};
+    u32 instance = 0;
+};
 
 
 union MeshSource
@@ -79,9 +92,13 @@ struct SceneImpl
     void SetLocalAABB( ActorID mi, const bxAABB& aabb );
 
     void BuildCommandBuffer( rdi::CommandBuffer cmdb, VertexTransformData* vtransform, rdi::ResourceDescriptor frameDataRDesc, const Camera& camera );
-    void BuildCommandBufferShadow( rdi::CommandBuffer cmdb, VertexTransformData* vtransform, rdi::Pipeline depthPipeline, const Matrix4& lightWorld, const ViewFrustum& lightFrustum );
+    void BuildCommandBufferShadow( rdi::CommandBuffer cmdb, VertexTransformData* vtransform, rdi::Pipeline depthPipeline, rdi::Pipeline depthPipelinePacked, const Matrix4& lightWorld, const ViewFrustum& lightFrustum );
     void ComputeAABB( bxAABB* sceneWorldAABB );
 
+    // -- spatial queries. Results are per instance.
+    u32  QueryAABB( array_t<ActorInstance>* result, const bxAABB& worldAABB );
+    bool RayCast( ActorInstance* result, f32* t, const Vector3& origin, const Vector3& dir, f32 maxT = FLT_MAX );
+
     void EnableSunSkyLight( const SunSkyLight& data = SunSkyLight() );
     void DisableSunSkyLight();
     SunSkyLight* GetSunSkyLight();
@@ -92,11 +109,13 @@ private:
     void _SetToDefaults( u32 index );
     void _AllocateMeshData( u32 newSize, bxAllocator* allocator );
     u32  _GetIndex( ActorID mi );
+    void _UpdateProxies( u32 index, u32 begin, u32 count );
 
     struct MeshData
     {
         void*           _memory_handle = nullptr;
         MeshMatrix*     matrices       = nullptr;
+        MeshProxy*      proxies        = nullptr;
         bxAABB*         local_aabb     = nullptr;
         MeshSource*     mesh_source    = nullptr;
         MaterialHandle* materials      = nullptr;
@@ -111,8 +130,8 @@ private:
 
     SunSkyLight* _sun_sky_light = nullptr;
 
-    bxAABB _scene_aabb = {};
-    u32 _scene_aabb_dirty = 0;
+    DynamicAABBTree _bvh;
+    array_t<u64>    _bvh_query_result;
 
     const char* _name = nullptr;
     bxAllocator* _allocator = nullptr;
@@ -0,0 +1,660 @@
+#include "ship_heightfield.h"
+#include <util/array.h>
+#include <util/common.h>
+#include <util/debug.h>
+#include <stdio.h>
+#include <math.h>
+
+namespace bx{ namespace ship{
+
+namespace
+{
+    inline u64 _AlignUp( u64 value, u64 alignment )
+    {
+        return ( ( value + alignment - 1 ) / alignment ) * alignment;
+    }
+
+    // returns number of levels. Offsets are in floats from tile begin, last entry is tile size
+    u32 _ComputeLevelOffsets( u32* offsets, u32 tileCells )
+    {
+        const u32 side = tileCells + 1;
+        u32 offset = side * side;
+        u32 num_levels = 0;
+        for( u32 res = tileCells / HeightfieldHeader::LEAF_CELLS; res > 0; res /= 2 )
+        {
+            offsets[num_levels++] = offset;
+            offset += res * res * 2;
+        }
+        offsets[num_levels] = offset;
+        return num_levels;
+    }
+
+    void _BuildPyramid( f32* tile, u32 tileCells, const u32* levelOffsets, u32 numLevels )
+    {
+        const u32 side = tileCells + 1;
+        const u32 leaf = HeightfieldHeader::LEAF_CELLS;
+
+        u32 res = tileCells / leaf;
+        f32* level = tile + levelOffsets[0];
+        for( u32 nz = 0; nz < res; ++nz )
+        {
+            for( u32 nx = 0; nx < res; ++nx )
+            {
+                f32 lo = FLT_MAX;
+                f32 hi = -FLT_MAX;
+                for( u32 z = nz * leaf; z <= ( nz + 1 ) * leaf; ++z )
+                {
+                    for( u32 x = nx * leaf; x <= ( nx + 1 ) * leaf; ++x )
+                    {
+                        const f32 h = tile[z * side + x];
+                        lo = minOfPair( lo, h );
+                        hi = maxOfPair( hi, h );
+                    }
+                }
+                level[( nz * res + nx ) * 2 + 0] = lo;
+                level[( nz * res + nx ) * 2 + 1] = hi;
+            }
+        }
+
+        for( u32 ilevel = 1; ilevel < numLevels; ++ilevel )
+        {
+            const f32* child = tile + levelOffsets[ilevel - 1];
+            const u32 child_res = res;
+            res /= 2;
+            level = tile + levelOffsets[ilevel];
+            for( u32 nz = 0; nz < res; ++nz )
+            {
+                for( u32 nx = 0; nx < res; ++nx )
+                {
+                    const f32* c00 = child + ( ( nz * 2 + 0 ) * child_res + nx * 2 ) * 2;
+                    const f32* c01 = child + ( ( nz * 2 + 1 ) * child_res + nx * 2 ) * 2;
+                    level[( nz * res + nx ) * 2 + 0] = minOfPair( minOfPair( c00[0], c00[2] ), minOfPair( c01[0], c01[2] ) );
+                    level[( nz * res + nx ) * 2 + 1] = maxOfPair( maxOfPair( c00[1], c00[3] ), maxOfPair( c01[1], c01[3] ) );
+                }
+            }
+        }
+    }
+
+    // reads 'numRows' rows and converts them to heights
+    bool _ReadRows( f32* output, FILE* src, u32 rowLength, u32 numRows, f32 scaleY, f32 offsetY )
+    {
+        const size_t count = (size_t)rowLength * numRows;
+        if( fread( output, sizeof( f32 ), count, src ) != count )
+            return false;
+
+        for( size_t i = 0; i < count; ++i )
+            output[i] = ( ::expf( output[i] ) - 1.f ) * scaleY - offsetY;
+
+        return true;
+    }
+}
+
+int HeightfieldBuildFromR32( const char* dstAbsPath, const char* srcAbsPath, const HeightfieldBuildDesc& desc )
+{
+    const u32 T = desc.tile_cells;
+    SYS_ASSERT( isPowerOfTwo( T ) && T >= HeightfieldHeader::LEAF_CELLS );
+
+    FILE* src = nullptr;
+    if( fopen_s( &src, srcAbsPath, "rb" ) != 0 )
+    {
+        bxLogError( "Can not open heightfield source %s", srcAbsPath );
+        return -1;
+    }
+
+    _fseeki64( src, 0, SEEK_END );
+    const u64 src_size = (u64)_ftelli64( src );
+    _fseeki64( src, 0, SEEK_SET );
+
+    // r32 has no header, field is assumed to be square
+    const u32 n = (u32)::sqrt( (f64)( src_size / sizeof( f32 ) ) );
+    if( n < 2 || (u64)n * n * sizeof( f32 ) != src_size )
+    {
+        bxLogError( "Heightfield source %s is not square", srcAbsPath );
+        fclose( src );
+        return -1;
+    }
+
+    HeightfieldHeader header = {};
+    header.tag = HeightfieldHeader::TAG;
+    header.version = HeightfieldHeader::VERSION;
+    header.num_samples_x = n;
+    header.num_samples_z = n;
+    header.tile_cells = T;
+    header.num_tiles_x = ( n - 1 + T - 1 ) / T;
+    header.num_tiles_z = header.num_tiles_x;
+    header.cell_size = desc.cell_size;
+    header.origin_x = -(f32)n * 0.5f * desc.cell_size;
+    header.origin_z = header.origin_x;
+
+    u32 level_offsets[17];
+    header.num_levels = _ComputeLevelOffsets( level_offsets, T );
+    const u32 tile_num_floats = level_offsets[header.num_levels];
+    header.tile_stride = _AlignUp( tile_num_floats * sizeof( f32 ), HeightfieldHeader::ALIGNMENT );
+
+    const u32 num_tiles = header.num_tiles_x * header.num_tiles_z;
+    header.tiles_offset = _AlignUp( sizeof( HeightfieldHeader ) + num_tiles * 2 * sizeof( f32 ), HeightfieldHeader::ALIGNMENT );
+
+    // band holds T+1 rows, which is one row of tiles
+    const u32 band_rows = T + 1;
+    array_t<f32> band;
+    array::resize( band, n * band_rows );
+
+    // lowest sample defines vertical offset (as it always did for ship terrain)
+    f32 min_raw = FLT_MAX;
+    for( u32 row = 0; row < n; row += band_rows )
+    {
+        const u32 count = minOfPair( band_rows, n - row );
+        const size_t num_read = fread( band.begin(), sizeof( f32 ), (size_t)n * count, src );
+        SYS_ASSERT( num_read == (size_t)n * count );
+        for( size_t i = 0; i < num_read; ++i )
+            min_raw = minOfPair( min_raw, band[(u32)i] );
+    }
+    const f32 offset_y = ::fabsf( min_raw ) + desc.height_offset;
+    _fseeki64( src, 0, SEEK_SET );
+
+    FILE* dst = nullptr;
+    if( fopen_s( &dst, dstAbsPath, "wb" ) != 0 )
+    {
+        bxLogError( "Can not create heightfield %s", dstAbsPath );
+        fclose( src );
+        return -1;
+    }
+
+    array_t<f32> tile_bounds;
+    array::resize( tile_bounds, num_tiles * 2 );
+
+    array_t<u8> block;
+    array::resize( block, (u32)header.tiles_offset );
+    memset( block.begin(), 0, header.tiles_offset );
+    bool ok = fwrite( block.begin(), 1, (size_t)header.tiles_offset, dst ) == header.tiles_offset;
+
+    array::resize( block, (u32)header.tile_stride );
+    memset( block.begin(), 0, header.tile_stride );
+    f32* tile = (f32*)block.begin();
+    const u32 side = T + 1;
+
+    // first row of band is the last row of previous one
+    ok = ok && _ReadRows( band.begin(), src, n, 1, desc.height_scale, offset_y );
+    for( u32 tz = 0; tz < header.num_tiles_z && ok; ++tz )
+    {
+        const u32 row_begin = tz * T;
+        if( tz > 0 )
+            memcpy( band.begin(), band.begin() + T * n, n * sizeof( f32 ) );
+
+        const u32 num_rows = minOfPair( band_rows, n - row_begin );
+        ok = _ReadRows( band.begin() + n, src, n, num_rows - 1, desc.height_scale, offset_y );
+
+        for( u32 tx = 0; tx < header.num_tiles_x && ok; ++tx )
+        {
+            // tiles at field edge are padded by replicating last sample
+            for( u32 lz = 0; lz < side; ++lz )
+            {
+                const f32* src_row = band.begin() + minOfPair( lz, num_rows - 1 ) * n;
+                for( u32 lx = 0; lx < side; ++lx )
+                    tile[lz * side + lx] = src_row[minOfPair( tx * T + lx, n - 1 )];
+            }
+            _BuildPyramid( tile, T, level_offsets, header.num_levels );
+
+            const f32* root = tile + level_offsets[header.num_levels - 1];
+            const u32 tile_index = tz * header.num_tiles_x + tx;
+            tile_bounds[tile_index * 2 + 0] = root[0];
+            tile_bounds[tile_index * 2 + 1] = root[1];
+
+            ok = fwrite( block.begin(), 1, (size_t)header.tile_stride, dst ) == header.tile_stride;
+        }
+    }
+
+    if( ok )
+    {
+        _fseeki64( dst, 0, SEEK_SET );
+        ok = fwrite( &header, sizeof( header ), 1, dst ) == 1;
+        ok = ok && fwrite( tile_bounds.begin(), sizeof( f32 ), tile_bounds.size, dst ) == tile_bounds.size;
+    }
+
+    fclose( dst );
+    fclose( src );
+    if( !ok )
+    {
+        bxLogError( "Writing heightfield %s failed", dstAbsPath );
+        return -1;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+int Heightfield::Open( const char* absPath )
+{
+    SYS_ASSERT( !IsOpen() );
+    SYS_ASSERT( ( HeightfieldHeader::ALIGNMENT % bxIO::mapViewAlignment() ) == 0 );
+
+    if( bxIO::mapFile( &_file, absPath ) != 0 )
+        return -1;
+
+    bool ok = _file.size >= sizeof( HeightfieldHeader );
+    u64 tiles_offset = 0;
+    if( ok )
+    {
+        const HeightfieldHeader* h = (const HeightfieldHeader*)bxIO::mapView( _file, 0, sizeof( HeightfieldHeader ) );
+        ok = h
+            && h->tag == HeightfieldHeader::TAG
+            && h->version == HeightfieldHeader::VERSION
+            && h->tiles_offset + (u64)h->num_tiles_x * h->num_tiles_z * h->tile_stride <= _file.size;
+        tiles_offset = ( ok ) ? h->tiles_offset : 0;
+        bxIO::unmapView( h );
+    }
+    if( !ok )
+    {
+        bxLogError( "Invalid heightfield %s", absPath );
+        bxIO::unmapFile( &_file );
+        return -1;
+    }
+
+    // header and tile bounds stay mapped
+    _header = (const HeightfieldHeader*)bxIO::mapView( _file, 0, (size_t)tiles_offset );
+    _tile_bounds = (const f32*)( _header + 1 );
+
+    u32 level_offsets[17];
+    const u32 num_levels = _ComputeLevelOffsets( level_offsets, _header->tile_cells );
+    SYS_ASSERT( num_levels == _header->num_levels );
+    memcpy( _level_offset, level_offsets, sizeof( _level_offset ) );
+    _num_tile_samples = ( _header->tile_cells + 1 ) * ( _header->tile_cells + 1 );
+
+    const u32 num_tiles = _header->num_tiles_x * _header->num_tiles_z;
+    array::resize( _tiles, num_tiles );
+    _min_y = FLT_MAX;
+    _max_y = -FLT_MAX;
+    for( u32 i = 0; i < num_tiles; ++i )
+    {
+        _tiles[i] = nullptr;
+        _min_y = minOfPair( _min_y, _tile_bounds[i * 2 + 0] );
+        _max_y = maxOfPair( _max_y, _tile_bounds[i * 2 + 1] );
+    }
+    _stats = {};
+    return 0;
+}
+
+void Heightfield::Close()
+{
+    if( !IsOpen() )
+        return;
+
+    for( u32 i = 0; i < _tiles.size; ++i )
+        _Evict( i );
+
+    array::clear( _tiles );
+    bxIO::unmapView( _header );
+    bxIO::unmapFile( &_file );
+    _header = nullptr;
+    _tile_bounds = nullptr;
+}
+
+const f32* Heightfield::_Tile( u32 tx, u32 tz )
+{
+    const u32 index = tz * _header->num_tiles_x + tx;
+    if( !_tiles[index] )
+    {
+        const size_t offset = (size_t)( _header->tiles_offset + index * _header->tile_stride );
+        _tiles[index] = (const f32*)bxIO::mapView( _file, offset, (size_t)_header->tile_stride );
+        SYS_ASSERT( _tiles[index] != nullptr );
+        _stats.num_resident_tiles += 1;
+        _stats.num_page_ins += 1;
+    }
+    return _tiles[index];
+}
+
+void Heightfield::_Evict( u32 tileIndex )
+{
+    if( !_tiles[tileIndex] )
+        return;
+
+    bxIO::unmapView( _tiles[tileIndex] );
+    _tiles[tileIndex] = nullptr;
+    _stats.num_resident_tiles -= 1;
+    _stats.num_evictions += 1;
+}
+
+void Heightfield::UpdateResidency( f32 x, f32 z, f32 radius )
+{
+    // any neighbour of a tile inside the circle (diagonal too) is closer than radius + tile diagonal
+    const f32 tile_size = _header->tile_cells * _header->cell_size;
+    const f32 keep_radius = radius + tile_size * 1.4143f;
+    const f32 radius_sqr = radius * radius;
+    const f32 keep_radius_sqr = keep_radius * keep_radius;
+
+    for( u32 tz = 0; tz < _header->num_tiles_z; ++tz )
+    {
+        for( u32 tx = 0; tx < _header->num_tiles_x; ++tx )
+        {
+            const f32 dist_sqr = TileDistanceSqr( tx, tz, x, z );
+            if( dist_sqr <= radius_sqr )
+                _Tile( tx, tz );
+            else if( dist_sqr > keep_radius_sqr )
+                _Evict( tz * _header->num_tiles_x + tx );
+        }
+    }
+}
+
+namespace
+{
+    // triangles of cell are (00,10,11) and (00,11,01), render mesh (ship_terrain.cpp) uses the same split
+    inline f32 _CellHeight( const f32* h00, u32 side, f32 fx, f32 fz )
+    {
+        const f32 a = h00[0];
+        const f32 b = h00[1];
+        const f32 c = h00[side];
+        const f32 d = h00[side + 1];
+        return ( fx >= fz )
+            ? a + ( b - a ) * fx + ( d - b ) * fz
+            : a + ( d - c ) * fx + ( c - a ) * fz;
+    }
+}
+
+f32 Heightfield::GetHeight( f32 x, f32 z )
+{
+    f32 h = 0.f;
+    const Vector3 point( x, 0.f, z );
+    GetHeights( &h, &point, 1 );
+    return h;
+}
+
+void Heightfield::GetHeights( f32* heights, const Vector3* points, u32 count )
+{
+    const HeightfieldHeader& hdr = *_header;
+    const f32 cell_inv = 1.f / hdr.cell_size;
+    const f32 max_gx = (f32)( hdr.num_samples_x - 1 );
+    const f32 max_gz = (f32)( hdr.num_samples_z - 1 );
+    const i32 max_cx = (i32)hdr.num_samples_x - 2;
+    const i32 max_cz = (i32)hdr.num_samples_z - 2;
+    const u32 T = hdr.tile_cells;
+    const u32 side = T + 1;
+
+    // consecutive points usually hit the same tile
+    u32 cached_index = UINT32_MAX;
+    const f32* tile = nullptr;
+    for( u32 i = 0; i < count; ++i )
+    {
+        const f32 gx = clamp( ( points[i].getX().getAsFloat() - hdr.origin_x ) * cell_inv, 0.f, max_gx );
+        const f32 gz = clamp( ( points[i].getZ().getAsFloat() - hdr.origin_z ) * cell_inv, 0.f, max_gz );
+        const i32 cx = minOfPair( (i32)gx, max_cx );
+        const i32 cz = minOfPair( (i32)gz, max_cz );
+        const u32 tx = cx / T;
+        const u32 tz = cz / T;
+
+        const u32 tile_index = tz * hdr.num_tiles_x + tx;
+        if( tile_index != cached_index )
+        {
+            tile = _Tile( tx, tz );
+            cached_index = tile_index;
+        }
+
+        const u32 lx = cx - tx * T;
+        const u32 lz = cz - tz * T;
+        heights[i] = _CellHeight( tile + lz * side + lx, side, gx - cx, gz - cz );
+    }
+}
+
+f32 Heightfield::Sample( i32 ix, i32 iz )
+{
+    const u32 T = _header->tile_cells;
+    const u32 x = (u32)clamp( ix, 0, (i32)_header->num_samples_x - 1 );
+    const u32 z = (u32)clamp( iz, 0, (i32)_header->num_samples_z - 1 );
+    const u32 tx = minOfPair( x / T, _header->num_tiles_x - 1 );
+    const u32 tz = minOfPair( z / T, _header->num_tiles_z - 1 );
+    return _Tile( tx, tz )[( z - tz * T ) * ( T + 1 ) + ( x - tx * T )];
+}
+
+Vector3 Heightfield::TileMin( u32 tx, u32 tz ) const
+{
+    const f32 tile_size = _header->tile_cells * _header->cell_size;
+    const f32 y = _tile_bounds[( tz * _header->num_tiles_x + tx ) * 2 + 0];
+    return Vector3( _header->origin_x + tx * tile_size, y, _header->origin_z + tz * tile_size );
+}
+Vector3 Heightfield::TileMax( u32 tx, u32 tz ) const
+{
+    const f32 tile_size = _header->tile_cells * _header->cell_size;
+    const f32 y = _tile_bounds[( tz * _header->num_tiles_x + tx ) * 2 + 1];
+    return Vector3( _header->origin_x + ( tx + 1 ) * tile_size, y, _header->origin_z + ( tz + 1 ) * tile_size );
+}
+f32 Heightfield::TileDistanceSqr( u32 tx, u32 tz, f32 x, f32 z ) const
+{
+    const f32 tile_size = _header->tile_cells * _header->cell_size;
+    const f32 lx = x - _header->origin_x;
+    const f32 lz = z - _header->origin_z;
+    const f32 dx = maxOfPair( 0.f, maxOfPair( tx * tile_size - lx, lx - ( tx + 1 ) * tile_size ) );
+    const f32 dz = maxOfPair( 0.f, maxOfPair( tz * tile_size - lz, lz - ( tz + 1 ) * tile_size ) );
+    return dx*dx + dz*dz;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Raycast works in grid space: x and z in cells, y in world units. Ray parameter is the same as in world space.
+namespace
+{
+    inline bool _IntersectBox( f32* tmin, f32* tmax, const f32 o[3], const f32 dinv[3], const f32 bmin[3], const f32 bmax[3] )
+    {
+        f32 t0 = tmin[0];
+        f32 t1 = tmax[0];
+        for( int i = 0; i < 3; ++i )
+        {
+            f32 ta = ( bmin[i] - o[i] ) * dinv[i];
+            f32 tb = ( bmax[i] - o[i] ) * dinv[i];
+            if( ta > tb )
+                Swap( ta, tb );
+            t0 = maxOfPair( t0, ta );
+            t1 = minOfPair( t1, tb );
+        }
+        tmin[0] = t0;
+        tmax[0] = t1;
+        return t0 <= t1;
+    }
+
+    // two sided
+    inline bool _IntersectTriangle( f32* t, const f32 o[3], const f32 d[3], const f32 p0[3], const f32 p1[3], const f32 p2[3] )
+    {
+        const f32 e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const f32 e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        const f32 p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+        const f32 det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if( ::fabsf( det ) < 1e-12f )
+            return false;
+
+        const f32 det_inv = 1.f / det;
+        const f32 s[3] = { o[0] - p0[0], o[1] - p0[1], o[2] - p0[2] };
+        const f32 u = ( s[0] * p[0] + s[1] * p[1] + s[2] * p[2] ) * det_inv;
+        if( u < 0.f || u > 1.f )
+            return false;
+
+        const f32 q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        const f32 v = ( d[0] * q[0] + d[1] * q[1] + d[2] * q[2] ) * det_inv;
+        if( v < 0.f || u + v > 1.f )
+            return false;
+
+        t[0] = ( e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2] ) * det_inv;
+        return true;
+    }
+
+    struct RayNode
+    {
+        u32 level;
+        u32 x;
+        u32 z;
+    };
+}
+
+bool Heightfield::_RaycastTile( HeightfieldRayHit* hit, u32 tx, u32 tz, const f32 o[3], const f32 d[3], const f32 dinv[3], f32 tmin, f32 tmax )
+{
+    const u32 T = _header->tile_cells;
+    const u32 side = T + 1;
+    const f32 base_x = (f32)( tx * T );
+    const f32 base_z = (f32)( tz * T );
+
+    // whole tile is tested with resident bounds first, so tiles which are missed are not paged in
+    {
+        const f32* bounds = _tile_bounds + ( tz * _header->num_tiles_x + tx ) * 2;
+        const f32 bmin[3] = { base_x, bounds[0], base_z };
+        const f32 bmax[3] = { base_x + T, bounds[1], base_z + T };
+        f32 t0 = tmin, t1 = tmax;
+        if( !_IntersectBox( &t0, &t1, o, dinv, bmin, bmax ) )
+            return false;
+    }
+
+    const f32* tile = _Tile( tx, tz );
+
+    // depth first, children ordered front to back. Nodes are disjoint in xz, so first hit is the closest one
+    RayNode stack[64];
+    u32 stack_size = 0;
+    stack[stack_size++] = { _header->num_levels - 1, 0, 0 };
+
+    while( stack_size )
+    {
+        const RayNode node = stack[--stack_size];
+        if( node.level == 0 )
+        {
+            const u32 leaf = HeightfieldHeader::LEAF_CELLS;
+            f32 best_t = tmax;
+            u32 best_cell = UINT32_MAX;
+            u32 best_triangle = 0;
+            for( u32 cz = node.z * leaf; cz < ( node.z + 1 ) * leaf; ++cz )
+            {
+                for( u32 cx = node.x * leaf; cx < ( node.x + 1 ) * leaf; ++cx )
+                {
+                    const f32* h = tile + cz * side + cx;
+                    const f32 x0 = base_x + cx;
+                    const f32 z0 = base_z + cz;
+                    const f32 p00[3] = { x0      , h[0]       , z0 };
+                    const f32 p10[3] = { x0 + 1.f, h[1]       , z0 };
+                    const f32 p01[3] = { x0      , h[side]    , z0 + 1.f };
+                    const f32 p11[3] = { x0 + 1.f, h[side + 1], z0 + 1.f };
+
+                    f32 t;
+                    if( _IntersectTriangle( &t, o, d, p00, p10, p11 ) && t >= tmin && t < best_t )
+                    {
+                        best_t = t;
+                        best_cell = cz * side + cx;
+                        best_triangle = 0;
+                    }
+                    if( _IntersectTriangle( &t, o, d, p00, p11, p01 ) && t >= tmin && t < best_t )
+                    {
+                        best_t = t;
+                        best_cell = cz * side + cx;
+                        best_triangle = 1;
+                    }
+                }
+            }
+
+            if( best_cell != UINT32_MAX )
+            {
+                const f32 cs = _header->cell_size;
+                const f32* h = tile + best_cell;
+                const Vector3 p00( 0.f, h[0], 0.f );
+                const Vector3 p10( cs, h[1], 0.f );
+                const Vector3 p01( 0.f, h[side], cs );
+                const Vector3 p11( cs, h[side + 1], cs );
+                Vector3 n = ( best_triangle == 0 ) ? cross( p11 - p00, p10 - p00 ) : cross( p01 - p00, p11 - p00 );
+                hit->normal = normalize( n );
+                hit->t = best_t;
+                return true;
+            }
+            continue;
+        }
+
+        // children sorted by entry distance, pushed back to front
+        const u32 child_level = node.level - 1;
+        const u32 child_res = ( T / HeightfieldHeader::LEAF_CELLS ) >> child_level;
+        const u32 child_cells = HeightfieldHeader::LEAF_CELLS << child_level;
+        const f32* child_bounds = tile + _level_offset[child_level];
+
+        RayNode children[4];
+        f32 children_t[4];
+        u32 num_children = 0;
+        for( u32 i = 0; i < 4; ++i )
+        {
+            const u32 cx = node.x * 2 + ( i & 1 );
+            const u32 cz = node.z * 2 + ( i >> 1 );
+            const f32* mm = child_bounds + ( cz * child_res + cx ) * 2;
+            const f32 bmin[3] = { base_x + cx * child_cells, mm[0], base_z + cz * child_cells };
+            const f32 bmax[3] = { bmin[0] + child_cells, mm[1], bmin[2] + child_cells };
+            f32 t0 = tmin, t1 = tmax;
+            if( !_IntersectBox( &t0, &t1, o, dinv, bmin, bmax ) )
+                continue;
+
+            u32 j = num_children++;
+            for( ; j > 0 && children_t[j - 1] < t0; --j )
+            {
+                children[j] = children[j - 1];
+                children_t[j] = children_t[j - 1];
+            }
+            children[j] = { child_level, cx, cz };
+            children_t[j] = t0;
+        }
+
+        SYS_ASSERT( stack_size + num_children <= 64 );
+        for( u32 i = 0; i < num_children; ++i )
+            stack[stack_size++] = children[i];
+    }
+
+    return false;
+}
+
+bool Heightfield::Raycast( HeightfieldRayHit* hit, const Vector3& origin, const Vector3& dir, f32 maxT )
+{
+    const HeightfieldHeader& hdr = *_header;
+    const f32 cell_inv = 1.f / hdr.cell_size;
+    const f32 o[3] = { ( origin.getX().getAsFloat() - hdr.origin_x ) * cell_inv, origin.getY().getAsFloat(), ( origin.getZ().getAsFloat() - hdr.origin_z ) * cell_inv };
+    const f32 d[3] = { dir.getX().getAsFloat() * cell_inv, dir.getY().getAsFloat(), dir.getZ().getAsFloat() * cell_inv };
+    f32 dinv[3];
+    for( int i = 0; i < 3; ++i )
+        dinv[i] = ( ::fabsf( d[i] ) > 1e-20f ) ? 1.f / d[i] : ( ( d[i] < 0.f ) ? -1e30f : 1e30f );
+
+    f32 t0 = 0.f;
+    f32 t1 = maxT;
+    {
+        const f32 bmin[3] = { 0.f, _min_y, 0.f };
+        const f32 bmax[3] = { (f32)( hdr.num_samples_x - 1 ), _max_y, (f32)( hdr.num_samples_z - 1 ) };
+        if( !_IntersectBox( &t0, &t1, o, dinv, bmin, bmax ) )
+            return false;
+    }
+
+    // 2d dda over tiles
+    const f32 T = (f32)hdr.tile_cells;
+    const f32 px = o[0] + d[0] * t0;
+    const f32 pz = o[2] + d[2] * t0;
+    i32 tx = clamp( (i32)::floorf( px / T ), 0, (i32)hdr.num_tiles_x - 1 );
+    i32 tz = clamp( (i32)::floorf( pz / T ), 0, (i32)hdr.num_tiles_z - 1 );
+
+    const i32 step_x = ( d[0] > 0.f ) ? 1 : -1;
+    const i32 step_z = ( d[2] > 0.f ) ? 1 : -1;
+    const f32 delta_x = ( d[0] != 0.f ) ? T * ::fabsf( dinv[0] ) : FLT_MAX;
+    const f32 delta_z = ( d[2] != 0.f ) ? T * ::fabsf( dinv[2] ) : FLT_MAX;
+    f32 next_x = ( d[0] != 0.f ) ? ( ( tx + ( step_x > 0 ? 1 : 0 ) ) * T - o[0] ) * dinv[0] : FLT_MAX;
+    f32 next_z = ( d[2] != 0.f ) ? ( ( tz + ( step_z > 0 ? 1 : 0 ) ) * T - o[2] ) * dinv[2] : FLT_MAX;
+
+    for( ;; )
+    {
+        if( _RaycastTile( hit, tx, tz, o, d, dinv, t0, t1 ) )
+        {
+            hit->position = origin + dir * hit->t;
+            return true;
+        }
+
+        if( next_x < next_z )
+        {
+            if( next_x > t1 )
+                break;
+            tx += step_x;
+            next_x += delta_x;
+        }
+        else
+        {
+            if( next_z > t1 )
+                break;
+            tz += step_z;
+            next_z += delta_z;
+        }
+
+        if( tx < 0 || tz < 0 || tx >= (i32)hdr.num_tiles_x || tz >= (i32)hdr.num_tiles_z )
+            break;
+    }
+    return false;
+}
+
+}}//
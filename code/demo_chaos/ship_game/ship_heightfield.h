@@ -0,0 +1,117 @@
+#pragma once
+
+#include <util/type.h>
+#include <util/containers.h>
+#include <util/filesystem.h>
+#include <util/vectormath/vectormath.h>
+
+namespace bx{ namespace ship{
+
+// Tiled heightfield file (.thf)
+// Heights are stored in world units in square tiles of 'tile_cells' cells. Tile has (tile_cells+1)^2 samples
+// (border samples are duplicated, so every tile is self contained) followed by min/max pyramid.
+// Pyramid level 0 has one node per 4x4 cells, every next level halves resolution down to single node.
+// Min/max of every tile is stored right after header. Tiles start at ALIGNMENT boundary, so each one
+// can be mapped separately.
+struct HeightfieldHeader
+{
+    enum : u32
+    {
+        TAG = 0x30464854, // THF0
+        VERSION = 1,
+        ALIGNMENT = 64 * 1024,
+        LEAF_CELLS = 4,
+    };
+
+    u32 tag;
+    u32 version;
+    u32 num_samples_x;
+    u32 num_samples_z;
+    u32 tile_cells;
+    u32 num_tiles_x;
+    u32 num_tiles_z;
+    u32 num_levels;
+    u64 tile_stride;
+    u64 tiles_offset;
+    f32 cell_size;
+    f32 origin_x;
+    f32 origin_z;
+    u32 padding;
+};
+
+struct HeightfieldBuildDesc
+{
+    u32 tile_cells = 128;       // power of 2. Render tile of 128 cells still fits u16 indices
+    f32 cell_size = 1.f;
+    f32 height_scale = 100.f;
+    f32 height_offset = 30.f;   // space below lowest sample
+};
+// Converts raw square .r32 file with exp encoded heights. Source is streamed in bands of tiles,
+// so it doesn't have to fit in memory. Field is centered at origin.
+int HeightfieldBuildFromR32( const char* dstAbsPath, const char* srcAbsPath, const HeightfieldBuildDesc& desc );
+
+struct HeightfieldRayHit
+{
+    Vector3 position{ 0.f };
+    Vector3 normal{ 0.f, 1.f, 0.f };
+    f32 t = 0.f;
+};
+
+struct HeightfieldStats
+{
+    u32 num_resident_tiles = 0;
+    u64 num_page_ins = 0;   // tile mapped
+    u64 num_evictions = 0;  // tile unmapped
+};
+
+// Memory mapped tiled heightfield.
+// Only tiles around observer are kept mapped (see UpdateResidency). Queries outside of this area map touched tiles
+// on demand, they stay mapped until UpdateResidency finds them outside of eviction radius. Not thread safe.
+class Heightfield
+{
+public:
+    int  Open( const char* absPath );
+    void Close();
+    bool IsOpen() const { return _header != nullptr; }
+
+    // maps tiles overlapping circle around (x,z). Tiles are unmapped when they are more than one ring (diagonal included)
+    // outside of the circle, so neighbours touched by queries near the border are not remapped every update
+    void UpdateResidency( f32 x, f32 z, f32 radius );
+
+    f32  GetHeight( f32 x, f32 z );
+    void GetHeights( f32* heights, const Vector3* points, u32 count );
+    // returns first hit along ray. 'dir' doesn't have to be normalized, t is in units of 'dir'
+    bool Raycast( HeightfieldRayHit* hit, const Vector3& origin, const Vector3& dir, f32 maxT );
+
+    // clamped to field
+    f32 Sample( i32 ix, i32 iz );
+
+    u32 NumTilesX() const { return _header->num_tiles_x; }
+    u32 NumTilesZ() const { return _header->num_tiles_z; }
+    u32 TileCells() const { return _header->tile_cells; }
+    f32 CellSize () const { return _header->cell_size; }
+    Vector3 TileMin( u32 tx, u32 tz ) const;
+    Vector3 TileMax( u32 tx, u32 tz ) const;
+    // squared distance from (x,z) to tile rectangle (zero when inside)
+    f32 TileDistanceSqr( u32 tx, u32 tz, f32 x, f32 z ) const;
+    bool IsResident( u32 tx, u32 tz ) const { return _tiles[tz * _header->num_tiles_x + tx] != nullptr; }
+    u64  ResidentBytes() const { return _stats.num_resident_tiles * _header->tile_stride; }
+    const HeightfieldStats& Stats() const { return _stats; }
+
+private:
+    const f32* _Tile( u32 tx, u32 tz );
+    void _Evict( u32 tileIndex );
+    bool _RaycastTile( HeightfieldRayHit* hit, u32 tx, u32 tz, const f32 origin[3], const f32 dir[3], const f32 dirInv[3], f32 tmin, f32 tmax );
+
+    bxFS::MappedFile _file;
+    const HeightfieldHeader* _header = nullptr;
+    const f32* _tile_bounds = nullptr; // min, max per tile
+    array_t<const f32*> _tiles;
+    u32 _num_tile_samples = 0;
+    u32 _level_offset[16] = {};        // in f32 from tile begin
+    f32 _min_y = 0.f;
+    f32 _max_y = 0.f;
+    HeightfieldStats _stats;
+};
+
+}}//
@@ -66,6 +66,7 @@ void Level::Tick( const GameTime& time )
     const float max_delta_time = 1.f / 60.f;
     float delta_time_acc = delta_time_sec;
 
+    _terrain.Tick( _player._pos );
     _player_camera.Tick( _player, _terrain, delta_time_sec );
     _player._input.Collect( bxWindow_get(), delta_time_sec, 0.3f );
     while( delta_time_acc > 0.f )
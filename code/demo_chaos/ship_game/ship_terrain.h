@@ -2,41 +2,49 @@
 
 #include <util/type.h>
 #include <util/vectormath/vectormath.h>
-#include <util/filesystem.h>
 #include <util/array.h>
 #include <rdi/rdi_backend.h>
 
 #include "../renderer_type.h"
+#include "ship_heightfield.h"
 
 
 namespace bx{namespace ship{
 
 struct Terrain
 {
-    bxFS::File _file = {};
-    u32 _num_samples_x = 0;
-    u32 _num_samples_z = 0;
-    f32* _samples = nullptr;
-    f32 _sample_scale_xz = 1.0f;
-    f32 _sample_scale_y = 100.f;
-    
-    u32 _num_tiles_x = 16;
-    u32 _num_tiles_z = 16;
-    
-    array_t<float3_t> _debug_points;
-    array_t<float3_t> _debug_normals;
-
-    array_t<rdi::RenderSource> _rsources;
-    array_t<gfx::ActorID > _actors;
+    Heightfield _heightfield;
+    gfx::Scene _scene = nullptr;
+    gfx::MaterialHandle _material = {};
+
+    f32 _resident_radius = 768.f;   // tiles overlapping this circle around observer are mapped and rendered
+    u32 _max_render_tiles_per_tick = 2;
+    u32 _num_render_points_per_side = 0;
     rdi::IndexBuffer _index_buffer_tile;
 
+    struct RenderTile
+    {
+        u32 tile_x;
+        u32 tile_z;
+        rdi::RenderSource rsource;
+        gfx::ActorID actor;
+    };
+    array_t<RenderTile> _render_tiles;
+
+    // .r32 heightfield is converted to tiled .thf (next to source file) when it doesn't exist yet
     void CreateFromFile( const char* filename, gfx::Scene scene );
     void Destroy();
+    // updates resident tiles and their render sources around observer
+    void Tick( const Vector3& observerPos );
 
     float GetHeightAtPoint( const Vector3 wsPoint );
+    void  GetHeightAtPoints( f32* heights, const Vector3* wsPoints, u32 count );
+    bool  Raycast( HeightfieldRayHit* hit, const Vector3& origin, const Vector3& dir, f32 maxT = FLT_MAX );
 
     void DebugDraw( u32 color );
-    
+
+    void _CreateRenderTile( u32 tx, u32 tz );
+    void _DestroyRenderTile( u32 index );
 };
 
 }}//
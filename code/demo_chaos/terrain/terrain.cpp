@@ -26,6 +26,10 @@ Instance* Create( const CreateInfo& info )
 
 void Destroy( Instance** i )
 {
+    if( !i[0] )
+        return;
+
+    i[0]->_ShutDown();
     BX_DELETE0( bxDefaultAllocator(), i[0] );
 }
 
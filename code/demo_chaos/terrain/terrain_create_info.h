@@ -24,6 +24,15 @@ struct CreateInfo
     // min and max divisions of single quad
     u32 min_tesselation_level = 2;
     f32 radius[Const::ELod::COUNT] = {};
+
+    // height field
+    f32 noise_frequency = 0.05f;
+    f32 height_scale = 8.f;
+    u32 noise_octaves = 6;
+
+    // tiles are generated asynchronously. Recently evicted tiles are cached
+    u32 num_generator_threads = 2;
+    u32 tile_cache_capacity = 256;
 };
 
 }}//
@@ -1,5 +1,8 @@
 #include "terrain_instance.h"
 #include <util/array.h>
+#include <util/common.h>
+#include <util/time.h>
+#include <util/perlin_noise.h>
 #include <rdi\rdi_debug_draw.h>
 
 #include "../imgui/imgui.h"
@@ -9,9 +12,38 @@ namespace bx{ namespace terrain{
 void Instance::DebugDraw( u32 color )
 {
     const Vector3F ext = Vector3F( _info.tile_side_length, 0.2f, _info.tile_side_length ) * 0.5f;
-    for( const Vector3F& pos : _tiles_world_pos )
+    for( u32 i = 0; i < _tiles_world_pos.size; ++i )
+    {
+        // tiles waiting for samples are drawn red
+        const u32 tile_color = ( _tiles_flags[i] & ETileFlag::READY ) ? color : 0xFF0000FF;
+        rdi::debug_draw::AddBox( Matrix4F::translation( _tiles_world_pos[i] ), ext, tile_color, 1 );
+    }
+}
+
+namespace
+{
+    // samples/sec of 256x256 fbm grid for every instruction set supported by cpu (zero for not supported)
+    // level is passed per call, so generator threads running in the background are not affected
+    void _BenchmarkNoise( f32 msamplesPerSecond[3], u32 octaves )
     {
-        rdi::debug_draw::AddBox( Matrix4F::translation( pos ), ext, color, 1 );
+        const int side = 256;
+        array_t<f32> samples;
+        array::resize( samples, side * side );
+        bxNoiseOutput out;
+        out.value = samples.begin();
+
+        const int max_level = bxNoise_simdLevel();
+        for( int level = eNOISE_SIMD_SCALAR; level <= eNOISE_SIMD_AVX2; ++level )
+        {
+            msamplesPerSecond[level] = 0.f;
+            if( level > max_level )
+                continue;
+
+            const u64 start_us = bxTime::us();
+            bxNoise_fbmGrid( (bxNoiseSimd)level, out, 0.f, 0.f, 0.f, 0.05f, 0.05f, side, side, (int)octaves );
+            const u64 duration_us = maxOfPair( bxTime::us() - start_us, (u64)1 );
+            msamplesPerSecond[level] = (f32)( side * side ) / (f32)duration_us;
+        }
     }
 }
 
@@ -22,6 +54,22 @@ void Instance::Gui()
         ImGui::Text( "grid center pos: %d, %d", _grid_center_pos.x, _grid_center_pos.y );
         ImGui::Text( "grid observer pos: %d, %d", _grid_observer_pos.x, _grid_observer_pos.y );
         ImGui::Text( "data center: %u, %u", _data_center.x, _data_center.y );
+
+        ImGui::Separator();
+        ImGui::Text( "generator threads: %u", _generator.NumThreads() );
+        ImGui::Text( "tiles/sec: %.1f", _stats.tiles_per_second );
+        ImGui::Text( "tiles generated: %llu", _generator.NumGenerated() );
+        ImGui::Text( "tiles pending: %u", _generator.NumPending() );
+        ImGui::Text( "tiles published: %u (stale: %u)", _stats.num_published, _stats.num_stale );
+        ImGui::Text( "cache: %u/%u (hits: %llu, misses: %llu)", _cache.Size(), _info.tile_cache_capacity, _cache.NumHits(), _cache.NumMisses() );
+        ImGui::Text( "tick: %llu us (worst: %llu us, last second: %llu us)", _stats.tick_us, _stats.max_tick_us, _stats.last_window_max_tick_us );
+        if( ImGui::Button( "reset worst" ) )
+            _stats.max_tick_us = 0;
+
+        ImGui::Separator();
+        if( ImGui::Button( "noise benchmark" ) )
+            _BenchmarkNoise( _noise_msamples, _info.noise_octaves );
+        ImGui::Text( "fbm Msamples/sec: scalar: %.2f, SSE: %.2f, AVX2: %.2f", _noise_msamples[0], _noise_msamples[1], _noise_msamples[2] );
     }
     ImGui::End();
 }
@@ -53,42 +101,56 @@ void Instance::_Init()
     _num_tiles_per_side = num_tiles_per_side;
     _num_tiles_in_radius = num_tiles_per_side / 2;
 
-    array::reserve( _tiles_world_pos, num_tiles_per_side * num_tiles_per_side );
-    array::reserve( _tiles_flags, _tiles_world_pos.capacity );
+    const u32 num_tiles = num_tiles_per_side * num_tiles_per_side;
+    array::reserve( _tiles_world_pos, num_tiles );
+    array::reserve( _tiles_grid_pos, num_tiles );
+    array::reserve( _tiles_generation, num_tiles );
+    array::reserve( _tiles_flags, num_tiles );
 
     _grid_center_pos = _ComputePosOnGrid( _observer_pos );
     _grid_observer_pos = _grid_center_pos;
     _data_center = Vector2UI( _num_tiles_in_radius, _num_tiles_in_radius );
 
-    const f32 off = max_radius * 0.5f;
-    const Vector3F zero_offset = Vector3F( -off, 0.f, -off );
-    const Vector3F observer_offset = toVector3Fxz( _grid_observer_pos ) * side_length;// projectVectorOnPlane( _observer_pos, _up_axis );
-
+    // data center holds observer tile, so tile (ix,iz) is placed relative to it
+    const i32 radius = (i32)_num_tiles_in_radius;
     for( u32 iz = 0; iz < num_tiles_per_side; ++iz )
     {
         for( u32 ix = 0; ix < num_tiles_per_side; ++ix )
         {
-            const float x = (f32)ix;
-            const float y = 0.f;
-            const float z = (f32)iz;
-            const Vector3F pos( x, y, z );
-            const Vector3F final_pos = ( pos * side_length ) + zero_offset + observer_offset;
-            array::push_back( _tiles_world_pos, final_pos );
-            array::push_back( _tiles_flags, (u8)0 );
+            const Vector2I grid_pos = _grid_observer_pos + Vector2I( (i32)ix - radius, (i32)iz - radius );
+            array::push_back( _tiles_world_pos, toVector3Fxz( grid_pos ) * side_length );
+            array::push_back( _tiles_grid_pos, grid_pos );
+            array::push_back( _tiles_generation, 0u );
+            array::push_back( _tiles_flags, (u8)ETileFlag::NEED_REBUILD );
         }
     }
 
+    const u32 num_side_samples = _ComputeNumDivisions( _info.min_tesselation_level + Const::ELod::COUNT );
     _num_tile_samples = _ComputeNumSamples( _info.min_tesselation_level + Const::ELod::COUNT );
 
     array::resize( _tiles_samples, _num_tile_samples * _tiles_world_pos.size );
     for( f32& sample : _tiles_samples )
         sample = 0.f;
 
+    TileNoiseDesc noise_desc;
+    noise_desc.tile_side_length = side_length;
+    noise_desc.num_side_samples = num_side_samples;
+    noise_desc.frequency = _info.noise_frequency;
+    noise_desc.height_scale = _info.height_scale;
+    noise_desc.octaves = _info.noise_octaves;
+    _generator.StartUp( noise_desc, num_tiles, _info.num_generator_threads );
+    _cache.StartUp( _info.tile_cache_capacity, _num_tile_samples );
 
-    for( u32 i = 0; i < _tiles_world_pos.size; ++i )
-    {
-        _GenerateTileSamples( i );
-    }
+    _stats = {};
+    _stats.window_start_us = bxTime::us();
+
+    // all tiles are requested in first Tick
+}
+
+void Instance::_ShutDown()
+{
+    _generator.ShutDown();
+    _cache.ShutDown();
 }
 
 namespace
@@ -156,9 +218,7 @@ void Instance::_ComputeTiles()
                 SYS_ASSERT( data_index < _tiles_world_pos.size );
 
                 Vector2I grid_pos = new_grid_observer_pos + Vector2I( xoffset, zoffset );
-                Vector3F world_pos = toVector3Fxz( grid_pos ) * _info.tile_side_length;
-                _tiles_world_pos[data_index] = world_pos;
-                _tiles_flags[data_index] |= ETileFlag::NEED_REBUILD;
+                _SetTilePos( data_index, grid_pos );
 
                 data_col = _Increment( data_col, last_index, delta.x );
             }
@@ -191,9 +251,7 @@ void Instance::_ComputeTiles()
                     continue;
 
                 Vector2I grid_pos = new_grid_observer_pos + Vector2I( xoffset, zoffset );
-                Vector3F world_pos = toVector3Fxz( grid_pos ) * _info.tile_side_length;
-                _tiles_world_pos[data_index] = world_pos;
-                _tiles_flags[data_index] |= ETileFlag::NEED_REBUILD;
+                _SetTilePos( data_index, grid_pos );
 
                 data_row = _Increment( data_row, last_index, delta.y );
             }
@@ -205,34 +263,101 @@ void Instance::_ComputeTiles()
     _grid_center_pos = _grid_observer_pos;
 }
 
-void Instance::_GenerateTileSamples( u32 tileIndex )
+void Instance::_SetTilePos( u32 tileIndex, const Vector2I& gridPos )
+{
+    _EvictTile( tileIndex );
+    _tiles_grid_pos[tileIndex] = gridPos;
+    _tiles_world_pos[tileIndex] = toVector3Fxz( gridPos ) * _info.tile_side_length;
+    _tiles_flags[tileIndex] |= ETileFlag::NEED_REBUILD;
+}
+
+void Instance::_EvictTile( u32 tileIndex )
+{
+    if( _tiles_flags[tileIndex] & ETileFlag::READY )
+    {
+        _cache.Put( _tiles_grid_pos[tileIndex], _TileSamples( tileIndex ) );
+        _tiles_flags[tileIndex] &= ~ETileFlag::READY;
+    }
+
+    // result for old position which is still in flight will be dropped to cache
+    _tiles_generation[tileIndex] += 1;
+}
+
+void Instance::_RequestTile( u32 tileIndex )
 {
-    const u32 n_side_divisions = _ComputeNumDivisions( _info.min_tesselation_level + Const::ELod::COUNT );
-    SYS_ASSERT( n_side_divisions >= 2 );
-    SYS_ASSERT( (n_side_divisions*n_side_divisions) == _num_tile_samples );
-    f32* samples = _TileSamples( tileIndex );
-
-    const f32 segment_len = _info.tile_side_length / (f32)( n_side_divisions - 1 );
-    
-    // TODO : generate samples 
+    if( _cache.Take( _tiles_grid_pos[tileIndex], _TileSamples( tileIndex ) ) )
+    {
+        _tiles_flags[tileIndex] |= ETileFlag::READY;
+        return;
+    }
+
+    TileRequest request;
+    request.grid_pos = _tiles_grid_pos[tileIndex];
+    request.slot = tileIndex;
+    request.generation = _tiles_generation[tileIndex];
+    _generator.Submit( request );
+}
+
+void Instance::_PublishCompleted()
+{
+    const TileResult* results = nullptr;
+    const u32 n = _generator.PopCompleted( &results );
+    for( u32 i = 0; i < n; ++i )
+    {
+        const TileResult& r = results[i];
+        const u32 slot = r.request.slot;
+        if( _tiles_generation[slot] == r.request.generation )
+        {
+            memcpy( _TileSamples( slot ), r.samples, _num_tile_samples * sizeof( f32 ) );
+            _tiles_flags[slot] |= ETileFlag::READY;
+            _stats.num_published += 1;
+        }
+        else
+        {
+            // observer moved away before tile was done. Keep it, observer may come back
+            _cache.Put( r.request.grid_pos, r.samples );
+            _stats.num_stale += 1;
+        }
+    }
 }
 
 void Instance::Tick()
 {
+    const u64 start_us = bxTime::us();
+
     // initialization
     if( array::empty( _tiles_world_pos ) )
         _Init();
 
     _ComputeTiles();
+    _generator.SetObserver( _grid_observer_pos );
 
     for( u32 i = 0; i < _tiles_flags.size; ++i )
     {
         if( _tiles_flags[i] & ETileFlag::NEED_REBUILD )
         {
-            _GenerateTileSamples( i );
+            _RequestTile( i );
         }
         _tiles_flags[i] &= ~ETileFlag::NEED_REBUILD;
     }
+
+    _PublishCompleted();
+
+    const u64 end_us = bxTime::us();
+    _stats.tick_us = end_us - start_us;
+    _stats.max_tick_us = maxOfPair( _stats.max_tick_us, _stats.tick_us );
+    _stats.window_max_tick_us = maxOfPair( _stats.window_max_tick_us, _stats.tick_us );
+
+    const u64 window_us = end_us - _stats.window_start_us;
+    if( window_us >= 1000000 )
+    {
+        const u64 generated = _generator.NumGenerated();
+        _stats.tiles_per_second = (f32)( (f64)( generated - _stats.window_generated ) * 1000000.0 / (f64)window_us );
+        _stats.window_generated = generated;
+        _stats.window_start_us = end_us;
+        _stats.last_window_max_tick_us = _stats.window_max_tick_us;
+        _stats.window_max_tick_us = 0;
+    }
 }
 
 }
@@ -3,6 +3,7 @@
 #include <util/containers.h>
 #include <util/vectormath/vectormath.h>
 #include "terrain_create_info.h"
+#include "terrain_tile_generator.h"
 
 #include <rdi/rdi_backend.h>
 #include "util/debug.h"
@@ -26,6 +27,7 @@ namespace ETileFlag
     enum Enum : u8
     {
         NEED_REBUILD = 0x1,
+        READY = 0x2, // samples are valid
     };
 }//
 
@@ -40,6 +42,8 @@ struct Instance
     u32 _indices_offset     [Const::ELod::COUNT] = {};
 
     Vector3FArray       _tiles_world_pos;
+    Vector2IArray       _tiles_grid_pos;
+    U32Array            _tiles_generation; // bumped when tile slot gets new position, so late results can be recognized
     F32Array            _tiles_samples;
     VertexBufferArray   _tiles_vbuff;
     U8Array             _tiles_flags;
@@ -53,6 +57,24 @@ struct Instance
     Vector2I _grid_observer_pos{ 0 };
     Vector2UI _data_center{ 0 };
 
+    TileGenerator _generator;
+    TileCache     _cache;
+
+    struct Stats
+    {
+        u64 tick_us = 0;
+        u64 max_tick_us = 0;        // worst main thread cost since start
+        u64 window_max_tick_us = 0; // worst in current window
+        u64 last_window_max_tick_us = 0;
+        u64 window_start_us = 0;
+        u64 window_generated = 0;
+        f32 tiles_per_second = 0.f;
+        u32 num_published = 0;
+        u32 num_stale = 0;
+    } _stats;
+
+    f32 _noise_msamples[3] = {}; // last noise benchmark result per bxNoiseSimd level
+
     Vector2I   _ComputePosOnGrid( const Vector3F& posWS )       { return toVector2xz<i32>( projectVectorOnPlane( posWS, _up_axis ) * _tile_side_length_inv ); }
     f32*       _TileSamples( u32 tileIndex )
     {
@@ -61,8 +83,12 @@ struct Instance
     }
 
     void _Init();
+    void _ShutDown();
     void _ComputeTiles();
-    void _GenerateTileSamples( u32 tileIndex );
+    void _SetTilePos( u32 tileIndex, const Vector2I& gridPos );
+    void _EvictTile( u32 tileIndex );
+    void _RequestTile( u32 tileIndex );
+    void _PublishCompleted();
 
     void Tick();
     void DebugDraw( u32 color );
@@ -0,0 +1,286 @@
+#include "terrain_tile_generator.h"
+
+#include <util/array.h>
+#include <util/common.h>
+#include <util/time.h>
+#include <util/perlin_noise.h>
+#include <util/thread/atomic.h>
+
+namespace bx{ namespace terrain{
+
+void GenerateTileSamples( f32* output, const Vector2I& gridPos, const TileNoiseDesc& desc )
+{
+    const u32 n = desc.num_side_samples;
+    SYS_ASSERT( n >= 2 );
+
+    const f32 segment_len = desc.tile_side_length / (f32)( n - 1 );
+    const f32 x0 = ( (f32)gridPos.x - 0.5f ) * desc.tile_side_length;
+    const f32 z0 = ( (f32)gridPos.y - 0.5f ) * desc.tile_side_length;
+    const f32 step = segment_len * desc.frequency;
+
+    bxNoiseOutput noise;
+    noise.value = output;
+    bxNoise_fbmGrid( noise, x0 * desc.frequency, 0.f, z0 * desc.frequency, step, step, (int)n, (int)n, (int)desc.octaves );
+
+    const u32 num_samples = n * n;
+    for( u32 i = 0; i < num_samples; ++i )
+        output[i] *= desc.height_scale;
+}
+
+//////////////////////////////////////////////////////////////////////////
+u32 TileGenerator::WorkerRun::run()
+{
+    array_t<f32> samples;
+    array::resize( samples, _gen->_num_samples );
+
+    for( ;; )
+    {
+        _gen->_wake.wait_infinite();
+        if( _gen->_quit )
+            break;
+
+        TileRequest request;
+        if( !_gen->_PopRequest( &request ) )
+            continue;
+
+        const u64 start_us = bxTime::us();
+        GenerateTileSamples( samples.begin(), request.grid_pos, _gen->_desc );
+        bxAtomic::interlockedAdd( &_gen->_generation_time_us, (i64)( bxTime::us() - start_us ) );
+        bxAtomic::interlockedInc( &_gen->_num_generated );
+
+        _gen->_PushResult( request, samples.begin() );
+    }
+    return 0;
+}
+
+void TileGenerator::StartUp( const TileNoiseDesc& desc, u32 numSlots, u32 numThreads )
+{
+    SYS_ASSERT( _num_threads == 0 );
+    _desc = desc;
+    _num_samples = desc.num_side_samples * desc.num_side_samples;
+    _num_threads = clamp( numThreads, 1u, (u32)eMAX_THREADS );
+    _quit = 0;
+
+    // one wake per pending request (there is at most one per slot) plus quit
+    _wake.create( 0, numSlots + _num_threads );
+    array::reserve( _pending, numSlots );
+
+    for( u32 i = 0; i < _num_threads; ++i )
+    {
+        WorkerRun* run = BX_NEW( bxDefaultAllocator(), WorkerRun, this );
+        _threads[i] = bxThread::startThread( run, "terrain generator" );
+    }
+}
+
+void TileGenerator::ShutDown()
+{
+    if( _num_threads == 0 )
+        return;
+
+    {
+        bxScopeLock<bxMutex> lock( _pending_lock );
+        array::clear( _pending );
+    }
+    _quit = 1;
+    _wake.signal( _num_threads );
+    for( u32 i = 0; i < _num_threads; ++i )
+        bxThread::stopThread( &_threads[i], true );
+
+    _wake.destroy();
+    _num_threads = 0;
+}
+
+void TileGenerator::SetObserver( const Vector2I& gridPos )
+{
+    bxScopeLock<bxMutex> lock( _pending_lock );
+    _observer = gridPos;
+}
+
+void TileGenerator::Submit( const TileRequest& request )
+{
+    {
+        bxScopeLock<bxMutex> lock( _pending_lock );
+        for( TileRequest& r : _pending )
+        {
+            if( r.slot == request.slot )
+            {
+                r = request;
+                return;
+            }
+        }
+        array::push_back( _pending, request );
+    }
+    _wake.signal( 1 );
+}
+
+u32 TileGenerator::NumPending()
+{
+    bxScopeLock<bxMutex> lock( _pending_lock );
+    return array::sizeu( _pending );
+}
+
+bool TileGenerator::_PopRequest( TileRequest* request )
+{
+    bxScopeLock<bxMutex> lock( _pending_lock );
+    const u32 n = array::sizeu( _pending );
+    if( n == 0 )
+        return false;
+
+    u32 best = 0;
+    i32 best_dist = INT32_MAX;
+    for( u32 i = 0; i < n; ++i )
+    {
+        const Vector2I d = _pending[i].grid_pos - _observer;
+        const i32 dist = d.x * d.x + d.y * d.y;
+        if( dist < best_dist )
+        {
+            best_dist = dist;
+            best = i;
+        }
+    }
+
+    request[0] = _pending[best];
+    _pending[best] = _pending[n - 1];
+    array::pop_back( _pending );
+    return true;
+}
+
+void TileGenerator::_PushResult( const TileRequest& request, const f32* samples )
+{
+    bxScopeLock<bxMutex> lock( _results_lock );
+    ResultBuffer& buffer = _results[_results_write];
+
+    const u32 offset = array::sizeu( buffer.samples );
+    array::resize( buffer.samples, offset + _num_samples );
+    memcpy( buffer.samples.begin() + offset, samples, _num_samples * sizeof( f32 ) );
+
+    TileResult result;
+    result.request = request;
+    result.samples = nullptr; // resolved in PopCompleted
+    result.samples_offset = offset;
+    array::push_back( buffer.results, result );
+}
+
+u32 TileGenerator::PopCompleted( const TileResult** results )
+{
+    u32 read = 0;
+    {
+        bxScopeLock<bxMutex> lock( _results_lock );
+        read = _results_write;
+        _results_write ^= 1;
+
+        // new write buffer holds results returned by previous call, which are not valid anymore
+        array::clear( _results[_results_write].results );
+        array::clear( _results[_results_write].samples );
+    }
+
+    // workers don't touch read buffer until next call
+    ResultBuffer& buffer = _results[read];
+    for( TileResult& r : buffer.results )
+        r.samples = buffer.samples.begin() + r.samples_offset;
+
+    results[0] = buffer.results.begin();
+    return array::sizeu( buffer.results );
+}
+
+//////////////////////////////////////////////////////////////////////////
+void TileCache::StartUp( u32 capacity, u32 numSamples )
+{
+    _capacity = capacity;
+    _num_samples = numSamples;
+    array::resize( _keys, capacity );
+    array::resize( _prev, capacity );
+    array::resize( _next, capacity );
+    array::resize( _samples, capacity * numSamples );
+    hash_map::reserve( _map, capacity );
+
+    _head = _tail = eNULL;
+    _free = ( capacity ) ? 0 : eNULL;
+    for( u32 i = 0; i < capacity; ++i )
+        _next[i] = ( i + 1 < capacity ) ? i + 1 : eNULL;
+}
+
+void TileCache::ShutDown()
+{
+    hash_map::clear( _map );
+    array::clear( _keys );
+    array::clear( _prev );
+    array::clear( _next );
+    array::clear( _samples );
+    _head = _tail = _free = eNULL;
+    _capacity = 0;
+}
+
+void TileCache::_Unlink( u32 entry )
+{
+    const u32 prev = _prev[entry];
+    const u32 next = _next[entry];
+    if( prev != eNULL ) _next[prev] = next; else _head = next;
+    if( next != eNULL ) _prev[next] = prev; else _tail = prev;
+}
+
+void TileCache::_LinkFront( u32 entry )
+{
+    _prev[entry] = eNULL;
+    _next[entry] = _head;
+    if( _head != eNULL )
+        _prev[_head] = entry;
+    _head = entry;
+    if( _tail == eNULL )
+        _tail = entry;
+}
+
+void TileCache::Put( const Vector2I& gridPos, const f32* samples )
+{
+    if( _capacity == 0 )
+        return;
+
+    const u64 key = _Key( gridPos );
+    u32 entry = eNULL;
+    if( const u32* found = hash_map::find( _map, key ) )
+    {
+        entry = *found;
+        _Unlink( entry );
+    }
+    else
+    {
+        if( _free != eNULL )
+        {
+            entry = _free;
+            _free = _next[entry];
+        }
+        else
+        {
+            entry = _tail;
+            _Unlink( entry );
+            hash_map::erase( _map, _keys[entry] );
+        }
+        _keys[entry] = key;
+        hash_map::insert( _map, key, entry );
+    }
+
+    memcpy( _samples.begin() + entry * _num_samples, samples, _num_samples * sizeof( f32 ) );
+    _LinkFront( entry );
+}
+
+bool TileCache::Take( const Vector2I& gridPos, f32* samples )
+{
+    const u64 key = _Key( gridPos );
+    const u32* found = hash_map::find( _map, key );
+    if( !found )
+    {
+        ++_num_misses;
+        return false;
+    }
+
+    const u32 entry = *found;
+    memcpy( samples, _samples.begin() + entry * _num_samples, _num_samples * sizeof( f32 ) );
+    _Unlink( entry );
+    hash_map::erase( _map, key );
+    _next[entry] = _free;
+    _free = entry;
+    ++_num_hits;
+    return true;
+}
+
+}}//
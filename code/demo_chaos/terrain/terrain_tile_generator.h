@@ -0,0 +1,138 @@
+#pragma once
+
+#include <util/type.h>
+#include <util/containers.h>
+#include <util/hash_map.h>
+#include <util/vectormath/vectormath.h>
+#include <util/thread/mutex.h>
+#include <util/thread/semaphore.h>
+#include <util/thread/thread.h>
+
+namespace bx{ namespace terrain{
+
+struct TileNoiseDesc
+{
+    f32 tile_side_length = 1.f;
+    u32 num_side_samples = 2;
+    f32 frequency = 0.05f;
+    f32 height_scale = 8.f;
+    u32 octaves = 6;
+};
+
+// fills num_side_samples^2 heights of tile centered at grid_pos * tile_side_length
+void GenerateTileSamples( f32* output, const Vector2I& gridPos, const TileNoiseDesc& desc );
+
+struct TileRequest
+{
+    Vector2I grid_pos;
+    u32 slot;
+    u32 generation;     // result is valid only when slot generation still matches
+};
+
+struct TileResult
+{
+    TileRequest request;
+    const f32* samples; // valid until next PopCompleted call
+    u32 samples_offset; // in generator result buffer, samples can grow until PopCompleted
+};
+
+// Generates tile samples on background threads.
+// Main thread submits requests and pops completed results once per frame. Both only take short locks,
+// so main thread never waits for generation. Workers always pick pending request closest to the observer.
+// Request for a slot which is already pending replaces the old one.
+class TileGenerator
+{
+public:
+    void StartUp( const TileNoiseDesc& desc, u32 numSlots, u32 numThreads );
+    void ShutDown();
+
+    void SetObserver( const Vector2I& gridPos );
+    void Submit( const TileRequest& request );
+
+    // returns number of results. Results are valid until next call
+    u32 PopCompleted( const TileResult** results );
+
+    u32 NumPending();
+    u32 NumThreads() const { return _num_threads; }
+    u64 NumGenerated() const { return (u64)_num_generated; }
+    u64 GenerationTimeUS() const { return (u64)_generation_time_us; }
+
+private:
+    class WorkerRun : public bxThreadRun
+    {
+    public:
+        WorkerRun( TileGenerator* g ) : _gen( g ) {}
+        virtual u32 run();
+
+    private:
+        TileGenerator* _gen;
+    };
+
+    struct ResultBuffer
+    {
+        array_t<TileResult> results;
+        array_t<f32>        samples;
+    };
+
+    bool _PopRequest( TileRequest* request );
+    void _PushResult( const TileRequest& request, const f32* samples );
+
+    enum { eMAX_THREADS = 8 };
+
+    TileNoiseDesc _desc;
+    u32 _num_samples = 0;
+    u32 _num_threads = 0;
+    bxThreadHandle _threads[eMAX_THREADS];
+
+    bxSemaphore _wake;
+    bxMutex _pending_lock;
+    array_t<TileRequest> _pending;
+    Vector2I _observer{ 0 };
+
+    bxMutex _results_lock;
+    ResultBuffer _results[2];
+    u32 _results_write = 0;
+
+    volatile u32 _quit = 0;
+    atomic64 _num_generated = 0;
+    atomic64 _generation_time_us = 0;
+};
+
+// Samples of recently evicted tiles, so observer going back and forth doesn't regenerate them.
+// Least recently put tile is dropped when cache is full. Not thread safe.
+class TileCache
+{
+public:
+    void StartUp( u32 capacity, u32 numSamples );
+    void ShutDown();
+
+    void Put( const Vector2I& gridPos, const f32* samples );
+    // copies samples and removes tile from cache (tile is live again)
+    bool Take( const Vector2I& gridPos, f32* samples );
+
+    u32 Size() const { return _map.size; }
+    u64 NumHits() const { return _num_hits; }
+    u64 NumMisses() const { return _num_misses; }
+
+private:
+    enum : u32 { eNULL = UINT32_MAX };
+
+    static u64 _Key( const Vector2I& p ) { return ( (u64)(u32)p.x << 32 ) | (u64)(u32)p.y; }
+    void _Unlink( u32 entry );
+    void _LinkFront( u32 entry );
+
+    hash_map_t<u64, u32> _map;
+    array_t<u64> _keys;
+    array_t<u32> _prev;
+    array_t<u32> _next;
+    array_t<f32> _samples;
+    u32 _head = eNULL; // most recent
+    u32 _tail = eNULL; // least recent
+    u32 _free = eNULL;
+    u32 _capacity = 0;
+    u32 _num_samples = 0;
+    u64 _num_hits = 0;
+    u64 _num_misses = 0;
+};
+
+}}//
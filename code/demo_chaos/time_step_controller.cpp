@@ -0,0 +1,80 @@
+#include "time_step_controller.h"
+#include <util/common.h>
+#include <util/debug.h>
+
+#include <math.h>
+#include <float.h>
+
+namespace bx
+{
+
+TimeStepPlan TimeStepController::Begin( float frameDt, float maxSpeed, float particleRadius, u32 numIterations )
+{
+    SYS_ASSERT( params.min_dt > 0.f && params.min_dt <= params.max_dt );
+
+    acc += maxOfPair( frameDt, 0.f );
+
+    TimeStepPlan plan;
+    plan.dt = ( maxSpeed > FLT_EPSILON ) ? params.cfl * particleRadius / maxSpeed : params.max_dt;
+    plan.dt = clamp( plan.dt, params.min_dt, params.max_dt );
+    plan.num_iterations = maxOfPair( numIterations, 1u );
+
+    const u32 min_iterations = clamp( params.min_iterations, 1u, plan.num_iterations );
+    u32 num_substeps = minOfPair( (u32)( acc / plan.dt ), params.max_substeps );
+
+    // lower iteration count first, then number of substeps
+    if( num_substeps && unit_cost_ms > 0.f )
+    {
+        const f32 units_in_budget = params.budget_ms / unit_cost_ms;
+        const f32 units_per_substep = units_in_budget / num_substeps;
+        if( units_per_substep < plan.num_iterations + 1 )
+        {
+            const u32 iterations = (u32)maxOfPair( units_per_substep - 1.f, 0.f );
+            plan.num_iterations = maxOfPair( iterations, min_iterations );
+            if( iterations < min_iterations )
+            {
+                const u32 affordable = (u32)( units_in_budget / ( min_iterations + 1 ) );
+                num_substeps = clamp( affordable, 1u, num_substeps );
+            }
+        }
+    }
+    plan.num_substeps = num_substeps;
+    return _Consume( plan );
+}
+
+TimeStepPlan TimeStepController::BeginReplay( float frameDt, const TimeStepPlan& recorded )
+{
+    acc += maxOfPair( frameDt, 0.f );
+    return _Consume( recorded );
+}
+
+TimeStepPlan TimeStepController::_Consume( const TimeStepPlan& plan )
+{
+    acc -= plan.num_substeps * plan.dt;
+
+    // time which can't be simulated within budget is caught up later, unless it's too much
+    const f32 lag = acc - plan.dt;
+    if( lag > params.max_lag )
+    {
+        stats.dropped_time += lag - params.max_lag;
+        acc -= lag - params.max_lag;
+    }
+
+    stats.num_substeps = plan.num_substeps;
+    stats.num_iterations = plan.num_iterations;
+    stats.dt = plan.dt;
+    return plan;
+}
+
+void TimeStepController::End( const TimeStepPlan& plan, u64 durationUS )
+{
+    stats.frame_ms = (f32)( durationUS * 0.001 );
+    if( !plan.num_substeps )
+        return;
+
+    const f32 units = (f32)( plan.num_substeps * ( plan.num_iterations + 1 ) );
+    const f32 cost = stats.frame_ms / units;
+    unit_cost_ms = ( unit_cost_ms > 0.f ) ? lerp( 0.1f, unit_cost_ms, cost ) : cost;
+}
+
+}//
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <util/type.h>
+
+namespace bx
+{
+
+// Picks substep size from CFL condition (particle shouldn't travel more than cfl * radius in one substep)
+// and fits number of substeps and solver iterations into per frame cpu budget.
+// Simulation time which doesn't fit into budget is carried to next frames up to max_lag and dropped above it.
+struct TimeStepParams
+{
+    f32 min_dt = 1.f / 240.f;
+    f32 max_dt = 1.f / 60.f;
+    f32 cfl = 0.4f;
+    f32 budget_ms = 4.f;
+    f32 max_lag = 0.25f;        // seconds
+    u32 max_substeps = 8;
+    u32 min_iterations = 1;
+};
+
+struct TimeStepStats
+{
+    u32 num_substeps = 0;       // last frame
+    u32 num_iterations = 0;     // last frame, per substep
+    f32 dt = 0.f;               // last frame substep size
+    f32 frame_ms = 0.f;         // last frame cpu time
+    f32 dropped_time = 0.f;     // simulation time thrown away since start (seconds)
+};
+
+struct TimeStepPlan
+{
+    u32 num_substeps = 0;
+    u32 num_iterations = 0;
+    f32 dt = 0.f;
+};
+
+struct TimeStepController
+{
+    TimeStepParams params;
+    TimeStepStats  stats;
+
+    f32 acc = 0.f;
+    f32 unit_cost_ms = 0.f;     // smoothed cost of one iteration. Substep costs ( iterations + 1 ) units
+
+    // maxSpeed is max particle speed from previous step, numIterations is requested (max) iteration count
+    TimeStepPlan Begin( float frameDt, float maxSpeed, float particleRadius, u32 numIterations );
+    // replays frame with plan it was originally simulated with. Cpu budget is not used, so result doesn't depend on timing
+    TimeStepPlan BeginReplay( float frameDt, const TimeStepPlan& recorded );
+    // durationUS is cpu time of all substeps of plan
+    void End( const TimeStepPlan& plan, u64 durationUS );
+
+    // fraction of substep left in accumulator, for interpolation
+    f32 Alpha( const TimeStepPlan& plan ) const { return ( plan.dt > 0.f ) ? acc / plan.dt : 0.f; }
+
+    TimeStepPlan _Consume( const TimeStepPlan& plan );
+};
+
+}//
@@ -6,6 +6,7 @@
 #include <util/buffer_utils.h>
 #include <util/common.h>
 #include <util/poly/poly_shape.h>
+#include <util/vertex_pack.h>
 
 #include <resource_manager/resource_manager.h>
 
@@ -65,7 +66,28 @@ struct ShaderObject
     InputLayout input_layout;
     ResourceDescriptor resource_desc;
 };
-void ShaderObjectCreate( ShaderObject* shaderObj, const ShaderFile* shaderFile, const char* passName, HardwareStateDesc* hwStateDescOverride )
+// shader signature says only 'float', actual stream formats come from packing (see vertex_pack.h)
+static void PackVertexLayout( VertexLayout* layout )
+{
+    for( u32 i = 0; i < layout->count; ++i )
+    {
+        VertexBufferDesc& desc = layout->descs[i];
+        if( desc.slot == EVertexSlot::POSITION )
+        {
+            desc.DataType( EDataType::HALF, 4 );
+        }
+        else if( desc.slot == EVertexSlot::NORMAL )
+        {
+            desc.DataType( EDataType::SHORT, 2 ).Normalized();
+        }
+        else if( desc.slot == EVertexSlot::TEXCOORD0 )
+        {
+            desc.DataType( EDataType::HALF, 2 );
+        }
+    }
+}
+
+void ShaderObjectCreate( ShaderObject* shaderObj, const ShaderFile* shaderFile, const char* passName, HardwareStateDesc* hwStateDescOverride, bool packedVertices )
 {
     const u32 pass_index = ShaderFileFindPass( shaderFile, passName );
     SYS_ASSERT( pass_index != UINT32_MAX );
@@ -80,7 +102,11 @@ void ShaderObjectCreate( ShaderObject* shaderObj, const ShaderFile* shaderFile,
     shaderObj->pass = device::CreateShaderPass( pass_create_info );
     shaderObj->pass.vertex_input_mask = pass.vertex_layout.InputMask();
     
-    shaderObj->input_layout = device::CreateInputLayout( pass.vertex_layout, shaderObj->pass );
+    VertexLayout vertex_layout = pass.vertex_layout;
+    if( packedVertices )
+        PackVertexLayout( &vertex_layout );
+
+    shaderObj->input_layout = device::CreateInputLayout( vertex_layout, shaderObj->pass );
     const HardwareStateDesc* hw_state_desc = ( hwStateDescOverride ) ? hwStateDescOverride : &pass.hw_state_desc;
     shaderObj->hardware_state = device::CreateHardwareState( *hw_state_desc );
 
@@ -119,7 +145,7 @@ struct PipelineImpl
 Pipeline CreatePipeline( const PipelineDesc& desc, bxAllocator* allocator /*= nullptr */ )
 {
     PipelineImpl* impl = (PipelineImpl*)BX_NEW( utils::getAllocator( allocator ), PipelineImpl );
-    ShaderObjectCreate( &impl->shader_object, desc.shader_file, desc.shader_pass_name, desc.hw_state_desc_override );
+    ShaderObjectCreate( &impl->shader_object, desc.shader_file, desc.shader_pass_name, desc.hw_state_desc_override, desc.packed_vertices != 0 );
     impl->topology = desc.topology;
 
     return impl;
@@ -524,6 +550,8 @@ struct RenderSourceImpl
     u16 num_vertex_buffers = 0;
     u8 num_draw_ranges = 0;
     u8 has_shared_index_buffer = 0;
+    u8 packed_vertices = 0;
+    f32 position_offset[3] = {};
     IndexBuffer index_buffer;
     VertexBuffer* vertex_buffers = nullptr;
     RenderSourceRange* draw_ranges = nullptr;
@@ -549,6 +577,8 @@ RenderSource CreateRenderSource( const RenderSourceDesc& desc, bxAllocator* allo
 
     impl->num_vertex_buffers = num_streams;
     impl->num_draw_ranges = num_draw_ranges;
+    impl->packed_vertices = ( desc.packed_vertices ) ? 1 : 0;
+    memcpy( impl->position_offset, desc.position_offset, sizeof( impl->position_offset ) );
 
     for( u32 i = 0; i < num_streams; ++i )
     {
@@ -655,7 +685,10 @@ RenderSourceRange GetRange( RenderSource rsource, u32 index )
     return rsource->draw_ranges[index];
 }
 
-RenderSource CreateRenderSourceFromPolyShape( const bxPolyShape& shape )
+bool HasPackedVertices( RenderSource rsource ) { return rsource->packed_vertices != 0; }
+const f32* GetPositionOffset( RenderSource rsource ) { return rsource->position_offset; }
+
+RenderSource CreateRenderSourceFromPolyShape( const bxPolyShape& shape, bool packed )
 {
     const int nVertices = shape.nvertices();
     const int nIndices = shape.ntriangles() * 3;
@@ -667,13 +700,39 @@ RenderSource CreateRenderSourceFromPolyShape( const bxPolyShape& shape )
 
     RenderSourceDesc desc = {};
     desc.Count( nVertices, nIndices );
-    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::POSITION ).DataType( EDataType::FLOAT, 3 ), pos );
-    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::NORMAL ).DataType( EDataType::FLOAT, 3 ), nrm );
-    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::TEXCOORD0 ).DataType( EDataType::FLOAT, 2 ), uvs );
     desc.IndexBuffer( EDataType::UINT, indices );
 
+    if( !packed )
+    {
+        desc.VertexBuffer( VertexBufferDesc( EVertexSlot::POSITION ).DataType( EDataType::FLOAT, 3 ), pos );
+        desc.VertexBuffer( VertexBufferDesc( EVertexSlot::NORMAL ).DataType( EDataType::FLOAT, 3 ), nrm );
+        desc.VertexBuffer( VertexBufferDesc( EVertexSlot::TEXCOORD0 ).DataType( EDataType::FLOAT, 2 ), uvs );
+        return CreateRenderSource( desc );
+    }
+
+    const u32 pos_stride = shape.n_elem_pos * sizeof( f32 );
+    const u32 mem_size = nVertices * ( eVERTEX_PACK_POSITION_SIZE + eVERTEX_PACK_NORMAL_SIZE + eVERTEX_PACK_TEXCOORD_SIZE );
+    u8* mem = (u8*)BX_MALLOC( bxDefaultAllocator(), mem_size, 4 );
+    u16* packed_pos = (u16*)mem;
+    i16* packed_nrm = (i16*)( packed_pos + nVertices * 4 );
+    u16* packed_uvs = (u16*)( packed_nrm + nVertices * 2 );
+
+    f32 bmin[3], bmax[3];
+    bxVertexPack_bounds( bmin, bmax, pos, pos_stride, nVertices );
+    const f32 center[3] = { ( bmin[0] + bmax[0] ) * 0.5f, ( bmin[1] + bmax[1] ) * 0.5f, ( bmin[2] + bmax[2] ) * 0.5f };
+
+    bxVertexPack_positions( packed_pos, pos, pos_stride, nVertices, center );
+    bxVertexPack_normals( packed_nrm, nrm, shape.n_elem_nrm * sizeof( f32 ), nVertices );
+    bxVertexPack_texcoords( packed_uvs, uvs, shape.n_elem_tex * sizeof( f32 ), nVertices );
+
+    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::POSITION ).DataType( EDataType::HALF, 4 ), packed_pos );
+    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::NORMAL ).DataType( EDataType::SHORT, 2 ).Normalized(), packed_nrm );
+    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::TEXCOORD0 ).DataType( EDataType::HALF, 2 ), packed_uvs );
+    desc.PackedVertices( center );
+
     RenderSource rsource = CreateRenderSource( desc );
-    
+    BX_FREE( bxDefaultAllocator(), mem );
+
     return rsource;
 }
 
@@ -24,6 +24,7 @@ struct PipelineDesc
     const char* shader_pass_name = nullptr;
     HardwareStateDesc* hw_state_desc_override = nullptr;
     ETopology::Enum topology = ETopology::TRIANGLES;
+    u32 packed_vertices = 0; // input layout reads streams made by CreateRenderSourceFromPolyShape( shape, true )
 
     PipelineDesc& Shader( ShaderFile* f, const char* pass_name )
     {
@@ -33,6 +34,7 @@ struct PipelineDesc
     }
     PipelineDesc& HardwareState( HardwareStateDesc* hwdesc ) { hw_state_desc_override = hwdesc; return *this; }
     PipelineDesc& Topology( ETopology::Enum t ) { topology = t; return *this;  }
+    PipelineDesc& PackedVertices( u32 onOff ) { packed_vertices = onOff; return *this; }
 };
 Pipeline CreatePipeline( const PipelineDesc& desc, bxAllocator* allocator = nullptr );
 void DestroyPipeline( Pipeline* pipeline, bxAllocator* allocator = nullptr );
@@ -158,6 +160,11 @@ struct RenderSourceDesc
 
     const RenderSourceRange* draw_ranges = nullptr;
 
+    // vertex data is packed with bxVertexPack_* functions (see util/vertex_pack.h),
+    // positions are relative to position_offset
+    u32 packed_vertices = 0;
+    f32 position_offset[3] = {};
+
     RenderSourceDesc& Count( u32 nVertices, u32 nIndices = 0 )
     {
         num_vertices = nVertices;
@@ -180,6 +187,14 @@ struct RenderSourceDesc
         index_data = initialData;
         return *this;
     }
+    RenderSourceDesc& PackedVertices( const f32 positionOffset[3] )
+    {
+        packed_vertices = 1;
+        position_offset[0] = positionOffset[0];
+        position_offset[1] = positionOffset[1];
+        position_offset[2] = positionOffset[2];
+        return *this;
+    }
     RenderSourceDesc& SharedIndexBuffer( rdi::IndexBuffer ibuffer )
     {
         SYS_ASSERT( index_type == EDataType::UNKNOWN );
@@ -203,7 +218,10 @@ u32 GetNRanges( RenderSource rsource );
 VertexBuffer GetVertexBuffer( RenderSource rsource, u32 index );
 IndexBuffer GetIndexBuffer( RenderSource rsource );
 RenderSourceRange GetRange( RenderSource rsource, u32 index );
-RenderSource CreateRenderSourceFromPolyShape( const bxPolyShape& shape );
+bool HasPackedVertices( RenderSource rsource );
+const f32* GetPositionOffset( RenderSource rsource );
+// packed: positions (relative to bounds center), normals and texcoords go through bxVertexPack_*
+RenderSource CreateRenderSourceFromPolyShape( const bxPolyShape& shape, bool packed = false );
 //////////////////////////////////////////////////////////////////////////
 RenderSource CreateFullscreenQuad();
 void DrawFullscreenQuad( CommandQueue* cmdq, RenderSource fsq );
@@ -62,6 +62,7 @@ namespace EDataType
         DEPTH16,
         DEPTH24_STENCIL8,
         DEPTH32F,
+        HALF,
 
         COUNT,
     };
@@ -79,6 +80,7 @@ namespace EDataType
         2, //DEPTH16,
         4, //DEPTH24_STENCIL8,
         4, //DEPTH32F,
+        2, //HALF,
     };
     static const char* name[] =
     {
@@ -94,6 +96,7 @@ namespace EDataType
         "depth16",
         "depth24_stencil8",
         "depth32F",
+        "half",
     };
     Enum FromName( const char* name );
     Enum FindBaseType( const char* name );
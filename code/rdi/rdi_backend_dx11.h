@@ -133,12 +133,26 @@ inline DXGI_FORMAT to_DXGI_FORMAT( Format fmt )
     }
     else if( dtype == EDataType::SHORT )
     {
-        if( num_elements == 1 ) result = DXGI_FORMAT_R16_SINT;
+        if( norm )
+        {
+            if( num_elements == 1 ) result = DXGI_FORMAT_R16_SNORM;
+            else if( num_elements == 2 ) result = DXGI_FORMAT_R16G16_SNORM;
+            else if( num_elements == 4 ) result = DXGI_FORMAT_R16G16B16A16_SNORM;
+        }
+        else if( num_elements == 1 ) result = DXGI_FORMAT_R16_SINT;
+        else if( num_elements == 2 ) result = DXGI_FORMAT_R16G16_SINT;
         else if( num_elements == 4 ) result = DXGI_FORMAT_R16G16B16A16_SINT;
     }
     else if( dtype == EDataType::USHORT )
     {
-        if( num_elements == 1 ) result = DXGI_FORMAT_R16_UINT;
+        if( norm )
+        {
+            if( num_elements == 1 ) result = DXGI_FORMAT_R16_UNORM;
+            else if( num_elements == 2 ) result = DXGI_FORMAT_R16G16_UNORM;
+            else if( num_elements == 4 ) result = DXGI_FORMAT_R16G16B16A16_UNORM;
+        }
+        else if( num_elements == 1 ) result = DXGI_FORMAT_R16_UINT;
+        else if( num_elements == 2 ) result = DXGI_FORMAT_R16G16_UINT;
         else if( num_elements == 4 ) result = DXGI_FORMAT_R16G16B16A16_UINT;
     }
     else if( dtype == EDataType::INT )
@@ -162,6 +176,12 @@ inline DXGI_FORMAT to_DXGI_FORMAT( Format fmt )
         else if( num_elements == 3 ) result = DXGI_FORMAT_R32G32B32_FLOAT;
         else if( num_elements == 4 ) result = DXGI_FORMAT_R32G32B32A32_FLOAT;
     }
+    else if( dtype == EDataType::HALF )
+    {
+        if( num_elements == 1 ) result = DXGI_FORMAT_R16_FLOAT;
+        else if( num_elements == 2 ) result = DXGI_FORMAT_R16G16_FLOAT;
+        else if( num_elements == 4 ) result = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    }
     else if( dtype == EDataType::DOUBLE )
     {
 
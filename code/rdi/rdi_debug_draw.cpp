@@ -7,7 +7,8 @@
 #include <util/poly/poly_shape.h>
 #include <util/color.h>
 #include <util/thread/mutex.h>
-#include <util/range_splitter.h>
+#include <util/thread/thread.h>
+#include <util/time.h>
 #include <util/view_frustum.h>
 #include <util/camera.h>
 #include "resource_manager/resource_manager.h"
@@ -16,48 +17,101 @@ namespace bx{ namespace rdi
 {
 namespace debug_draw
 {
-struct BIT_ALIGNMENT_16 Shpere
+// GPU layout, records are packed to it by _Flush
+struct BIT_ALIGNMENT_16 Instance
 {
-    Vector4 pos_radius;
-    u32 colorRGBA;
-    i32 depth;
+    Vector4 world_rows[3];
+    float4_t colorRGBA;
 };
 
-struct BIT_ALIGNMENT_16 Box
+struct BIT_ALIGNMENT_16 Line
 {
-    Matrix4 transform; // pose * (ext*2)
-    u32 colorRGBA;
-    i32 depth;
+    Vector4 pointA; // w: colorRGBA
+    Vector4 pointB; // w: colorRGBA
 };
 
-struct BIT_ALIGNMENT_16 Line
+struct InstanceData
+{
+    u32 begin;
+    u32 padding_[3];
+};
+struct MaterialData
+{
+    Matrix4 view_proj;
+};
+
+// recorded as passed to Add* functions
+struct SphereRecord
+{
+    Vector4F pos_radius;
+    u32 color;
+};
+struct BIT_ALIGNMENT_16 BoxRecord
+{
+    Matrix4 pose;
+    Vector3 ext;
+    u32 color;
+};
+struct LineRecord
 {
-    Vector3 pointA;
-    Vector3 pointB;
-    u32 colorRGBA;
-    i32 depth;
+    Vector3F point_a;
+    Vector3F point_b;
+    u32 color;
 };
 
-struct InstanceBuffer
+// Single producer (owner thread) / single consumer (_Flush) queue of fixed size chunks. Records are never moved,
+// so _Flush reads committed part of chunk which is still being filled. Drained chunks go back to owner through free_list.
+template< typename T >
+struct RecordQueue
 {
-    enum { eMAX_INSTANCES = 16 };
+    enum : u32 { eCHUNK_SIZE = 1024 };
+    struct Chunk
+    {
+        T data[eCHUNK_SIZE];
+        Chunk* volatile next;
+        volatile u32 count; // records below are complete
+        u32 read;           // _Flush only
+    };
+
+    Chunk* tail = nullptr;       // owner thread only
+    Chunk* owner_free = nullptr; // owner thread only
+    Chunk* volatile free_list = nullptr;
+
+    Chunk* head = nullptr;       // _Flush only
+    Chunk* flush_last = nullptr; // last chunk seen by _CountRecords and its count
+    u32    flush_end = 0;
+};
 
-    Matrix4 worldMatrix[eMAX_INSTANCES];
-    float4_t colorRGBA[eMAX_INSTANCES];
+struct ThreadBuffer
+{
+    RecordQueue<SphereRecord> spheres;
+    RecordQueue<BoxRecord>    boxes;
+    RecordQueue<LineRecord>   lines;
 };
-struct MaterialData
+
+// thread buffers are registered by first Add* call of each thread. Lock is taken only then and by _Flush
+struct Recorder
 {
-    Matrix4 view_proj;
+    bxBenaphore registry_lock;
+    array_t<ThreadBuffer*> thread_buffers;
+    u32 generation = 0;
 };
 
 struct Context
 {
-    enum { eMAX_LINES = 64 };
+    enum 
+    { 
+        eINITIAL_INSTANCES = 1024,
+        eINITIAL_LINES = 1024 * 16,
+    };
 
-    bxBenaphore lock;
+    Recorder recorder;
 
     rdi::ConstantBuffer cbuffer_instances = {};
     rdi::ConstantBuffer cbuffer_mdata = {};
+    rdi::BufferRO instance_buffer = {};
+    u32 instance_capacity = 0;
+    u32 line_capacity = 0;
         
     rdi::RenderSource rSource_sphere = BX_RDI_NULL_HANDLE;
     rdi::RenderSource rSource_box    = BX_RDI_NULL_HANDLE;
@@ -65,12 +119,216 @@ struct Context
 
     rdi::Pipeline pipeline_object = BX_RDI_NULL_HANDLE;
     rdi::Pipeline pipeline_lines  = BX_RDI_NULL_HANDLE;
-
-    array_t<Shpere> spheres;
-    array_t<Box>    boxes;
-    array_t<Line>   lines;
 };
 static Context* __dd = nullptr;
+static u32 __generation = 0;
+static __declspec( thread ) ThreadBuffer* __thread_buffer = nullptr;
+static __declspec( thread ) u32 __thread_buffer_generation = 0;
+
+static u32 _GrowCapacity( u32 capacity, u32 required )
+{
+    while( capacity < required )
+        capacity *= 2;
+    return capacity;
+}
+static void _CreateInstanceBuffer( u32 capacity )
+{
+    __dd->instance_buffer = device::CreateBufferRO( capacity * 4, rdi::Format( rdi::EDataType::FLOAT, 4 ), rdi::ECpuAccess::WRITE, rdi::EGpuAccess::READ );
+    __dd->instance_capacity = capacity;
+
+    rdi::ResourceDescriptor rdesc = GetResourceDescriptor( __dd->pipeline_object );
+    SetResourceRO( rdesc, "instance_data", &__dd->instance_buffer );
+}
+static void _CreateLineSource( u32 capacity )
+{
+    RenderSourceDesc desc;
+    desc.VertexBuffer( VertexBufferDesc( EVertexSlot::POSITION ).DataType( EDataType::FLOAT, 4 ), nullptr );
+    desc.Count( capacity * 2, 0 );
+    __dd->rSource_lines = rdi::CreateRenderSource( desc );
+    __dd->line_capacity = capacity;
+}
+
+// --- record queue
+template< typename T >
+static typename RecordQueue<T>::Chunk* _AllocateChunk( RecordQueue<T>& q )
+{
+    typedef typename RecordQueue<T>::Chunk Chunk;
+    if( !q.owner_free )
+    {
+        // free list is taken as whole, so there is no ABA with _Flush pushing to it
+        Chunk* list = nullptr;
+        do
+        {
+            list = q.free_list;
+        } while( bxAtomic::CASPtr( (void* volatile*)&q.free_list, list, nullptr ) != list );
+        q.owner_free = list;
+    }
+
+    Chunk* chunk = q.owner_free;
+    if( chunk )
+        q.owner_free = chunk->next;
+    else
+        chunk = (Chunk*)BX_MALLOC( bxDefaultAllocator(), sizeof( Chunk ), ALIGNOF( Chunk ) );
+
+    chunk->next = nullptr;
+    chunk->count = 0;
+    chunk->read = 0;
+    return chunk;
+}
+template< typename T >
+static void _InitQueue( RecordQueue<T>& q )
+{
+    q.tail = _AllocateChunk( q );
+    q.head = q.tail;
+}
+template< typename T >
+static void _FreeChunks( typename RecordQueue<T>::Chunk* chunk )
+{
+    while( chunk )
+    {
+        typename RecordQueue<T>::Chunk* next = chunk->next;
+        BX_FREE( bxDefaultAllocator(), chunk );
+        chunk = next;
+    }
+}
+template< typename T >
+static void _DestroyQueue( RecordQueue<T>& q )
+{
+    _FreeChunks<T>( q.head );
+    _FreeChunks<T>( q.owner_free );
+    _FreeChunks<T>( q.free_list );
+    q = RecordQueue<T>();
+}
+
+// owner thread
+template< typename T >
+static inline void _Push( RecordQueue<T>& q, const T& record )
+{
+    typename RecordQueue<T>::Chunk* chunk = q.tail;
+    u32 count = chunk->count;
+    if( count == RecordQueue<T>::eCHUNK_SIZE )
+    {
+        typename RecordQueue<T>::Chunk* next = _AllocateChunk( q );
+        _WriteBarrier();
+        chunk->next = next;
+        q.tail = chunk = next;
+        count = 0;
+    }
+
+    chunk->data[count] = record;
+    _WriteBarrier();
+    chunk->count = count + 1;
+}
+
+// _Flush. Remembers where counting stopped, so _PackRecords packs exactly counted records
+template< typename T >
+static u32 _CountRecords( RecordQueue<T>& q )
+{
+    u32 n = 0;
+    typename RecordQueue<T>::Chunk* chunk = q.head;
+    for( ;; )
+    {
+        const u32 end = chunk->count;
+        _ReadWriteBarrier();
+        n += end - chunk->read;
+
+        // chunk is linked only when full
+        typename RecordQueue<T>::Chunk* next = chunk->next;
+        if( end < RecordQueue<T>::eCHUNK_SIZE || !next )
+        {
+            q.flush_last = chunk;
+            q.flush_end = end;
+            return n;
+        }
+        chunk = next;
+    }
+}
+template< typename T, typename TGpu, typename TPack >
+static TGpu* _PackRecords( TGpu* dst, RecordQueue<T>& q, TPack pack )
+{
+    typedef typename RecordQueue<T>::Chunk Chunk;
+    Chunk* chunk = q.head;
+    for( ;; )
+    {
+        const bool last = chunk == q.flush_last;
+        const u32 end = ( last ) ? q.flush_end : (u32)RecordQueue<T>::eCHUNK_SIZE;
+        for( u32 i = chunk->read; i < end; ++i )
+            pack( dst++, chunk->data[i] );
+
+        if( last )
+        {
+            chunk->read = end;
+            break;
+        }
+
+        // drained chunk goes back to owner
+        Chunk* next = chunk->next;
+        Chunk* list = nullptr;
+        do
+        {
+            list = q.free_list;
+            chunk->next = list;
+        } while( bxAtomic::CASPtr( (void* volatile*)&q.free_list, list, chunk ) != list );
+        chunk = next;
+    }
+    q.head = chunk;
+    return dst;
+}
+
+static ThreadBuffer* _GetThreadBuffer( Recorder* rec )
+{
+    ThreadBuffer* tb = __thread_buffer;
+    if( tb && __thread_buffer_generation == rec->generation )
+        return tb;
+
+    tb = BX_NEW( bxDefaultAllocator(), ThreadBuffer );
+    _InitQueue( tb->spheres );
+    _InitQueue( tb->boxes );
+    _InitQueue( tb->lines );
+    {
+        bxScopeBenaphore lock( rec->registry_lock );
+        array::push_back( rec->thread_buffers, tb );
+    }
+    __thread_buffer = tb;
+    __thread_buffer_generation = rec->generation;
+    return tb;
+}
+static void _DestroyThreadBuffers( Recorder* rec )
+{
+    for( ThreadBuffer* tb : rec->thread_buffers )
+    {
+        _DestroyQueue( tb->spheres );
+        _DestroyQueue( tb->boxes );
+        _DestroyQueue( tb->lines );
+        BX_DELETE( bxDefaultAllocator(), tb );
+    }
+    array::clear( rec->thread_buffers );
+}
+
+// --- packing
+static inline void _MakeInstance( Instance* inst, const Matrix4& world, u32 colorRGBA )
+{
+    const Matrix4 wt = transpose( world );
+    inst->world_rows[0] = wt.getCol0();
+    inst->world_rows[1] = wt.getCol1();
+    inst->world_rows[2] = wt.getCol2();
+    bxColor::u32ToFloat4( colorRGBA, inst->colorRGBA.xyzw );
+}
+static inline void _PackSphere( Instance* dst, const SphereRecord& r )
+{
+    const Vector4 pos_radius = toVector4( r.pos_radius );
+    _MakeInstance( dst, appendScale( Matrix4::translation( pos_radius.getXYZ() ), Vector3( pos_radius.getW() * twoVec ) ), r.color );
+}
+static inline void _PackBox( Instance* dst, const BoxRecord& r )
+{
+    _MakeInstance( dst, appendScale( r.pose, r.ext * twoVec ), r.color );
+}
+static inline void _PackLine( Line* dst, const LineRecord& r )
+{
+    const f32 color = TypeReinterpert( r.color ).f;
+    dst->pointA = Vector4( r.point_a.x, r.point_a.y, r.point_a.z, color );
+    dst->pointB = Vector4( r.point_b.x, r.point_b.y, r.point_b.z, color );
+}
   
 //////////////////////////////////////////////////////////////////////////
 void _Startup()
@@ -78,8 +336,9 @@ void _Startup()
     ResourceManager* resourceManager = bx::GResourceManager();
 
     __dd = BX_NEW( bxDefaultAllocator(), Context );
+    __dd->recorder.generation = ++__generation;
 
-    __dd->cbuffer_instances = device::CreateConstantBuffer( sizeof( InstanceBuffer ) );
+    __dd->cbuffer_instances = device::CreateConstantBuffer( sizeof( InstanceData ) );
     __dd->cbuffer_mdata = device::CreateConstantBuffer( sizeof( MaterialData ) );
 
     rdi::ShaderFile* sf = rdi::ShaderFileLoad( "shader/bin/debug.shader", resourceManager );
@@ -109,17 +368,8 @@ void _Startup()
     __dd->rSource_sphere = CreateRenderSourceFromPolyShape( polyShape );
     bxPolyShape_deallocateShape( &polyShape );
 
-    {
-        RenderSourceDesc desc;
-        desc.VertexBuffer( VertexBufferDesc( EVertexSlot::POSITION ).DataType( EDataType::FLOAT, 4 ), nullptr );
-        desc.Count( Context::eMAX_LINES * 2, 0 );
-        __dd->rSource_lines = rdi::CreateRenderSource( desc );
-    }
-
-    array::reserve( __dd->spheres, InstanceBuffer::eMAX_INSTANCES );
-    array::reserve( __dd->boxes, InstanceBuffer::eMAX_INSTANCES );
-    array::reserve( __dd->spheres, Context::eMAX_LINES );
-
+    _CreateInstanceBuffer( Context::eINITIAL_INSTANCES );
+    _CreateLineSource( Context::eINITIAL_LINES );
 }
 void _Shutdown()
 {
@@ -128,12 +378,15 @@ void _Shutdown()
 
     ResourceManager* resourceManager = bx::GResourceManager();
 
+    _DestroyThreadBuffers( &__dd->recorder );
+
     DestroyRenderSource( &__dd->rSource_lines );
     DestroyRenderSource( &__dd->rSource_box );
     DestroyRenderSource( &__dd->rSource_sphere );
     DestroyPipeline( &__dd->pipeline_lines );
     DestroyPipeline( &__dd->pipeline_object );
 
+    device::DestroyBufferRO( &__dd->instance_buffer );
     device::DestroyConstantBuffer( &__dd->cbuffer_instances );
     device::DestroyConstantBuffer( &__dd->cbuffer_mdata );
 
@@ -145,154 +398,118 @@ void _Flush( CommandQueue* cmdq, const Matrix4& view, const Matrix4& proj )
     if( !__dd )
         return;
 
-    bxScopeBenaphore lock( __dd->lock );
+    Recorder* rec = &__dd->recorder;
+    bxScopeBenaphore lock( rec->registry_lock );
+    
+    const u32 nBuffers = array::size( rec->thread_buffers );
+    u32 nSpheres = 0;
+    u32 nBoxes = 0;
+    u32 nLines = 0;
+    for( u32 i = 0; i < nBuffers; ++i )
+    {
+        ThreadBuffer* tb = rec->thread_buffers[i];
+        nSpheres += _CountRecords( tb->spheres );
+        nBoxes += _CountRecords( tb->boxes );
+        nLines += _CountRecords( tb->lines );
+    }
 
     MaterialData mdata;
     mdata.view_proj = proj * view;
     context::UpdateCBuffer( cmdq, __dd->cbuffer_mdata, &mdata );
-    
-    const int nSpheres = array::size( __dd->spheres );
-    const int nBoxes = array::size( __dd->boxes );
 
-    if( nSpheres || nBoxes )
+    const u32 nInstances = nSpheres + nBoxes;
+    if( nInstances )
     {
+        if( nInstances > __dd->instance_capacity )
+        {
+            device::DestroyBufferRO( &__dd->instance_buffer );
+            _CreateInstanceBuffer( _GrowCapacity( __dd->instance_capacity, nInstances ) );
+        }
+
+        // spheres first, then boxes
+        Instance* dst = (Instance*)context::Map( cmdq, __dd->instance_buffer, 0, EMapType::WRITE );
+        Instance* dst_boxes = dst + nSpheres;
+        for( u32 i = 0; i < nBuffers; ++i )
+        {
+            ThreadBuffer* tb = rec->thread_buffers[i];
+            dst = _PackRecords( dst, tb->spheres, _PackSphere );
+            dst_boxes = _PackRecords( dst_boxes, tb->boxes, _PackBox );
+        }
+        context::Unmap( cmdq, __dd->instance_buffer );
+
         BindPipeline( cmdq, __dd->pipeline_object, true );
 
+        InstanceData idata = {};
         if( nSpheres )
         {
+            idata.begin = 0;
+            context::UpdateCBuffer( cmdq, __dd->cbuffer_instances, &idata );
             BindRenderSource( cmdq, __dd->rSource_sphere );
-            
-            InstanceBuffer ibuffer;
-            bxRangeSplitter splitter = bxRangeSplitter::splitByGrab( nSpheres, InstanceBuffer::eMAX_INSTANCES );
-            
-            while( splitter.elementsLeft() )
-            {
-                const int offset = splitter.grabbedElements;
-                const int grab = splitter.nextGrab();
-                for( int iobj = 0; iobj < grab; ++iobj )
-                {
-                    const Shpere& sph = __dd->spheres[offset + iobj];
-                    ibuffer.worldMatrix[iobj] = appendScale( Matrix4::translation( sph.pos_radius.getXYZ() ), Vector3( sph.pos_radius.getW() * twoVec ) );
-                    bxColor::u32ToFloat4( sph.colorRGBA, ibuffer.colorRGBA[iobj].xyzw );
-                }
-                context::UpdateCBuffer( cmdq, __dd->cbuffer_instances, &ibuffer );
-                SubmitRenderSourceInstanced( cmdq, __dd->rSource_sphere, grab );
-            }
+            SubmitRenderSourceInstanced( cmdq, __dd->rSource_sphere, nSpheres );
         }
-
         if( nBoxes )
         {
+            idata.begin = nSpheres;
+            context::UpdateCBuffer( cmdq, __dd->cbuffer_instances, &idata );
             BindRenderSource( cmdq, __dd->rSource_box );
-            
-            InstanceBuffer ibuffer;
-            bxRangeSplitter splitter = bxRangeSplitter::splitByGrab( nBoxes, InstanceBuffer::eMAX_INSTANCES );
-
-            while( splitter.elementsLeft() )
-            {
-                const int offset = splitter.grabbedElements;
-                const int grab = splitter.nextGrab();
-                for( int iobj = 0; iobj < grab; ++iobj )
-                {
-                    const Box& box = __dd->boxes[offset + iobj];
-                    ibuffer.worldMatrix[iobj] = box.transform;
-                    bxColor::u32ToFloat4( box.colorRGBA, ibuffer.colorRGBA[iobj].xyzw );
-                }
-
-                context::UpdateCBuffer( cmdq, __dd->cbuffer_instances, &ibuffer );
-                SubmitRenderSourceInstanced( cmdq, __dd->rSource_box, grab );
-            }
+            SubmitRenderSourceInstanced( cmdq, __dd->rSource_box, nBoxes );
         }
     }
 
-    const int nLines = array::size( __dd->lines );
     if( nLines )
     {
-        BindPipeline( cmdq, __dd->pipeline_lines, true );
-
-        VertexBuffer vbuffer = GetVertexBuffer( __dd->rSource_lines, 0 );
-        BindRenderSource( cmdq, __dd->rSource_lines );
-
-        //gdi::shaderFx_enable( ctx, __dd->fxI, "lines" );
-        //bxGdiVertexBuffer lineVBuffer = __dd->rSource_lines->vertexBuffers[0];
-        //gdi::renderSource_enable( ctx, __dd->rSource_lines );
-
-        bxRangeSplitter splitter = bxRangeSplitter::splitByGrab( nLines, Context::eMAX_LINES );
-        while( splitter.elementsLeft() )
+        if( nLines > __dd->line_capacity )
         {
-            const int offset = splitter.grabbedElements;
-            const int grab = splitter.nextGrab();
-
-            //Vector4* lineBuffer = (Vector4*)ctx->backend()->mapVertices( lineVBuffer, 0, grab * 2, gdi::eMAP_WRITE );
-            Vector4* lineBuffer = (Vector4*)context::Map( cmdq, vbuffer, 0, grab * 2, EMapType::WRITE );
+            DestroyRenderSource( &__dd->rSource_lines );
+            _CreateLineSource( _GrowCapacity( __dd->line_capacity, nLines ) );
+        }
 
-            for( int iobj = 0; iobj < grab; ++iobj )
-            {
-                const Line& line = __dd->lines[offset + iobj];
-                Vector4* dstLine = lineBuffer + iobj * 2;
-                dstLine[0].setXYZ( line.pointA );
-                dstLine[0].setW( TypeReinterpert( line.colorRGBA ).f );
-                dstLine[1].setXYZ( line.pointB );
-                dstLine[1].setW( TypeReinterpert( line.colorRGBA ).f );
-            }
+        VertexBuffer vbuffer = GetVertexBuffer( __dd->rSource_lines, 0 );
+        Line* dst = (Line*)context::Map( cmdq, vbuffer, 0, nLines * 2, EMapType::WRITE );
+        for( u32 i = 0; i < nBuffers; ++i )
+            dst = _PackRecords( dst, rec->thread_buffers[i]->lines, _PackLine );
+        context::Unmap( cmdq, vbuffer );
 
-            context::Unmap( cmdq, vbuffer );
-            //ctx->backend()->unmapVertices( lineVBuffer );
-            //bxGdiRenderSurface surf( gdi::eLINES, 0, grab * 2 );
-            //gdi::renderSurface_draw( ctx, surf );
-            context::SetTopology( cmdq, ETopology::LINES );
-            context::Draw( cmdq, grab * 2, 0 );
-        }
+        BindPipeline( cmdq, __dd->pipeline_lines, true );
+        BindRenderSource( cmdq, __dd->rSource_lines );
+        context::SetTopology( cmdq, ETopology::LINES );
+        context::Draw( cmdq, nLines * 2, 0 );
     }
-
-    array::clear( __dd->spheres );
-    array::clear( __dd->boxes );
-    array::clear( __dd->lines );
 }
 
 //////////////////////////////////////////////////////////////////////////
-void AddSphere( const Vector4& pos_radius, u32 colorRGBA, int depth )
+// Add* functions don't take any lock, record goes to queue of calling thread
+void AddSphere( const Vector4F& pos_radius, u32 colorRGBA, int depth )
 {
     if( !__dd )
         return;
 
-    bxScopeBenaphore lock( __dd->lock );
-
-    Shpere sphere;
+    SphereRecord sphere;
     sphere.pos_radius = pos_radius;
-    sphere.colorRGBA = colorRGBA;
-    sphere.depth = depth;
-
-    array::push_back( __dd->spheres, sphere );
+    sphere.color = colorRGBA;
+    _Push( _GetThreadBuffer( &__dd->recorder )->spheres, sphere );
 }
 void AddBox( const Matrix4& pose, const Vector3& ext, u32 colorRGBA, int depth )
 {
     if( !__dd )
         return;
 
-    bxScopeBenaphore lock( __dd->lock );
-
-    Box box;
-    box.transform = appendScale( pose, ext * twoVec );
-    box.colorRGBA = colorRGBA;
-    box.depth = depth;
-
-    array::push_back( __dd->boxes, box );
-
+    BoxRecord box;
+    box.pose = pose;
+    box.ext = ext;
+    box.color = colorRGBA;
+    _Push( _GetThreadBuffer( &__dd->recorder )->boxes, box );
 }
-void AddLine( const Vector3& pointA, const Vector3& pointB, u32 colorRGBA, int depth )
+void AddLine( const Vector3F& pointA, const Vector3F& pointB, u32 colorRGBA, int depth )
 {
     if( !__dd )
         return;
 
-    bxScopeBenaphore lock( __dd->lock );
-
-    Line line;
-    line.pointA = pointA;
-    line.pointB = pointB;
-    line.colorRGBA = colorRGBA;
-    line.depth = depth;
-
-    array::push_back( __dd->lines, line );
+    LineRecord line;
+    line.point_a = pointA;
+    line.point_b = pointB;
+    line.color = colorRGBA;
+    _Push( _GetThreadBuffer( &__dd->recorder )->lines, line );
 }
 
 void AddAxes( const Matrix4& pose )
@@ -337,17 +554,17 @@ void AddFrustum( const Matrix4& viewProj, u32 colorRGBA, int depth )
     AddFrustum( corners, colorRGBA, depth );
 }
 
-void AddSphere( const Vector4F& pos_radius, u32 colorRGBA, int depth )
+void AddSphere( const Vector4& pos_radius, u32 colorRGBA, int depth )
 {
-    AddSphere( toVector4( pos_radius ), colorRGBA, depth );
+    AddSphere( toVector4F( pos_radius ), colorRGBA, depth );
 }
 void AddBox( const Matrix4F& pose, const Vector3F& ext, u32 colorRGBA, int depth )
 {
     return AddBox( toMatrix4( pose ), toVector3( ext ), colorRGBA, depth );
 }
-void AddLine( const Vector3F& pointA, const Vector3F& pointB, u32 colorRGBA, int depth )
+void AddLine( const Vector3& pointA, const Vector3& pointB, u32 colorRGBA, int depth )
 {
-    return AddLine( toVector3( pointA ), toVector3( pointB ), colorRGBA, depth );
+    return AddLine( toVector3F( pointA ), toVector3F( pointB ), colorRGBA, depth );
 }
 void AddAxes( const Matrix4F& pose )
 {
@@ -368,4 +585,160 @@ void AddFrustum( const Vector3F corners[8], u32 colorRGBA, int depth )
     AddFrustum( cornersV3, colorRGBA, depth );
 }
 
+//////////////////////////////////////////////////////////////////////////
+namespace
+{
+    inline f32 ElapsedMS( u64 startUS )
+    {
+        return (f32)( ( bxTime::us() - startUS ) * 0.001 );
+    }
+
+    // previous scheme, kept only for comparison
+    struct LockedLineBuffer
+    {
+        bxBenaphore lock;
+        array_t<Line> lines;
+    };
+
+    enum : u32 { eMAX_BENCHMARK_THREADS = 64 };
+
+    struct BenchmarkShared
+    {
+        Recorder recorder;
+        LockedLineBuffer locked[eMAX_BENCHMARK_THREADS];
+        u32 use_locked = 0;
+        u32 lines_per_thread = 0;
+        volatile u32 go = 0;
+        atomic32 num_done = 0;
+    };
+
+    class BenchmarkRun : public bxThreadRun
+    {
+    public:
+        BenchmarkRun( BenchmarkShared* shared, u32 index ) : _shared( shared ), _index( index ) {}
+        virtual u32 run()
+        {
+            while( !_shared->go )
+                bxThread::yeld();
+
+            LineRecord line;
+            line.point_a = Vector3F( 0.f, 0.f, 0.f );
+            line.point_b = Vector3F( 1.f, 1.f, 1.f );
+            line.color = _index;
+            if( _shared->use_locked )
+            {
+                LockedLineBuffer& buffer = _shared->locked[_index];
+                for( u32 i = 0; i < _shared->lines_per_thread; ++i )
+                {
+                    line.point_a.x = (f32)i;
+                    bxScopeBenaphore lock( buffer.lock );
+                    _PackLine( &buffer.lines[array::push_back( buffer.lines, Line() )], line );
+                }
+            }
+            else
+            {
+                for( u32 i = 0; i < _shared->lines_per_thread; ++i )
+                {
+                    line.point_a.x = (f32)i;
+                    _Push( _GetThreadBuffer( &_shared->recorder )->lines, line );
+                }
+            }
+            bxAtomic::interlockedInc( &_shared->num_done );
+            return 0;
+        }
+
+    private:
+        BenchmarkShared* _shared;
+        u32 _index;
+    };
+
+    f32 RunBenchmarkThreads( BenchmarkShared* shared, u32 numThreads, BenchmarkResult* result, Line* packed, u32* numPacked )
+    {
+        bxThreadHandle threads[eMAX_BENCHMARK_THREADS];
+        for( u32 i = 0; i < numThreads; ++i )
+            threads[i] = bxThread::startThread( BX_NEW( bxDefaultAllocator(), BenchmarkRun, shared, i ), "debug draw benchmark" );
+
+        const u64 start_us = bxTime::us();
+        shared->go = 1;
+        if( packed )
+        {
+            // flush while recording, as frame does
+            for( ;; )
+            {
+                const bool done = shared->num_done == (atomic32)numThreads;
+                _ReadWriteBarrier();
+
+                const u64 pack_us = bxTime::us();
+                bxScopeBenaphore lock( shared->recorder.registry_lock );
+                for( ThreadBuffer* tb : shared->recorder.thread_buffers )
+                {
+                    const u32 n = _CountRecords( tb->lines );
+                    SYS_ASSERT( numPacked[0] + n <= result->num_lines );
+                    _PackRecords( packed + numPacked[0], tb->lines, _PackLine );
+                    numPacked[0] += n;
+                }
+                result->pack_ms += ElapsedMS( pack_us );
+                result->num_flushes += 1;
+                if( done )
+                    break;
+
+                bxThread::yeld();
+            }
+        }
+        else
+        {
+            while( shared->num_done != (atomic32)numThreads )
+                bxThread::yeld();
+        }
+        const f32 elapsed_ms = ElapsedMS( start_us );
+
+        for( u32 i = 0; i < numThreads; ++i )
+            bxThread::stopThread( &threads[i], true );
+
+        return elapsed_ms;
+    }
+}//
+
+void Benchmark( BenchmarkResult* result, u32 numLines, u32 numThreads )
+{
+    result[0] = BenchmarkResult();
+    result->num_threads = clamp( numThreads, 1u, (u32)eMAX_BENCHMARK_THREADS );
+    result->num_lines = ( numLines / result->num_threads ) * result->num_threads;
+
+    const u32 lines_per_thread = result->num_lines / result->num_threads;
+    array_t<Line> packed;
+    array::resize( packed, result->num_lines );
+
+    // own recorder, so benchmark threads don't register in debug draw context
+    BenchmarkShared* shared = BX_NEW( bxDefaultAllocator(), BenchmarkShared );
+    shared->recorder.generation = ++__generation;
+    shared->lines_per_thread = lines_per_thread;
+
+    u32 num_packed = 0;
+    result->record_ms = RunBenchmarkThreads( shared, result->num_threads, result, packed.begin(), &num_packed );
+
+    // records of each thread must come out complete and in order
+    result->errors = result->num_lines - num_packed;
+    array_t<u32> next_index;
+    array::resize( next_index, result->num_threads );
+    memset( next_index.begin(), 0x00, result->num_threads * sizeof( u32 ) );
+    for( u32 i = 0; i < num_packed; ++i )
+    {
+        const u32 thread = TypeReinterpert( packed[i].pointA.getW().getAsFloat() ).u;
+        const u32 index = (u32)packed[i].pointA.getX().getAsFloat();
+        if( thread >= result->num_threads || index != next_index[thread]++ )
+            result->errors += 1;
+    }
+    _DestroyThreadBuffers( &shared->recorder );
+
+    shared->go = 0;
+    shared->num_done = 0;
+    shared->use_locked = 1;
+    for( u32 i = 0; i < result->num_threads; ++i )
+        array::reserve( shared->locked[i].lines, lines_per_thread );
+    result->record_locked_ms = RunBenchmarkThreads( shared, result->num_threads, result, nullptr, nullptr );
+
+    BX_DELETE( bxDefaultAllocator(), shared );
+}
+
 }}}///
\ No newline at end of file
@@ -27,5 +27,18 @@ namespace debug_draw
     void AddFrustum( const Matrix4F& viewProj, u32 colorRGBA, int depth );
     void AddFrustum( const Vector3F corners[8], u32 colorRGBA, int depth );
 
+    // lines recorded from many threads, while main thread flushes them as it does every frame. Doesn't need _Startup
+    struct BenchmarkResult
+    {
+        u32 num_lines = 0;
+        u32 num_threads = 0;
+        u32 num_flushes = 0;
+        f32 record_ms = 0.f;        // wall clock, all threads recording
+        f32 record_locked_ms = 0.f; // the same with per thread array under lock and GPU layout built by Add* (previous scheme)
+        f32 pack_ms = 0.f;          // all flushes, counting and packing to GPU layout
+        u32 errors = 0;             // lines lost, duplicated or out of order
+    };
+    void Benchmark( BenchmarkResult* result, u32 numLines = 1024 * 1024, u32 numThreads = 8 );
+
 }//
 }}///
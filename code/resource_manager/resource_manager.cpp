@@ -5,6 +5,7 @@
 #include <util/filesystem.h>
 #include <util/thread/mutex.h>
 #include <util/debug.h>
+#include <util/trace.h>
 
 namespace bx
 {
@@ -176,6 +177,7 @@ public:
 
     ResourceLoadResult loadResource( const char* filename, EResourceFileType::Enum fileType ) override
     {
+        BX_TRACE_SCOPE( "ResourceManager::loadResource" );
         ResourceID resource_id = ResourceManager::createResourceID( filename );
         _mapLock.lock();
         
@@ -308,24 +310,18 @@ void ResourceManager::shutdown()
 Handle HandleManager::Create( uptr data )
 {
     _lock.lock();
-    Handle handle = id_table::create( _id_table );
+    Handle handle = _slots.Create();
+    _slots.Value( handle ) = (u64)data;
     _lock.unlock();
-
-    _data[handle.index] = data;
     return handle;
 }
 
 void HandleManager::Destroy( Handle handle )
 {
-    if( !id_table::has( _id_table, handle ) )
-        return;
-
     _lock.lock();
-    u32 index = handle.index;
-    id_table::destroy( _id_table, handle );
+    if( _slots.Alive( handle ) )
+        _slots.Destroy( handle );
     _lock.unlock();
-
-    _data[handle.index] = 0;
 }
 
 static HandleManager* g_handle_manager = nullptr;
@@ -333,11 +329,13 @@ void HandleManager::_StartUp()
 {
     SYS_ASSERT( g_handle_manager == nullptr );
     g_handle_manager = BX_NEW( bxDefaultAllocator(), HandleManager );
+    g_handle_manager->_slots.StartUp();
 }
 
 void HandleManager::_ShutDown()
 {
     SYS_ASSERT( g_handle_manager != nullptr );
+    g_handle_manager->_slots.ShutDown();
     BX_DELETE0( bxDefaultAllocator(), g_handle_manager );
 }
 
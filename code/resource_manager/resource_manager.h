@@ -3,7 +3,7 @@
 #include <util/filesystem.h>
 #include <util/type.h>
 #include <util/debug.h>
-#include <util/id_table.h>
+#include <util/slot_map.h>
 #include <util/thread/mutex.h>
 
 namespace bx
@@ -66,36 +66,37 @@ public:
 };
 //////////////////////////////////////////////////////////////////////////
 
-typedef id_t Handle;
+typedef SlotHandle Handle;
+// thread safe and grows on demand. Create/Destroy are serialized, lookups are lock free
 class HandleManager
 {
 public:
     Handle Create( uptr data );
     void Destroy( Handle handle );
 
-    bool Alive( Handle handle ) const { return id_table::has( _id_table, handle ); }
+    bool Alive( Handle handle ) const { return _slots.Alive( handle ); }
     
     uptr Data( Handle handle )
     {
-        SYS_ASSERT( id_table::has( _id_table, handle ) );
-        return _data[handle.index];
+        SYS_ASSERT( _slots.Alive( handle ) );
+        return (uptr)_slots.Value( handle );
     }
     template< typename T >
     T DataAs( Handle handle )
     {
-        SYS_STATIC_ASSERT( sizeof( T ) == sizeof( *_data ) );
+        SYS_STATIC_ASSERT( sizeof( T ) == sizeof( uptr ) );
         return (T)Data( handle );
     }
     
     void SetData( Handle handle, uptr data )
     {
-        SYS_ASSERT( id_table::has( _id_table, handle ) );
-        _data[handle.index] = data;
+        SYS_ASSERT( _slots.Alive( handle ) );
+        _slots.Value( handle ) = (u64)data;
     }
     template< typename T >
     void SetDataAs( Handle handle, T data )
     {
-        SYS_STATIC_ASSERT( sizeof( T ) == sizeof( *_data ) );
+        SYS_STATIC_ASSERT( sizeof( T ) == sizeof( uptr ) );
         SetData( handle, (uptr)data );
     }
 
@@ -103,10 +104,7 @@ public:
     static void _ShutDown();
 
 private:
-    static const u32 MAX_HANDLES = 16*1024;
-    id_table_t<MAX_HANDLES> _id_table;
-    uptr _data[MAX_HANDLES] = {};
-
+    SlotAllocator _slots;
     bxBenaphore _lock;
 };
 
@@ -24,12 +24,14 @@ passes:
     };
 };#~header
 
-#define MAX_WORLD_MATRICES 16
-shared cbuffer InstanceData : register(b1)
+#include <sys/binding_map.h>
+
+shared cbuffer InstanceData : register(BSLOT(SLOT_INSTANCE_OFFSET))
 {
-    matrix world_matrix[MAX_WORLD_MATRICES];	
-	float4 color[MAX_WORLD_MATRICES];
+    uint instance_begin;
 };
+// 4 elements per instance: 3 rows of world matrix and color
+Buffer<float4> instance_data : register(TSLOT(SLOT_INSTANCE_DATA_WORLD));
 
 shared cbuffer MaterialData : register(b3)
 {
@@ -56,10 +58,11 @@ struct out_PS
 in_PS vs_object( in_VS input )
 {
     in_PS output;
-	matrix wm = world_matrix[input.instanceID];
-	float4 world_pos = mul( wm, float4( input.pos.xyz, 1.0 ) );
+	uint base = ( instance_begin + input.instanceID ) * 4;
+	float4 local_pos = float4( input.pos.xyz, 1.0 );
+	float4 world_pos = float4( dot( instance_data[base], local_pos ), dot( instance_data[base+1], local_pos ), dot( instance_data[base+2], local_pos ), 1.0 );
     output.h_pos = mul( view_proj_matrix, world_pos );
-	output.color = color[input.instanceID];
+	output.color = instance_data[base+3];
     return output;
 }
 
@@ -14,6 +14,25 @@ passes:
             USE_TEXTURES = 1;
         };
     };
+    geometry_notexture_packed =
+    {
+        vertex = "vs_geometry_main";
+        pixel = "ps_geometry_main";
+        define = 
+        {
+            PACKED_VERTICES = 1;
+        };
+    };
+    geometry_texture_packed =
+    {
+        vertex = "vs_geometry_main";
+        pixel = "ps_geometry_main";
+        define = 
+        {
+            USE_TEXTURES = 1;
+            PACKED_VERTICES = 1;
+        };
+    };
 }; #~header
 
 #include <sys/vertex_transform.hlsl>
@@ -24,7 +43,11 @@ struct in_VS
 {
     uint instanceID : SV_InstanceID;
     float3 pos : POSITION;
+#if defined(PACKED_VERTICES)
+    float2 normal : NORMAL; // octahedral
+#else
     float3 normal : NORMAL;
+#endif
 #if defined(USE_TEXTURES)
     float2 texcoord : TEXCOORD0;
 #endif
@@ -65,6 +88,14 @@ cbuffer MaterialData : register( BSLOT( SLOT_MATERIAL_DATA ) )
     MATERIAL_TEXTURES;
 #endif
 
+float3 decodeOctahedral( in float2 e )
+{
+    float3 n = float3( e.xy, 1.0 - abs( e.x ) - abs( e.y ) );
+    float t = saturate( -n.z );
+    n.xy += ( n.xy >= 0.0 ) ? -t : t;
+    return normalize( n );
+}
+
 in_PS vs_geometry_main(in_VS IN)
 {
     in_PS OUT = (in_PS) 0;
@@ -77,7 +108,12 @@ in_PS vs_geometry_main(in_VS IN)
 
     float4 localPos = float4(IN.pos, 1.0);
     float3 wpos = transformPosition(row0, row1, row2, localPos);
-    float3 wnrm = transformNormal(row0IT, row1IT, row2IT, IN.normal);
+#if defined(PACKED_VERTICES)
+    float3 normal = decodeOctahedral( IN.normal );
+#else
+    float3 normal = IN.normal;
+#endif
+    float3 wnrm = transformNormal(row0IT, row1IT, row2IT, normal);
 
     float4 wpos4 = float4( wpos, 1.0 );
     OUT.hpos = mul( _viewProj, wpos4 );
@@ -16,7 +16,7 @@ passes:
 #include <sys/samplers.hlsl>
 #include <material_data.h>
 
-Buffer<float3> _particle_data : register(TSLOT(SLOT_INSTANCE_PARTICLE_DATA));
+Buffer<float4> _particle_data : register(TSLOT(SLOT_INSTANCE_PARTICLE_DATA)); // float or half, xyz is used
 
 struct in_VS
 {
@@ -51,11 +51,12 @@ shared
 cbuffer MaterialData : register( BSLOT( SLOT_MATERIAL_DATA ) )
 {
     float4 _color;
+    float4 _position_offset; // half positions are relative to body bounds center
 }; 
 
-float3 GetWorldPos( in uint instanceID, in uint vertexID, in Buffer<float3> inputData, in float3x3 camera_rot )
+float3 GetWorldPos( in uint instanceID, in uint vertexID, in Buffer<float4> inputData, in float3x3 camera_rot )
 {
-    float3 pdata = inputData[instanceID];
+    float3 pdata = inputData[instanceID].xyz + _position_offset.xyz;
 
     const float4 xoffset = float4( -1.f, 1.f, -1.f, 1.f );
     const float4 yoffset = float4( -1.f, -1.f, 1.f, 1.f );
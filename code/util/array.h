@@ -97,4 +97,23 @@ namespace array
 
         arr.size = newSize;
     }
+
+    // exchanges storage (with allocators), elements are not copied
+    template< typename T > void swap( array_t<T>& a, array_t<T>& b )
+    {
+        T* data = a.data;
+        const u32 size = a.size;
+        const u32 capacity = a.capacity;
+        bxAllocator* allocator = a.allocator;
+
+        a.data = b.data;
+        a.size = b.size;
+        a.capacity = b.capacity;
+        a.allocator = b.allocator;
+
+        b.data = data;
+        b.size = size;
+        b.capacity = capacity;
+        b.allocator = allocator;
+    }
 }///
@@ -5,6 +5,12 @@
 #include <util/hash.h>
 #include <util/hashmap.h>
 #include <util/string_util.h>
+#include <util/hash_map.h>
+#include <util/array.h>
+#include <util/memory.h>
+#include <util/common.h>
+#include <util/thread/parallel.h>
+#include <util/filesystem.h>
 namespace
 {
     inline size_t hashNameGet( const char* name )
@@ -127,101 +133,529 @@ namespace bxScene
 
 namespace bxScene
 {
-    int script_run( bxAsciiScript* script, const char* scriptTxt )
+    namespace
     {
+        // Shared by script_run and script_compile. Sink gets:
+        //   bool object( typeName, objectName ) - returns false when object doesn't take attributes ('$' lines are skipped)
+        //   void attribute( name, attribData, isString )
+        //   void command( name, attribData, isString )
+        template< typename TSink >
+        int _ParseScript( const char* scriptTxt, TSink& sink )
+        {
+            char line[MAX_LINE_SIZE + 1] = { 0 };
+            char token[MAX_TOKEN_SIZE + 1] = { 0 };
+
+            bxAsciiScript_AttribData attribData;
+            memset( &attribData, 0x00, sizeof( bxAsciiScript_AttribData ) );
+
+            bool takesAttributes = false;
+            char* scriptPtr = (char*)scriptTxt;
+
+            char* lineDelimeter = "\n";
+            {
+                char* endOfLine = string::find( scriptPtr, lineDelimeter );
+                if ( endOfLine && endOfLine[-1] == '\r' )
+                {
+                    lineDelimeter = "\r\n";
+                }
+            }
+
+            while ( 1 )
+            {
+                scriptPtr = string::token( scriptPtr, line, MAX_LINE_SIZE, lineDelimeter );
+                if ( string::equal( line, "\r" ) )
+                    continue;
 
-        char line[MAX_LINE_SIZE + 1] = { 0 };
-        char token[MAX_TOKEN_SIZE + 1] = { 0 };
+                if ( !scriptPtr && string::length( line ) == 0 )
+                {
+                    break;
+                }
 
-        bxAsciiScript_AttribData attribData;
-        memset( &attribData, 0x00, sizeof( bxAsciiScript_AttribData ) );
+                char* linePtr = string::token( line, token, MAX_TOKEN_SIZE, " " );
+                if ( token[0] == '@' )
+                {
+                    char objName[MAX_TOKEN_SIZE + 1] = { 0 };
+                    linePtr = string::token( linePtr, objName, MAX_TOKEN_SIZE, " " );
+                    takesAttributes = sink.object( token + 1, objName );
+                }
+                else if ( ( token[0] == '$' && takesAttributes ) || token[0] == ':' )
+                {
+                    memset( &attribData, 0x00, sizeof( bxAsciiScript_AttribData ) );
+                    if ( attrib_parseLine( &attribData, linePtr ) != 0 )
+                        continue;
 
-        bxAsciiScript_Callback* currentCallback = 0;
-        char* scriptPtr = (char*)scriptTxt;
+                    const char* args = ( linePtr ) ? linePtr + strspn( linePtr, " " ) : "";
+                    const bool isString = args[0] == '\"';
+                    if ( token[0] == '$' )
+                        sink.attribute( token + 1, attribData, isString );
+                    else
+                        sink.command( token + 1, attribData, isString );
+                }
+            }
+            return 0;
+        }
 
-        char* lineDelimeter = "\n";
+        struct ScriptRunSink
         {
-            char* endOfLine = string::find( scriptPtr, lineDelimeter );
-            if ( endOfLine && endOfLine[-1] == '\r' )
+            bxAsciiScript* script;
+            bxAsciiScript_Callback* currentCallback;
+
+            bool object( const char* typeName, const char* objName )
+            {
+                currentCallback = scriptCallbackFind( script, hashNameGet( typeName ) );
+                if ( currentCallback )
+                {
+                    currentCallback->onCreate( typeName, objName );
+                }
+                return currentCallback != nullptr;
+            }
+            void attribute( const char* attribName, const bxAsciiScript_AttribData& attribData, bool )
             {
-                lineDelimeter = "\r\n";
+                currentCallback->onAttribute( attribName, attribData );
             }
+            void command( const char* cmdName, const bxAsciiScript_AttribData& attribData, bool )
+            {
+                bxAsciiScript_Callback* callback = ( currentCallback ) ? currentCallback : scriptCallbackFind( script, hashNameGet( cmdName ) );
+                if ( callback )
+                {
+                    callback->onCommand( cmdName, attribData );
+                }
+            }
+        };
+    }//
+
+    int script_run( bxAsciiScript* script, const char* scriptTxt )
+    {
+        ScriptRunSink sink = { script, nullptr };
+        return _ParseScript( scriptTxt, sink );
+    }
+
+    void script_addCallback( bxAsciiScript* script, const char* name, bxAsciiScript_Callback* callback )
+    {
+        const size_t nameHash = hashNameGet( name );
+        SYS_ASSERT( hashmap::lookup( script->_map_callback, nameHash ) == 0 );
+
+        hashmap_t::cell_t* cell = hashmap::insert( script->_map_callback, nameHash );
+        cell->value = size_t( callback );
+    }
+}///
+
+
+namespace bxScene
+{
+    u64 script_nameHash( const char* name )
+    {
+        return (u64)hashNameGet( name );
+    }
+
+    namespace
+    {
+        // array::resize grows to exact size, which is quadratic for byte streams
+        template< typename T >
+        inline void _ResizeGeometric( array_t<T>& arr, u32 newSize )
+        {
+            if( newSize > arr.capacity )
+                array::reserve( arr, (int)maxOfPair( newSize, arr.capacity * 2 ) );
+            array::resize( arr, (int)newSize );
         }
 
-        while ( 1 )
+        struct ScriptCompiler
         {
-            scriptPtr = string::token( scriptPtr, line, MAX_LINE_SIZE, lineDelimeter );
-            if ( string::equal( line, "\r" ) )
-                continue;
+            array_t<bxSceneBinary_Type> types;
+            array_t<bxSceneBinary_Object> objects;
+            array_t<bxSceneBinary_Attribute> attributes; // attributes of objects in script order
+            array_t<bxSceneBinary_Attribute> commands;
+            array_t<u8> data;
+            array_t<char> strings;
+            hash_map_t<u64, u32> string_offsets;
 
-            if ( !scriptPtr && string::length( line ) == 0 )
+            u32 addString( const char* str, u64 hash )
             {
-                break;
+                const u32* found = hash_map::find( string_offsets, hash );
+                if( found && string::equal( strings.begin() + *found, str ) )
+                    return *found;
+
+                const u32 len = string::length( str );
+                const u32 offset = array::sizeu( strings );
+                _ResizeGeometric( strings, offset + len + 1 );
+                memcpy( strings.begin() + offset, str, len + 1 );
+                if( !found )
+                    hash_map::insert( string_offsets, hash, offset );
+
+                return offset;
             }
 
-            char* linePtr = string::token( line, token, MAX_TOKEN_SIZE, " " );
-            if ( token[0] == '@' )
+            u32 addData( const bxAsciiScript_AttribData& attribData )
             {
-                char objName[MAX_TOKEN_SIZE + 1] = { 0 };
-                linePtr = string::token( linePtr, objName, MAX_TOKEN_SIZE, " " );
+                // zero terminated, 4 bytes aligned
+                const u32 offset = array::sizeu( data );
+                const u32 size = ( attribData.numBytes + 1 + 3 ) & ~3;
+                _ResizeGeometric( data, offset + size );
+                memset( data.begin() + offset, 0, size );
+                memcpy( data.begin() + offset, attribData.dataPointer(), attribData.numBytes );
+                return offset;
+            }
 
-                char* typeName = token + 1;
-                size_t typeNameHash = hashNameGet( typeName );
-                bxAsciiScript_Callback* callback = scriptCallbackFind( script, typeNameHash );
-                if ( callback )
+            u32 findType( const char* typeName, u64 hash )
+            {
+                for( u32 i = 0; i < array::sizeu( types ); ++i )
                 {
-                    callback->onCreate( typeName, objName );
+                    if( types[i].name_hash == hash && string::equal( strings.begin() + types[i].name, typeName ) )
+                        return i;
                 }
 
-                currentCallback = callback;
+                bxSceneBinary_Type t = {};
+                t.name_hash = hash;
+                t.name = addString( typeName, hash );
+                return (u32)array::push_back( types, t );
+            }
+
+            // _ParseScript sink
+            bxSceneBinary_Object* currentObject = nullptr;
+
+            bool object( const char* typeName, const char* objName )
+            {
+                bxSceneBinary_Object obj = {};
+                obj.type = findType( typeName, hashNameGet( typeName ) );
+                obj.name_hash = hashNameGet( objName );
+                obj.name = addString( objName, obj.name_hash );
+                obj.first_attribute = array::sizeu( attributes );
+                types[obj.type].num_objects += 1;
+                const int index = array::push_back( objects, obj );
+                currentObject = &objects[index];
+                return true;
+            }
+            void addAttribute( const char* name, const bxAsciiScript_AttribData& attribData, u32 flags )
+            {
+                bxSceneBinary_Attribute attr = {};
+                attr.name_hash = hashNameGet( name );
+                attr.name = addString( name, attr.name_hash );
+                attr.data = addData( attribData );
+                attr.num_bytes = attribData.numBytes;
+                attr.flags = flags;
+
+                if( currentObject )
+                {
+                    array::push_back( attributes, attr );
+                    currentObject->num_attributes += 1;
+                }
+                else
+                {
+                    array::push_back( commands, attr );
+                }
+            }
+            void attribute( const char* name, const bxAsciiScript_AttribData& attribData, bool isString )
+            {
+                addAttribute( name, attribData, ( isString ) ? bxSceneBinary_Attribute::eFLAG_STRING : 0 );
+            }
+            void command( const char* name, const bxAsciiScript_AttribData& attribData, bool isString )
+            {
+                addAttribute( name, attribData, bxSceneBinary_Attribute::eFLAG_COMMAND | ( ( isString ) ? bxSceneBinary_Attribute::eFLAG_STRING : 0 ) );
+            }
+        };
+
+        inline u32 _AlignOffset( u32 offset ) { return ( offset + 7 ) & ~7; }
+    }//
+
+    int script_compile( bxSceneBinary** outBinary, const char* scriptTxt, bxAllocator* allocator )
+    {
+        ScriptCompiler sc;
+        _ParseScript( scriptTxt, sc );
+
+        const u32 numTypes = array::sizeu( sc.types );
+        const u32 numObjects = array::sizeu( sc.objects );
+        const u32 numAttributes = array::sizeu( sc.attributes );
+        const u32 numCommands = array::sizeu( sc.commands );
+
+        u32 offset = _AlignOffset( sizeof( bxSceneBinary ) );
+        const u32 offsetTypes = offset;      offset = _AlignOffset( offset + numTypes * sizeof( bxSceneBinary_Type ) );
+        const u32 offsetObjects = offset;    offset = _AlignOffset( offset + numObjects * sizeof( bxSceneBinary_Object ) );
+        const u32 offsetAttributes = offset; offset = _AlignOffset( offset + ( numAttributes + numCommands ) * sizeof( bxSceneBinary_Attribute ) );
+        const u32 offsetData = offset;       offset = _AlignOffset( offset + array::sizeu( sc.data ) );
+        const u32 offsetStrings = offset;    offset = _AlignOffset( offset + array::sizeu( sc.strings ) );
+        const u32 sizeInBytes = offset;
+
+        if( !allocator )
+            allocator = bxDefaultAllocator();
+
+        u8* mem = (u8*)BX_MALLOC( allocator, sizeInBytes, 8 );
+        memset( mem, 0, sizeInBytes );
+
+        bxSceneBinary* bin = (bxSceneBinary*)mem;
+        bin->tag = bxSceneBinary::eTAG;
+        bin->version = bxSceneBinary::eVERSION;
+        bin->size_in_bytes = sizeInBytes;
+        bin->num_types = numTypes;
+        bin->num_objects = numObjects;
+        bin->num_attributes = numAttributes;
+        bin->num_commands = numCommands;
+        bin->offset_types = offsetTypes;
+        bin->offset_objects = offsetObjects;
+        bin->offset_attributes = offsetAttributes;
+        bin->offset_data = offsetData;
+        bin->offset_strings = offsetStrings;
+        bin->size_data = array::sizeu( sc.data );
+        bin->size_strings = array::sizeu( sc.strings );
+        bin->source_hash = script_sourceHash( scriptTxt );
+
+        if( numTypes )
+            memcpy( mem + offsetTypes, sc.types.begin(), numTypes * sizeof( bxSceneBinary_Type ) );
+
+        if( numObjects )
+            memcpy( mem + offsetObjects, sc.objects.begin(), numObjects * sizeof( bxSceneBinary_Object ) );
+        if( numAttributes )
+            memcpy( mem + offsetAttributes, sc.attributes.begin(), numAttributes * sizeof( bxSceneBinary_Attribute ) );
+        if( numCommands )
+            memcpy( mem + offsetAttributes + numAttributes * sizeof( bxSceneBinary_Attribute ), sc.commands.begin(), numCommands * sizeof( bxSceneBinary_Attribute ) );
+
+        if( bin->size_data )
+            memcpy( mem + offsetData, sc.data.begin(), bin->size_data );
+        if( bin->size_strings )
+            memcpy( mem + offsetStrings, sc.strings.begin(), bin->size_strings );
+
+        outBinary[0] = bin;
+        return 0;
+    }
+
+    namespace
+    {
+        inline bool _RangeValid( u32 offset, u64 size, u32 totalSize )
+        {
+            return (u64)offset + size <= (u64)totalSize;
+        }
+        inline bool _AttributeValid( const bxSceneBinary* bin, const bxSceneBinary_Attribute& a )
+        {
+            return a.name < bin->size_strings && _RangeValid( a.data, (u64)a.num_bytes + 1, bin->size_data );
+        }
+    }//
+
+    const bxSceneBinary* script_binaryFromMemory( const void* data, size_t sizeInBytes )
+    {
+        const bxSceneBinary* bin = (const bxSceneBinary*)data;
+        if( !data || ( (uptr)data & 7 ) || sizeInBytes < sizeof( bxSceneBinary ) )
+        {
+            bxLogError( "scene binary: invalid data" );
+            return nullptr;
+        }
+        if( bin->tag != bxSceneBinary::eTAG || bin->version != bxSceneBinary::eVERSION || bin->size_in_bytes > sizeInBytes )
+        {
+            bxLogError( "scene binary: invalid header (tag: 0x%x, version: %u)", bin->tag, bin->version );
+            return nullptr;
+        }
+
+        const u32 size = bin->size_in_bytes;
+        const bool sectionsValid =
+            _RangeValid( bin->offset_types, (u64)bin->num_types * sizeof( bxSceneBinary_Type ), size ) &&
+            _RangeValid( bin->offset_objects, (u64)bin->num_objects * sizeof( bxSceneBinary_Object ), size ) &&
+            _RangeValid( bin->offset_attributes, ( (u64)bin->num_attributes + bin->num_commands ) * sizeof( bxSceneBinary_Attribute ), size ) &&
+            _RangeValid( bin->offset_data, bin->size_data, size ) &&
+            _RangeValid( bin->offset_strings, bin->size_strings, size ) &&
+            ( ( bin->offset_types | bin->offset_objects | bin->offset_attributes ) & 7 ) == 0 &&
+            ( bin->size_strings == 0 || bin->string( bin->size_strings - 1 )[0] == 0 );
+        if( !sectionsValid )
+        {
+            bxLogError( "scene binary: corrupted sections" );
+            return nullptr;
+        }
+
+        // indices are checked once here, so running the scene doesn't need to
+        for( u32 i = 0; i < bin->num_types; ++i )
+        {
+            const bxSceneBinary_Type& t = bin->types()[i];
+            if( t.name >= bin->size_strings || t.num_objects > bin->num_objects )
+            {
+                bxLogError( "scene binary: corrupted type %u", i );
+                return nullptr;
+            }
+        }
+        for( u32 i = 0; i < bin->num_objects; ++i )
+        {
+            const bxSceneBinary_Object& o = bin->objects()[i];
+            if( o.name >= bin->size_strings || o.type >= bin->num_types || !_RangeValid( o.first_attribute, o.num_attributes, bin->num_attributes ) )
+            {
+                bxLogError( "scene binary: corrupted object %u", i );
+                return nullptr;
+            }
+        }
+        for( u32 i = 0; i < bin->num_attributes + bin->num_commands; ++i )
+        {
+            if( !_AttributeValid( bin, bin->attributes()[i] ) )
+            {
+                bxLogError( "scene binary: corrupted attribute %u", i );
+                return nullptr;
+            }
+        }
+
+        return bin;
+    }
+
+    namespace
+    {
+        inline void _AttribDataGet( bxAsciiScript_AttribData* attribData, const bxSceneBinary* bin, const bxSceneBinary_Attribute& a )
+        {
+            const u32 maxBytes = sizeof( attribData->string ) - 1;
+            const u32 numBytes = ( a.num_bytes < maxBytes ) ? a.num_bytes : maxBytes;
+            memcpy( attribData->dataPointer(), bin->data( a.data ), numBytes );
+            attribData->string[numBytes] = 0;
+            attribData->numBytes = numBytes;
+        }
+
+        void _RunCommand( bxAsciiScript* script, bxAsciiScript_Callback* callback, const bxSceneBinary* bin, const bxSceneBinary_Attribute& cmd )
+        {
+            if( !callback )
+                callback = scriptCallbackFind( script, (size_t)cmd.name_hash );
+
+            if( callback )
+            {
+                bxAsciiScript_AttribData attribData;
+                _AttribDataGet( &attribData, bin, cmd );
+                callback->onCommand( bin->string( cmd.name ), attribData );
             }
-            else if ( token[0] == '$' && currentCallback )
+        }
+
+        void _CreateObject( bxAsciiScript* script, bxAsciiScript_Callback* callback, const bxSceneBinary* bin, const bxSceneBinary_Object& obj )
+        {
+            const bxSceneBinary_Attribute* attributes = bin->attributes() + obj.first_attribute;
+            if( callback )
             {
-                memset( &attribData, 0x00, sizeof( bxAsciiScript_AttribData ) );
-                char* attribName = token + 1;
-                char attribDataToken[MAX_TOKEN_SIZE + 1] = { 0 };
+                callback->onCreate( bin->string( bin->types()[obj.type].name ), bin->string( obj.name ) );
+            }
 
-                int ierr = attrib_parseLine( &attribData, linePtr );
-                if ( ierr == 0 )
+            bxAsciiScript_AttribData attribData;
+            for( u32 i = 0; i < obj.num_attributes; ++i )
+            {
+                const bxSceneBinary_Attribute& a = attributes[i];
+                if( a.flags & bxSceneBinary_Attribute::eFLAG_COMMAND )
+                {
+                    _RunCommand( script, callback, bin, a );
+                }
+                else if( callback )
                 {
-                    currentCallback->onAttribute( attribName, attribData );
+                    _AttribDataGet( &attribData, bin, a );
+                    callback->onAttribute( bin->string( a.name ), attribData );
                 }
             }
-            else if ( token[0] == ':' )
+        }
+    }//
+
+    namespace
+    {
+        // run of consecutive objects of the same type
+        void _CreateRun( bxAsciiScript* script, bxAsciiScript_Callback* callback, const bxSceneBinary* bin, const bxSceneBinary_Object* objects, u32 count, u32 batchSize, array_t<u8>& batchHandled )
+        {
+            if( callback && callback->isParallelSafe() && count > batchSize )
             {
-                memset( &attribData, 0x00, sizeof( bxAsciiScript_AttribData ) );
-                char* cmdName = token + 1;
-                char attribDataToken[MAX_TOKEN_SIZE + 1] = { 0 };
-                int ierr = attrib_parseLine( &attribData, linePtr );
-                if ( ierr == 0 )
+                // batches not taken by onCreateBatch are created one by one afterwards, still in script order
+                const u32 numBatches = ( count + batchSize - 1 ) / batchSize;
+                array::resize( batchHandled, numBatches );
+                u8* handled = batchHandled.begin();
+                bxParallel::forRange( numBatches, 1, [&]( u32 begin, u32 end, u32 )
                 {
-                    if ( currentCallback )
+                    for( u32 ibatch = begin; ibatch < end; ++ibatch )
                     {
-                        currentCallback->onCommand( cmdName, attribData );
-                    }
-                    else
-                    {
-                        size_t cmdNameHash = hashNameGet( cmdName );
-                        bxAsciiScript_Callback* callback = scriptCallbackFind( script, cmdNameHash );
-                        if ( callback )
-                        {
-                            callback->onCommand( cmdName, attribData );
-                        }
+                        const u32 first = ibatch * batchSize;
+                        handled[ibatch] = callback->onCreateBatch( bin, objects + first, minOfPair( batchSize, count - first ) ) ? 1 : 0;
                     }
+                } );
+
+                for( u32 ibatch = 0; ibatch < numBatches; ++ibatch )
+                {
+                    if( handled[ibatch] )
+                        continue;
+
+                    const u32 first = ibatch * batchSize;
+                    const u32 last = minOfPair( first + batchSize, count );
+                    for( u32 i = first; i < last; ++i )
+                        _CreateObject( script, callback, bin, objects[i] );
                 }
+                return;
+            }
+
+            bool batched = callback != nullptr;
+            u32 begin = 0;
+            while( batched && begin < count )
+            {
+                const u32 n = minOfPair( batchSize, count - begin );
+                batched = callback->onCreateBatch( bin, objects + begin, n );
+                begin += ( batched ) ? n : 0;
             }
+
+            for( u32 i = begin; i < count; ++i )
+                _CreateObject( script, callback, bin, objects[i] );
         }
+    }//
 
+    int script_runBinary( bxAsciiScript* script, const bxSceneBinary* bin, u32 batchSize )
+    {
+        SYS_ASSERT( batchSize > 0 );
+
+        const bxSceneBinary_Attribute* commands = bin->commands();
+        for( u32 i = 0; i < bin->num_commands; ++i )
+            _RunCommand( script, nullptr, bin, commands[i] );
+
+        array_t<u8> batchHandled;
+        const bxSceneBinary_Object* objects = bin->objects();
+        u32 begin = 0;
+        while( begin < bin->num_objects )
+        {
+            const u32 type = objects[begin].type;
+            u32 end = begin + 1;
+            while( end < bin->num_objects && objects[end].type == type )
+                ++end;
+
+            bxAsciiScript_Callback* callback = scriptCallbackFind( script, (size_t)bin->types()[type].name_hash );
+            _CreateRun( script, callback, bin, objects + begin, end - begin, batchSize, batchHandled );
+            begin = end;
+        }
 
         return 0;
     }
 
-    void script_addCallback( bxAsciiScript* script, const char* name, bxAsciiScript_Callback* callback )
+    u32 script_sourceHash( const char* scriptTxt )
     {
-        const size_t nameHash = hashNameGet( name );
-        SYS_ASSERT( hashmap::lookup( script->_map_callback, nameHash ) == 0 );
+        return murmur3_hash32( scriptTxt, string::length( scriptTxt ), 0x5CE7E0B1 );
+    }
 
-        hashmap_t::cell_t* cell = hashmap::insert( script->_map_callback, nameHash );
-        cell->value = size_t( callback );
+    int script_runFile( bxAsciiScript* script, const char* absPath, u32 batchSize )
+    {
+        unsigned char* text = nullptr;
+        size_t textSize = 0;
+        if( bxIO::readTextFile( &text, &textSize, absPath ) != 0 )
+        {
+            bxLogError( "scene: can not read '%s'", absPath );
+            return -1;
+        }
+
+        bxFS::Path binPath;
+        sprintf_s( binPath.name, bxFS::Path::ePATH_LEN + 1, "%s.bin", absPath );
+        const u32 sourceHash = script_sourceHash( (const char*)text );
+
+        // blob is 8 bytes aligned, file buffer doesn't have to be
+        bxSceneBinary* bin = nullptr;
+        unsigned char* binFile = nullptr;
+        size_t binFileSize = 0;
+        if( bxIO::fileExists( binPath.name ) && bxIO::readFile( &binFile, &binFileSize, binPath.name ) == 0 )
+        {
+            bin = (bxSceneBinary*)BX_MALLOC( bxDefaultAllocator(), binFileSize, 8 );
+            memcpy( bin, binFile, binFileSize );
+            BX_FREE0( bxDefaultAllocator(), binFile );
+
+            if( !script_binaryFromMemory( bin, binFileSize ) || bin->source_hash != sourceHash )
+                BX_FREE0( bxDefaultAllocator(), bin );
+        }
+
+        if( !bin )
+        {
+            script_compile( &bin, (const char*)text );
+            if( bxIO::writeFile( binPath.name, (unsigned char*)bin, bin->size_in_bytes ) < 0 )
+            {
+                bxLogWarning( "scene: can not write compiled scene '%s'", binPath.name );
+            }
+        }
+        BX_FREE0( bxDefaultAllocator(), text );
+
+        const int result = script_runBinary( script, bin, batchSize );
+        BX_FREE0( bxDefaultAllocator(), bin );
+        return result;
     }
 }///
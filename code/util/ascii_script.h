@@ -2,6 +2,8 @@
 
 #include "containers.h"
 
+struct bxAllocator;
+
 ////
 //
 /*
@@ -34,6 +36,73 @@ struct bxAsciiScript_AttribData
     unsigned dataSizeInBytes() const { return numBytes; }
 };
 
+////
+// Compiled script.
+// Relocatable blob: every reference is an offset from the beginning of header, so the file can be used in place after loading.
+// Objects and their attributes are stored in script order. Names are pre-hashed with the same
+// hash as callbacks, so running compiled scene doesn't touch any text.
+// Attribute values are stored exactly like in bxAsciiScript_AttribData (numbers as f32 array or zero terminated string).
+struct bxSceneBinary_Type
+{
+    u64 name_hash;
+    u32 name;           // offset in string pool
+    u32 num_objects;
+};
+struct bxSceneBinary_Object
+{
+    u64 name_hash;
+    u32 name;
+    u32 type;
+    u32 first_attribute;
+    u32 num_attributes;
+};
+struct bxSceneBinary_Attribute
+{
+    enum : u32
+    {
+        eFLAG_STRING = 0x1,
+        eFLAG_COMMAND = 0x2, // ':' line inside object
+    };
+    u64 name_hash;
+    u32 name;
+    u32 data;           // offset in data section, 4 bytes aligned
+    u32 num_bytes;      // same as bxAsciiScript_AttribData::numBytes
+    u32 flags;
+};
+struct bxSceneBinary
+{
+    enum : u32
+    {
+        eTAG = 0x424E4353, // 'SCNB'
+        eVERSION = 2,
+    };
+    u32 tag;
+    u32 version;
+    u32 size_in_bytes;
+    u32 num_types;
+    u32 num_objects;
+    u32 num_attributes;
+    u32 num_commands;   // global commands (before first object). Stored in attribute table after object attributes
+    u32 offset_types;
+    u32 offset_objects;
+    u32 offset_attributes;
+    u32 offset_data;
+    u32 offset_strings;
+    u32 size_data;
+    u32 size_strings;
+    u32 source_hash;    // script_sourceHash of script text, compiled file is rebuilt when it doesn't match
+
+    const bxSceneBinary_Type*      types     () const { return (const bxSceneBinary_Type*)( (const u8*)this + offset_types ); }
+    const bxSceneBinary_Object*    objects   () const { return (const bxSceneBinary_Object*)( (const u8*)this + offset_objects ); }
+    const bxSceneBinary_Attribute* attributes() const { return (const bxSceneBinary_Attribute*)( (const u8*)this + offset_attributes ); }
+    const bxSceneBinary_Attribute* commands  () const { return attributes() + num_attributes; }
+    const char* string( u32 offset ) const { return (const char*)this + offset_strings + offset; }
+    const void* data  ( u32 offset ) const { return (const u8*)this + offset_data + offset; }
+
+    const f32*  attribNumbers( const bxSceneBinary_Attribute& a ) const { return (const f32*)data( a.data ); }
+    const char* attribString ( const bxSceneBinary_Attribute& a ) const { return (const char*)data( a.data ); }
+};
+
 struct bxAsciiScript;
 struct bxAsciiScript_Callback
 {
@@ -42,6 +111,12 @@ struct bxAsciiScript_Callback
     virtual void onCreate( const char* typeName, const char* objectName ) = 0;
     virtual void onAttribute( const char* attrName, const bxAsciiScript_AttribData& attribData ) = 0;
     virtual void onCommand( const char* cmdName, const bxAsciiScript_AttribData& args ) = 0;
+
+    // compiled scenes only. Creates batch of objects at once (attributes and object commands included).
+    // Returning false means not supported, and objects are created with onCreate/onAttribute/onCommand sequence.
+    // Objects in batch are independent, so if isParallelSafe() returns true, batches are dispatched on many threads at once.
+    virtual bool onCreateBatch( const bxSceneBinary* scene, const bxSceneBinary_Object* objects, u32 count ) { (void)scene; (void)objects; (void)count; return false; }
+    virtual bool isParallelSafe() const { return false; }
 };
 
 struct bxAsciiScript
@@ -52,4 +127,19 @@ namespace bxScene
 {
     int  script_run( bxAsciiScript* script, const char* scriptTxt );
     void script_addCallback( bxAsciiScript* script, const char* name, bxAsciiScript_Callback* callback );
+
+    // same hash as used for callbacks and in compiled scenes
+    u64 script_nameHash( const char* name );
+
+    // compiles script to binary blob allocated from 'allocator' (default allocator if null). Blob can be written to file as is
+    int script_compile( bxSceneBinary** outBinary, const char* scriptTxt, bxAllocator* allocator = nullptr );
+    // validates blob loaded to memory. Returns null when data is not valid scene binary. Data has to be 8 bytes aligned
+    const bxSceneBinary* script_binaryFromMemory( const void* data, size_t sizeInBytes );
+    // creates objects in script order. Consecutive objects of the same type go to onCreateBatch in batches of 'batchSize' objects.
+    // Global commands are executed first
+    int script_runBinary( bxAsciiScript* script, const bxSceneBinary* binary, u32 batchSize = 256 );
+
+    u32 script_sourceHash( const char* scriptTxt );
+    // runs compiled scene cached next to script ('<absPath>.bin'). Cache is (re)built when it is missing or stale
+    int script_runFile( bxAsciiScript* script, const char* absPath, u32 batchSize = 256 );
 }///
\ No newline at end of file
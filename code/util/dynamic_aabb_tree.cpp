@@ -0,0 +1,620 @@
+#include "dynamic_aabb_tree.h"
+#include "array.h"
+#include "debug.h"
+#include "common.h"
+#include "random.h"
+#include "time.h"
+
+namespace bx{
+
+namespace
+{
+    inline float SurfaceArea( const bxAABB& aabb )
+    {
+        const Vector3 d = aabb.max - aabb.min;
+        const floatInVec dx = d.getX();
+        const floatInVec dy = d.getY();
+        const floatInVec dz = d.getZ();
+        return ( twoVec * ( dx*dy + dy*dz + dz*dx ) ).getAsFloat();
+    }
+
+    inline bool Contains( const bxAABB& outer, const bxAABB& inner )
+    {
+        const __m128 a = vec_cmple( outer.min.get128(), inner.min.get128() );
+        const __m128 b = vec_cmpge( outer.max.get128(), inner.max.get128() );
+        return ( _mm_movemask_ps( vec_and( a, b ) ) & 0x7 ) == 0x7;
+    }
+
+    inline bool Overlaps( const bxAABB& a, const bxAABB& b )
+    {
+        const __m128 c0 = vec_cmple( a.min.get128(), b.max.get128() );
+        const __m128 c1 = vec_cmpge( a.max.get128(), b.min.get128() );
+        return ( _mm_movemask_ps( vec_and( c0, c1 ) ) & 0x7 ) == 0x7;
+    }
+
+    inline bool RayOverlaps( const bxAABB& aabb, const Vector3& origin, const Vector3& rcpDir, float maxT )
+    {
+        const Vector3 t0 = mulPerElem( aabb.min - origin, rcpDir );
+        const Vector3 t1 = mulPerElem( aabb.max - origin, rcpDir );
+        const float tmin = maxElem( minPerElem( t0, t1 ) ).getAsFloat();
+        const float tmax = minElem( maxPerElem( t0, t1 ) ).getAsFloat();
+        return tmax >= maxOfPair( tmin, 0.f ) && tmin <= maxT;
+    }
+}//
+
+void DynamicAABBTree::StartUp( f32 fatMargin, u32 initialCapacity, bxAllocator* allocator )
+{
+    SYS_ASSERT( _nodes == nullptr );
+    _allocator = ( allocator ) ? allocator : bxDefaultAllocator();
+    _fat_margin = fatMargin;
+    _root = eNULL_NODE;
+    _free_list = eNULL_NODE;
+    _num_nodes = 0;
+    _num_leaves = 0;
+    _capacity = 0;
+
+    if( !initialCapacity )
+        return;
+
+    _nodes = (Node*)BX_MALLOC( _allocator, initialCapacity * sizeof( Node ), ALIGNOF( Node ) );
+    _capacity = initialCapacity;
+    for( u32 i = 0; i < _capacity; ++i )
+    {
+        new( &_nodes[i] ) Node();
+        _nodes[i].parent = ( i + 1 < _capacity ) ? i + 1 : eNULL_NODE;
+    }
+    _free_list = 0;
+}
+
+void DynamicAABBTree::ShutDown()
+{
+    if( !_allocator )
+        return;
+
+    BX_FREE0( _allocator, _nodes );
+    _capacity = 0;
+    _num_nodes = 0;
+    _num_leaves = 0;
+    _root = eNULL_NODE;
+    _free_list = eNULL_NODE;
+    _allocator = nullptr;
+}
+
+u32 DynamicAABBTree::CreateProxy( const bxAABB& aabb, u64 userData )
+{
+    const u32 proxy = _AllocateNode();
+    const Vector3 margin( _fat_margin );
+
+    Node& node = _nodes[proxy];
+    node.aabb = bxAABB( aabb.min - margin, aabb.max + margin );
+    node.user_data = userData;
+    node.height = 0;
+
+    _InsertLeaf( proxy );
+    ++_num_leaves;
+    return proxy;
+}
+
+void DynamicAABBTree::DestroyProxy( u32 proxy )
+{
+    SYS_ASSERT( proxy < _capacity );
+    SYS_ASSERT( _nodes[proxy].IsLeaf() );
+
+    _RemoveLeaf( proxy );
+    _FreeNode( proxy );
+    --_num_leaves;
+}
+
+bool DynamicAABBTree::MoveProxy( u32 proxy, const bxAABB& aabb )
+{
+    SYS_ASSERT( proxy < _capacity );
+    SYS_ASSERT( _nodes[proxy].IsLeaf() );
+
+    if( Contains( _nodes[proxy].aabb, aabb ) )
+        return false;
+
+    _RemoveLeaf( proxy );
+
+    const Vector3 margin( _fat_margin );
+    _nodes[proxy].aabb = bxAABB( aabb.min - margin, aabb.max + margin );
+
+    _InsertLeaf( proxy );
+    return true;
+}
+
+bool DynamicAABBTree::RootAABB( bxAABB* aabb ) const
+{
+    if( _root == eNULL_NODE )
+        return false;
+
+    aabb[0] = _nodes[_root].aabb;
+    return true;
+}
+
+u32 DynamicAABBTree::QueryAABB( array_t<u64>* result, const bxAABB& aabb ) const
+{
+    if( _root == eNULL_NODE )
+        return 0;
+
+    u32 count = 0;
+    u32 stack[eMAX_STACK];
+    u32 stack_size = 0;
+    stack[stack_size++] = _root;
+    while( stack_size )
+    {
+        const u32 index = stack[--stack_size];
+
+        const Node& node = _nodes[index];
+        if( !Overlaps( node.aabb, aabb ) )
+            continue;
+
+        if( node.IsLeaf() )
+        {
+            array::push_back( *result, node.user_data );
+            ++count;
+        }
+        else
+        {
+            SYS_ASSERT( stack_size + 2 <= eMAX_STACK );
+            stack[stack_size++] = node.child1;
+            stack[stack_size++] = node.child2;
+        }
+    }
+    return count;
+}
+
+u32 DynamicAABBTree::QueryFrustum( array_t<u64>* result, const gfx::ViewFrustum& frustum ) const
+{
+    if( _root == eNULL_NODE )
+        return 0;
+
+    u32 count = 0;
+    u32 stack[eMAX_STACK];
+    u32 stack_size = 0;
+    stack[stack_size++] = _root;
+    while( stack_size )
+    {
+        const u32 index = stack[--stack_size];
+
+        const Node& node = _nodes[index];
+        if( !gfx::viewFrustumAABBIntersect( frustum, node.aabb.min, node.aabb.max ).getAsBool() )
+            continue;
+
+        if( node.IsLeaf() )
+        {
+            array::push_back( *result, node.user_data );
+            ++count;
+        }
+        else
+        {
+            SYS_ASSERT( stack_size + 2 <= eMAX_STACK );
+            stack[stack_size++] = node.child1;
+            stack[stack_size++] = node.child2;
+        }
+    }
+    return count;
+}
+
+void DynamicAABBTree::RayCast( const Vector3& origin, const Vector3& dir, float maxT, RayCastCallback callback, void* udata ) const
+{
+    if( _root == eNULL_NODE )
+        return;
+
+    const Vector3 rcp_dir = divPerElem( Vector3( 1.f ), dir );
+
+    u32 stack[eMAX_STACK];
+    u32 stack_size = 0;
+    stack[stack_size++] = _root;
+    while( stack_size )
+    {
+        const u32 index = stack[--stack_size];
+
+        const Node& node = _nodes[index];
+        if( !RayOverlaps( node.aabb, origin, rcp_dir, maxT ) )
+            continue;
+
+        if( node.IsLeaf() )
+        {
+            maxT = ( *callback )( udata, node.user_data, origin, dir, maxT );
+            if( maxT <= 0.f )
+                return;
+        }
+        else
+        {
+            SYS_ASSERT( stack_size + 2 <= eMAX_STACK );
+            stack[stack_size++] = node.child1;
+            stack[stack_size++] = node.child2;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+u32 DynamicAABBTree::_AllocateNode()
+{
+    if( _free_list == eNULL_NODE )
+    {
+        SYS_ASSERT( _num_nodes == _capacity );
+
+        const u32 new_capacity = _capacity * 2 + 16;
+        Node* new_nodes = (Node*)BX_MALLOC( _allocator, new_capacity * sizeof( Node ), ALIGNOF( Node ) );
+        if( _nodes )
+        {
+            memcpy( new_nodes, _nodes, _capacity * sizeof( Node ) );
+        }
+        BX_FREE( _allocator, _nodes );
+        _nodes = new_nodes;
+
+        for( u32 i = _capacity; i < new_capacity; ++i )
+        {
+            new( &_nodes[i] ) Node();
+            _nodes[i].parent = ( i + 1 < new_capacity ) ? i + 1 : eNULL_NODE;
+        }
+        _free_list = _capacity;
+        _capacity = new_capacity;
+    }
+
+    const u32 index = _free_list;
+    Node& node = _nodes[index];
+    _free_list = node.parent;
+    node.parent = eNULL_NODE;
+    node.child1 = eNULL_NODE;
+    node.child2 = eNULL_NODE;
+    node.height = 0;
+    node.user_data = 0;
+    ++_num_nodes;
+    return index;
+}
+
+void DynamicAABBTree::_FreeNode( u32 index )
+{
+    SYS_ASSERT( index < _capacity );
+    SYS_ASSERT( _num_nodes > 0 );
+    _nodes[index].parent = _free_list;
+    _nodes[index].height = -1;
+    _free_list = index;
+    --_num_nodes;
+}
+
+void DynamicAABBTree::_InsertLeaf( u32 leaf )
+{
+    if( _root == eNULL_NODE )
+    {
+        _root = leaf;
+        _nodes[_root].parent = eNULL_NODE;
+        return;
+    }
+
+    // find best sibling using surface area heuristic
+    const bxAABB leaf_aabb = _nodes[leaf].aabb;
+    u32 index = _root;
+    while( !_nodes[index].IsLeaf() )
+    {
+        const u32 child1 = _nodes[index].child1;
+        const u32 child2 = _nodes[index].child2;
+
+        const float area = SurfaceArea( _nodes[index].aabb );
+        const float combined_area = SurfaceArea( bxAABB::merge( _nodes[index].aabb, leaf_aabb ) );
+
+        // cost of creating a new parent for this node and the new leaf
+        const float cost = 2.f * combined_area;
+
+        // minimum cost of pushing the leaf further down the tree
+        const float inheritance_cost = 2.f * ( combined_area - area );
+
+        float cost1 = SurfaceArea( bxAABB::merge( leaf_aabb, _nodes[child1].aabb ) ) + inheritance_cost;
+        if( !_nodes[child1].IsLeaf() )
+            cost1 -= SurfaceArea( _nodes[child1].aabb );
+
+        float cost2 = SurfaceArea( bxAABB::merge( leaf_aabb, _nodes[child2].aabb ) ) + inheritance_cost;
+        if( !_nodes[child2].IsLeaf() )
+            cost2 -= SurfaceArea( _nodes[child2].aabb );
+
+        if( cost < cost1 && cost < cost2 )
+            break;
+
+        index = ( cost1 < cost2 ) ? child1 : child2;
+    }
+
+    const u32 sibling = index;
+    const u32 old_parent = _nodes[sibling].parent;
+    const u32 new_parent = _AllocateNode();
+    _nodes[new_parent].parent = old_parent;
+    _nodes[new_parent].aabb = bxAABB::merge( leaf_aabb, _nodes[sibling].aabb );
+    _nodes[new_parent].height = _nodes[sibling].height + 1;
+    _nodes[new_parent].child1 = sibling;
+    _nodes[new_parent].child2 = leaf;
+    _nodes[sibling].parent = new_parent;
+    _nodes[leaf].parent = new_parent;
+
+    if( old_parent != eNULL_NODE )
+    {
+        if( _nodes[old_parent].child1 == sibling )
+            _nodes[old_parent].child1 = new_parent;
+        else
+            _nodes[old_parent].child2 = new_parent;
+    }
+    else
+    {
+        _root = new_parent;
+    }
+
+    _RefitToRoot( _nodes[leaf].parent );
+}
+
+void DynamicAABBTree::_RemoveLeaf( u32 leaf )
+{
+    if( leaf == _root )
+    {
+        _root = eNULL_NODE;
+        return;
+    }
+
+    const u32 parent = _nodes[leaf].parent;
+    const u32 grand_parent = _nodes[parent].parent;
+    const u32 sibling = ( _nodes[parent].child1 == leaf ) ? _nodes[parent].child2 : _nodes[parent].child1;
+
+    if( grand_parent != eNULL_NODE )
+    {
+        if( _nodes[grand_parent].child1 == parent )
+            _nodes[grand_parent].child1 = sibling;
+        else
+            _nodes[grand_parent].child2 = sibling;
+
+        _nodes[sibling].parent = grand_parent;
+        _FreeNode( parent );
+
+        _RefitToRoot( grand_parent );
+    }
+    else
+    {
+        _root = sibling;
+        _nodes[sibling].parent = eNULL_NODE;
+        _FreeNode( parent );
+    }
+}
+
+void DynamicAABBTree::_RefitToRoot( u32 index )
+{
+    while( index != eNULL_NODE )
+    {
+        index = _Balance( index );
+
+        Node& node = _nodes[index];
+        const Node& child1 = _nodes[node.child1];
+        const Node& child2 = _nodes[node.child2];
+
+        node.height = 1 + maxOfPair( child1.height, child2.height );
+        node.aabb = bxAABB::merge( child1.aabb, child2.aabb );
+
+        index = node.parent;
+    }
+}
+
+// Performs a left or right rotation if node A is imbalanced. Returns the new root index.
+u32 DynamicAABBTree::_Balance( u32 iA )
+{
+    Node* A = _nodes + iA;
+    if( A->IsLeaf() || A->height < 2 )
+        return iA;
+
+    const u32 iB = A->child1;
+    const u32 iC = A->child2;
+    Node* B = _nodes + iB;
+    Node* C = _nodes + iC;
+
+    const i32 balance = C->height - B->height;
+
+    // rotate C up
+    if( balance > 1 )
+    {
+        const u32 iF = C->child1;
+        const u32 iG = C->child2;
+        Node* F = _nodes + iF;
+        Node* G = _nodes + iG;
+
+        C->child1 = iA;
+        C->parent = A->parent;
+        A->parent = iC;
+
+        if( C->parent != eNULL_NODE )
+        {
+            if( _nodes[C->parent].child1 == iA )
+                _nodes[C->parent].child1 = iC;
+            else
+                _nodes[C->parent].child2 = iC;
+        }
+        else
+        {
+            _root = iC;
+        }
+
+        if( F->height > G->height )
+        {
+            C->child2 = iF;
+            A->child2 = iG;
+            G->parent = iA;
+            A->aabb = bxAABB::merge( B->aabb, G->aabb );
+            C->aabb = bxAABB::merge( A->aabb, F->aabb );
+
+            A->height = 1 + maxOfPair( B->height, G->height );
+            C->height = 1 + maxOfPair( A->height, F->height );
+        }
+        else
+        {
+            C->child2 = iG;
+            A->child2 = iF;
+            F->parent = iA;
+            A->aabb = bxAABB::merge( B->aabb, F->aabb );
+            C->aabb = bxAABB::merge( A->aabb, G->aabb );
+
+            A->height = 1 + maxOfPair( B->height, F->height );
+            C->height = 1 + maxOfPair( A->height, G->height );
+        }
+
+        return iC;
+    }
+
+    // rotate B up
+    if( balance < -1 )
+    {
+        const u32 iD = B->child1;
+        const u32 iE = B->child2;
+        Node* D = _nodes + iD;
+        Node* E = _nodes + iE;
+
+        B->child1 = iA;
+        B->parent = A->parent;
+        A->parent = iB;
+
+        if( B->parent != eNULL_NODE )
+        {
+            if( _nodes[B->parent].child1 == iA )
+                _nodes[B->parent].child1 = iB;
+            else
+                _nodes[B->parent].child2 = iB;
+        }
+        else
+        {
+            _root = iB;
+        }
+
+        if( D->height > E->height )
+        {
+            B->child2 = iD;
+            A->child1 = iE;
+            E->parent = iA;
+            A->aabb = bxAABB::merge( C->aabb, E->aabb );
+            B->aabb = bxAABB::merge( A->aabb, D->aabb );
+
+            A->height = 1 + maxOfPair( C->height, E->height );
+            B->height = 1 + maxOfPair( A->height, D->height );
+        }
+        else
+        {
+            B->child2 = iE;
+            A->child1 = iD;
+            D->parent = iA;
+            A->aabb = bxAABB::merge( C->aabb, D->aabb );
+            B->aabb = bxAABB::merge( A->aabb, E->aabb );
+
+            A->height = 1 + maxOfPair( C->height, D->height );
+            B->height = 1 + maxOfPair( A->height, E->height );
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
+
+//////////////////////////////////////////////////////////////////////////
+namespace
+{
+    inline f32 ElapsedMS( u64 startUS )
+    {
+        return (f32)( ( bxTime::us() - startUS ) * 0.001 );
+    }
+    static float CountRayHit( void* udata, u64 userData, const Vector3& origin, const Vector3& dir, float maxT )
+    {
+        ( (u32*)udata )[0] += 1;
+        return maxT;
+    }
+}//
+
+void DynamicAABBTreeBenchmark( DynamicAABBTreeBenchmarkResult* result, u32 numProxies )
+{
+    const u32 NUM_VIEWS = 16;
+    const u32 NUM_REGIONS = 256;
+    const u32 NUM_RAYS = 256;
+
+    bxRandomGen rnd( 0x5EED );
+    array_t<Vector3> centers;
+    array_t<u32> proxies;
+    array::resize( centers, numProxies );
+    array::resize( proxies, numProxies );
+    for( u32 i = 0; i < numProxies; ++i )
+        centers[i] = Vector3( rnd.getf( -500.f, 500.f ), rnd.getf( -50.f, 50.f ), rnd.getf( -500.f, 500.f ) );
+
+    const Vector3 half_extent( 0.5f );
+    DynamicAABBTree tree;
+    tree.StartUp( 0.1f, numProxies * 2 );
+
+    result[0] = DynamicAABBTreeBenchmarkResult();
+    result->num_proxies = numProxies;
+
+    u64 start_us = bxTime::us();
+    for( u32 i = 0; i < numProxies; ++i )
+        proxies[i] = tree.CreateProxy( bxAABB( centers[i] - half_extent, centers[i] + half_extent ), i );
+    result->build_ms = ElapsedMS( start_us );
+
+    // jitter is smaller than fat margin
+    for( u32 i = 0; i < numProxies; ++i )
+        centers[i] += Vector3( rnd.getf( -0.04f, 0.04f ), 0.f, rnd.getf( -0.04f, 0.04f ) );
+
+    start_us = bxTime::us();
+    for( u32 i = 0; i < numProxies; ++i )
+        result->num_reinserted += tree.MoveProxy( proxies[i], bxAABB( centers[i] - half_extent, centers[i] + half_extent ) );
+    result->update_small_ms = ElapsedMS( start_us );
+
+    for( u32 i = 0; i < numProxies; ++i )
+        centers[i] += Vector3( rnd.getf( -5.f, 5.f ), 0.f, rnd.getf( -5.f, 5.f ) );
+
+    start_us = bxTime::us();
+    for( u32 i = 0; i < numProxies; ++i )
+        result->num_reinserted += tree.MoveProxy( proxies[i], bxAABB( centers[i] - half_extent, centers[i] + half_extent ) );
+    result->update_large_ms = ElapsedMS( start_us );
+    result->height = tree.Height();
+
+    array_t<u64> query_result;
+    array::reserve( query_result, numProxies );
+
+    const Matrix4 proj = Matrix4::perspective( 1.f, 16.f / 9.f, 0.1f, 300.f );
+    u64 tree_us = 0;
+    u64 linear_us = 0;
+    for( u32 iview = 0; iview < NUM_VIEWS; ++iview )
+    {
+        const Point3 eye( rnd.getf( -250.f, 250.f ), 20.f, rnd.getf( -250.f, 250.f ) );
+        const Point3 target( rnd.getf( -500.f, 500.f ), 0.f, rnd.getf( -500.f, 500.f ) );
+        const gfx::ViewFrustum frustum = gfx::viewFrustumExtract( proj * Matrix4::lookAt( eye, target, Vector3::yAxis() ) );
+
+        array::clear( query_result );
+        start_us = bxTime::us();
+        result->num_visible += tree.QueryFrustum( &query_result, frustum );
+        tree_us += bxTime::us() - start_us;
+
+        start_us = bxTime::us();
+        for( u32 i = 0; i < numProxies; ++i )
+        {
+            if( gfx::viewFrustumAABBIntersect( frustum, centers[i] - half_extent, centers[i] + half_extent ).getAsBool() )
+                result->num_visible_linear += 1;
+        }
+        linear_us += bxTime::us() - start_us;
+    }
+    result->num_visible /= NUM_VIEWS;
+    result->num_visible_linear /= NUM_VIEWS;
+    result->query_frustum_ms = (f32)( tree_us * 0.001 / NUM_VIEWS );
+    result->linear_frustum_ms = (f32)( linear_us * 0.001 / NUM_VIEWS );
+
+    start_us = bxTime::us();
+    for( u32 i = 0; i < NUM_REGIONS; ++i )
+    {
+        const Vector3 center( rnd.getf( -500.f, 500.f ), 0.f, rnd.getf( -500.f, 500.f ) );
+        array::clear( query_result );
+        tree.QueryAABB( &query_result, bxAABB( center - Vector3( 10.f ), center + Vector3( 10.f ) ) );
+    }
+    result->query_aabb_ms = ElapsedMS( start_us ) / NUM_REGIONS;
+
+    u32 num_hits = 0;
+    start_us = bxTime::us();
+    for( u32 i = 0; i < NUM_RAYS; ++i )
+    {
+        const Vector3 origin( -500.f, rnd.getf( -5.f, 5.f ), rnd.getf( -500.f, 500.f ) );
+        const Vector3 dir = normalize( Vector3( 1000.f, 0.f, rnd.getf( -500.f, 500.f ) ) );
+        tree.RayCast( origin, dir, 1500.f, CountRayHit, &num_hits );
+    }
+    result->ray_cast_ms = ElapsedMS( start_us ) / NUM_RAYS;
+
+    tree.ShutDown();
+}
+
+}//
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "type.h"
+#include "bbox.h"
+#include "containers.h"
+#include "view_frustum.h"
+
+namespace bx{
+
+// Incrementally updated bounding volume hierarchy. Leaves store fattened AABBs so small movements
+// do not touch the tree at all. Leaves which leave their fat box are reinserted and the path to root
+// is rebalanced with tree rotations.
+struct DynamicAABBTree
+{
+    enum : u32
+    {
+        eNULL_NODE = UINT32_MAX,
+        eMAX_STACK = 256, // traversal stack of queries. Tree is kept balanced, so its height stays far below
+    };
+
+    // called for each leaf hit by the ray. Must return new maxT for the ray ( return maxT to continue unchanged, 0 to stop )
+    typedef float( *RayCastCallback )( void* udata, u64 userData, const Vector3& origin, const Vector3& dir, float maxT );
+
+    struct Node
+    {
+        bxAABB aabb;
+        u64 user_data = 0;
+        u32 parent = eNULL_NODE; // next free node when not used
+        u32 child1 = eNULL_NODE;
+        u32 child2 = eNULL_NODE;
+        i32 height = -1;
+
+        bool IsLeaf() const { return child1 == eNULL_NODE; }
+    };
+
+    void StartUp( f32 fatMargin = 0.1f, u32 initialCapacity = 256, bxAllocator* allocator = nullptr );
+    void ShutDown();
+
+    u32  CreateProxy( const bxAABB& aabb, u64 userData );
+    void DestroyProxy( u32 proxy );
+    // returns true when proxy has been reinserted
+    bool MoveProxy( u32 proxy, const bxAABB& aabb );
+    void SetUserData( u32 proxy, u64 userData ) { _nodes[proxy].user_data = userData; }
+
+    u64           UserData( u32 proxy ) const { return _nodes[proxy].user_data; }
+    const bxAABB& FatAABB ( u32 proxy ) const { return _nodes[proxy].aabb; }
+    u32           NumProxies() const { return _num_leaves; }
+    i32           Height() const { return ( _root == eNULL_NODE ) ? 0 : _nodes[_root].height; }
+    bool          RootAABB( bxAABB* aabb ) const;
+
+    // results are appended to 'result' array as user data of leaves. Queries can run concurrently
+    u32  QueryAABB   ( array_t<u64>* result, const bxAABB& aabb ) const;
+    u32  QueryFrustum( array_t<u64>* result, const gfx::ViewFrustum& frustum ) const;
+    void RayCast     ( const Vector3& origin, const Vector3& dir, float maxT, RayCastCallback callback, void* udata ) const;
+
+    //////////////////////////////////////////////////////////////////////////
+    u32  _AllocateNode();
+    void _FreeNode( u32 node );
+    void _InsertLeaf( u32 leaf );
+    void _RemoveLeaf( u32 leaf );
+    u32  _Balance( u32 index );
+    void _RefitToRoot( u32 index );
+
+    Node* _nodes      = nullptr;
+    u32   _capacity   = 0;
+    u32   _num_nodes  = 0;
+    u32   _num_leaves = 0;
+    u32   _root       = eNULL_NODE;
+    u32   _free_list  = eNULL_NODE;
+    f32   _fat_margin = 0.1f;
+
+    bxAllocator* _allocator = nullptr;
+};
+
+// Headless benchmark on numProxies unit boxes scattered over 1000 x 100 x 1000 region. Times are in milliseconds,
+// queries are averaged over random views, regions and rays. Linear frustum test of every box is measured for comparison.
+struct DynamicAABBTreeBenchmarkResult
+{
+    u32 num_proxies = 0;
+    i32 height = 0;
+    f32 build_ms = 0.f;
+    f32 update_small_ms = 0.f;  // all proxies moved within their fat boxes
+    f32 update_large_ms = 0.f;  // all proxies moved far enough to be reinserted
+    u32 num_reinserted = 0;
+    f32 query_frustum_ms = 0.f;
+    f32 linear_frustum_ms = 0.f;
+    u32 num_visible = 0;
+    u32 num_visible_linear = 0; // tree queries fat boxes, so it reports a few more
+    f32 query_aabb_ms = 0.f;    // 20 x 20 x 20 region
+    f32 ray_cast_ms = 0.f;      // ray across whole region, all hits reported
+};
+void DynamicAABBTreeBenchmark( DynamicAABBTreeBenchmarkResult* result, u32 numProxies );
+
+}//
@@ -5,6 +5,7 @@
 #include <direct.h>
 #include <errno.h>
 #include <string.h>
+#include <windows.h>
 
 //#pragma warning( disable: 4996 )
 
@@ -120,6 +121,73 @@ int createDir( const char* abs_path )
 	return (res == ENOENT ) ? -1 : 0;
 }
 
+int fileExists( const char* abs_path )
+{
+    const DWORD attributes = GetFileAttributesA( abs_path );
+    return ( attributes != INVALID_FILE_ATTRIBUTES && !( attributes & FILE_ATTRIBUTE_DIRECTORY ) ) ? 1 : 0;
+}
+
+int mapFile( bxFS::MappedFile* file, const char* abs_path )
+{
+    HANDLE hfile = CreateFileA( abs_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL );
+    if( hfile == INVALID_HANDLE_VALUE )
+    {
+        bxLogError( "Can not open file %s for mapping\n", abs_path );
+        return -1;
+    }
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( hfile, &size ) || size.QuadPart == 0 )
+    {
+        CloseHandle( hfile );
+        return -1;
+    }
+
+    HANDLE hmapping = CreateFileMappingA( hfile, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( !hmapping )
+    {
+        bxLogError( "Can not create mapping of file %s\n", abs_path );
+        CloseHandle( hfile );
+        return -1;
+    }
+
+    file->file_handle = hfile;
+    file->mapping_handle = hmapping;
+    file->size = (size_t)size.QuadPart;
+    return 0;
+}
+
+void unmapFile( bxFS::MappedFile* file )
+{
+    if( file->mapping_handle )
+        CloseHandle( (HANDLE)file->mapping_handle );
+    if( file->file_handle )
+        CloseHandle( (HANDLE)file->file_handle );
+
+    file[0] = bxFS::MappedFile();
+}
+
+const void* mapView( const bxFS::MappedFile& file, size_t offset, size_t size )
+{
+    SYS_ASSERT( ( offset % mapViewAlignment() ) == 0 );
+    SYS_ASSERT( offset + size <= file.size );
+    const u64 offset64 = offset;
+    return MapViewOfFile( (HANDLE)file.mapping_handle, FILE_MAP_READ, (DWORD)( offset64 >> 32 ), (DWORD)( offset64 & 0xFFFFFFFF ), size );
+}
+
+void unmapView( const void* view )
+{
+    if( view )
+        UnmapViewOfFile( view );
+}
+
+size_t mapViewAlignment()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return info.dwAllocationGranularity;
+}
+
 }//io
 
 
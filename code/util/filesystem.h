@@ -7,6 +7,7 @@ namespace bxIO
     extern int writeFile( const char* absPath, unsigned char* buf, size_t sizeInBytes );
     extern int copyFile( const char* absDstPath, const char* absSrcPath );
     extern int createDir( const char* absPath );
+    extern int fileExists( const char* absPath );
 }//
 
 /// file
@@ -30,6 +31,16 @@ namespace bxFS
         void release();
     };
 
+    // read only file mapping. Parts of file are mapped as separate views, which are paged in by os when touched
+    struct MappedFile
+    {
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+        size_t size = 0;
+
+        bool ok() const { return mapping_handle != nullptr; }
+    };
+
     struct Path
     {
         enum { ePATH_LEN = 255 };
@@ -40,6 +51,16 @@ namespace bxFS
     };
 }//
 
+namespace bxIO
+{
+    extern int  mapFile( bxFS::MappedFile* file, const char* absPath );
+    extern void unmapFile( bxFS::MappedFile* file );
+    // offset has to be multiple of mapViewAlignment()
+    extern const void* mapView( const bxFS::MappedFile& file, size_t offset, size_t size );
+    extern void unmapView( const void* view );
+    extern size_t mapViewAlignment();
+}//
+
 /// filesystem
 class bxFileSystem
 {
@@ -0,0 +1,248 @@
+#include "float16.h"
+#include <intrin.h>
+#include <immintrin.h>
+
+namespace
+{
+    static bxFloat16Simd _DetectSimdLevel()
+    {
+        int regs[4];
+        __cpuidex( regs, 1, 0 );
+        const bool osxsave = ( regs[2] & ( 1 << 27 ) ) != 0;
+        const bool avx     = ( regs[2] & ( 1 << 28 ) ) != 0;
+        const bool f16c    = ( regs[2] & ( 1 << 29 ) ) != 0;
+
+        // F16C works on ymm registers, they have to be enabled by os
+        if( f16c && osxsave && avx && ( _xgetbv( 0 ) & 6 ) == 6 )
+            return eFLOAT16_SIMD_F16C;
+
+        return eFLOAT16_SIMD_SSE2;
+    }
+    static const bxFloat16Simd g_simd_supported = _DetectSimdLevel();
+    inline bxFloat16Simd _ClampLevel( bxFloat16Simd level ) { return ( level < g_simd_supported ) ? level : g_simd_supported; }
+
+    //////////////////////////////////////////////////////////////////////////
+    // float_to_half_fast3 with round to nearest even. Half denormals are made by float addition,
+    // which does the rounding for us.
+    static const u32 c_f16max       = ( 127 + 16 ) << 23;   // first float which is inf in half
+    static const u32 c_f32infty     = 255 << 23;
+    static const u32 c_min_normal   = 113 << 23;            // smallest normal half
+    static const u32 c_denorm_magic = ( ( 127 - 15 ) + ( 23 - 10 ) + 1 ) << 23;
+    static const u32 c_normal_bias  = ( ( 15 - 127 ) << 23 ) + 0xfff;
+
+    inline u16 _FloatToHalf( f32 value )
+    {
+        FP32 f = fromF32( value );
+        const u32 sign = f.u & 0x80000000u;
+        f.u ^= sign;
+
+        u32 o;
+        if( f.u >= c_f16max )
+        {
+            o = 0x7c00;
+            if( f.u > c_f32infty )
+                o |= 0x200 | ( ( f.u >> 13 ) & 0x3ff );
+        }
+        else if( f.u < c_min_normal )
+        {
+            f.f += fromU32( c_denorm_magic ).f;
+            o = f.u - c_denorm_magic;
+        }
+        else
+        {
+            const u32 mant_odd = ( f.u >> 13 ) & 1;
+            o = ( f.u + c_normal_bias + mant_odd ) >> 13;
+        }
+        return (u16)( o | ( sign >> 16 ) );
+    }
+
+    inline f32 _HalfToFloat( u16 value )
+    {
+        FP32 o = half_to_float( fromU16( value ) );
+        if( ( value & 0x7c00 ) == 0x7c00 && ( value & 0x3ff ) )
+            o.u |= 0x400000; // quiet NaN
+        return o.f;
+    }
+
+    inline __m128i _FloatToHalfSSE2( __m128 f )
+    {
+        const __m128i mask_sign = _mm_set1_epi32( 0x80000000 );
+        const __m128i f16max = _mm_set1_epi32( c_f16max - 1 );
+        const __m128i f32infty = _mm_set1_epi32( c_f32infty );
+        const __m128i min_normal = _mm_set1_epi32( c_min_normal );
+        const __m128i denorm_magic = _mm_set1_epi32( c_denorm_magic );
+        const __m128i normal_bias = _mm_set1_epi32( c_normal_bias );
+        const __m128i one = _mm_set1_epi32( 1 );
+
+        const __m128i u = _mm_castps_si128( f );
+        const __m128i sign = _mm_and_si128( u, mask_sign );
+        const __m128i a = _mm_xor_si128( u, sign );
+
+        // all compares are signed, which is fine because sign is cleared
+        const __m128 denorm_f = _mm_add_ps( _mm_castsi128_ps( a ), _mm_castsi128_ps( denorm_magic ) );
+        const __m128i denorm = _mm_sub_epi32( _mm_castps_si128( denorm_f ), denorm_magic );
+
+        const __m128i mant_odd = _mm_and_si128( _mm_srli_epi32( a, 13 ), one );
+        const __m128i normal = _mm_srli_epi32( _mm_add_epi32( _mm_add_epi32( a, normal_bias ), mant_odd ), 13 );
+
+        const __m128i nan_mant = _mm_or_si128( _mm_set1_epi32( 0x200 ), _mm_and_si128( _mm_srli_epi32( a, 13 ), _mm_set1_epi32( 0x3ff ) ) );
+        const __m128i is_nan = _mm_cmpgt_epi32( a, f32infty );
+        const __m128i infnan = _mm_or_si128( _mm_set1_epi32( 0x7c00 ), _mm_and_si128( is_nan, nan_mant ) );
+
+        const __m128i is_denorm = _mm_cmpgt_epi32( min_normal, a );
+        const __m128i is_infnan = _mm_cmpgt_epi32( a, f16max );
+        __m128i result = _mm_or_si128( _mm_and_si128( is_denorm, denorm ), _mm_andnot_si128( is_denorm, normal ) );
+        result = _mm_or_si128( _mm_and_si128( is_infnan, infnan ), _mm_andnot_si128( is_infnan, result ) );
+        return _mm_or_si128( result, _mm_srli_epi32( sign, 16 ) );
+    }
+
+    inline __m128 _HalfToFloatSSE2( __m128i h )
+    {
+        const __m128i mask_nosign = _mm_set1_epi32( 0x7fff );
+        const __m128 magic = _mm_castsi128_ps( _mm_set1_epi32( ( 254 - 15 ) << 23 ) );
+        const __m128i was_infnan = _mm_set1_epi32( 0x7bff );
+        const __m128i was_inf = _mm_set1_epi32( 0x7c00 );
+        const __m128 exp_infnan = _mm_castsi128_ps( _mm_set1_epi32( 255 << 23 ) );
+        const __m128 quiet_bit = _mm_castsi128_ps( _mm_set1_epi32( 0x400000 ) );
+
+        const __m128i expmant = _mm_and_si128( mask_nosign, h );
+        const __m128i justsign = _mm_xor_si128( h, expmant );
+        const __m128i shifted = _mm_slli_epi32( expmant, 13 );
+        const __m128 scaled = _mm_mul_ps( _mm_castsi128_ps( shifted ), magic );
+        const __m128i b_wasinfnan = _mm_cmpgt_epi32( expmant, was_infnan );
+        const __m128i b_wasnan = _mm_cmpgt_epi32( expmant, was_inf );
+        const __m128i sign = _mm_slli_epi32( justsign, 16 );
+        const __m128 infnanexp = _mm_and_ps( _mm_castsi128_ps( b_wasinfnan ), exp_infnan );
+        const __m128 quiet = _mm_and_ps( _mm_castsi128_ps( b_wasnan ), quiet_bit );
+        const __m128 sign_inf = _mm_or_ps( _mm_castsi128_ps( sign ), _mm_or_ps( infnanexp, quiet ) );
+        return _mm_or_ps( scaled, sign_inf );
+    }
+
+    // 8 x u32 (each fits in 16 bits) -> 8 x u16. packs is signed, so values are sign extended first
+    inline __m128i _Pack16( __m128i a, __m128i b )
+    {
+        a = _mm_srai_epi32( _mm_slli_epi32( a, 16 ), 16 );
+        b = _mm_srai_epi32( _mm_slli_epi32( b, 16 ), 16 );
+        return _mm_packs_epi32( a, b );
+    }
+
+    static void _FromFloatSSE2( u16* dst, const f32* src, u32 count )
+    {
+        u32 i = 0;
+        for( ; i + 8 <= count; i += 8 )
+        {
+            const __m128i h0 = _FloatToHalfSSE2( _mm_loadu_ps( src + i ) );
+            const __m128i h1 = _FloatToHalfSSE2( _mm_loadu_ps( src + i + 4 ) );
+            _mm_storeu_si128( (__m128i*)( dst + i ), _Pack16( h0, h1 ) );
+        }
+        for( ; i < count; ++i )
+            dst[i] = _FloatToHalf( src[i] );
+    }
+
+    static void _ToFloatSSE2( f32* dst, const u16* src, u32 count )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        u32 i = 0;
+        for( ; i + 8 <= count; i += 8 )
+        {
+            const __m128i h = _mm_loadu_si128( (const __m128i*)( src + i ) );
+            _mm_storeu_ps( dst + i    , _HalfToFloatSSE2( _mm_unpacklo_epi16( h, zero ) ) );
+            _mm_storeu_ps( dst + i + 4, _HalfToFloatSSE2( _mm_unpackhi_epi16( h, zero ) ) );
+        }
+        for( ; i < count; ++i )
+            dst[i] = _HalfToFloat( src[i] );
+    }
+
+    static void _FromFloatF16C( u16* dst, const f32* src, u32 count )
+    {
+        u32 i = 0;
+        for( ; i + 16 <= count; i += 16 )
+        {
+            const __m128i h0 = _mm256_cvtps_ph( _mm256_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT );
+            const __m128i h1 = _mm256_cvtps_ph( _mm256_loadu_ps( src + i + 8 ), _MM_FROUND_TO_NEAREST_INT );
+            _mm_storeu_si128( (__m128i*)( dst + i ), h0 );
+            _mm_storeu_si128( (__m128i*)( dst + i + 8 ), h1 );
+        }
+        for( ; i + 4 <= count; i += 4 )
+            _mm_storel_epi64( (__m128i*)( dst + i ), _mm_cvtps_ph( _mm_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT ) );
+        _mm256_zeroupper();
+
+        for( ; i < count; ++i )
+            dst[i] = _FloatToHalf( src[i] );
+    }
+
+    static void _ToFloatF16C( f32* dst, const u16* src, u32 count )
+    {
+        u32 i = 0;
+        for( ; i + 16 <= count; i += 16 )
+        {
+            const __m256 f0 = _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i*)( src + i ) ) );
+            const __m256 f1 = _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i*)( src + i + 8 ) ) );
+            _mm256_storeu_ps( dst + i, f0 );
+            _mm256_storeu_ps( dst + i + 8, f1 );
+        }
+        for( ; i + 4 <= count; i += 4 )
+            _mm_storeu_ps( dst + i, _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i*)( src + i ) ) ) );
+        _mm256_zeroupper();
+
+        for( ; i < count; ++i )
+            dst[i] = _HalfToFloat( src[i] );
+    }
+}//
+
+u16 bxFloat16_fromFloat( f32 value )
+{
+    return _FloatToHalf( value );
+}
+f32 bxFloat16_toFloat( u16 value )
+{
+    return _HalfToFloat( value );
+}
+
+void bxFloat16_fromFloat( u16* dst, const f32* src, u32 count )
+{
+    bxFloat16_fromFloat( g_simd_supported, dst, src, count );
+}
+void bxFloat16_toFloat( f32* dst, const u16* src, u32 count )
+{
+    bxFloat16_toFloat( g_simd_supported, dst, src, count );
+}
+
+void bxFloat16_fromFloat( bxFloat16Simd level, u16* dst, const f32* src, u32 count )
+{
+    switch( _ClampLevel( level ) )
+    {
+    case eFLOAT16_SIMD_F16C:
+        _FromFloatF16C( dst, src, count );
+        break;
+    case eFLOAT16_SIMD_SSE2:
+        _FromFloatSSE2( dst, src, count );
+        break;
+    default:
+        for( u32 i = 0; i < count; ++i )
+            dst[i] = _FloatToHalf( src[i] );
+        break;
+    }
+}
+
+void bxFloat16_toFloat( bxFloat16Simd level, f32* dst, const u16* src, u32 count )
+{
+    switch( _ClampLevel( level ) )
+    {
+    case eFLOAT16_SIMD_F16C:
+        _ToFloatF16C( dst, src, count );
+        break;
+    case eFLOAT16_SIMD_SSE2:
+        _ToFloatSSE2( dst, src, count );
+        break;
+    default:
+        for( u32 i = 0; i < count; ++i )
+            dst[i] = _HalfToFloat( src[i] );
+        break;
+    }
+}
+
+bxFloat16Simd bxFloat16_simdLevel()
+{
+    return g_simd_supported;
+}
@@ -52,6 +52,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <emmintrin.h>
+#include "type.h"
 
 typedef unsigned int uint;
 
@@ -82,6 +83,28 @@ inline FP32 fromU32( uint u ) { FP32 fp; fp.u = u; return fp; }
 inline FP32 fromF32( float f ) { FP32 fp; fp.f = f; return fp; }
 inline FP16 fromU16( unsigned short u ) { FP16 fp; fp.u = u; return fp; }
 
+//////////////////////////////////////////////////////////////////////////
+// Bulk conversions (float16.cpp).
+// Use F16C when cpu supports it, SSE2 otherwise. All paths round to nearest even and give
+// the same results (NaNs are quieted, upper mantissa bits are kept).
+u16  bxFloat16_fromFloat( f32 value );
+f32  bxFloat16_toFloat( u16 value );
+void bxFloat16_fromFloat( u16* dst, const f32* src, u32 count );
+void bxFloat16_toFloat( f32* dst, const u16* src, u32 count );
+
+enum bxFloat16Simd
+{
+    eFLOAT16_SIMD_SCALAR = 0,
+    eFLOAT16_SIMD_SSE2,
+    eFLOAT16_SIMD_F16C,
+};
+// Best instruction set supported by cpu. Bulk conversions above always use it.
+bxFloat16Simd bxFloat16_simdLevel();
+
+// Bulk conversions with instruction set passed explicitly (eg. for comparison). Level is clamped to bxFloat16_simdLevel().
+void bxFloat16_fromFloat( bxFloat16Simd level, u16* dst, const f32* src, u32 count );
+void bxFloat16_toFloat( bxFloat16Simd level, f32* dst, const u16* src, u32 count );
+
 static FP16 float_to_half_full( FP32 f )
 {
     FP16 o = { 0 };
@@ -0,0 +1,86 @@
+#include "hash_map.h"
+#include "hashmap.h"
+#include "array.h"
+#include "time.h"
+
+namespace
+{
+    inline f32 ElapsedMS( u64 startUS )
+    {
+        return (f32)( ( bxTime::us() - startUS ) * 0.001 );
+    }
+
+    // the same insert -> hit -> miss -> erase round for both tables
+    template< typename Tinsert, typename Tfind, typename Terase >
+    void BenchmarkRound( HashMapBenchmarkResult* result, u32 method, const u64* keys, const u64* missKeys, Tinsert insert, Tfind find, Terase erase )
+    {
+        const u32 n = result->num_keys;
+
+        u64 start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+            insert( keys[i], (u64)i );
+        result->insert_ms[method] += ElapsedMS( start_us );
+
+        u32 num_wrong = 0;
+        start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+        {
+            const u64* value = find( keys[i] );
+            num_wrong += ( !value || *value != i ) ? 1 : 0;
+        }
+        result->hit_ms[method] += ElapsedMS( start_us );
+
+        start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+            num_wrong += ( find( missKeys[i] ) ) ? 1 : 0;
+        result->miss_ms[method] += ElapsedMS( start_us );
+
+        start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+            erase( keys[i] );
+        result->erase_ms[method] += ElapsedMS( start_us );
+
+        for( u32 i = 0; i < n; ++i )
+            num_wrong += ( find( keys[i] ) ) ? 1 : 0;
+        result->errors[method] += num_wrong;
+    }
+}//
+
+void HashMapBenchmark( HashMapBenchmarkResult* result, u32 numKeys, u32 numRounds )
+{
+    result[0] = HashMapBenchmarkResult();
+    result->num_keys = numKeys;
+    result->num_rounds = numRounds;
+
+    // mix64 is a bijection with mix64( 0 ) == 0, so keys are unique, never 0 (reserved by hashmap_t) and misses never hit
+    array_t<u64> keys;
+    array_t<u64> miss_keys;
+    array::resize( keys, numKeys );
+    array::resize( miss_keys, numKeys );
+    for( u32 i = 0; i < numKeys; ++i )
+    {
+        keys[i] = hash_map::mix64( (u64)i + 1 );
+        miss_keys[i] = hash_map::mix64( (u64)numKeys + i + 1 );
+    }
+
+    hash_map_t<u64, u64> hmap;
+    hash_map::reserve( hmap, numKeys );
+    result->capacity[HashMapBenchmarkResult::HASH_MAP] = hmap.capacity;
+
+    hashmap_t old_hmap;
+    hashmap::reserve( old_hmap, (size_t)numKeys * 4 / 3 + 1 );
+    result->capacity[HashMapBenchmarkResult::HASHMAP] = (u32)old_hmap.capacity;
+
+    for( u32 round = 0; round < numRounds; ++round )
+    {
+        BenchmarkRound( result, HashMapBenchmarkResult::HASH_MAP, keys.begin(), miss_keys.begin(),
+            [&hmap]( u64 key, u64 value ) { hash_map::insert( hmap, key, value ); },
+            [&hmap]( u64 key ) { return (const u64*)hash_map::find( hmap, key ); },
+            [&hmap]( u64 key ) { hash_map::erase( hmap, key ); } );
+
+        BenchmarkRound( result, HashMapBenchmarkResult::HASHMAP, keys.begin(), miss_keys.begin(),
+            [&old_hmap]( u64 key, u64 value ) { hashmap::set( old_hmap, key, value ); },
+            [&old_hmap]( u64 key ) { const hashmap_t::cell_t* cell = hashmap::lookup( (const hashmap_t&)old_hmap, key ); return ( cell ) ? &cell->value : (const u64*)nullptr; },
+            [&old_hmap]( u64 key ) { hashmap::eraseByKey( old_hmap, key ); } );
+    }
+}
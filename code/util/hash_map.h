@@ -0,0 +1,332 @@
+#pragma once
+
+#include "type.h"
+#include "memory.h"
+#include "debug.h"
+#include "hash.h"
+
+#include <emmintrin.h>
+#include <intrin.h>
+#include <type_traits>
+
+// Open addressing hash map with SIMD group probing (Swiss table like).
+// One control byte per slot is kept separately from slots: EMPTY (high bit set) or 7 bits of key hash.
+// Probing tests 16 control bytes at once with SSE2, so full keys are compared only on hash match.
+// Probe sequence is linear, which allows deletion by backward shifting (no tombstones).
+// Keys and values have to be trivially copyable. Any key value is valid (no reserved keys).
+namespace hash_map
+{
+    enum : u32
+    {
+        GROUP_WIDTH = 16,
+        MIN_CAPACITY = 16,
+    };
+    enum : u8
+    {
+        CTRL_EMPTY = 0x80,
+    };
+
+    inline u64 mix64( u64 k )
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    // default hash: small keys (integers, pointers, enums) are mixed directly, bigger keys are hashed bytewise
+    template< typename K >
+    struct default_hash_t
+    {
+        u64 operator()( const K& key ) const
+        {
+            if( sizeof( K ) <= sizeof( u64 ) )
+            {
+                u64 k = 0;
+                memcpy( &k, &key, sizeof( K ) );
+                return mix64( k );
+            }
+            u64 h[2];
+            murmur3_hash128( h, &key, sizeof( K ), 0 );
+            return h[0];
+        }
+    };
+
+    inline u32 _FirstBit( u32 mask )
+    {
+        unsigned long index;
+        _BitScanForward( &index, mask );
+        return (u32)index;
+    }
+}//
+
+template< typename K, typename V, typename Hash = hash_map::default_hash_t<K> >
+struct hash_map_t
+{
+    static_assert( std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value, "hash_map_t: key and value have to be trivially copyable" );
+
+    struct slot_t
+    {
+        K key;
+        V value;
+    };
+
+    u8* ctrl;      // capacity + GROUP_WIDTH bytes. Tail mirrors first bytes, so group load never wraps
+    slot_t* slots;
+    bxAllocator* allocator;
+
+    u32 size;
+    u32 capacity;  // power of 2 or 0
+    Hash hasher;
+
+    hash_map_t( bxAllocator* alloc = bxDefaultAllocator() )
+        : ctrl( nullptr ), slots( nullptr ), allocator( alloc ), size( 0 ), capacity( 0 )
+    {}
+    ~hash_map_t()
+    {
+        BX_FREE0( allocator, ctrl );
+        BX_FREE0( allocator, slots );
+    }
+
+private:
+    hash_map_t( const hash_map_t& );
+    hash_map_t& operator = ( const hash_map_t& );
+};
+
+namespace hash_map
+{
+    // max load factor 7/8
+    inline u32 _MaxSize( u32 capacity ) { return capacity - capacity / 8; }
+
+    template< typename M >
+    inline void _SetCtrl( M& m, u32 index, u8 value )
+    {
+        m.ctrl[index] = value;
+        if( index < GROUP_WIDTH - 1 )
+            m.ctrl[m.capacity + index] = value;
+    }
+
+    // returns slot index or UINT32_MAX
+    template< typename M, typename K >
+    inline u32 _Find( const M& m, const K& key, u64 hash )
+    {
+        if( m.capacity == 0 )
+            return UINT32_MAX;
+
+        const u32 mask = m.capacity - 1;
+        const __m128i h2 = _mm_set1_epi8( (char)( hash & 0x7F ) );
+        u32 pos = (u32)( hash >> 7 ) & mask;
+        for( ;; )
+        {
+            const __m128i group = _mm_loadu_si128( (const __m128i*)( m.ctrl + pos ) );
+            u32 match = (u32)_mm_movemask_epi8( _mm_cmpeq_epi8( group, h2 ) );
+            while( match )
+            {
+                const u32 index = ( pos + _FirstBit( match ) ) & mask;
+                if( m.slots[index].key == key )
+                    return index;
+                match &= match - 1;
+            }
+            if( _mm_movemask_epi8( group ) )
+                return UINT32_MAX;
+
+            pos = ( pos + GROUP_WIDTH ) & mask;
+        }
+    }
+
+    // returns first empty slot on probe sequence. Table must have at least one empty slot
+    template< typename M >
+    inline u32 _FindEmpty( const M& m, u64 hash )
+    {
+        const u32 mask = m.capacity - 1;
+        u32 pos = (u32)( hash >> 7 ) & mask;
+        for( ;; )
+        {
+            const __m128i group = _mm_loadu_si128( (const __m128i*)( m.ctrl + pos ) );
+            const u32 empty = (u32)_mm_movemask_epi8( group );
+            if( empty )
+                return ( pos + _FirstBit( empty ) ) & mask;
+
+            pos = ( pos + GROUP_WIDTH ) & mask;
+        }
+    }
+
+    template< typename K, typename V, typename H >
+    void _Rehash( hash_map_t<K, V, H>& m, u32 newCapacity )
+    {
+        typedef typename hash_map_t<K, V, H>::slot_t Slot;
+        SYS_ASSERT( is_pow2( newCapacity ) );
+        SYS_ASSERT( m.size <= _MaxSize( newCapacity ) );
+
+        u8* old_ctrl = m.ctrl;
+        Slot* old_slots = m.slots;
+        const u32 old_capacity = m.capacity;
+
+        m.ctrl = (u8*)BX_MALLOC( m.allocator, newCapacity + GROUP_WIDTH, 16 );
+        m.slots = (Slot*)BX_MALLOC( m.allocator, newCapacity * sizeof( Slot ), ALIGNOF( Slot ) );
+        m.capacity = newCapacity;
+        memset( m.ctrl, CTRL_EMPTY, newCapacity + GROUP_WIDTH );
+
+        for( u32 i = 0; i < old_capacity; ++i )
+        {
+            if( old_ctrl[i] & CTRL_EMPTY )
+                continue;
+
+            const u64 hash = m.hasher( old_slots[i].key );
+            const u32 index = _FindEmpty( m, hash );
+            _SetCtrl( m, index, (u8)( hash & 0x7F ) );
+            m.slots[index] = old_slots[i];
+        }
+
+        BX_FREE( m.allocator, old_ctrl );
+        BX_FREE( m.allocator, old_slots );
+    }
+
+    // makes room for 'count' elements without rehashing
+    template< typename K, typename V, typename H >
+    void reserve( hash_map_t<K, V, H>& m, u32 count )
+    {
+        u32 capacity = ( m.capacity ) ? m.capacity : MIN_CAPACITY;
+        while( _MaxSize( capacity ) < count )
+            capacity *= 2;
+
+        if( capacity > m.capacity )
+            _Rehash( m, capacity );
+    }
+
+    template< typename K, typename V, typename H >
+    inline V* find( hash_map_t<K, V, H>& m, const K& key )
+    {
+        const u32 index = _Find( m, key, m.hasher( key ) );
+        return ( index != UINT32_MAX ) ? &m.slots[index].value : nullptr;
+    }
+    template< typename K, typename V, typename H >
+    inline const V* find( const hash_map_t<K, V, H>& m, const K& key )
+    {
+        const u32 index = _Find( m, key, m.hasher( key ) );
+        return ( index != UINT32_MAX ) ? &m.slots[index].value : nullptr;
+    }
+    template< typename K, typename V, typename H >
+    inline bool contains( const hash_map_t<K, V, H>& m, const K& key )
+    {
+        return _Find( m, key, m.hasher( key ) ) != UINT32_MAX;
+    }
+
+    // returns value for key. New entries are initialized with 'initValue', and 'inserted' is set accordingly
+    template< typename K, typename V, typename H >
+    V* find_or_insert( hash_map_t<K, V, H>& m, const K& key, const V& initValue, bool* inserted = nullptr )
+    {
+        const u64 hash = m.hasher( key );
+        const u32 found = _Find( m, key, hash );
+        if( inserted )
+            *inserted = ( found == UINT32_MAX );
+        if( found != UINT32_MAX )
+            return &m.slots[found].value;
+
+        if( m.size + 1 > _MaxSize( m.capacity ) )
+            _Rehash( m, ( m.capacity ) ? m.capacity * 2 : MIN_CAPACITY );
+
+        const u32 index = _FindEmpty( m, hash );
+        _SetCtrl( m, index, (u8)( hash & 0x7F ) );
+        m.slots[index].key = key;
+        m.slots[index].value = initValue;
+        ++m.size;
+        return &m.slots[index].value;
+    }
+
+    // inserts or overwrites value
+    template< typename K, typename V, typename H >
+    inline V* insert( hash_map_t<K, V, H>& m, const K& key, const V& value )
+    {
+        V* v = find_or_insert( m, key, value );
+        *v = value;
+        return v;
+    }
+
+    template< typename K, typename V, typename H >
+    bool erase( hash_map_t<K, V, H>& m, const K& key )
+    {
+        u32 hole = _Find( m, key, m.hasher( key ) );
+        if( hole == UINT32_MAX )
+            return false;
+
+        // backward shift: move following entries of the cluster to the hole if it's still on their probe sequence
+        const u32 mask = m.capacity - 1;
+        u32 j = hole;
+        for( ;; )
+        {
+            j = ( j + 1 ) & mask;
+            if( m.ctrl[j] & CTRL_EMPTY )
+                break;
+
+            const u32 home = (u32)( m.hasher( m.slots[j].key ) >> 7 ) & mask;
+            if( ( ( j - home ) & mask ) >= ( ( j - hole ) & mask ) )
+            {
+                _SetCtrl( m, hole, m.ctrl[j] );
+                m.slots[hole] = m.slots[j];
+                hole = j;
+            }
+        }
+        _SetCtrl( m, hole, CTRL_EMPTY );
+        --m.size;
+        return true;
+    }
+
+    // keeps memory
+    template< typename K, typename V, typename H >
+    void clear( hash_map_t<K, V, H>& m )
+    {
+        if( m.ctrl )
+            memset( m.ctrl, CTRL_EMPTY, m.capacity + GROUP_WIDTH );
+        m.size = 0;
+    }
+
+    template< typename K, typename V, typename H >
+    inline bool empty( const hash_map_t<K, V, H>& m ) { return m.size == 0; }
+    template< typename K, typename V, typename H >
+    inline u32 size( const hash_map_t<K, V, H>& m ) { return m.size; }
+
+    // func( const K& key, V& value ). Map must not be modified during iteration
+    template< typename K, typename V, typename H, typename F >
+    void for_each( hash_map_t<K, V, H>& m, const F& func )
+    {
+        for( u32 i = 0; i < m.capacity; ++i )
+        {
+            if( !( m.ctrl[i] & CTRL_EMPTY ) )
+                func( (const K&)m.slots[i].key, m.slots[i].value );
+        }
+    }
+    template< typename K, typename V, typename H, typename F >
+    void for_each( const hash_map_t<K, V, H>& m, const F& func )
+    {
+        for( u32 i = 0; i < m.capacity; ++i )
+        {
+            if( !( m.ctrl[i] & CTRL_EMPTY ) )
+                func( (const K&)m.slots[i].key, (const V&)m.slots[i].value );
+        }
+    }
+}//
+
+// insert, hit lookup, miss lookup and erase of numKeys random u64 keys for hash_map_t<u64, u64> and hashmap_t.
+// Both tables are reserved up front, so no rehash is timed. hashmap_t grows at 3/4 load and hash_map_t at 7/8,
+// so capacities can differ. Times are summed over rounds.
+struct HashMapBenchmarkResult
+{
+    enum EMethod : u32
+    {
+        HASH_MAP = 0, // hash_map_t
+        HASHMAP,      // hashmap_t
+        NUM_METHODS,
+    };
+    u32 num_keys = 0;
+    u32 num_rounds = 0;
+    u32 capacity [NUM_METHODS] = {};
+    f32 insert_ms[NUM_METHODS] = {};
+    f32 hit_ms   [NUM_METHODS] = {};
+    f32 miss_ms  [NUM_METHODS] = {};
+    f32 erase_ms [NUM_METHODS] = {};
+    u32 errors   [NUM_METHODS] = {}; // wrong values found, misses found or keys left after erase
+};
+void HashMapBenchmark( HashMapBenchmarkResult* result, u32 numKeys = 100000, u32 numRounds = 10 );
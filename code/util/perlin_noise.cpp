@@ -1,5 +1,9 @@
 #include "perlin_noise.h"
+#include "type.h"
+#include "debug.h"
 #include <math.h>
+#include <string.h>
+#include <intrin.h>
 // not same permutation table as Perlin's reference to avoid copyright issues;
 // Perlin's table can be found at http://mrl.nyu.edu/~perlin/noise/
 // @OPTIMIZE: should this be unsigned char instead of int for cache?
@@ -266,3 +270,501 @@ void bxNoise_fbm( float out[4], float x, float y, float z, int octaves, float ws
     out[3] = dz * octavesInv;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// batch evaluation
+// Same math as scalar bxNoise_perlin, one point per lane. Gradient is looked up directly by corner hash,
+// so every corner costs one gather from permutation table and one per gradient component.
+namespace
+{
+    struct NoiseTables
+    {
+        int   perm[512];
+        float grad_x[256];
+        float grad_y[256];
+        float grad_z[256];
+
+        NoiseTables()
+        {
+            for( int i = 0; i < 512; ++i )
+                perm[i] = stb__perlin_randtab[i];
+
+            for( int i = 0; i < 256; ++i )
+            {
+                grad_x[i] = stb__perlin_grad( i, 1.f, 0.f, 0.f );
+                grad_y[i] = stb__perlin_grad( i, 0.f, 1.f, 0.f );
+                grad_z[i] = stb__perlin_grad( i, 0.f, 0.f, 1.f );
+            }
+        }
+    };
+    static const NoiseTables g_tables;
+
+    static bxNoiseSimd _DetectSimdLevel()
+    {
+        int regs[4];
+        __cpuidex( regs, 1, 0 );
+        const bool sse41   = ( regs[2] & ( 1 << 19 ) ) != 0;
+        const bool osxsave = ( regs[2] & ( 1 << 27 ) ) != 0;
+        const bool avx     = ( regs[2] & ( 1 << 28 ) ) != 0;
+        if( !sse41 )
+            return eNOISE_SIMD_SCALAR;
+
+        // ymm registers have to be enabled by os
+        if( !osxsave || !avx || ( _xgetbv( 0 ) & 6 ) != 6 )
+            return eNOISE_SIMD_SSE;
+
+        __cpuidex( regs, 7, 0 );
+        return ( regs[1] & ( 1 << 5 ) ) ? eNOISE_SIMD_AVX2 : eNOISE_SIMD_SSE;
+    }
+    static const bxNoiseSimd g_simd_supported = _DetectSimdLevel();
+    inline bxNoiseSimd _ClampLevel( bxNoiseSimd level ) { return ( level < g_simd_supported ) ? level : g_simd_supported; }
+
+    //////////////////////////////////////////////////////////////////////////
+    struct SseI
+    {
+        enum { WIDTH = 4 };
+        __m128i v;
+        SseI() {}
+        SseI( __m128i a ) : v( a ) {}
+        explicit SseI( int a ) : v( _mm_set1_epi32( a ) ) {}
+        static SseI lanes() { return _mm_setr_epi32( 0, 1, 2, 3 ); }
+    };
+    struct SseF
+    {
+        enum { WIDTH = 4 };
+        typedef SseI Int;
+        __m128 v;
+        SseF() {}
+        SseF( __m128 a ) : v( a ) {}
+        explicit SseF( float a ) : v( _mm_set1_ps( a ) ) {}
+        static SseF load( const float* p ) { return _mm_loadu_ps( p ); }
+        void store( float* p ) const { _mm_storeu_ps( p, v ); }
+    };
+    inline SseF operator + ( SseF a, SseF b ) { return _mm_add_ps( a.v, b.v ); }
+    inline SseF operator - ( SseF a, SseF b ) { return _mm_sub_ps( a.v, b.v ); }
+    inline SseF operator * ( SseF a, SseF b ) { return _mm_mul_ps( a.v, b.v ); }
+    inline SseF operator / ( SseF a, SseF b ) { return _mm_div_ps( a.v, b.v ); }
+    inline SseF operator - ( SseF a ) { return _mm_xor_ps( a.v, _mm_set1_ps( -0.f ) ); }
+    inline SseI operator + ( SseI a, SseI b ) { return _mm_add_epi32( a.v, b.v ); }
+    inline SseI operator & ( SseI a, SseI b ) { return _mm_and_si128( a.v, b.v ); }
+    inline SseF vfloor( SseF a ) { return _mm_floor_ps( a.v ); }
+    inline SseI vtoInt( SseF a ) { return _mm_cvttps_epi32( a.v ); }
+    inline SseF vtoFloat( SseI a ) { return _mm_cvtepi32_ps( a.v ); }
+    inline SseI vgather( const int* table, SseI i )
+    {
+        return _mm_setr_epi32( table[_mm_cvtsi128_si32( i.v )], table[_mm_extract_epi32( i.v, 1 )], table[_mm_extract_epi32( i.v, 2 )], table[_mm_extract_epi32( i.v, 3 )] );
+    }
+    inline SseF vgather( const float* table, SseI i )
+    {
+        return _mm_setr_ps( table[_mm_cvtsi128_si32( i.v )], table[_mm_extract_epi32( i.v, 1 )], table[_mm_extract_epi32( i.v, 2 )], table[_mm_extract_epi32( i.v, 3 )] );
+    }
+
+    struct AvxI
+    {
+        enum { WIDTH = 8 };
+        __m256i v;
+        AvxI() {}
+        AvxI( __m256i a ) : v( a ) {}
+        explicit AvxI( int a ) : v( _mm256_set1_epi32( a ) ) {}
+        static AvxI lanes() { return _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ); }
+    };
+    struct AvxF
+    {
+        enum { WIDTH = 8 };
+        typedef AvxI Int;
+        __m256 v;
+        AvxF() {}
+        AvxF( __m256 a ) : v( a ) {}
+        explicit AvxF( float a ) : v( _mm256_set1_ps( a ) ) {}
+        static AvxF load( const float* p ) { return _mm256_loadu_ps( p ); }
+        void store( float* p ) const { _mm256_storeu_ps( p, v ); }
+    };
+    inline AvxF operator + ( AvxF a, AvxF b ) { return _mm256_add_ps( a.v, b.v ); }
+    inline AvxF operator - ( AvxF a, AvxF b ) { return _mm256_sub_ps( a.v, b.v ); }
+    inline AvxF operator * ( AvxF a, AvxF b ) { return _mm256_mul_ps( a.v, b.v ); }
+    inline AvxF operator / ( AvxF a, AvxF b ) { return _mm256_div_ps( a.v, b.v ); }
+    inline AvxF operator - ( AvxF a ) { return _mm256_xor_ps( a.v, _mm256_set1_ps( -0.f ) ); }
+    inline AvxI operator + ( AvxI a, AvxI b ) { return _mm256_add_epi32( a.v, b.v ); }
+    inline AvxI operator & ( AvxI a, AvxI b ) { return _mm256_and_si256( a.v, b.v ); }
+    inline AvxF vfloor( AvxF a ) { return _mm256_floor_ps( a.v ); }
+    inline AvxI vtoInt( AvxF a ) { return _mm256_cvttps_epi32( a.v ); }
+    inline AvxF vtoFloat( AvxI a ) { return _mm256_cvtepi32_ps( a.v ); }
+    inline AvxI vgather( const int* table, AvxI i ) { return _mm256_i32gather_epi32( table, i.v, 4 ); }
+    inline AvxF vgather( const float* table, AvxI i ) { return _mm256_i32gather_ps( table, i.v, 4 ); }
+
+    //////////////////////////////////////////////////////////////////////////
+    template< class F > inline F _Fade ( F x ) { return x*x*x * ( x * ( x*F( 6.0f ) - F( 15.0f ) ) + F( 10.0f ) ); }
+    template< class F > inline F _DFade( F x ) { return F( 30.0f ) * x*x * ( x * ( x - F( 2.0f ) ) + F( 1.0f ) ); }
+
+    template< class F >
+    inline F _Grad( typename F::Int hash, F x, F y, F z )
+    {
+        const F gx = vgather( g_tables.grad_x, hash );
+        const F gy = vgather( g_tables.grad_y, hash );
+        const F gz = vgather( g_tables.grad_z, hash );
+        return gx*x + gy*y + gz*z;
+    }
+
+    // y and z part of lattice. Computed per lane for arbitrary points and once per row for grids
+    template< class F >
+    struct LatticeYZ
+    {
+        typename F::Int hash[4]; // perm[ j + perm[k] ] for corners (dj,dk), index dj + 2*dk
+        F v0, w0;
+        F v, w;
+        F dv, dw;
+    };
+
+    template< class F >
+    inline void _ComputeLatticeYZ( LatticeYZ<F>* l, F y, F z )
+    {
+        typedef typename F::Int I;
+        const F fj = vfloor( y );
+        const F fk = vfloor( z );
+        const I mask( 255 );
+        const I one( 1 );
+        const I j0 = vtoInt( fj ) & mask;
+        const I j1 = ( vtoInt( fj ) + one ) & mask;
+        const I c0 = vgather( g_tables.perm, vtoInt( fk ) & mask );
+        const I c1 = vgather( g_tables.perm, ( vtoInt( fk ) + one ) & mask );
+        l->hash[0] = vgather( g_tables.perm, j0 + c0 );
+        l->hash[1] = vgather( g_tables.perm, j1 + c0 );
+        l->hash[2] = vgather( g_tables.perm, j0 + c1 );
+        l->hash[3] = vgather( g_tables.perm, j1 + c1 );
+        l->v0 = y - fj;
+        l->w0 = z - fk;
+        l->v = _Fade( l->v0 );
+        l->w = _Fade( l->w0 );
+        l->dv = _DFade( l->v0 );
+        l->dw = _DFade( l->w0 );
+    }
+
+    template< class F >
+    inline void _ComputeLatticeYZRow( LatticeYZ<F>* l, float y, float z )
+    {
+        typedef typename F::Int I;
+        const float fj = ::floorf( y );
+        const float fk = ::floorf( z );
+        const int j = (int)fj;
+        const int k = (int)fk;
+        const int c0 = stb__perlin_randtab[k & 255];
+        const int c1 = stb__perlin_randtab[( k + 1 ) & 255];
+        l->hash[0] = I( stb__perlin_randtab[( ( j + 0 ) & 255 ) + c0] );
+        l->hash[1] = I( stb__perlin_randtab[( ( j + 1 ) & 255 ) + c0] );
+        l->hash[2] = I( stb__perlin_randtab[( ( j + 0 ) & 255 ) + c1] );
+        l->hash[3] = I( stb__perlin_randtab[( ( j + 1 ) & 255 ) + c1] );
+        const float v0 = y - fj;
+        const float w0 = z - fk;
+        l->v0 = F( v0 );
+        l->w0 = F( w0 );
+        l->v = F( fade( v0 ) );
+        l->w = F( fade( w0 ) );
+        l->dv = F( dfade( v0 ) );
+        l->dw = F( dfade( w0 ) );
+    }
+
+    template< class F >
+    inline void _Perlin( F out[4], F x, const LatticeYZ<F>& l )
+    {
+        typedef typename F::Int I;
+        const F fi = vfloor( x );
+        const I i0 = vtoInt( fi ) & I( 255 );
+        const I i1 = ( vtoInt( fi ) + I( 1 ) ) & I( 255 );
+
+        const F one( 1.f );
+        const F u0 = x - fi;
+        const F u0m = u0 - one;
+        const F v0m = l.v0 - one;
+        const F w0m = l.w0 - one;
+
+        const F a = _Grad( vgather( g_tables.perm, i0 + l.hash[0] ), u0 , l.v0, l.w0 );
+        const F b = _Grad( vgather( g_tables.perm, i1 + l.hash[0] ), u0m, l.v0, l.w0 );
+        const F c = _Grad( vgather( g_tables.perm, i0 + l.hash[1] ), u0 , v0m , l.w0 );
+        const F d = _Grad( vgather( g_tables.perm, i1 + l.hash[1] ), u0m, v0m , l.w0 );
+        const F e = _Grad( vgather( g_tables.perm, i0 + l.hash[2] ), u0 , l.v0, w0m );
+        const F f = _Grad( vgather( g_tables.perm, i1 + l.hash[2] ), u0m, l.v0, w0m );
+        const F g = _Grad( vgather( g_tables.perm, i0 + l.hash[3] ), u0 , v0m , w0m );
+        const F h = _Grad( vgather( g_tables.perm, i1 + l.hash[3] ), u0m, v0m , w0m );
+
+        const F du = _DFade( u0 );
+        const F u = _Fade( u0 );
+        const F& v = l.v;
+        const F& w = l.w;
+
+        const F k0 = a;
+        const F k1 = b - a;
+        const F k2 = c - a;
+        const F k3 = e - a;
+        const F k4 = a - b - c + d;
+        const F k5 = a - c - e + g;
+        const F k6 = a - b - e + f;
+        const F k7 = -a + b + c - d + e - f - g + h;
+
+        out[0] = k0 + k1*u + k2*v + k3*w + k4*u*v + k5*v*w + k6*w*u + k7*u*v*w;
+        out[1] = du * ( k1 + k4*v + k6*w + k7*v*w );
+        out[2] = l.dv * ( k2 + k5*w + k4*u + k7*w*u );
+        out[3] = l.dw * ( k3 + k6*u + k5*v + k7*u*v );
+    }
+
+    template< class F >
+    inline void _Store( const bxNoiseOutput& out, int offset, const F r[4] )
+    {
+        if( out.value ) r[0].store( out.value + offset );
+        if( out.dx )    r[1].store( out.dx + offset );
+        if( out.dy )    r[2].store( out.dy + offset );
+        if( out.dz )    r[3].store( out.dz + offset );
+    }
+
+    // lanes past the end are computed from padded input and dropped
+    template< class F >
+    inline void _StorePartial( const bxNoiseOutput& out, int offset, int count, const F r[4] )
+    {
+        float tmp[4][F::WIDTH];
+        for( int i = 0; i < 4; ++i )
+            r[i].store( tmp[i] );
+
+        float* dst[4] = { out.value, out.dx, out.dy, out.dz };
+        for( int i = 0; i < 4; ++i )
+        {
+            if( dst[i] )
+                memcpy( dst[i] + offset, tmp[i], count * sizeof( float ) );
+        }
+    }
+
+    template< class F >
+    inline F _LoadPartial( const float* src, int count )
+    {
+        float tmp[F::WIDTH] = {};
+        memcpy( tmp, src, count * sizeof( float ) );
+        return F::load( tmp );
+    }
+
+    template< class F >
+    inline void _Fbm( F out[4], F x, F y, F z, int octaves, float wstep, float dstep )
+    {
+        F f( 0.f );
+        F dx( 0.f ), dy( 0.f ), dz( 0.f );
+        float w = 1.f;
+        const F dstepv( dstep );
+        for( int i = 0; i < octaves; ++i )
+        {
+            LatticeYZ<F> l;
+            _ComputeLatticeYZ( &l, y, z );
+
+            F n[4];
+            _Perlin( n, x, l );
+            dx = dx + n[1];
+            dy = dy + n[2];
+            dz = dz + n[3];
+
+            f = f + F( w ) * n[0] / ( F( 1.0f ) + dx*dx + dy*dy + dz*dz );
+            w *= wstep;
+            x = x * dstepv;
+            y = y * dstepv;
+            z = z * dstepv;
+        }
+
+        const F octaves_inv( 1.f / (float)octaves );
+        out[0] = f;
+        out[1] = dx * octaves_inv;
+        out[2] = dy * octaves_inv;
+        out[3] = dz * octaves_inv;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    template< class F >
+    void _PerlinBatch( const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count )
+    {
+        const int n_full = count - ( count % F::WIDTH );
+        F r[4];
+        for( int i = 0; i < n_full; i += F::WIDTH )
+        {
+            LatticeYZ<F> l;
+            _ComputeLatticeYZ( &l, F::load( y + i ), F::load( z + i ) );
+            _Perlin( r, F::load( x + i ), l );
+            _Store( out, i, r );
+        }
+        if( n_full < count )
+        {
+            const int n = count - n_full;
+            LatticeYZ<F> l;
+            _ComputeLatticeYZ( &l, _LoadPartial<F>( y + n_full, n ), _LoadPartial<F>( z + n_full, n ) );
+            _Perlin( r, _LoadPartial<F>( x + n_full, n ), l );
+            _StorePartial( out, n_full, n, r );
+        }
+    }
+
+    template< class F >
+    void _FbmBatch( const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count, int octaves, float wstep, float dstep )
+    {
+        const int n_full = count - ( count % F::WIDTH );
+        F r[4];
+        for( int i = 0; i < n_full; i += F::WIDTH )
+        {
+            _Fbm( r, F::load( x + i ), F::load( y + i ), F::load( z + i ), octaves, wstep, dstep );
+            _Store( out, i, r );
+        }
+        if( n_full < count )
+        {
+            const int n = count - n_full;
+            _Fbm( r, _LoadPartial<F>( x + n_full, n ), _LoadPartial<F>( y + n_full, n ), _LoadPartial<F>( z + n_full, n ), octaves, wstep, dstep );
+            _StorePartial( out, n_full, n, r );
+        }
+    }
+
+    template< class F >
+    void _FbmGrid( const bxNoiseOutput& out, float x0, float y, float z0, float stepX, float stepZ, int countX, int countZ, int octaves, float wstep, float dstep )
+    {
+        typedef typename F::Int I;
+        enum { eMAX_OCTAVES = 32 };
+        LatticeYZ<F> row[eMAX_OCTAVES];
+        float octave_w[eMAX_OCTAVES];
+
+        SYS_ASSERT( octaves <= eMAX_OCTAVES );
+        const int n_octaves = ( octaves < eMAX_OCTAVES ) ? octaves : eMAX_OCTAVES;
+        const F octaves_inv( 1.f / (float)octaves );
+        const F dstepv( dstep );
+
+        for( int iz = 0; iz < countZ; ++iz )
+        {
+            // row is shared by all lanes, so whole yz part of lattice is computed once per octave
+            {
+                float oy = y;
+                float oz = z0 + (float)iz * stepZ;
+                float w = 1.f;
+                for( int o = 0; o < n_octaves; ++o )
+                {
+                    _ComputeLatticeYZRow( &row[o], oy, oz );
+                    octave_w[o] = w;
+                    w *= wstep;
+                    oy *= dstep;
+                    oz *= dstep;
+                }
+            }
+
+            const int row_offset = iz * countX;
+            for( int ix = 0; ix < countX; ix += F::WIDTH )
+            {
+                F x = F( x0 ) + vtoFloat( I( ix ) + I::lanes() ) * F( stepX );
+
+                F f( 0.f );
+                F dx( 0.f ), dy( 0.f ), dz( 0.f );
+                for( int o = 0; o < n_octaves; ++o )
+                {
+                    F n[4];
+                    _Perlin( n, x, row[o] );
+                    dx = dx + n[1];
+                    dy = dy + n[2];
+                    dz = dz + n[3];
+
+                    f = f + F( octave_w[o] ) * n[0] / ( F( 1.0f ) + dx*dx + dy*dy + dz*dz );
+                    x = x * dstepv;
+                }
+
+                F r[4];
+                r[0] = f;
+                r[1] = dx * octaves_inv;
+                r[2] = dy * octaves_inv;
+                r[3] = dz * octaves_inv;
+
+                const int n = countX - ix;
+                if( n >= F::WIDTH )
+                    _Store( out, row_offset + ix, r );
+                else
+                    _StorePartial( out, row_offset + ix, n, r );
+            }
+        }
+    }
+
+    inline void _StoreScalar( const bxNoiseOutput& out, int offset, const float r[4] )
+    {
+        if( out.value ) out.value[offset] = r[0];
+        if( out.dx )    out.dx[offset] = r[1];
+        if( out.dy )    out.dy[offset] = r[2];
+        if( out.dz )    out.dz[offset] = r[3];
+    }
+}
+
+void bxNoise_perlinBatch( const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count )
+{
+    bxNoise_perlinBatch( g_simd_supported, out, x, y, z, count );
+}
+void bxNoise_fbmBatch( const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count, int octaves, float wstep, float dstep )
+{
+    bxNoise_fbmBatch( g_simd_supported, out, x, y, z, count, octaves, wstep, dstep );
+}
+void bxNoise_fbmGrid( const bxNoiseOutput& out, float x0, float y, float z0, float stepX, float stepZ, int countX, int countZ, int octaves, float wstep, float dstep )
+{
+    bxNoise_fbmGrid( g_simd_supported, out, x0, y, z0, stepX, stepZ, countX, countZ, octaves, wstep, dstep );
+}
+
+void bxNoise_perlinBatch( bxNoiseSimd level, const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count )
+{
+    switch( _ClampLevel( level ) )
+    {
+    case eNOISE_SIMD_AVX2:
+        _PerlinBatch<AvxF>( out, x, y, z, count );
+        break;
+    case eNOISE_SIMD_SSE:
+        _PerlinBatch<SseF>( out, x, y, z, count );
+        break;
+    default:
+        for( int i = 0; i < count; ++i )
+        {
+            float r[4];
+            bxNoise_perlin( r, x[i], y[i], z[i] );
+            _StoreScalar( out, i, r );
+        }
+        break;
+    }
+}
+
+void bxNoise_fbmBatch( bxNoiseSimd level, const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count, int octaves, float wstep, float dstep )
+{
+    switch( _ClampLevel( level ) )
+    {
+    case eNOISE_SIMD_AVX2:
+        _FbmBatch<AvxF>( out, x, y, z, count, octaves, wstep, dstep );
+        break;
+    case eNOISE_SIMD_SSE:
+        _FbmBatch<SseF>( out, x, y, z, count, octaves, wstep, dstep );
+        break;
+    default:
+        for( int i = 0; i < count; ++i )
+        {
+            float r[4];
+            bxNoise_fbm( r, x[i], y[i], z[i], octaves, wstep, dstep );
+            _StoreScalar( out, i, r );
+        }
+        break;
+    }
+}
+
+void bxNoise_fbmGrid( bxNoiseSimd level, const bxNoiseOutput& out, float x0, float y, float z0, float stepX, float stepZ, int countX, int countZ, int octaves, float wstep, float dstep )
+{
+    switch( _ClampLevel( level ) )
+    {
+    case eNOISE_SIMD_AVX2:
+        _FbmGrid<AvxF>( out, x0, y, z0, stepX, stepZ, countX, countZ, octaves, wstep, dstep );
+        break;
+    case eNOISE_SIMD_SSE:
+        _FbmGrid<SseF>( out, x0, y, z0, stepX, stepZ, countX, countZ, octaves, wstep, dstep );
+        break;
+    default:
+        for( int iz = 0; iz < countZ; ++iz )
+        {
+            const float z = z0 + (float)iz * stepZ;
+            for( int ix = 0; ix < countX; ++ix )
+            {
+                float r[4];
+                bxNoise_fbm( r, x0 + (float)ix * stepX, y, z, octaves, wstep, dstep );
+                _StoreScalar( out, iz * countX + ix, r );
+            }
+        }
+        break;
+    }
+}
+
+bxNoiseSimd bxNoise_simdLevel()
+{
+    return g_simd_supported;
+}
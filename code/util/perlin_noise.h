@@ -7,4 +7,35 @@
 // wrapping.)
 float bxNoise_perlin(float x, float y, float z, int x_wrap = 0, int y_wrap = 0, int z_wrap = 0 );
 void bxNoise_perlin( float out[4], float x, float y, float z );
-void bxNoise_fbm( float out[4], float x, float y, float z, int octaves, float wstep = 0.5f, float dstep = 2.f );
\ No newline at end of file
+void bxNoise_fbm( float out[4], float x, float y, float z, int octaves, float wstep = 0.5f, float dstep = 2.f );
+
+// Batch versions. Points are passed as SoA arrays and 4 (SSE) or 8 (AVX2) of them are evaluated at once.
+// Results are the same as from scalar functions above. Derivative outputs are optional (can be null).
+struct bxNoiseOutput
+{
+    float* value = nullptr;
+    float* dx = nullptr;
+    float* dy = nullptr;
+    float* dz = nullptr;
+};
+void bxNoise_perlinBatch( const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count );
+void bxNoise_fbmBatch( const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count, int octaves, float wstep = 0.5f, float dstep = 2.f );
+
+// Fills countX*countZ samples on plane y. Sample (ix,iz) is taken at ( x0 + ix*stepX, y, z0 + iz*stepZ )
+// and stored at [iz*countX + ix]. Lattice hashing in y and z is done once per row.
+void bxNoise_fbmGrid( const bxNoiseOutput& out, float x0, float y, float z0, float stepX, float stepZ, int countX, int countZ, int octaves, float wstep = 0.5f, float dstep = 2.f );
+
+enum bxNoiseSimd
+{
+    eNOISE_SIMD_SCALAR = 0,
+    eNOISE_SIMD_SSE,
+    eNOISE_SIMD_AVX2,
+};
+// Best instruction set supported by cpu. Functions above always use it.
+bxNoiseSimd bxNoise_simdLevel();
+
+// Same as above, but with instruction set passed explicitly (eg. for comparison). Level is clamped to bxNoise_simdLevel().
+// There is no global state involved, so these can be called while other threads generate noise.
+void bxNoise_perlinBatch( bxNoiseSimd level, const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count );
+void bxNoise_fbmBatch( bxNoiseSimd level, const bxNoiseOutput& out, const float* x, const float* y, const float* z, int count, int octaves, float wstep = 0.5f, float dstep = 2.f );
+void bxNoise_fbmGrid( bxNoiseSimd level, const bxNoiseOutput& out, float x0, float y, float z0, float stepX, float stepZ, int countX, int countZ, int octaves, float wstep = 0.5f, float dstep = 2.f );
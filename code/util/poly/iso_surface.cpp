@@ -0,0 +1,651 @@
+#include "iso_surface.h"
+#include "poly_shape.h"
+#include "../array.h"
+#include "../debug.h"
+#include "../memory.h"
+#include "../time.h"
+#include "../thread/parallel.h"
+
+#include <string.h>
+
+namespace bx{
+
+namespace iso_surface_internal
+{
+    enum : u32
+    {
+        eLOCAL_BITS = 14,
+        eLOCAL_MASK = ( 1 << eLOCAL_BITS ) - 1,
+        eMAX_CHUNKS = 1 << ( 32 - eLOCAL_BITS ),
+        eNO_VERTEX = 0xFFFF,
+    };
+
+    // corners: 0(0,0,0) 1(0,1,0) 2(1,1,0) 3(1,0,0) 4(0,0,1) 5(0,1,1) 6(1,1,1) 7(1,0,1)
+    static const u8 s_corner[8][3] =
+    {
+        { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 },
+        { 0, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 0, 1 },
+    };
+
+    // edge -> start sample offset and axis
+    static const u8 s_edge[12][4] =
+    {
+        { 0, 0, 0, 1 }, { 0, 1, 0, 0 }, { 1, 0, 0, 1 }, { 0, 0, 0, 0 },
+        { 0, 0, 1, 1 }, { 0, 1, 1, 0 }, { 1, 0, 1, 1 }, { 0, 0, 1, 0 },
+        { 0, 0, 0, 2 }, { 0, 1, 0, 2 }, { 1, 1, 0, 2 }, { 1, 0, 0, 2 },
+    };
+
+    // Paul Bourke's triangulation table
+    static const i8 s_tri_table[256][16] =
+    {
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1 },
+        { 8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1 },
+        { 3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1 },
+        { 4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1 },
+        { 4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1 },
+        { 9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1 },
+        { 10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1 },
+        { 5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1 },
+        { 5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1 },
+        { 8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1 },
+        { 2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1 },
+        { 2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1 },
+        { 11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1 },
+        { 5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1 },
+        { 11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1 },
+        { 11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1 },
+        { 2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1 },
+        { 6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1 },
+        { 3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1 },
+        { 6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1 },
+        { 6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1 },
+        { 8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1 },
+        { 7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1 },
+        { 3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1 },
+        { 0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1 },
+        { 9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1 },
+        { 8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1 },
+        { 5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1 },
+        { 0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1 },
+        { 6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1 },
+        { 10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1 },
+        { 1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1 },
+        { 0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1 },
+        { 3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1 },
+        { 6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1 },
+        { 9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1 },
+        { 8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1 },
+        { 3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1 },
+        { 6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1 },
+        { 10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1 },
+        { 10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1 },
+        { 2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1 },
+        { 7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1 },
+        { 7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1 },
+        { 2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1 },
+        { 1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1 },
+        { 11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1 },
+        { 8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1 },
+        { 0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1 },
+        { 7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1 },
+        { 7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1 },
+        { 10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1 },
+        { 0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1 },
+        { 7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1 },
+        { 6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1 },
+        { 6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1 },
+        { 4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1 },
+        { 10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1 },
+        { 8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1 },
+        { 1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1 },
+        { 10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1 },
+        { 10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1 },
+        { 9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1 },
+        { 7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1 },
+        { 3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1 },
+        { 7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1 },
+        { 3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1 },
+        { 6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1 },
+        { 9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1 },
+        { 1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1 },
+        { 4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1 },
+        { 7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1 },
+        { 6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1 },
+        { 0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1 },
+        { 6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1 },
+        { 0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1 },
+        { 11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1 },
+        { 6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1 },
+        { 5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1 },
+        { 9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1 },
+        { 1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1 },
+        { 10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1 },
+        { 0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1 },
+        { 10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1 },
+        { 11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1 },
+        { 9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1 },
+        { 7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1 },
+        { 2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1 },
+        { 9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1 },
+        { 9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1 },
+        { 1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1 },
+        { 5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1 },
+        { 0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1 },
+        { 10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1 },
+        { 2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1 },
+        { 0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1 },
+        { 0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1 },
+        { 9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1 },
+        { 5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1 },
+        { 5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1 },
+        { 8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1 },
+        { 9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1 },
+        { 1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1 },
+        { 3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1 },
+        { 4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1 },
+        { 9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1 },
+        { 11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1 },
+        { 11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1 },
+        { 2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1 },
+        { 9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1 },
+        { 3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1 },
+        { 1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1 },
+        { 4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1 },
+        { 0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1 },
+        { 9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1 },
+        { 1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+        { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    };
+
+    inline u32 ChunkBegin( u32 chunk, u32 chunkCells ) { return chunk * chunkCells; }
+    // last chunk owns also the last layer of samples
+    inline u32 ChunkSamplesEnd( u32 chunk, u32 numChunks, u32 chunkCells, u32 numSamples )
+    {
+        return ( chunk + 1 == numChunks ) ? numSamples : ( chunk + 1 ) * chunkCells;
+    }
+    inline u32 ChunkCellsEnd( u32 chunk, u32 chunkCells, u32 numSamples )
+    {
+        return minOfPair( ( chunk + 1 ) * chunkCells, numSamples - 1 );
+    }
+}//
+using namespace iso_surface_internal;
+
+void IsoSurfaceMesher::StartUp( u32 numSamplesX, u32 numSamplesY, u32 numSamplesZ, const Vector3F& origin, const Vector3F& cellSize, u32 chunkCells, bxAllocator* allocator )
+{
+    SYS_ASSERT( _chunks == nullptr );
+    SYS_ASSERT( numSamplesX > 1 && numSamplesY > 1 && numSamplesZ > 1 );
+    SYS_ASSERT( chunkCells > 0 && chunkCells <= eMAX_CHUNK_CELLS );
+
+    _allocator = ( allocator ) ? allocator : bxDefaultAllocator();
+    _num_samples[0] = numSamplesX;
+    _num_samples[1] = numSamplesY;
+    _num_samples[2] = numSamplesZ;
+    _chunk_cells = chunkCells;
+    _origin = origin;
+    _cell_size = cellSize;
+
+    for( u32 i = 0; i < 3; ++i )
+        _num_chunks[i] = ( _num_samples[i] - 1 + chunkCells - 1 ) / chunkCells;
+
+    const u32 num_chunks = _num_chunks[0] * _num_chunks[1] * _num_chunks[2];
+    SYS_ASSERT( num_chunks <= eMAX_CHUNKS );
+
+    _chunks = (Chunk*)BX_MALLOC( _allocator, num_chunks * sizeof( Chunk ), ALIGNOF( Chunk ) );
+    for( u32 i = 0; i < num_chunks; ++i )
+    {
+        Chunk* chunk = new( &_chunks[i] ) Chunk();
+        chunk->positions.allocator = _allocator;
+        chunk->normals.allocator = _allocator;
+        chunk->edge_vertex.allocator = _allocator;
+        chunk->triangles.allocator = _allocator;
+    }
+
+    _field = nullptr;
+    _stats = Stats();
+    _stats.num_chunks = num_chunks;
+}
+
+void IsoSurfaceMesher::ShutDown()
+{
+    if( !_chunks )
+        return;
+
+    for( u32 i = 0; i < _stats.num_chunks; ++i )
+        _chunks[i].~Chunk();
+
+    BX_FREE0( _allocator, _chunks );
+    _field = nullptr;
+    _stats = Stats();
+}
+
+void IsoSurfaceMesher::MarkDirty( u32 minX, u32 minY, u32 minZ, u32 maxX, u32 maxY, u32 maxZ )
+{
+    // edge vertices use samples at both ends and their neighbours for gradient,
+    // so edges starting up to 2 samples before the region are affected as well
+    const u32 smin[3] = { minX, minY, minZ };
+    const u32 smax[3] = { maxX, maxY, maxZ };
+    u32 cmin[3], cmax[3];
+    for( u32 i = 0; i < 3; ++i )
+    {
+        const u32 lo = ( smin[i] > 2 ) ? smin[i] - 2 : 0;
+        const u32 hi = minOfPair( smax[i] + 1, _num_samples[i] - 1 );
+        cmin[i] = minOfPair( lo / _chunk_cells, _num_chunks[i] - 1 );
+        cmax[i] = minOfPair( hi / _chunk_cells, _num_chunks[i] - 1 );
+    }
+
+    for( u32 cz = cmin[2]; cz <= cmax[2]; ++cz )
+        for( u32 cy = cmin[1]; cy <= cmax[1]; ++cy )
+            for( u32 cx = cmin[0]; cx <= cmax[0]; ++cx )
+                _chunks[_ChunkIndex( cx, cy, cz )].dirty = 1;
+}
+
+void IsoSurfaceMesher::MarkAllDirty()
+{
+    for( u32 i = 0; i < _stats.num_chunks; ++i )
+        _chunks[i].dirty = 1;
+}
+
+void IsoSurfaceMesher::Update( const f32* field, f32 isoLevel )
+{
+    bxTimeQuery time_query = bxTimeQuery::begin();
+
+    if( field != _field || isoLevel != _iso_level )
+        MarkAllDirty();
+
+    _field = field;
+    _iso_level = isoLevel;
+
+    // cells of lower neighbours reference edges owned by dirty chunk, so they have to be triangulated again
+    array_t<u32> dirty_chunks;
+    array_t<u32> triangulate_chunks;
+    for( u32 cz = 0; cz < _num_chunks[2]; ++cz )
+    {
+        for( u32 cy = 0; cy < _num_chunks[1]; ++cy )
+        {
+            for( u32 cx = 0; cx < _num_chunks[0]; ++cx )
+            {
+                if( !_chunks[_ChunkIndex( cx, cy, cz )].dirty )
+                    continue;
+
+                for( u32 nz = ( cz ) ? cz - 1 : 0; nz <= cz; ++nz )
+                    for( u32 ny = ( cy ) ? cy - 1 : 0; ny <= cy; ++ny )
+                        for( u32 nx = ( cx ) ? cx - 1 : 0; nx <= cx; ++nx )
+                            _chunks[_ChunkIndex( nx, ny, nz )].retriangulate = 1;
+            }
+        }
+    }
+    for( u32 i = 0; i < _stats.num_chunks; ++i )
+    {
+        if( _chunks[i].dirty )
+            array::push_back( dirty_chunks, i );
+        if( _chunks[i].retriangulate )
+            array::push_back( triangulate_chunks, i );
+    }
+
+    IsoSurfaceMesher* self = this;
+    const u32* dirty_list = dirty_chunks.begin();
+    bxParallel::forRange( dirty_chunks.size, 1, [self, dirty_list]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+            self->_ComputeEdges( dirty_list[i] );
+    } );
+
+    const u32* triangulate_list = triangulate_chunks.begin();
+    bxParallel::forRange( triangulate_chunks.size, 1, [self, triangulate_list]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+            self->_Triangulate( triangulate_list[i] );
+    } );
+
+    u32 num_vertices = 0;
+    u32 num_triangles = 0;
+    for( u32 i = 0; i < _stats.num_chunks; ++i )
+    {
+        Chunk& chunk = _chunks[i];
+        chunk.dirty = 0;
+        chunk.retriangulate = 0;
+        chunk.vertex_base = num_vertices;
+        num_vertices += chunk.positions.size;
+        num_triangles += chunk.triangles.size / 3;
+    }
+
+    bxTimeQuery::end( &time_query );
+    _stats.update_time_ms = (f32)( time_query.durationUS / 1000.0 );
+    _stats.num_meshed_chunks = triangulate_chunks.size;
+    _stats.num_vertices = num_vertices;
+    _stats.num_triangles = num_triangles;
+}
+
+void IsoSurfaceMesher::_ComputeEdges( u32 chunkIndex )
+{
+    Chunk& chunk = _chunks[chunkIndex];
+    const u32 nx = _num_samples[0];
+    const u32 ny = _num_samples[1];
+    const u32 nz = _num_samples[2];
+    const f32* field = _field;
+    const f32 iso = _iso_level;
+
+    u32 c[3];
+    c[0] = chunkIndex % _num_chunks[0];
+    c[1] = ( chunkIndex / _num_chunks[0] ) % _num_chunks[1];
+    c[2] = chunkIndex / ( _num_chunks[0] * _num_chunks[1] );
+
+    u32 begin[3], end[3];
+    for( u32 i = 0; i < 3; ++i )
+    {
+        begin[i] = ChunkBegin( c[i], _chunk_cells );
+        end[i] = ChunkSamplesEnd( c[i], _num_chunks[i], _chunk_cells, _num_samples[i] );
+    }
+    const u32 osx = end[0] - begin[0];
+    const u32 osy = end[1] - begin[1];
+    const u32 osz = end[2] - begin[2];
+
+    array::clear( chunk.positions );
+    array::clear( chunk.normals );
+    array::resize( chunk.edge_vertex, osx * osy * osz * 3 );
+    memset( chunk.edge_vertex.begin(), 0xFF, chunk.edge_vertex.size * sizeof( u16 ) );
+
+    auto sample = [field, nx, ny]( u32 x, u32 y, u32 z ) { return field[( z * ny + y ) * nx + x]; };
+    auto gradient = [&sample, nx, ny, nz, this]( u32 x, u32 y, u32 z )
+    {
+        const u32 x0 = ( x ) ? x - 1 : 0, x1 = minOfPair( x + 1, nx - 1 );
+        const u32 y0 = ( y ) ? y - 1 : 0, y1 = minOfPair( y + 1, ny - 1 );
+        const u32 z0 = ( z ) ? z - 1 : 0, z1 = minOfPair( z + 1, nz - 1 );
+        return Vector3F(
+            ( sample( x1, y, z ) - sample( x0, y, z ) ) / ( ( x1 - x0 ) * _cell_size.x ),
+            ( sample( x, y1, z ) - sample( x, y0, z ) ) / ( ( y1 - y0 ) * _cell_size.y ),
+            ( sample( x, y, z1 ) - sample( x, y, z0 ) ) / ( ( z1 - z0 ) * _cell_size.z ) );
+    };
+
+    for( u32 z = begin[2]; z < end[2]; ++z )
+    {
+        for( u32 y = begin[1]; y < end[1]; ++y )
+        {
+            for( u32 x = begin[0]; x < end[0]; ++x )
+            {
+                const f32 v0 = sample( x, y, z );
+                const u32 p0[3] = { x, y, z };
+                const u32 local = ( ( z - begin[2] ) * osy + ( y - begin[1] ) ) * osx + ( x - begin[0] );
+
+                for( u32 axis = 0; axis < 3; ++axis )
+                {
+                    if( p0[axis] + 1 >= _num_samples[axis] )
+                        continue;
+
+                    u32 p1[3] = { x, y, z };
+                    p1[axis] += 1;
+                    const f32 v1 = sample( p1[0], p1[1], p1[2] );
+                    if( ( v0 < iso ) == ( v1 < iso ) )
+                        continue;
+
+                    const f32 t = ( iso - v0 ) / ( v1 - v0 );
+                    Vector3F pos( (f32)x, (f32)y, (f32)z );
+                    pos[axis] += t;
+
+                    const Vector3F g0 = gradient( x, y, z );
+                    const Vector3F g1 = gradient( p1[0], p1[1], p1[2] );
+
+                    SYS_ASSERT( chunk.positions.size < eLOCAL_MASK );
+                    chunk.edge_vertex[local * 3 + axis] = (u16)chunk.positions.size;
+                    array::push_back( chunk.positions, _origin + mulPerElem( pos, _cell_size ) );
+                    array::push_back( chunk.normals, normalizeSafeF( g0 + ( g1 - g0 ) * t ) );
+                }
+            }
+        }
+    }
+}
+
+void IsoSurfaceMesher::_Triangulate( u32 chunkIndex )
+{
+    Chunk& chunk = _chunks[chunkIndex];
+    const u32 nx = _num_samples[0];
+    const u32 ny = _num_samples[1];
+    const f32* field = _field;
+    const f32 iso = _iso_level;
+
+    u32 c[3];
+    c[0] = chunkIndex % _num_chunks[0];
+    c[1] = ( chunkIndex / _num_chunks[0] ) % _num_chunks[1];
+    c[2] = chunkIndex / ( _num_chunks[0] * _num_chunks[1] );
+
+    u32 begin[3], end[3];
+    for( u32 i = 0; i < 3; ++i )
+    {
+        begin[i] = ChunkBegin( c[i], _chunk_cells );
+        end[i] = ChunkCellsEnd( c[i], _chunk_cells, _num_samples[i] );
+    }
+
+    array::clear( chunk.triangles );
+
+    for( u32 z = begin[2]; z < end[2]; ++z )
+    {
+        for( u32 y = begin[1]; y < end[1]; ++y )
+        {
+            for( u32 x = begin[0]; x < end[0]; ++x )
+            {
+                u32 cube_index = 0;
+                for( u32 i = 0; i < 8; ++i )
+                {
+                    const u32 index = ( ( z + s_corner[i][2] ) * ny + ( y + s_corner[i][1] ) ) * nx + ( x + s_corner[i][0] );
+                    cube_index |= ( field[index] < iso ) ? ( 1 << i ) : 0;
+                }
+                if( cube_index == 0 || cube_index == 255 )
+                    continue;
+
+                u32 edge_key[12];
+                u32 edge_done = 0;
+                const i8* tri = s_tri_table[cube_index];
+                for( u32 i = 0; tri[i] != -1; i += 3 )
+                {
+                    for( u32 k = 0; k < 3; ++k )
+                    {
+                        const u32 e = tri[i + k];
+                        if( edge_done & ( 1 << e ) )
+                            continue;
+
+                        // find chunk which owns the edge
+                        const u32 p[3] = { x + s_edge[e][0], y + s_edge[e][1], z + s_edge[e][2] };
+                        u32 oc[3], local[3], os[3];
+                        for( u32 a = 0; a < 3; ++a )
+                        {
+                            oc[a] = minOfPair( p[a] / _chunk_cells, _num_chunks[a] - 1 );
+                            local[a] = p[a] - oc[a] * _chunk_cells;
+                            os[a] = ChunkSamplesEnd( oc[a], _num_chunks[a], _chunk_cells, _num_samples[a] ) - oc[a] * _chunk_cells;
+                        }
+                        const u32 owner = _ChunkIndex( oc[0], oc[1], oc[2] );
+                        const u32 local_index = ( ( local[2] * os[1] + local[1] ) * os[0] + local[0] ) * 3 + s_edge[e][3];
+                        const u16 vertex = _chunks[owner].edge_vertex[local_index];
+                        SYS_ASSERT( vertex != eNO_VERTEX );
+
+                        edge_key[e] = ( owner << eLOCAL_BITS ) | vertex;
+                        edge_done |= 1 << e;
+                    }
+
+                    // same winding as CIsoSurface
+                    array::push_back( chunk.triangles, edge_key[tri[i + 0]] );
+                    array::push_back( chunk.triangles, edge_key[tri[i + 2]] );
+                    array::push_back( chunk.triangles, edge_key[tri[i + 1]] );
+                }
+            }
+        }
+    }
+}
+
+void IsoSurfaceMesher::BuildPolyShape( bxPolyShape* shape ) const
+{
+    SYS_ASSERT( shape->n_elem_pos == 3 && shape->n_elem_nrm == 3 );
+    bxPolyShape_allocateShape( shape, _stats.num_vertices, _stats.num_triangles * 3 );
+
+    array_t<u32> index_base;
+    array::resize( index_base, _stats.num_chunks );
+    u32 num_indices = 0;
+    for( u32 i = 0; i < _stats.num_chunks; ++i )
+    {
+        index_base[i] = num_indices;
+        num_indices += _chunks[i].triangles.size;
+    }
+
+    const IsoSurfaceMesher* self = this;
+    const u32* index_base_ptr = index_base.begin();
+    bxParallel::forRange( _stats.num_chunks, 16, [self, shape, index_base_ptr]( u32 begin, u32 end, u32 )
+    {
+        for( u32 i = begin; i < end; ++i )
+        {
+            const Chunk& chunk = self->_chunks[i];
+            for( u32 v = 0; v < chunk.positions.size; ++v )
+            {
+                const Vector3F& pos = chunk.positions[v];
+                const Vector3F& nrm = chunk.normals[v];
+                f32* dst_pos = shape->position( chunk.vertex_base + v );
+                f32* dst_nrm = shape->normal( chunk.vertex_base + v );
+                dst_pos[0] = pos.x; dst_pos[1] = pos.y; dst_pos[2] = pos.z;
+                dst_nrm[0] = nrm.x; dst_nrm[1] = nrm.y; dst_nrm[2] = nrm.z;
+            }
+
+            u32* dst_index = shape->indices + index_base_ptr[i];
+            for( u32 key : chunk.triangles )
+                *dst_index++ = self->_chunks[key >> eLOCAL_BITS].vertex_base + ( key & eLOCAL_MASK );
+        }
+    } );
+}
+
+}//
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../type.h"
+#include "../containers.h"
+#include "../vectormath/vectormath.h"
+
+struct bxAllocator;
+struct bxPolyShape;
+
+namespace bx{
+
+// Marching cubes over dense scalar field ( x is the fastest changing axis ).
+// Field is split into chunks of cells which are meshed independently on all threads.
+// Each chunk owns vertices on edges starting at its samples, so vertices on chunk borders are shared, not duplicated.
+// After field modification only chunks touching modified region have to be re-meshed.
+class IsoSurfaceMesher
+{
+public:
+    enum : u32
+    {
+        eMAX_CHUNK_CELLS = 16, // local edge index has to fit in 14 bits
+    };
+
+    struct Stats
+    {
+        f32 update_time_ms = 0.f;
+        u32 num_chunks = 0;
+        u32 num_meshed_chunks = 0;
+        u32 num_vertices = 0;
+        u32 num_triangles = 0;
+    };
+
+    // numSamples* is number of field values in each direction ( number of cells + 1 )
+    void StartUp( u32 numSamplesX, u32 numSamplesY, u32 numSamplesZ, const Vector3F& origin, const Vector3F& cellSize, u32 chunkCells = eMAX_CHUNK_CELLS, bxAllocator* allocator = nullptr );
+    void ShutDown();
+
+    // marks samples in range [min, max] as modified
+    void MarkDirty( u32 minX, u32 minY, u32 minZ, u32 maxX, u32 maxY, u32 maxZ );
+    void MarkAllDirty();
+
+    // re-meshes dirty chunks. Changing isoLevel re-meshes everything
+    void Update( const f32* field, f32 isoLevel );
+
+    // welded mesh with positions, normals and indices. Shape has to be deallocated with bxPolyShape_deallocateShape
+    void BuildPolyShape( bxPolyShape* shape ) const;
+
+    u32          NumVertices()  const { return _stats.num_vertices; }
+    u32          NumTriangles() const { return _stats.num_triangles; }
+    const Stats& GetStats()     const { return _stats; }
+
+    //////////////////////////////////////////////////////////////////////////
+    struct Chunk
+    {
+        array_t<Vector3F> positions;
+        array_t<Vector3F> normals;
+        array_t<u16> edge_vertex; // 3 entries per owned sample
+        array_t<u32> triangles;   // vertex keys: owner chunk << 14 | local vertex
+        u32 vertex_base = 0;
+        u8 dirty = 1;
+        u8 retriangulate = 1;
+    };
+
+    void _ComputeEdges( u32 chunkIndex );
+    void _Triangulate( u32 chunkIndex );
+    u32  _ChunkIndex( u32 cx, u32 cy, u32 cz ) const { return ( cz * _num_chunks[1] + cy ) * _num_chunks[0] + cx; }
+
+    bxAllocator* _allocator = nullptr;
+    Chunk* _chunks = nullptr;
+    u32 _num_samples[3] = {};
+    u32 _num_chunks[3] = {};
+    u32 _chunk_cells = 0;
+    Vector3F _origin{ 0.f };
+    Vector3F _cell_size{ 1.f };
+
+    const f32* _field = nullptr;
+    f32 _iso_level = 0.f;
+    Stats _stats;
+};
+
+}//
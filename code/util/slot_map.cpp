@@ -0,0 +1,316 @@
+#include "slot_map.h"
+#include "memory.h"
+#include "id_table.h"
+#include "random.h"
+#include "time.h"
+#include "thread/atomic.h"
+#include "thread/mutex.h"
+
+namespace bx{
+
+static inline i64 _MakeFreeHead( u32 index, u32 tag )
+{
+    return (i64)( ( (u64)tag << 32 ) | index );
+}
+
+void SlotAllocator::StartUp( u32 chunkSizeLog2, bxAllocator* allocator )
+{
+    SYS_ASSERT( chunkSizeLog2 >= 8 && chunkSizeLog2 <= eINDEX_BITS );
+    _allocator = ( allocator ) ? allocator : bxDefaultAllocator();
+    _chunk_shift = chunkSizeLog2;
+    _chunk_mask = ( 1u << chunkSizeLog2 ) - 1;
+    _free_head = _MakeFreeHead( eNULL_INDEX, 0 );
+    _high_water = 0;
+    _size = 0;
+}
+
+void SlotAllocator::ShutDown()
+{
+    for( u32 i = 0; i < eMAX_CHUNKS; ++i )
+    {
+        if( _chunks[i] )
+        {
+            BX_FREE( _allocator, _chunks[i] );
+            _chunks[i] = nullptr;
+        }
+    }
+    _free_head = _MakeFreeHead( eNULL_INDEX, 0 );
+    _high_water = 0;
+    _size = 0;
+}
+
+SlotAllocator::Slot* SlotAllocator::_AllocateChunk()
+{
+    const u32 chunk_size = _chunk_mask + 1;
+    Slot* chunk = (Slot*)BX_MALLOC( _allocator, chunk_size * sizeof( Slot ), ALIGNOF( Slot ) );
+    memset( chunk, 0, chunk_size * sizeof( Slot ) );
+    return chunk;
+}
+
+void SlotAllocator::_EnsureChunk( u32 index )
+{
+    const u32 ichunk = index >> _chunk_shift;
+    SYS_ASSERT( ichunk < eMAX_CHUNKS );
+    if( !_chunks[ichunk] )
+        _chunks[ichunk] = _AllocateChunk();
+}
+
+void SlotAllocator::_EnsureChunkConcurrent( u32 index )
+{
+    const u32 ichunk = index >> _chunk_shift;
+    SYS_ASSERT( ichunk < eMAX_CHUNKS );
+    if( _chunks[ichunk] )
+        return;
+
+    // many threads can race for the same chunk. Loser frees its copy
+    Slot* chunk = _AllocateChunk();
+    if( bxAtomic::CASPtr( (void* volatile*)&_chunks[ichunk], nullptr, chunk ) != nullptr )
+    {
+        BX_FREE( _allocator, chunk );
+    }
+}
+
+SlotHandle SlotAllocator::Create()
+{
+    u32 index = (u32)_free_head;
+    if( index != eNULL_INDEX )
+    {
+        const u32 tag = (u32)( (u64)_free_head >> 32 );
+        _free_head = _MakeFreeHead( _GetSlot( index ).next_free, tag + 1 );
+    }
+    else
+    {
+        SYS_ASSERT( (u32)_high_water < eMAX_SLOTS );
+        index = (u32)_high_water++;
+        _EnsureChunk( index );
+    }
+
+    Slot& slot = _GetSlot( index );
+    slot.generation += 1;
+    slot.next_free = eNULL_INDEX;
+    slot.value = 0;
+    ++_size;
+
+    SlotHandle h;
+    h.index = index;
+    h.generation = slot.generation & eGENERATION_MASK;
+    return h;
+}
+
+void SlotAllocator::Destroy( SlotHandle h )
+{
+    SYS_ASSERT( Alive( h ) );
+    Slot& slot = _GetSlot( h.index );
+    slot.generation += 1;
+    slot.next_free = (u32)_free_head;
+
+    const u32 tag = (u32)( (u64)_free_head >> 32 );
+    _free_head = _MakeFreeHead( h.index, tag + 1 );
+    --_size;
+}
+
+SlotHandle SlotAllocator::CreateConcurrent()
+{
+    u32 index = eNULL_INDEX;
+    for( ;; )
+    {
+        const i64 head = _free_head;
+        const u32 first = (u32)head;
+        if( first == eNULL_INDEX )
+            break;
+
+        // next_free may be stale when other thread pops this slot first. Tag makes CAS fail then
+        const u32 next = _GetSlot( first ).next_free;
+        const i64 new_head = _MakeFreeHead( next, (u32)( (u64)head >> 32 ) + 1 );
+        if( bxAtomic::CAS( &_free_head, head, new_head ) == head )
+        {
+            index = first;
+            break;
+        }
+    }
+
+    if( index == eNULL_INDEX )
+    {
+        index = (u32)bxAtomic::interlockedAdd( &_high_water, 1 );
+        SYS_ASSERT( index < eMAX_SLOTS );
+        _EnsureChunkConcurrent( index );
+    }
+
+    Slot& slot = _GetSlot( index );
+    slot.next_free = eNULL_INDEX;
+    slot.value = 0;
+    const u32 generation = slot.generation + 1;
+    bxAtomic::exchangeRelease( (atomic32*)&slot.generation, (i32)generation );
+    bxAtomic::interlockedInc( &_size );
+
+    SlotHandle h;
+    h.index = index;
+    h.generation = generation & eGENERATION_MASK;
+    return h;
+}
+
+void SlotAllocator::DestroyConcurrent( SlotHandle h )
+{
+    SYS_ASSERT( Alive( h ) );
+    Slot& slot = _GetSlot( h.index );
+    bxAtomic::exchangeRelease( (atomic32*)&slot.generation, (i32)( slot.generation + 1 ) );
+    bxAtomic::interlockedDec( &_size );
+
+    for( ;; )
+    {
+        const i64 head = _free_head;
+        slot.next_free = (u32)head;
+        const i64 new_head = _MakeFreeHead( h.index, (u32)( (u64)head >> 32 ) + 1 );
+        if( bxAtomic::CAS( &_free_head, head, new_head ) == head )
+            break;
+    }
+}
+
+SlotHandle SlotAllocator::HandleAt( u32 index ) const
+{
+    SlotHandle h = {};
+    if( index < (u32)_high_water && _chunks[index >> _chunk_shift] )
+    {
+        const u32 generation = _GetSlot( index ).generation;
+        if( generation & 1 )
+        {
+            h.index = index;
+            h.generation = generation & eGENERATION_MASK;
+        }
+    }
+    return h;
+}
+
+void SlotAllocator::SaveState( u32* dst ) const
+{
+    const u32 high_water = HighWater();
+    dst[0] = (u32)_free_head;
+    dst[1] = high_water;
+    dst[2] = (u32)_size;
+    for( u32 i = 0; i < high_water; ++i )
+    {
+        const Slot& slot = _GetSlot( i );
+        dst[3 + i * 2 + 0] = slot.generation;
+        dst[3 + i * 2 + 1] = slot.next_free;
+    }
+}
+
+bool SlotAllocator::LoadState( const u32* src, u32 numWords )
+{
+    if( numWords < 3 || numWords != 3 + 2 * src[1] || src[1] > eMAX_SLOTS )
+        return false;
+
+    // slots above loaded high water are reset, so they start from generation 0 as after StartUp
+    const u32 high_water = src[1];
+    const u32 old_high_water = HighWater();
+    for( u32 i = 0; i < high_water; ++i )
+    {
+        _EnsureChunk( i );
+        Slot& slot = _GetSlot( i );
+        slot.generation = src[3 + i * 2 + 0];
+        slot.next_free = src[3 + i * 2 + 1];
+        slot.value = 0;
+    }
+    for( u32 i = high_water; i < old_high_water; ++i )
+        _GetSlot( i ) = {};
+
+    _free_head = _MakeFreeHead( src[0], 0 );
+    _high_water = (atomic32)high_water;
+    _size = (atomic32)src[2];
+    return true;
+}
+
+namespace
+{
+    inline f32 ElapsedMS( u64 startUS )
+    {
+        return (f32)( ( bxTime::us() - startUS ) * 0.001 );
+    }
+
+    // the same create -> lookup -> destroy round for every method
+    template< typename Tcreate, typename Talive, typename Tdestroy >
+    void BenchmarkRound( SlotMapBenchmarkResult* result, u32 method, u32* handles, const u32* destroyOrder, Tcreate create, Talive alive, Tdestroy destroy )
+    {
+        const u32 n = result->num_handles;
+
+        u64 start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+            handles[i] = create();
+        result->create_ms[method] += ElapsedMS( start_us );
+
+        u32 num_alive = 0;
+        start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+            num_alive += alive( handles[destroyOrder[i]] ) ? 1 : 0;
+        result->lookup_ms[method] += ElapsedMS( start_us );
+        result->errors[method] += n - num_alive;
+
+        start_us = bxTime::us();
+        for( u32 i = 0; i < n; ++i )
+            destroy( handles[destroyOrder[i]] );
+        result->destroy_ms[method] += ElapsedMS( start_us );
+
+        for( u32 i = 0; i < n; ++i )
+            result->errors[method] += alive( handles[i] ) ? 1 : 0;
+    }
+}//
+
+void SlotMapBenchmark( SlotMapBenchmarkResult* result, u32 numHandles, u32 numRounds )
+{
+    result[0] = SlotMapBenchmarkResult();
+    result->num_handles = minOfPair( numHandles, (u32)SlotMapBenchmarkResult::eMAX_HANDLES );
+    result->num_rounds = numRounds;
+
+    const u32 n = result->num_handles;
+    array_t<u32> handles;
+    array_t<u32> destroy_order;
+    array::resize( handles, n );
+    array::resize( destroy_order, n );
+
+    bxRandomGen rnd( 0x510775 );
+    for( u32 i = 0; i < n; ++i )
+        destroy_order[i] = i;
+    for( u32 i = n; i > 1; --i )
+    {
+        const u32 j = rnd.get0n( i );
+        const u32 tmp = destroy_order[i - 1];
+        destroy_order[i - 1] = destroy_order[j];
+        destroy_order[j] = tmp;
+    }
+
+    typedef id_table_t< SlotMapBenchmarkResult::eMAX_HANDLES > IdTable;
+    IdTable* id_tbl = BX_NEW( bxDefaultAllocator(), IdTable );
+
+    SlotAllocator slots;
+    slots.StartUp();
+    bxBenaphore lock;
+
+    auto ToSlot = []( u32 hash ) { SlotHandle h; h.hash = hash; return h; };
+    for( u32 round = 0; round < numRounds; ++round )
+    {
+        BenchmarkRound( result, SlotMapBenchmarkResult::ID_TABLE, handles.begin(), destroy_order.begin(),
+            [id_tbl]() { return id_table::create( *id_tbl ).hash; },
+            [id_tbl]( u32 h ) { return id_table::has( *id_tbl, make_id( h ) ); },
+            [id_tbl]( u32 h ) { id_table::destroy( *id_tbl, make_id( h ) ); } );
+
+        BenchmarkRound( result, SlotMapBenchmarkResult::SLOTS, handles.begin(), destroy_order.begin(),
+            [&slots]() { return slots.Create().hash; },
+            [&slots, ToSlot]( u32 h ) { return slots.Alive( ToSlot( h ) ); },
+            [&slots, ToSlot]( u32 h ) { slots.Destroy( ToSlot( h ) ); } );
+
+        BenchmarkRound( result, SlotMapBenchmarkResult::SLOTS_LOCKED, handles.begin(), destroy_order.begin(),
+            [&slots, &lock]() { lock.lock(); const u32 h = slots.Create().hash; lock.unlock(); return h; },
+            [&slots, ToSlot]( u32 h ) { return slots.Alive( ToSlot( h ) ); },
+            [&slots, &lock, ToSlot]( u32 h ) { lock.lock(); slots.Destroy( ToSlot( h ) ); lock.unlock(); } );
+
+        BenchmarkRound( result, SlotMapBenchmarkResult::SLOTS_CONCURRENT, handles.begin(), destroy_order.begin(),
+            [&slots]() { return slots.CreateConcurrent().hash; },
+            [&slots, ToSlot]( u32 h ) { return slots.Alive( ToSlot( h ) ); },
+            [&slots, ToSlot]( u32 h ) { slots.DestroyConcurrent( ToSlot( h ) ); } );
+    }
+
+    slots.ShutDown();
+    BX_DELETE( bxDefaultAllocator(), id_tbl );
+}
+
+}//
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "type.h"
+#include "debug.h"
+#include "containers.h"
+#include "array.h"
+
+struct bxAllocator;
+
+namespace bx{
+
+// 32 bit handle, same size as id_t. Holds slot index and low bits of slot generation.
+// Generation is odd for alive slots, so zero handle is never valid. Stale handle can alias
+// new one after 2048 reuses of the same slot.
+union SlotHandle
+{
+    u32 hash;
+    struct
+    {
+        u32 index      : 20;
+        u32 generation : 12;
+    };
+};
+inline bool operator == ( SlotHandle a, SlotHandle b ) { return a.hash == b.hash; }
+inline bool operator != ( SlotHandle a, SlotHandle b ) { return a.hash != b.hash; }
+
+// Growable generational handle allocator. Slots are allocated in chunks which never move,
+// so capacity grows without invalidating handles or addresses of slot values.
+// Each slot carries one u64 value for the user.
+// Create/Destroy are for single threaded use. *Concurrent versions are lock free
+// (tagged free list and atomic bump of high water mark) and can be called from many threads at once,
+// but both kinds must not be mixed at the same time.
+class SlotAllocator
+{
+public:
+    enum : u32
+    {
+        eINDEX_BITS = 20,
+        eMAX_SLOTS = 1 << eINDEX_BITS,
+        eGENERATION_MASK = ( 1 << 12 ) - 1,
+        eMAX_CHUNKS = 4096,
+        eNULL_INDEX = UINT32_MAX,
+    };
+
+    // chunkSizeLog2 has to be at least 8, so eMAX_SLOTS fit in eMAX_CHUNKS
+    void StartUp( u32 chunkSizeLog2 = 10, bxAllocator* allocator = nullptr );
+    void ShutDown();
+
+    SlotHandle Create();
+    void       Destroy( SlotHandle h );
+
+    SlotHandle CreateConcurrent();
+    void       DestroyConcurrent( SlotHandle h );
+
+    bool Alive( SlotHandle h ) const
+    {
+        if( !( h.generation & 1 ) || h.index >= (u32)_high_water )
+            return false;
+        const Slot* chunk = _chunks[h.index >> _chunk_shift];
+        return chunk && ( chunk[h.index & _chunk_mask].generation & eGENERATION_MASK ) == h.generation;
+    }
+
+    u64& Value( SlotHandle h )
+    {
+        SYS_ASSERT( Alive( h ) );
+        return _GetSlot( h.index ).value;
+    }
+    u64 Value( SlotHandle h ) const
+    {
+        SYS_ASSERT( Alive( h ) );
+        return _GetSlot( h.index ).value;
+    }
+
+    // handle for index if slot is alive, zero handle otherwise
+    SlotHandle HandleAt( u32 index ) const;
+
+    u32 Size()      const { return (u32)_size; }
+    u32 HighWater() const { return (u32)_high_water; } // all indices ever returned are below this value
+
+    // Free list and generations, so the same handles are returned after LoadState. Slot values are not included.
+    // Layout: first free, high water, size, then generation and next free of every slot below high water.
+    // Single threaded use only.
+    u32  StateSize() const { return 3 + 2 * HighWater(); } // in u32 words
+    void SaveState( u32* dst ) const;
+    bool LoadState( const u32* src, u32 numWords );
+
+private:
+    struct Slot
+    {
+        u32 generation;
+        u32 next_free;
+        u64 value;
+    };
+
+    Slot&       _GetSlot( u32 index )       { return _chunks[index >> _chunk_shift][index & _chunk_mask]; }
+    const Slot& _GetSlot( u32 index ) const { return _chunks[index >> _chunk_shift][index & _chunk_mask]; }
+    Slot* _AllocateChunk();
+    void  _EnsureChunk( u32 index );
+    void  _EnsureChunkConcurrent( u32 index );
+
+    Slot* volatile _chunks[eMAX_CHUNKS] = {};
+    atomic64 _free_head = eNULL_INDEX; // low 32 bits: first free slot, high 32 bits: ABA tag
+    atomic32 _high_water = 0;
+    atomic32 _size = 0;
+    u32 _chunk_shift = 0;
+    u32 _chunk_mask = 0;
+    bxAllocator* _allocator = nullptr;
+};
+
+// Generational slot map with densely packed values.
+// Values live in contiguous array (order changes when element is destroyed), handles map to dense index through SlotAllocator.
+// T has to be copyable with assignment. Not thread safe.
+template< typename T >
+class SlotMap
+{
+public:
+    void StartUp( u32 chunkSizeLog2 = 10, bxAllocator* allocator = nullptr )
+    {
+        _slots.StartUp( chunkSizeLog2, allocator );
+        if( allocator )
+        {
+            _dense.allocator = allocator;
+            _dense_handles.allocator = allocator;
+        }
+    }
+    void ShutDown()
+    {
+        array::clear( _dense );
+        array::clear( _dense_handles );
+        _slots.ShutDown();
+    }
+
+    SlotHandle Create( const T& value )
+    {
+        SlotHandle h = _slots.Create();
+        _slots.Value( h ) = array::push_back( _dense, value );
+        array::push_back( _dense_handles, h );
+        return h;
+    }
+    void Destroy( SlotHandle h )
+    {
+        SYS_ASSERT( _slots.Alive( h ) );
+        const u32 dense_index = (u32)_slots.Value( h );
+        const u32 last = array::sizeu( _dense ) - 1;
+        if( dense_index != last )
+        {
+            _dense[dense_index] = _dense[last];
+            _dense_handles[dense_index] = _dense_handles[last];
+            _slots.Value( _dense_handles[dense_index] ) = dense_index;
+        }
+        array::pop_back( _dense );
+        array::pop_back( _dense_handles );
+        _slots.Destroy( h );
+    }
+
+    bool Alive( SlotHandle h ) const { return _slots.Alive( h ); }
+
+    T* Get( SlotHandle h )
+    {
+        return ( _slots.Alive( h ) ) ? &_dense[(u32)_slots.Value( h )] : nullptr;
+    }
+    const T* Get( SlotHandle h ) const
+    {
+        return ( _slots.Alive( h ) ) ? &_dense[(u32)_slots.Value( h )] : nullptr;
+    }
+
+    // dense access
+    u32 Size() const { return array::sizeu( _dense ); }
+    T*       begin()       { return array::begin( _dense ); }
+    T*       end  ()       { return array::end( _dense ); }
+    const T* begin() const { return array::begin( _dense ); }
+    const T* end  () const { return array::end( _dense ); }
+    SlotHandle DenseHandle( u32 denseIndex ) const { return _dense_handles[denseIndex]; }
+
+private:
+    SlotAllocator       _slots;
+    array_t<T>          _dense;
+    array_t<SlotHandle> _dense_handles;
+};
+
+// create/lookup/destroy of numHandles handles (destroyed in random order) for id_table_t, SlotAllocator,
+// SlotAllocator behind benaphore (HandleManager) and lock free path on single thread. Times are summed over rounds.
+// id_table_t has fixed capacity, so numHandles is clamped to eMAX_HANDLES.
+struct SlotMapBenchmarkResult
+{
+    enum : u32
+    {
+        eMAX_HANDLES = 16 * 1024,
+    };
+    enum EMethod : u32
+    {
+        ID_TABLE = 0,
+        SLOTS,
+        SLOTS_LOCKED,
+        SLOTS_CONCURRENT,
+        NUM_METHODS,
+    };
+    u32 num_handles = 0;
+    u32 num_rounds = 0;
+    f32 create_ms [NUM_METHODS] = {};
+    f32 lookup_ms [NUM_METHODS] = {};
+    f32 destroy_ms[NUM_METHODS] = {};
+    u32 errors    [NUM_METHODS] = {}; // lookups of alive/destroyed handles with wrong answer. id_table_t aliases when its 16 bit id wraps
+};
+void SlotMapBenchmark( SlotMapBenchmarkResult* result, u32 numHandles = SlotMapBenchmarkResult::eMAX_HANDLES, u32 numRounds = 50 );
+
+}//
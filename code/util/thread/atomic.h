@@ -14,6 +14,8 @@ typedef HANDLE			 bxThreadEventHandle;
 namespace bxAtomic
 {
     __forceinline atomic32 CAS( volatile atomic32* dst, volatile atomic32 cmp, atomic32 exc ) { return InterlockedCompareExchange( dst, exc, cmp ); }
+    __forceinline i64 CAS( atomic64* dst, i64 cmp, i64 exc ) { return InterlockedCompareExchange64( dst, exc, cmp ); } // returns previous value
+    __forceinline void* CASPtr( void* volatile* dst, void* cmp, void* exc ) { return InterlockedCompareExchangePointer( dst, exc, cmp ); }
     __forceinline bool CAS2( volatile atomic32* dst, volatile atomic32 cmp1, volatile atomic32 cmp2, atomic32 exc1, atomic32 exc2 ) 
     { 
     #ifdef x86
@@ -45,6 +47,8 @@ namespace bxAtomic
     __forceinline i32 interlockedDec( atomic32* value ) { return InterlockedDecrement( value ); }
     __forceinline i64 interlockedInc( atomic64* value ) { return InterlockedIncrement64( value ); }
     __forceinline i64 interlockedDec( atomic64* value ) { return InterlockedDecrement64( value ); }
+    __forceinline i32 interlockedAdd( atomic32* value, i32 add ) { return InterlockedExchangeAdd( value, add ); } // returns previous value
+    __forceinline i64 interlockedAdd( atomic64* value, i64 add ) { return InterlockedExchangeAdd64( value, add ); }
 
     __forceinline i32 compareExchangeAcquire( atomic32* dst, i32 cmp, i32 exc ) { return InterlockedCompareExchangeAcquire( dst, exc, cmp ); }
     __forceinline i64 compareExchangeAcquire( atomic64* dst, i64 cmp, i64 exc ) { return InterlockedCompareExchangeAcquire64( dst, exc, cmp ); }
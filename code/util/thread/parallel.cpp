@@ -0,0 +1,173 @@
+#include "parallel.h"
+#include "thread.h"
+#include "semaphore.h"
+#include "mutex.h"
+#include "atomic.h"
+#include "../debug.h"
+#include "../common.h"
+#include "../memory.h"
+
+namespace bxParallel
+{
+    enum
+    {
+        eMAX_WORKERS = 63,
+    };
+
+    struct Job
+    {
+        ForCallback callback;
+        void* user_data;
+        u32 count;
+        u32 grain;
+
+        atomic32 next;          // first element of next chunk to grab
+        atomic32 pending_wakes; // number of worker wake ups which didn't check out from the job yet
+    };
+
+    struct Pool;
+    class WorkerRun : public bxThreadRun
+    {
+    public:
+        WorkerRun( Pool* p, u32 index ) : _pool( p ), _index( index ) {}
+        virtual u32 run();
+
+    private:
+        Pool* _pool;
+        u32 _index;
+    };
+
+    struct Pool
+    {
+        bxThreadHandle threads[eMAX_WORKERS];
+        u32 num_workers = 0;
+
+        bxSemaphore wake;
+        bxMutex dispatch_lock;
+
+        Job* volatile current_job = nullptr;
+        volatile u32 quit = 0;
+    };
+    static Pool* __pool = nullptr;
+    static __declspec( thread ) u32 __thread_index = 0;
+    static __declspec( thread ) u32 __inside_job = 0;
+
+    static void _RunChunks( Job* job, u32 threadIndex )
+    {
+        for( ;; )
+        {
+            const u32 begin = (u32)bxAtomic::interlockedAdd( &job->next, (i32)job->grain );
+            if( begin >= job->count )
+                break;
+
+            const u32 end = minOfPair( begin + job->grain, job->count );
+            ( *job->callback )( begin, end, threadIndex, job->user_data );
+        }
+    }
+
+    u32 WorkerRun::run()
+    {
+        __thread_index = _index;
+        __inside_job = 1;
+        for( ;; )
+        {
+            _pool->wake.wait_infinite();
+            if( _pool->quit )
+                break;
+
+            Job* job = _pool->current_job;
+            SYS_ASSERT( job != nullptr );
+            _RunChunks( job, _index );
+
+            // job must not be touched after this point
+            bxAtomic::interlockedDec( &job->pending_wakes );
+        }
+        return 0;
+    }
+
+    void startUp( u32 numWorkers )
+    {
+        SYS_ASSERT( __pool == nullptr );
+        if( numWorkers == 0 )
+        {
+            const u32 num_cpus = bxThread::numberOfProcessors();
+            numWorkers = ( num_cpus > 1 ) ? num_cpus - 1 : 0;
+        }
+        numWorkers = minOfPair( numWorkers, (u32)eMAX_WORKERS );
+
+        __pool = BX_NEW( bxDefaultAllocator(), Pool );
+        __pool->wake.create( 0, eMAX_WORKERS );
+        __pool->num_workers = numWorkers;
+        for( u32 i = 0; i < numWorkers; ++i )
+        {
+            WorkerRun* run = BX_NEW( bxDefaultAllocator(), WorkerRun, __pool, i + 1 );
+            __pool->threads[i] = bxThread::startThread( run, "bxParallel worker" );
+        }
+    }
+
+    void shutDown()
+    {
+        if( !__pool )
+            return;
+
+        __pool->quit = 1;
+        __pool->wake.signal( __pool->num_workers );
+        for( u32 i = 0; i < __pool->num_workers; ++i )
+        {
+            bxThread::stopThread( &__pool->threads[i], true );
+        }
+        BX_DELETE0( bxDefaultAllocator(), __pool );
+    }
+
+    u32 numThreads()
+    {
+        return ( __pool ) ? __pool->num_workers + 1 : 1;
+    }
+    u32 threadIndex()
+    {
+        return __thread_index;
+    }
+
+    void forRange( u32 count, u32 grain, ForCallback callback, void* userData )
+    {
+        if( count == 0 )
+            return;
+
+        grain = maxOfPair( grain, 1u );
+        const u32 num_chunks = ( count + grain - 1 ) / grain;
+
+        // run serially when there is nothing to share, pool is busy or we are already inside of a job
+        if( !__pool || __pool->num_workers == 0 || num_chunks == 1 || __inside_job || !__pool->dispatch_lock.tryLock() )
+        {
+            for( u32 begin = 0; begin < count; begin += grain )
+            {
+                ( *callback )( begin, minOfPair( begin + grain, count ), __thread_index, userData );
+            }
+            return;
+        }
+
+        Job job;
+        job.callback = callback;
+        job.user_data = userData;
+        job.count = count;
+        job.grain = grain;
+        job.next = 0;
+
+        const u32 num_wakes = minOfPair( num_chunks - 1, __pool->num_workers );
+        job.pending_wakes = num_wakes;
+        __pool->current_job = &job;
+        __pool->wake.signal( num_wakes );
+
+        __inside_job = 1;
+        _RunChunks( &job, 0 );
+        __inside_job = 0;
+
+        // wait for workers. Each wake up has to check out, because job lives on our stack
+        while( job.pending_wakes != 0 )
+        {
+            bxThread::yeld();
+        }
+        __pool->current_job = nullptr;
+        __pool->dispatch_lock.unlock();
+    }
+}//
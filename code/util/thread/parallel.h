@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../type.h"
+
+// Minimal fork/join worker pool. Calling thread always participates in the work and has thread index 0.
+// Workers have indices 1..numThreads()-1, so per thread scratch buffers can be indexed directly.
+// Nested calls (from inside of callback) are executed serially on the calling thread.
+namespace bxParallel
+{
+    typedef void( *ForCallback )( u32 begin, u32 end, u32 threadIndex, void* userData );
+
+    // numWorkers == 0 means number of processors - 1
+    void startUp( u32 numWorkers = 0 );
+    void shutDown();
+
+    u32 numThreads();
+    u32 threadIndex();
+
+    // splits [0, count) into chunks of 'grain' elements and distributes them over all threads
+    void forRange( u32 count, u32 grain, ForCallback callback, void* userData );
+
+    template< typename F >
+    void _ForRangeTrampoline( u32 begin, u32 end, u32 threadIndex, void* userData )
+    {
+        ( *(const F*)userData )( begin, end, threadIndex );
+    }
+
+    // func( u32 begin, u32 end, u32 threadIndex )
+    template< typename F >
+    inline void forRange( u32 count, u32 grain, const F& func )
+    {
+        forRange( count, grain, _ForRangeTrampoline<F>, (void*)&func );
+    }
+}//
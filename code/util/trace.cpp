@@ -0,0 +1,272 @@
+#include "trace.h"
+#include "time.h"
+#include "memory.h"
+#include "debug.h"
+#include "common.h"
+#include "thread/mutex.h"
+#include "thread/thread.h"
+
+#include <stdio.h>
+#include <intrin.h>
+
+namespace bxTrace
+{
+    enum EEventType : u32
+    {
+        eBEGIN = 0,
+        eEND,
+        eCOUNTER,
+        eFRAME,
+    };
+
+    struct Event
+    {
+        u64 tsc;
+        const char* name;
+        f32 value;
+        u32 type;
+    };
+
+    // single producer ring. Only owner thread writes, capture is read when nobody records
+    struct ThreadRing
+    {
+        Event* events = nullptr;
+        u32 mask = 0;
+        volatile u32 head = 0; // number of events written since capture start
+        atomic32 writing = 0;  // set while owner writes event, see _WaitForWriters
+        i32 thread_id = 0;
+        ThreadRing* next = nullptr;
+    };
+
+    struct Context
+    {
+        enum { eMAX_FILENAME = 255 };
+
+        bxBenaphore lock; // guards ring registration
+        ThreadRing* rings = nullptr;
+        u32 events_per_thread = 0;
+        u32 generation = 0;
+
+        char filename[eMAX_FILENAME + 1] = {};
+        u32 frames_requested = 0;
+        u32 frames_left = 0;
+
+        u64 start_tsc = 0;
+        u64 start_us = 0;
+    };
+    static Context* __ctx = nullptr;
+    static u32 __generation = 0;
+    static u32 __capture_counter = 0;
+    static atomic32 __capture_id = 0; // 0 when not capturing
+    static __declspec( thread ) ThreadRing* __ring = nullptr;
+    static __declspec( thread ) u32 __ring_generation = 0;
+
+    static ThreadRing* _RegisterRing()
+    {
+        ThreadRing* ring = BX_NEW( bxDefaultAllocator(), ThreadRing );
+        ring->events = (Event*)BX_MALLOC( bxDefaultAllocator(), __ctx->events_per_thread * sizeof( Event ), ALIGNOF( Event ) );
+        ring->mask = __ctx->events_per_thread - 1;
+        ring->thread_id = bxThread::currentThreadId();
+        {
+            bxScopeBenaphore lock( __ctx->lock );
+            ring->next = __ctx->rings;
+            __ctx->rings = ring;
+        }
+
+        __ring = ring;
+        __ring_generation = __ctx->generation;
+        return ring;
+    }
+
+    // Event is written only if captureId is still current. Writer announces itself before checking it,
+    // so after capture id is changed and _WaitForWriters returns, nobody touches the rings.
+    static inline void _Record( u32 type, const char* name, f32 value, u32 captureId )
+    {
+        const Context* ctx = __ctx;
+        if( !ctx )
+            return;
+
+        ThreadRing* ring = __ring;
+        if( !ring || __ring_generation != ctx->generation )
+            ring = _RegisterRing();
+
+        bxAtomic::exchangeRelease( &ring->writing, 1 );
+        if( (u32)__capture_id == captureId )
+        {
+            const u32 head = ring->head;
+            Event& e = ring->events[head & ring->mask];
+            e.tsc = __rdtsc();
+            e.name = name;
+            e.value = value;
+            e.type = type;
+            _WriteBarrier();
+            ring->head = head + 1;
+        }
+        bxAtomic::exchangeRelease( &ring->writing, 0 );
+    }
+
+    // call after __capture_id is changed. Writers which have seen previous id finish their event
+    static void _WaitForWriters()
+    {
+        for( ThreadRing* ring = __ctx->rings; ring; ring = ring->next )
+        {
+            while( ring->writing )
+                _mm_pause();
+        }
+    }
+
+    void startUp( u32 eventsPerThread )
+    {
+        SYS_ASSERT( __ctx == nullptr );
+
+        u32 capacity = 1024;
+        while( capacity < eventsPerThread )
+            capacity *= 2;
+
+        __ctx = BX_NEW( bxDefaultAllocator(), Context );
+        __ctx->events_per_thread = capacity;
+        __ctx->generation = ++__generation;
+    }
+
+    void shutDown()
+    {
+        if( !__ctx )
+            return;
+
+        bxAtomic::exchangeRelease( &__capture_id, 0 );
+        _WaitForWriters();
+
+        ThreadRing* ring = __ctx->rings;
+        while( ring )
+        {
+            ThreadRing* next = ring->next;
+            BX_FREE0( bxDefaultAllocator(), ring->events );
+            BX_DELETE( bxDefaultAllocator(), ring );
+            ring = next;
+        }
+        BX_DELETE0( bxDefaultAllocator(), __ctx );
+    }
+
+    void captureFrames( u32 numFrames, const char* filename )
+    {
+        if( !__ctx || __capture_id || numFrames == 0 )
+            return;
+
+        sprintf_s( __ctx->filename, Context::eMAX_FILENAME, "%s", filename );
+        __ctx->frames_requested = numFrames;
+    }
+
+    bool isCapturing()
+    {
+        return __capture_id != 0;
+    }
+
+    static void _WriteCapture( u64 endTsc, u64 endUs )
+    {
+        FILE* f = nullptr;
+        errno_t err = fopen_s( &f, __ctx->filename, "wb" );
+        if( err != 0 )
+        {
+            bxLogError( "Can not open trace file %s (errno: %d)", __ctx->filename, err );
+            return;
+        }
+
+        const u64 duration_us = maxOfPair( endUs - __ctx->start_us, (u64)1 );
+        const double us_per_tick = double( duration_us ) / double( endTsc - __ctx->start_tsc );
+
+        u32 num_events = 0;
+        fprintf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+        for( const ThreadRing* ring = __ctx->rings; ring; ring = ring->next )
+        {
+            const u32 head = ring->head;
+            const u32 capacity = ring->mask + 1;
+            const u32 begin = ( head > capacity ) ? head - capacity : 0;
+            for( u32 i = begin; i < head; ++i )
+            {
+                const Event& e = ring->events[i & ring->mask];
+                const double ts = double( e.tsc - __ctx->start_tsc ) * us_per_tick;
+                const char* separator = ( num_events ) ? ",\n" : "";
+                switch( e.type )
+                {
+                case eBEGIN:
+                    fprintf( f, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":0,\"tid\":%d}", separator, e.name, ts, ring->thread_id );
+                    break;
+                case eEND:
+                    fprintf( f, "%s{\"ph\":\"E\",\"ts\":%.3f,\"pid\":0,\"tid\":%d}", separator, ts, ring->thread_id );
+                    break;
+                case eCOUNTER:
+                    fprintf( f, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"tid\":%d,\"args\":{\"value\":%f}}", separator, e.name, ts, ring->thread_id, e.value );
+                    break;
+                case eFRAME:
+                    fprintf( f, "%s{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":0,\"tid\":%d}", separator, ts, ring->thread_id );
+                    break;
+                }
+                ++num_events;
+            }
+        }
+        fprintf( f, "\n]}\n" );
+        fclose( f );
+
+        bxLogInfo( "Trace capture written to %s (%u events, %.2f ms)", __ctx->filename, num_events, double( duration_us ) * 0.001 );
+    }
+
+    void frameMark()
+    {
+        if( !__ctx )
+            return;
+
+        const u32 capture_id = (u32)__capture_id;
+        if( capture_id )
+        {
+            _Record( eFRAME, "Frame", 0.f, capture_id );
+            if( --__ctx->frames_left == 0 )
+            {
+                // scopes still open are ended after this point, their END events are dropped
+                bxAtomic::exchangeRelease( &__capture_id, 0 );
+                _WaitForWriters();
+
+                const u64 end_tsc = __rdtsc();
+                const u64 end_us = bxTime::us();
+                _WriteCapture( end_tsc, end_us );
+            }
+        }
+        else if( __ctx->frames_requested )
+        {
+            // nobody records while capture is off, so rings can be safely reset
+            for( ThreadRing* ring = __ctx->rings; ring; ring = ring->next )
+                ring->head = 0;
+
+            __ctx->frames_left = __ctx->frames_requested;
+            __ctx->frames_requested = 0;
+            __ctx->start_us = bxTime::us();
+            __ctx->start_tsc = __rdtsc();
+
+            // never 0, and different from any id stamped into scopes which are still open
+            __capture_counter = maxOfPair( __capture_counter + 1, 1u );
+            bxAtomic::exchangeRelease( &__capture_id, (i32)__capture_counter );
+            _Record( eFRAME, "Frame", 0.f, __capture_counter );
+        }
+    }
+
+    u32 _BeginScope( const char* name )
+    {
+        const u32 capture_id = (u32)__capture_id;
+        if( !capture_id )
+            return 0;
+
+        _Record( eBEGIN, name, 0.f, capture_id );
+        return capture_id;
+    }
+    void _EndScope( u32 captureId )
+    {
+        _Record( eEND, nullptr, 0.f, captureId );
+    }
+    void _Counter( const char* name, f32 value )
+    {
+        const u32 capture_id = (u32)__capture_id;
+        if( !capture_id )
+            return;
+
+        _Record( eCOUNTER, name, value, capture_id );
+    }
+}//
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "type.h"
+
+#ifndef BX_TRACE_ENABLED
+#define BX_TRACE_ENABLED 1
+#endif
+
+// In-process trace capture.
+// Every thread records scope begin/end events and counters into its own ring buffer (no locks, no allocations on hot path).
+// Timestamps come from rdtsc and are converted to microseconds when capture is written.
+// Capture is started for N frames and written as Chrome trace-event JSON ( chrome://tracing, ui.perfetto.dev ).
+// Names have to be string literals (only pointers are stored).
+namespace bxTrace
+{
+    // eventsPerThread is rounded up to power of 2. When ring is full, oldest events are overwritten
+    void startUp( u32 eventsPerThread = 64 * 1024 );
+    void shutDown();
+
+    // capture starts with next frameMark() and ends after numFrames marks. Output is written during last frameMark()
+    void captureFrames( u32 numFrames, const char* filename );
+    bool isCapturing();
+
+    // has to be called once per frame from main thread, outside of any parallel jobs
+    void frameMark();
+
+    // returns id of capture the begin event was recorded to (0 when not capturing). End has to be recorded only when begin was,
+    // and is dropped when capture has ended or another one started since begin
+    u32  _BeginScope( const char* name );
+    void _EndScope( u32 captureId );
+    void _Counter( const char* name, f32 value );
+}//
+
+struct bxTraceScope
+{
+    bxTraceScope( const char* name ) : _capture_id( bxTrace::_BeginScope( name ) ) {}
+    ~bxTraceScope()
+    {
+        if( _capture_id )
+            bxTrace::_EndScope( _capture_id );
+    }
+    u32 _capture_id;
+};
+
+#if BX_TRACE_ENABLED == 1
+#define BX_TRACE_CONCAT_IMPL( a, b ) a##b
+#define BX_TRACE_CONCAT( a, b ) BX_TRACE_CONCAT_IMPL( a, b )
+#define BX_TRACE_SCOPE( name ) bxTraceScope BX_TRACE_CONCAT( __trace_scope_, __LINE__ )( name )
+#define BX_TRACE_COUNTER( name, value ) bxTrace::_Counter( name, (f32)( value ) )
+#else
+#define BX_TRACE_SCOPE( name )
+#define BX_TRACE_COUNTER( name, value )
+#endif
@@ -0,0 +1,146 @@
+#include "vertex_pack.h"
+#include "float16.h"
+#include "common.h"
+#include <math.h>
+#include <float.h>
+#include <intrin.h>
+
+namespace
+{
+    inline const f32* _Element( const f32* base, u32 stride, u32 index )
+    {
+        return (const f32*)( (const u8*)base + (uptr)index * stride );
+    }
+
+    // 4 normals at once. Scalar tail goes through same function, so results don't depend on count
+    static void _EncodeOct4( i16* dst, __m128 x, __m128 y, __m128 z )
+    {
+        const __m128 mask_abs = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+        const __m128 mask_sign = _mm_castsi128_ps( _mm_set1_epi32( 0x80000000 ) );
+        const __m128 one = _mm_set1_ps( 1.f );
+        const __m128 zero = _mm_setzero_ps();
+
+        const __m128 ax = _mm_and_ps( x, mask_abs );
+        const __m128 ay = _mm_and_ps( y, mask_abs );
+        const __m128 az = _mm_and_ps( z, mask_abs );
+        const __m128 sum = _mm_max_ps( _mm_add_ps( _mm_add_ps( ax, ay ), az ), _mm_set1_ps( FLT_MIN ) );
+        const __m128 inv = _mm_div_ps( one, sum );
+
+        const __m128 px = _mm_mul_ps( x, inv );
+        const __m128 py = _mm_mul_ps( y, inv );
+
+        // lower hemisphere is folded over diagonals. sign( 0 ) = 1
+        const __m128 sign_x = _mm_and_ps( _mm_cmplt_ps( px, zero ), mask_sign );
+        const __m128 sign_y = _mm_and_ps( _mm_cmplt_ps( py, zero ), mask_sign );
+        const __m128 fx = _mm_or_ps( _mm_sub_ps( one, _mm_and_ps( py, mask_abs ) ), sign_x );
+        const __m128 fy = _mm_or_ps( _mm_sub_ps( one, _mm_and_ps( px, mask_abs ) ), sign_y );
+
+        const __m128 lower = _mm_cmplt_ps( z, zero );
+        const __m128 ex = _mm_or_ps( _mm_and_ps( lower, fx ), _mm_andnot_ps( lower, px ) );
+        const __m128 ey = _mm_or_ps( _mm_and_ps( lower, fy ), _mm_andnot_ps( lower, py ) );
+
+        const __m128 scale = _mm_set1_ps( 32767.f );
+        const __m128i qx = _mm_cvtps_epi32( _mm_mul_ps( ex, scale ) );
+        const __m128i qy = _mm_cvtps_epi32( _mm_mul_ps( ey, scale ) );
+        const __m128i packed = _mm_packs_epi32( _mm_unpacklo_epi32( qx, qy ), _mm_unpackhi_epi32( qx, qy ) );
+        _mm_storeu_si128( (__m128i*)dst, packed );
+    }
+}//
+
+void bxVertexPack_bounds( f32 bmin[3], f32 bmax[3], const f32* positions, u32 stride, u32 count )
+{
+    bmin[0] = bmin[1] = bmin[2] = FLT_MAX;
+    bmax[0] = bmax[1] = bmax[2] = -FLT_MAX;
+    for( u32 i = 0; i < count; ++i )
+    {
+        const f32* p = _Element( positions, stride, i );
+        for( u32 j = 0; j < 3; ++j )
+        {
+            bmin[j] = minOfPair( bmin[j], p[j] );
+            bmax[j] = maxOfPair( bmax[j], p[j] );
+        }
+    }
+}
+
+void bxVertexPack_positions( u16* dst, const f32* positions, u32 stride, u32 count, const f32 offset[3] )
+{
+    enum { eCHUNK = 256 };
+    f32 tmp[eCHUNK * 4];
+
+    for( u32 begin = 0; begin < count; begin += eCHUNK )
+    {
+        const u32 n = minOfPair( (u32)eCHUNK, count - begin );
+        for( u32 i = 0; i < n; ++i )
+        {
+            const f32* p = _Element( positions, stride, begin + i );
+            f32* t = tmp + i * 4;
+            t[0] = p[0] - offset[0];
+            t[1] = p[1] - offset[1];
+            t[2] = p[2] - offset[2];
+            t[3] = 1.f;
+        }
+        bxFloat16_fromFloat( dst + begin * 4, tmp, n * 4 );
+    }
+}
+
+void bxVertexPack_normals( i16* dst, const f32* normals, u32 stride, u32 count )
+{
+    u32 i = 0;
+    for( ; i + 4 <= count; i += 4 )
+    {
+        const f32* n0 = _Element( normals, stride, i );
+        const f32* n1 = _Element( normals, stride, i + 1 );
+        const f32* n2 = _Element( normals, stride, i + 2 );
+        const f32* n3 = _Element( normals, stride, i + 3 );
+        const __m128 x = _mm_setr_ps( n0[0], n1[0], n2[0], n3[0] );
+        const __m128 y = _mm_setr_ps( n0[1], n1[1], n2[1], n3[1] );
+        const __m128 z = _mm_setr_ps( n0[2], n1[2], n2[2], n3[2] );
+        _EncodeOct4( dst + i * 2, x, y, z );
+    }
+    for( ; i < count; ++i )
+    {
+        const f32* n = _Element( normals, stride, i );
+        i16 tmp[8];
+        _EncodeOct4( tmp, _mm_set1_ps( n[0] ), _mm_set1_ps( n[1] ), _mm_set1_ps( n[2] ) );
+        dst[i * 2] = tmp[0];
+        dst[i * 2 + 1] = tmp[1];
+    }
+}
+
+void bxVertexPack_texcoords( u16* dst, const f32* texcoords, u32 stride, u32 count )
+{
+    if( stride == 2 * sizeof( f32 ) )
+    {
+        bxFloat16_fromFloat( dst, texcoords, count * 2 );
+        return;
+    }
+
+    enum { eCHUNK = 512 };
+    f32 tmp[eCHUNK * 2];
+    for( u32 begin = 0; begin < count; begin += eCHUNK )
+    {
+        const u32 n = minOfPair( (u32)eCHUNK, count - begin );
+        for( u32 i = 0; i < n; ++i )
+        {
+            const f32* t = _Element( texcoords, stride, begin + i );
+            tmp[i * 2] = t[0];
+            tmp[i * 2 + 1] = t[1];
+        }
+        bxFloat16_fromFloat( dst + begin * 2, tmp, n * 2 );
+    }
+}
+
+void bxVertexUnpack_normal( f32 normal[3], const i16 packed[2] )
+{
+    f32 x = maxOfPair( -1.f, (f32)packed[0] / 32767.f );
+    f32 y = maxOfPair( -1.f, (f32)packed[1] / 32767.f );
+    const f32 z = 1.f - fabsf( x ) - fabsf( y );
+    const f32 t = maxOfPair( -z, 0.f );
+    x += ( x >= 0.f ) ? -t : t;
+    y += ( y >= 0.f ) ? -t : t;
+
+    const f32 inv_len = 1.f / sqrtf( x * x + y * y + z * z );
+    normal[0] = x * inv_len;
+    normal[1] = y * inv_len;
+    normal[2] = z * inv_len;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "type.h"
+
+// Packed vertex streams. Position, normal and texcoord take 16 bytes instead of 32.
+// position : 4 x half. xyz is relative to 'offset' (usually center of mesh bounds), so half precision
+//            is spent on mesh extent instead of distance from origin. w = 1
+// normal   : 2 x snorm16, octahedral encoding
+// texcoord : 2 x half
+// 'stride' is distance in bytes between consecutive source elements.
+enum
+{
+    eVERTEX_PACK_POSITION_SIZE = 4 * sizeof( u16 ),
+    eVERTEX_PACK_NORMAL_SIZE = 2 * sizeof( i16 ),
+    eVERTEX_PACK_TEXCOORD_SIZE = 2 * sizeof( u16 ),
+};
+
+void bxVertexPack_bounds( f32 bmin[3], f32 bmax[3], const f32* positions, u32 stride, u32 count );
+void bxVertexPack_positions( u16* dst, const f32* positions, u32 stride, u32 count, const f32 offset[3] );
+void bxVertexPack_normals( i16* dst, const f32* normals, u32 stride, u32 count );
+void bxVertexPack_texcoords( u16* dst, const f32* texcoords, u32 stride, u32 count );
+
+// same as decoding in shaders
+void bxVertexUnpack_normal( f32 normal[3], const i16 packed[2] );